@@ -77,6 +77,72 @@ inline __m256 _mm256_flip_sign_ps(__m256 x) {
     return _mm256_mul_ps(x, avx_constants::minus_one<float>);
 }
 
+/**
+ * x / sqrt(y), computed as x * rsqrt(y) with one Newton-Raphson step on the approximate rsqrt:
+ * r = r * (1.5 - 0.5 * y * r * r)
+ * The relative error is about 1e-7 instead of 1e-4 of _mm256_rsqrt_ps alone
+ */
+inline __m256 _mm256_div_sqrt_ps(__m256 x, __m256 y) {
+    __m256 r = _mm256_rsqrt_ps(y);
+    __m256 half_y_r = _mm256_mul_ps(_mm256_mul_ps(avx_constants::half<float>, y), r);
+    __m256 refined =
+        _mm256_mul_ps(r, _mm256_fnmadd_ps(half_y_r, r, avx_constants::three_halves<float>));
+    // For y = 0 and y = inf the Newton step computes 0 * inf, keep the approximation there
+    __m256 is_nan = _mm256_cmp_ps(refined, refined, _CMP_UNORD_Q);
+    return _mm256_mul_ps(x, _mm256_blendv_ps(refined, r, is_nan));
+}
+
+// There is no rsqrt for double in AVX2, and the float one has not enough precision
+inline __m256d _mm256_div_sqrt_pd(__m256d x, __m256d y) {
+    return _mm256_div_pd(x, _mm256_sqrt_pd(y));
+}
+
+/**
+ * In-register transpose of the 4x4 block of doubles stored in rows
+ */
+inline void _mm256_transpose_pd(__m256d *rows) {
+    __m256d t0 = _mm256_unpacklo_pd(rows[0], rows[1]);
+    __m256d t1 = _mm256_unpackhi_pd(rows[0], rows[1]);
+    __m256d t2 = _mm256_unpacklo_pd(rows[2], rows[3]);
+    __m256d t3 = _mm256_unpackhi_pd(rows[2], rows[3]);
+    rows[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+    rows[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+    rows[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+    rows[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+/**
+ * In-register transpose of the 8x8 block of floats stored in rows
+ */
+inline void _mm256_transpose_ps(__m256 *rows) {
+    __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+    __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+    __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
 /**
  * Experimental fast exponential
  */
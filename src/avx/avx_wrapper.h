@@ -160,6 +160,28 @@ simd_type<T> _mm256_flip_sign_px(simd_type<T> x) {
     }
 }
 
+template <typename T>
+simd_type<T> _mm256_div_sqrt_px(simd_type<T> x, simd_type<T> y) {
+    if constexpr (std::is_same_v<T, float>) {
+        return _mm256_div_sqrt_ps(x, y);
+    } else if constexpr (std::is_same_v<T, double>) {
+        return _mm256_div_sqrt_pd(x, y);
+    } else {
+        static_assert(std::is_same_v<T, float>);
+    }
+}
+
+template <typename T>
+simd_type<T> _mm256_fmsub_px(simd_type<T> x, simd_type<T> y, simd_type<T> z) {
+    if constexpr (std::is_same_v<T, float>) {
+        return _mm256_fmsub_ps(x, y, z);
+    } else if constexpr (std::is_same_v<T, double>) {
+        return _mm256_fmsub_pd(x, y, z);
+    } else {
+        static_assert(std::is_same_v<T, float>);
+    }
+}
+
 template <typename T>
 simd_type<T> _mm256_fnmadd_px(simd_type<T> x, simd_type<T> y, simd_type<T> z) {
     if constexpr (std::is_same_v<T, float>) {
@@ -204,6 +226,36 @@ simd_type<T> _mm256_and_px(simd_type<T> x, simd_type<T> y) {
     }
 }
 
+// The elements of y where the sign bit of mask is set, of x elsewhere
+template <typename T>
+simd_type<T> _mm256_blendv_px(simd_type<T> x, simd_type<T> y, simd_type<T> mask) {
+    if constexpr (std::is_same_v<T, float>) {
+        return _mm256_blendv_ps(x, y, mask);
+    } else if constexpr (std::is_same_v<T, double>) {
+        return _mm256_blendv_pd(x, y, mask);
+    } else {
+        static_assert(std::is_same_v<T, float>);
+    }
+}
+
+// The elements x[l * stride] of the lanes l, gathered from memory. The masked gathers, with every
+// lane enabled, start from a defined register (GCC warns on the source of the unmasked ones)
+template <typename T>
+simd_type<T> _mm256_strided_load_px(const T *x, int stride) {
+    if constexpr (std::is_same_v<T, float>) {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i index = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stride));
+        const __m256 all_lanes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), x, index, all_lanes, sizeof(float));
+    } else if constexpr (std::is_same_v<T, double>) {
+        const __m128i index = _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(stride));
+        const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, index, all_lanes, sizeof(double));
+    } else {
+        static_assert(std::is_same_v<T, float>);
+    }
+}
+
 template <typename T>
 unsigned _mm256_movemask_px(simd_type<T> x) {
     if constexpr (std::is_same_v<T, float>) {
@@ -214,3 +266,17 @@ unsigned _mm256_movemask_px(simd_type<T> x) {
         static_assert(std::is_same_v<T, float>);
     }
 }
+
+/**
+ * Transposes the square block of intrinsic_size<T> registers
+ */
+template <typename T>
+void _mm256_transpose_px(simd_type<T> *rows) {
+    if constexpr (std::is_same_v<T, float>) {
+        _mm256_transpose_ps(rows);
+    } else if constexpr (std::is_same_v<T, double>) {
+        _mm256_transpose_pd(rows);
+    } else {
+        static_assert(std::is_same_v<T, float>);
+    }
+}
@@ -1,19 +1,64 @@
 #pragma once
 
+#ifndef NATIVE_GEMM
 #include <cblas.h>
+#endif
 #include <cassert>
+#include <stdexcept>
+
+#include "gemm/gemm.h"
+#include "threading.h"
 
 /**
  * We use external libraries for less trivial operations.
  * BLAS for Matrix Multiplication
+ *
+ * The in-tree GEMM (see gemm/gemm.h) can be used instead of BLAS, at runtime with
+ * set_gemm_backend, or at build time by defining NATIVE_GEMM, that also removes the dependency on
+ * BLAS.
  */
 
+enum class GemmBackend { BLAS, NATIVE };
+
+namespace gemm {
+#ifdef NATIVE_GEMM
+    inline GemmBackend backend{GemmBackend::NATIVE};
+#else
+    inline GemmBackend backend{GemmBackend::BLAS};
+#endif
+} // namespace gemm
+
+inline void set_gemm_backend(GemmBackend backend) {
+#ifdef NATIVE_GEMM
+    if (backend == GemmBackend::BLAS) {
+        throw std::runtime_error("BLAS is not available, the project was built with NATIVE_GEMM");
+    }
+#endif
+    gemm::backend = backend;
+}
+
 template <typename T, bool TransposeM1 = false, bool TransposeM2 = false>
 requires(std::is_same_v<T, double> || std::is_same_v<T, float>) void blas_mat_mul(
-    const T *m1, const T *m2, T *res, int m1_rows, int m1_cols, int m2_rows, int m2_cols) {
+    const T *m1, const T *m2, T *res, int m1_rows, int m1_cols, int m2_rows, int m2_cols,
+    bool accumulate = false) {
 
+    // Matrix-vector products (e.g. inference on a single sample) do not need a full GEMM
+    if (native_mat_vec<T, TransposeM1, TransposeM2>(
+            m1, m2, res, m1_rows, m1_cols, m2_rows, m2_cols, accumulate)) {
+        return;
+    }
+
+    size_t flops = static_cast<size_t>(m1_rows) * m1_cols * (TransposeM2 ? m2_rows : m2_cols);
+    if (gemm::backend == GemmBackend::NATIVE || flops <= gemm::SMALL_GEMM_FLOPS) {
+        native_mat_mul<T, TransposeM1, TransposeM2>(
+            m1, m2, res, m1_rows, m1_cols, m2_rows, m2_cols, accumulate);
+        return;
+    }
+
+#ifndef NATIVE_GEMM
     constexpr T alpha = static_cast<T>(1.0);
-    constexpr T beta = static_cast<T>(0.0);
+    // If accumulate is true res += m1 * m2, otherwise res = m1 * m2
+    const T beta = static_cast<T>(accumulate ? 1.0 : 0.0);
 
     constexpr CBLAS_TRANSPOSE transa = TransposeM1 ? CblasTrans : CblasNoTrans;
     constexpr CBLAS_TRANSPOSE transb = TransposeM2 ? CblasTrans : CblasNoTrans;
@@ -26,6 +71,9 @@ requires(std::is_same_v<T, double> || std::is_same_v<T, float>) void blas_mat_mu
 
     assert(a_cols == b_rows);
 
+    // The threads of the BLAS pool are set for each call (see threading.h)
+    threading::set_blas_threads(threading::threads_for(flops));
+
     if constexpr (std::is_same_v<T, double>) {
         cblas_dgemm(CblasRowMajor,
                     transa,
@@ -57,4 +105,5 @@ requires(std::is_same_v<T, double> || std::is_same_v<T, float>) void blas_mat_mu
                     res,
                     b_cols);
     }
+#endif
 }
\ No newline at end of file
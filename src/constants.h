@@ -24,6 +24,8 @@ using simd_type = typename struct_simd_type<T>::type;
 namespace ops {
     template <bool tLeft, bool tRight>
     constexpr size_t MAT_MUL;
+    template <bool relu>
+    constexpr size_t LINEAR;
 
     constexpr size_t VARIABLE_OP = 0;
     constexpr size_t CONSTANT_OP = 1;
@@ -58,6 +60,103 @@ namespace ops {
     constexpr size_t SQRT = 19;
     constexpr size_t FLATTEN = 20;
     constexpr size_t INDEXER = 21;
+    constexpr size_t CHECKPOINT = 22;
+
+    // Duplicate the top of the stack (common subexpressions are evaluated only once)
+    constexpr size_t DUP_OP = 23;
+
+    // Fused operator FMS (a * b) - c
+    constexpr size_t FMS_OP = 24;
+    // Fused operator FNMA a - (b * c)
+    constexpr size_t FNMA_OP = 25;
+    // Fused operator a / sqrt(b), computed as a * rsqrt(b)
+    constexpr size_t DIVIDE_SQRT_OP = 26;
+
+    // Fused matmul(a, b) + c, and relu(matmul(a, b) + c)
+    template <>
+    constexpr size_t LINEAR<false> = 27;
+    template <>
+    constexpr size_t LINEAR<true> = 28;
+
+    // Matrix multiplication of the last two dimensions, for each item of the batch
+    constexpr size_t BATCH_MAT_MUL = 29;
+
+    // Product with a sparse matrix, the matrix is not on the stack
+    constexpr size_t SPARSE_MAT_MUL = 30;
+    // Product of a sparse input (the left operand) with a matrix, the input is not on the stack
+    constexpr size_t SPARSE_INPUT_MAT_MUL = 31;
+
+    // Rows of an embedding table gathered by index
+    constexpr size_t EMBEDDING = 32;
+
+    // 1d and 2d max and average pooling
+    constexpr size_t POOL_1D = 33;
+    constexpr size_t POOL_2D = 34;
+
+    // 1d and 2d transposed convolution operators
+    constexpr size_t CONV_TRANSPOSE_1D = 35;
+    constexpr size_t CONV_TRANSPOSE_2D = 36;
+
+    // Fused relu(conv_1d(...)) and relu(conv_2d(...))
+    constexpr size_t CONV_RELU_1D = 37;
+    constexpr size_t CONV_RELU_2D = 38;
+
+    // A leaf repeated in a fused expression is loaded once: LOAD_KEEP_OP<slot> loads it and keeps
+    // a copy in a saved register, REUSE_OP<slot> pushes the saved register again
+    constexpr size_t N_SAVED_REGISTERS = 4;
+    template <size_t slot>
+    requires(slot < N_SAVED_REGISTERS) constexpr size_t LOAD_KEEP_OP = 39 + slot;
+    template <size_t slot>
+    requires(slot < N_SAVED_REGISTERS) constexpr size_t REUSE_OP = 39 + N_SAVED_REGISTERS + slot;
+
+    constexpr bool is_load_keep_op(size_t op) {
+        return op >= LOAD_KEEP_OP<0> && op < LOAD_KEEP_OP<0> + N_SAVED_REGISTERS;
+    }
+    constexpr bool is_reuse_op(size_t op) {
+        return op >= REUSE_OP<0> && op < REUSE_OP<0> + N_SAVED_REGISTERS;
+    }
+
+    /**
+     * Number of operands of each operator
+     */
+    constexpr size_t n_operands(size_t op) {
+        if (is_load_keep_op(op) || is_reuse_op(op)) {
+            return 0;
+        }
+        switch (op) {
+        case VARIABLE_OP:
+        case CONSTANT_OP:
+        // DUP_OP reads its operand without popping it
+        case DUP_OP:
+            return 0;
+        case SUM_OP:
+        case DIFF_OP:
+        case MUL_OP:
+        case DIVIDE_OP:
+        case DIVIDE_SQRT_OP:
+        case MAT_MUL<false, false>:
+        case MAT_MUL<false, true>:
+        case MAT_MUL<true, false>:
+        case MAT_MUL<true, true>:
+        case BATCH_MAT_MUL:
+            return 2;
+        case FMA_OP:
+        case FAM_OP:
+        case FMS_OP:
+        case FNMA_OP:
+        case LINEAR<false>:
+        case LINEAR<true>:
+        case CONV_1D:
+        case CONV_2D:
+        case CONV_TRANSPOSE_1D:
+        case CONV_TRANSPOSE_2D:
+        case CONV_RELU_1D:
+        case CONV_RELU_2D:
+            return 3;
+        default:
+            return 1;
+        }
+    }
 } // namespace ops
 
 namespace avx_constants {
@@ -80,6 +179,25 @@ namespace avx_constants {
     constexpr simd_type<float> minus_one<float> = {
         -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f};
 
+    template <typename T>
+    constexpr simd_type<T> half;
+
+    template <>
+    constexpr simd_type<double> half<double> = {0.5, 0.5, 0.5, 0.5};
+
+    template <>
+    constexpr simd_type<float> half<float> = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+
+    template <typename T>
+    constexpr simd_type<T> three_halves;
+
+    template <>
+    constexpr simd_type<double> three_halves<double> = {1.5, 1.5, 1.5, 1.5};
+
+    template <>
+    constexpr simd_type<float> three_halves<float> = {
+        1.5f, 1.5f, 1.5f, 1.5f, 1.5f, 1.5f, 1.5f, 1.5f};
+
     template <typename T>
     constexpr size_t intrinsic_size = struct_simd_type<T>::size;
 } // namespace avx_constants
\ No newline at end of file
@@ -0,0 +1,858 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "../tensor.h"
+#include "../interpreter.h"
+#include "../gemm/frozen_matrix.h"
+#include "../threading.h"
+#include "convolution_epilogue.h"
+#include "direct_convolution.h"
+#include "fft_convolution.h"
+
+/**
+ * 1d convolution kernels, shared by the expression node DApConv1d and by the dynamic graphs.
+ *
+ * The convolution is implemented with the im2col transformation: the kernel and the input are
+ * rearranged into two matrices such that the convolution becomes a single matrix multiplication.
+ * The bias, and the relu of the fused node relu(conv_1d(...)), are applied while the product is
+ * written to the output, see convolution_epilogue.h. Small kernels (few channels) are applied
+ * directly on x instead, see direct_convolution.h, and long kernels through the FFT, see
+ * fft_convolution.h.
+ *
+ * In a grouped convolution the im2col matrices of the groups are stacked along the rows, and the
+ * product is a GEMM for each group. Dilation only spreads the windows on x.
+ *
+ * The im2col transformations are split between threads (see threading::parallel_for), each
+ * thread writes its own rows, or its own samples and channels for the inverse of im2col where the
+ * windows overlap.
+ *
+ * The transposed convolution (see transposed_forward) runs the same transformations backwards.
+ */
+template <typename DType>
+class Convolution1D {
+  public:
+    // Stride of the convolution
+    size_t STRIDE{1};
+    // padding of the convolution
+    // For the moment only zero-padding supported
+    size_t PADDING{0};
+    // Distance on x between two consecutive elements of the kernel
+    size_t DILATION{1};
+    // The channels are split in GROUPS groups, the output channels of a group read only the input
+    // channels of the same group (GROUPS == IN_CHANNELS is a depthwise convolution)
+    size_t GROUPS{1};
+    // Direct, im2col or FFT, by default it is chosen from the shape of the kernel
+    ConvolutionAlgorithm ALGORITHM{ConvolutionAlgorithm::AUTOMATIC};
+    // Layout of x and of the output, channels-last requires the im2col kernels
+    ConvolutionLayout LAYOUT{ConvolutionLayout::CHANNELS_FIRST};
+    // If not zero, out of training the im2col matrix is built and multiplied by chunks of samples
+    // of at most this many bytes (e.g. the size of L2), see tiled_forward
+    size_t IM2COL_TILE_BYTES{0};
+    // Transposed convolution only: the convolutions of STRIDE different widths have an output of
+    // the width of x, OUTPUT_PADDING (smaller than STRIDE) elements are added to the smallest one
+    size_t OUTPUT_PADDING{0};
+
+  private:
+    // We cache the kernel and x in their im2col version for the backpropagation (for the
+    // transposed convolution x is rearranged as the gradient of the output, see res_im2col)
+    ConstTensor<DType> kernel_data_im2col;
+    ConstTensor<DType> x_data_im2col;
+    // or as they are, if the direct kernels or the FFT were used
+    ConstTensor<DType> kernel_data;
+    ConstTensor<DType> x_data;
+    // Algorithm of the last forward step
+    ConvolutionAlgorithm algorithm_used{ConvolutionAlgorithm::IM2COL};
+
+    // While frozen the im2col kernel matrix of a dense convolution is built and packed only once,
+    // for the eval
+    bool is_frozen{false};
+    FrozenMatrix<DType> frozen_kernel{};
+
+    // those variables get a non-zero value in the forward step.
+    // We need to cache them for the backpropagation.
+    size_t KERNEL_SIZE{0};
+    size_t IN_CHANNELS{0};
+    size_t OUT_CHANNELS{0};
+    size_t GROUP_IN_CHANNELS{0};
+    size_t GROUP_OUT_CHANNELS{0};
+
+    size_t BATCH_SIZE{0};
+    size_t FEATURE_SIZE{0};
+    size_t EFFECTIVE_WIDTH{0};
+
+  public:
+    /**
+     * kernel has shape [OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_SIZE]
+     * x has shape [BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE]
+     * bias has shape [OUT_CHANNELS]
+     * With the channels-last layout x has shape [BATCH_SIZE, FEATURE_SIZE, IN_CHANNELS] and the
+     * output [BATCH_SIZE, EFFECTIVE_WIDTH, OUT_CHANNELS]
+     *
+     * If keep_temporaries is true the im2col matrices (or kernel and x for the direct kernels and
+     * the FFT) are cached for the backward step. With relu the output goes through a relu, the
+     * backward step expects the gradient already masked by it
+     */
+    template <bool keep_temporaries, bool relu = false>
+    Tensor<DType> forward(const ConstTensor<DType> &kernel,
+                          const ConstTensor<DType> &x,
+                          const ConstTensor<DType> &bias) {
+        set_shapes(kernel, x, bias);
+        algorithm_used = choose_algorithm();
+        if (algorithm_used == ConvolutionAlgorithm::DIRECT ||
+            algorithm_used == ConvolutionAlgorithm::FFT) {
+            if constexpr (keep_temporaries) {
+                kernel_data = kernel;
+                x_data = x;
+            }
+            Tensor<DType> res = algorithm_used == ConvolutionAlgorithm::FFT
+                                    ? fft_forward(kernel, x, bias)
+                                    : direct_forward(kernel, x, bias);
+            // These kernels add the bias themselves, only the relu is left
+            if constexpr (relu) {
+                conv_epilogue::bias_activation<relu, DType>(
+                    LAYOUT, &res[0], nullptr, BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH);
+            }
+            return res;
+        }
+
+        if constexpr (!keep_temporaries) {
+            if (IM2COL_TILE_BYTES != 0) {
+                return tiled_forward<relu>(kernel, x, bias);
+            }
+            if (is_frozen && GROUPS == 1) {
+                if (frozen_kernel.empty()) {
+                    frozen_kernel.template set</*transpose=*/true>(kernel_im2col(kernel));
+                }
+                Tensor<DType> x_matrix = x_im2col(x);
+                auto res_shape = Shape::get_matmul_shape<false, true>(
+                    x_matrix.get_shape(), frozen_kernel.get_matrix().get_shape());
+                return res_col2im<relu>(
+                    mat_mul_wrapper<DType, false, true>(x_matrix, frozen_kernel, res_shape),
+                    &bias[0]);
+            }
+        }
+
+        Tensor<DType> kernel_matrix = kernel_im2col(kernel);
+        Tensor<DType> x_matrix = x_im2col(x);
+
+        Shape res_shape{x_matrix.get_shape()[0], GROUP_OUT_CHANNELS};
+        Tensor<DType> res = res_col2im<relu>(
+            grouped_mat_mul_wrapper<DType, false, true>(x_matrix, kernel_matrix, res_shape, GROUPS),
+            &bias[0]);
+
+        if constexpr (keep_temporaries) {
+            kernel_data_im2col = kernel_matrix;
+            x_data_im2col = x_matrix;
+        }
+        return res;
+    }
+
+    /**
+     * Returns the gradients of the kernel, of x and of the bias.
+     * Requires a previous call to forward<true>
+     */
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    backward(const ConstTensor<DType> &grad) {
+        if (algorithm_used == ConvolutionAlgorithm::DIRECT) {
+            return direct_backward(grad);
+        }
+        if (algorithm_used == ConvolutionAlgorithm::FFT) {
+            return fft_backward(grad);
+        }
+        ConstTensor<DType> grad_im2col = res_im2col(grad);
+
+        Tensor<DType> x_grad = x_col2im(grouped_mat_mul_wrapper<DType, false, false>(
+            grad_im2col, kernel_data_im2col, x_data_im2col.get_shape(), GROUPS));
+        Tensor<DType> kernel_grad = kernel_col2im(grouped_mat_mul_wrapper<DType, true, false>(
+            grad_im2col, x_data_im2col, kernel_data_im2col.get_shape(), GROUPS));
+
+        return {kernel_grad, x_grad, channel_sums(grad, OUT_CHANNELS, EFFECTIVE_WIDTH)};
+    }
+
+    /**
+     * Transposed convolution, the adjoint of the convolution: x has the shape of the output of a
+     * convolution, the result has the shape of its input.
+     * kernel has shape [IN_CHANNELS, OUT_CHANNELS / GROUPS, KERNEL_SIZE]
+     * x has shape [BATCH_SIZE, IN_CHANNELS, WIDTH]
+     * bias has shape [OUT_CHANNELS]
+     * The output has shape [BATCH_SIZE, OUT_CHANNELS, OUTPUT_WIDTH] with OUTPUT_WIDTH equal to
+     * (WIDTH - 1) * STRIDE - 2 * PADDING + DILATION * (KERNEL_SIZE - 1) + 1 + OUTPUT_PADDING,
+     * channels-last as for forward.
+     *
+     * x is rearranged as the gradient of the output of the convolution, multiplied by the im2col
+     * kernel, and the windows are added to the output: the backward step of the convolution with
+     * respect to its input. Only the im2col kernels are used.
+     */
+    template <bool keep_temporaries>
+    Tensor<DType> transposed_forward(const ConstTensor<DType> &kernel,
+                                     const ConstTensor<DType> &x,
+                                     const ConstTensor<DType> &bias) {
+        set_transposed_shapes(kernel, x, bias);
+        algorithm_used = ConvolutionAlgorithm::IM2COL;
+
+        Tensor<DType> kernel_matrix = kernel_im2col(kernel);
+        ConstTensor<DType> x_matrix = res_im2col(x);
+
+        Shape windows_shape{x_matrix.get_shape()[0], GROUP_IN_CHANNELS * KERNEL_SIZE};
+        Tensor<DType> res = x_col2im(grouped_mat_mul_wrapper<DType, false, false>(
+            x_matrix, kernel_matrix, windows_shape, GROUPS));
+        // The windows overlap, the bias is added once they are all summed
+        conv_epilogue::bias_activation</*relu=*/false, DType>(
+            LAYOUT, &res[0], &bias[0], BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE);
+
+        if constexpr (keep_temporaries) {
+            kernel_data_im2col = kernel_matrix;
+            x_data_im2col = x_matrix;
+        }
+        return res;
+    }
+
+    /**
+     * Returns the gradients of the kernel, of x and of the bias of the transposed convolution.
+     * Requires a previous call to transposed_forward<true>
+     */
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    transposed_backward(const ConstTensor<DType> &grad) {
+        // The gradient is the input of a convolution
+        assert(grad.get_shape() == input_shape());
+        ConstTensor<DType> grad_im2col = x_im2col(grad);
+
+        Shape x_grad_shape{grad_im2col.get_shape()[0], GROUP_OUT_CHANNELS};
+        Tensor<DType> x_grad = res_col2im(grouped_mat_mul_wrapper<DType, false, true>(
+            grad_im2col, kernel_data_im2col, x_grad_shape, GROUPS));
+        Tensor<DType> kernel_grad = kernel_col2im(grouped_mat_mul_wrapper<DType, true, false>(
+            x_data_im2col, grad_im2col, kernel_data_im2col.get_shape(), GROUPS));
+
+        return {kernel_grad, x_grad, channel_sums(grad, IN_CHANNELS, FEATURE_SIZE)};
+    }
+
+    void release_temporaries() {
+        kernel_data_im2col = ConstTensor<DType>{};
+        x_data_im2col = ConstTensor<DType>{};
+        kernel_data = ConstTensor<DType>{};
+        x_data = ConstTensor<DType>{};
+    }
+
+    /**
+     * While frozen the kernel and the bias must not change, a new call to freeze drops the
+     * prepared kernel matrix
+     */
+    void freeze(bool frozen = true) {
+        is_frozen = frozen;
+        frozen_kernel.clear();
+    }
+
+  private:
+    void set_kernel_shapes(const ConstTensor<DType> &kernel) {
+        const Shape &kernel_shape = kernel.get_shape();
+        const auto &kernel_shape_data = kernel_shape.get_shape();
+
+        // By convention we assume that the kernel must have the following shape
+        // [OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_SIZE]
+        assert(kernel_shape.get_dimension() == 3);
+        assert(GROUPS > 0 && DILATION > 0);
+        OUT_CHANNELS = kernel_shape_data[0];
+        GROUP_IN_CHANNELS = kernel_shape_data[1];
+        IN_CHANNELS = GROUPS * GROUP_IN_CHANNELS;
+        KERNEL_SIZE = kernel_shape_data[2];
+        assert(OUT_CHANNELS % GROUPS == 0);
+        GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
+    }
+
+    void set_shapes(const ConstTensor<DType> &kernel,
+                    const ConstTensor<DType> &x,
+                    const ConstTensor<DType> &bias) {
+        set_kernel_shapes(kernel);
+        assert(bias.get_shape().get_dimension() == 1);
+        assert(OUT_CHANNELS == bias.get_shape()[0]);
+
+        const Shape &t_shape = x.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the input x must have the following shape
+        // [BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE], or [BATCH_SIZE, FEATURE_SIZE, IN_CHANNELS]
+        assert(t_shape.get_dimension() == 3);
+        BATCH_SIZE = t_shape_data[0];
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            FEATURE_SIZE = t_shape_data[1];
+            assert(IN_CHANNELS == t_shape_data[2]);
+        } else {
+            assert(IN_CHANNELS == t_shape_data[1]);
+            FEATURE_SIZE = t_shape_data[2];
+        }
+
+        // Residual number of features after the application of the 1d convolution
+        const size_t KERNEL_EXTENT = (KERNEL_SIZE - 1) * DILATION + 1;
+        assert(FEATURE_SIZE + 2 * PADDING >= KERNEL_EXTENT);
+        EFFECTIVE_WIDTH = (FEATURE_SIZE - KERNEL_EXTENT + 2 * PADDING) / STRIDE + 1;
+    }
+
+    // The shapes of the convolution transposed by transposed_forward: x has the shape of its
+    // output, and the output the shape of its input
+    void set_transposed_shapes(const ConstTensor<DType> &kernel,
+                               const ConstTensor<DType> &x,
+                               const ConstTensor<DType> &bias) {
+        set_kernel_shapes(kernel);
+        assert(bias.get_shape().get_dimension() == 1);
+        assert(IN_CHANNELS == bias.get_shape()[0]);
+
+        const Shape &t_shape = x.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // x has shape [BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH], or channels-last
+        // [BATCH_SIZE, EFFECTIVE_WIDTH, OUT_CHANNELS]
+        assert(t_shape.get_dimension() == 3);
+        BATCH_SIZE = t_shape_data[0];
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            EFFECTIVE_WIDTH = t_shape_data[1];
+            assert(OUT_CHANNELS == t_shape_data[2]);
+        } else {
+            assert(OUT_CHANNELS == t_shape_data[1]);
+            EFFECTIVE_WIDTH = t_shape_data[2];
+        }
+        assert(EFFECTIVE_WIDTH > 0);
+
+        if (OUTPUT_PADDING >= STRIDE) {
+            throw std::runtime_error(
+                "The output padding of a transposed convolution must be smaller than the stride");
+        }
+        const size_t PADDED_SIZE =
+            (EFFECTIVE_WIDTH - 1) * STRIDE + (KERNEL_SIZE - 1) * DILATION + 1 + OUTPUT_PADDING;
+        if (PADDED_SIZE <= 2 * PADDING) {
+            throw std::runtime_error("The padding of a transposed convolution removes its output");
+        }
+        FEATURE_SIZE = PADDED_SIZE - 2 * PADDING;
+    }
+
+    ConvolutionAlgorithm choose_algorithm() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            if (ALGORITHM != ConvolutionAlgorithm::AUTOMATIC &&
+                ALGORITHM != ConvolutionAlgorithm::IM2COL) {
+                throw std::runtime_error("The channels-last layout requires the im2col kernels");
+            }
+            return ConvolutionAlgorithm::IM2COL;
+        }
+        if (ALGORITHM == ConvolutionAlgorithm::WINOGRAD) {
+            throw std::runtime_error("The Winograd convolution is available only in 2d");
+        }
+        const bool dense = GROUPS == 1 && DILATION == 1;
+        if (ALGORITHM == ConvolutionAlgorithm::FFT) {
+            if (!dense) {
+                throw std::runtime_error(
+                    "The FFT convolution is available only without groups and dilation");
+            }
+            return ConvolutionAlgorithm::FFT;
+        }
+        // The depthwise convolutions always use the direct kernels
+        if (ALGORITHM == ConvolutionAlgorithm::AUTOMATIC && GROUPS > 1 && GROUP_IN_CHANNELS == 1) {
+            return ConvolutionAlgorithm::DIRECT;
+        }
+        if (direct_conv::use_direct(ALGORITHM, GROUP_IN_CHANNELS * KERNEL_SIZE)) {
+            return ConvolutionAlgorithm::DIRECT;
+        }
+        if (ALGORITHM == ConvolutionAlgorithm::AUTOMATIC && dense &&
+            KERNEL_SIZE >= fft_conv::MIN_FFT_KERNEL_SIZE) {
+            return ConvolutionAlgorithm::FFT;
+        }
+        return ConvolutionAlgorithm::IM2COL;
+    }
+
+    // A 1d convolution is a 2d convolution with a single row
+    direct_conv::Geometry geometry() const {
+        return {.batch = BATCH_SIZE,
+                .in_channels = IN_CHANNELS,
+                .out_channels = OUT_CHANNELS,
+                .kernel_height = 1,
+                .kernel_width = KERNEL_SIZE,
+                .stride_height = 1,
+                .stride_width = STRIDE,
+                .padding_height = 0,
+                .padding_width = PADDING,
+                .data_height = 1,
+                .data_width = FEATURE_SIZE,
+                .effective_height = 1,
+                .effective_width = EFFECTIVE_WIDTH,
+                .dilation_height = 1,
+                .dilation_width = DILATION,
+                .groups = GROUPS};
+    }
+
+    Tensor<DType> direct_forward(const ConstTensor<DType> &kernel,
+                                 const ConstTensor<DType> &x,
+                                 const ConstTensor<DType> &bias) const {
+        Tensor<DType> res{{BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH}};
+        direct_conv::forward<DType>(geometry(), &x[0], &kernel[0], &bias[0], &res[0]);
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    direct_backward(const ConstTensor<DType> &grad) const {
+        assert(grad.get_shape() == Shape({BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH}));
+        Tensor<DType> kernel_grad({OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_SIZE});
+        Tensor<DType> x_grad({BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE});
+        Tensor<DType> bias_grad({OUT_CHANNELS});
+        direct_conv::backward<DType>(geometry(),
+                                     &x_data[0],
+                                     &kernel_data[0],
+                                     &grad[0],
+                                     &kernel_grad[0],
+                                     &x_grad[0],
+                                     &bias_grad[0]);
+
+        kernel_grad.wrap_for_broadcasting();
+        x_grad.wrap_for_broadcasting();
+        bias_grad.wrap_for_broadcasting();
+        return {kernel_grad, x_grad, bias_grad};
+    }
+
+    fft_conv::Geometry fft_geometry() const {
+        return {.batch = BATCH_SIZE,
+                .in_channels = IN_CHANNELS,
+                .out_channels = OUT_CHANNELS,
+                .kernel_size = KERNEL_SIZE,
+                .stride = STRIDE,
+                .padding = PADDING,
+                .data_size = FEATURE_SIZE,
+                .effective_size = EFFECTIVE_WIDTH};
+    }
+
+    Tensor<DType> fft_forward(const ConstTensor<DType> &kernel,
+                              const ConstTensor<DType> &x,
+                              const ConstTensor<DType> &bias) const {
+        Tensor<DType> res{{BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH}};
+        fft_conv::forward<DType>(fft_geometry(), &x[0], &kernel[0], &bias[0], &res[0]);
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    fft_backward(const ConstTensor<DType> &grad) const {
+        assert(grad.get_shape() == Shape({BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH}));
+        Tensor<DType> kernel_grad({OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE});
+        Tensor<DType> x_grad({BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE});
+        Tensor<DType> bias_grad({OUT_CHANNELS});
+        fft_conv::backward<DType>(fft_geometry(),
+                                  &x_data[0],
+                                  &kernel_data[0],
+                                  &grad[0],
+                                  &kernel_grad[0],
+                                  &x_grad[0],
+                                  &bias_grad[0]);
+
+        kernel_grad.wrap_for_broadcasting();
+        x_grad.wrap_for_broadcasting();
+        bias_grad.wrap_for_broadcasting();
+        return {kernel_grad, x_grad, bias_grad};
+    }
+
+    /**
+     * im2col and matrix multiplication by chunks of samples, the im2col matrix of a chunk takes
+     * at most IM2COL_TILE_BYTES (but a chunk has at least one sample). The im2col matrix of the
+     * whole batch is never built, and the matrix of a chunk is still in cache when it is
+     * multiplied.
+     */
+    template <bool relu>
+    Tensor<DType> tiled_forward(const ConstTensor<DType> &kernel,
+                                const ConstTensor<DType> &x,
+                                const ConstTensor<DType> &bias) {
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        const size_t TILE_SAMPLES = std::clamp<size_t>(
+            IM2COL_TILE_BYTES / (GROUPS * EFFECTIVE_WIDTH * ROW_SIZE * sizeof(DType)),
+            1,
+            BATCH_SIZE);
+        const bool use_frozen = is_frozen && GROUPS == 1;
+        // In the channels-last layout, without groups, the rows of the product are the output of
+        // the chunk
+        const bool rows_are_output = LAYOUT == ConvolutionLayout::CHANNELS_LAST && GROUPS == 1;
+
+        ConstTensor<DType> kernel_matrix{};
+        if (!use_frozen) {
+            kernel_matrix = kernel_im2col(kernel);
+        } else if (frozen_kernel.empty()) {
+            frozen_kernel.template set</*transpose=*/true>(kernel_im2col(kernel));
+        }
+
+        Tensor<DType> res(output_shape());
+        std::vector<DType> x_tile(GROUPS * TILE_SAMPLES * EFFECTIVE_WIDTH * ROW_SIZE);
+        const size_t RES_TILE_SIZE = TILE_SAMPLES * EFFECTIVE_WIDTH * OUT_CHANNELS;
+        std::vector<DType> res_tile(rows_are_output ? 0 : RES_TILE_SIZE);
+        for (size_t b = 0; b < BATCH_SIZE; b += TILE_SAMPLES) {
+            const size_t b_end = std::min(b + TILE_SAMPLES, BATCH_SIZE);
+            const size_t n_rows = (b_end - b) * EFFECTIVE_WIDTH;
+            fill_x_im2col(&x[0], x_tile.data(), b, b_end);
+            DType *res_rows =
+                rows_are_output ? &res[b * EFFECTIVE_WIDTH * OUT_CHANNELS] : res_tile.data();
+            if (use_frozen) {
+                frozen_kernel.template mat_mul<false, true>(x_tile.data(),
+                                                            res_rows,
+                                                            static_cast<int>(n_rows),
+                                                            static_cast<int>(ROW_SIZE),
+                                                            false);
+            }
+            for (size_t group = 0; group < GROUPS && !use_frozen; ++group) {
+                const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                blas_mat_mul<DType, false, true>(x_tile.data() + group * n_rows * ROW_SIZE,
+                                                 &kernel_matrix[first_channel * ROW_SIZE],
+                                                 res_rows + group * n_rows * GROUP_OUT_CHANNELS,
+                                                 static_cast<int>(n_rows),
+                                                 static_cast<int>(ROW_SIZE),
+                                                 static_cast<int>(GROUP_OUT_CHANNELS),
+                                                 static_cast<int>(ROW_SIZE));
+            }
+            if (rows_are_output) {
+                conv_epilogue::bias_activation<relu>(
+                    LAYOUT, res_rows, &bias[0], b_end - b, OUT_CHANNELS, EFFECTIVE_WIDTH);
+            } else {
+                fill_res_col2im<relu>(res_tile.data(), &res[0], &bias[0], b, b_end);
+            }
+        }
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    // Column of the element (ic, k) of a window in the im2col matrices, ic is a channel of the
+    // group. In the channels-last layout the channels of a position are contiguous in x, and so in
+    // a window.
+    size_t im2col_column(size_t ic, size_t k) const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return k * GROUP_IN_CHANNELS + ic;
+        }
+        return ic * KERNEL_SIZE + k;
+    }
+
+    // we implement the convolution with the im2col transformation. The rows of a group are its
+    // output channels, so the matrices of the groups are already stacked.
+    Tensor<DType> kernel_im2col(const ConstTensor<DType> &kernel) {
+        Tensor<DType> res({OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE});
+
+        threading::parallel_for(
+            OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE, [&](size_t oc_begin, size_t oc_end) {
+                for (size_t oc = oc_begin; oc < oc_end; ++oc) {
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        for (size_t k = 0; k < KERNEL_SIZE; ++k) {
+                            res(oc, im2col_column(ic, k)) = kernel(oc, ic, k);
+                        }
+                    }
+                }
+            });
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    Tensor<DType> x_im2col(const ConstTensor<DType> &tensor) const {
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        Tensor<DType> tensor_im2col({GROUPS * BATCH_SIZE * EFFECTIVE_WIDTH, ROW_SIZE});
+        fill_x_im2col(&tensor[0], &tensor_im2col[0], 0, BATCH_SIZE);
+
+        tensor_im2col.wrap_for_broadcasting();
+        return tensor_im2col;
+    }
+
+    /**
+     * Writes the im2col rows of the samples [b_begin, b_end) of x to im2col_rows, the matrix of a
+     * group after the other
+     */
+    void
+    fill_x_im2col(const DType *x_data, DType *im2col_rows, size_t b_begin, size_t b_end) const {
+        // The padding is never materialized: each window is copied from x where it overlaps x,
+        // and set to zero directly where it lies on the padding
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        const size_t N_ROWS = (b_end - b_begin) * EFFECTIVE_WIDTH;
+        // In the channels-last layout, with neither groups nor dilation, the part of a window
+        // inside x is a single block of x
+        const bool contiguous_windows = GROUPS == 1 && DILATION == 1;
+        auto fill_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t b = b_begin + i / EFFECTIVE_WIDTH;
+                const size_t w = i % EFFECTIVE_WIDTH;
+                const DType *x_batch = x_data + b * IN_CHANNELS * FEATURE_SIZE;
+                auto [k_begin, k_end] = direct_conv::valid_window(
+                    w * STRIDE, PADDING, FEATURE_SIZE, KERNEL_SIZE, DILATION);
+                for (size_t group = 0; group < GROUPS; group++) {
+                    DType *row = im2col_rows + (group * N_ROWS + i) * ROW_SIZE;
+                    if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+                        const DType *x_group = x_batch + group * GROUP_IN_CHANNELS;
+                        std::fill_n(row, k_begin * GROUP_IN_CHANNELS, DType{0});
+                        if (contiguous_windows && k_begin < k_end) {
+                            std::copy_n(x_group + (w * STRIDE + k_begin - PADDING) * IN_CHANNELS,
+                                        (k_end - k_begin) * IN_CHANNELS,
+                                        row + k_begin * IN_CHANNELS);
+                        }
+                        for (size_t k = k_begin; k < k_end && !contiguous_windows; k++) {
+                            std::copy_n(
+                                x_group + (w * STRIDE + k * DILATION - PADDING) * IN_CHANNELS,
+                                GROUP_IN_CHANNELS,
+                                row + k * GROUP_IN_CHANNELS);
+                        }
+                        std::fill_n(row + k_end * GROUP_IN_CHANNELS,
+                                    (KERNEL_SIZE - k_end) * GROUP_IN_CHANNELS,
+                                    DType{0});
+                        continue;
+                    }
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ic++) {
+                        const DType *x_row =
+                            x_batch + (group * GROUP_IN_CHANNELS + ic) * FEATURE_SIZE;
+                        DType *window = row + ic * KERNEL_SIZE;
+                        for (size_t k = 0; k < k_begin; k++) {
+                            window[k] = DType{0};
+                        }
+                        for (size_t k = k_begin; k < k_end; k++) {
+                            window[k] = x_row[w * STRIDE + k * DILATION - PADDING];
+                        }
+                        for (size_t k = k_end; k < KERNEL_SIZE; k++) {
+                            window[k] = DType{0};
+                        }
+                    }
+                }
+            }
+        };
+        threading::parallel_for(N_ROWS, GROUPS * ROW_SIZE, fill_rows);
+    }
+
+    ConstTensor<DType> res_im2col(const ConstTensor<DType> &res_grad) {
+        // By convention we assume that the gradient has the shape of the output
+        assert(res_grad.get_shape() == output_shape());
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+        if (channels_last && GROUPS == 1) {
+            // [BATCH_SIZE, EFFECTIVE_WIDTH, OUT_CHANNELS] is already the gradient matrix
+            ConstTensor<DType> res_grad_im2col = res_grad;
+            res_grad_im2col.set_shape({BATCH_SIZE * EFFECTIVE_WIDTH, OUT_CHANNELS});
+            return res_grad_im2col;
+        }
+
+        const size_t N_ROWS = BATCH_SIZE * EFFECTIVE_WIDTH;
+        Tensor<DType> res_grad_im2col{{GROUPS * N_ROWS, GROUP_OUT_CHANNELS}};
+        const DType *grad_data = &res_grad[0];
+        DType *matrix_data = &res_grad_im2col[0];
+        // Each thread writes whole rows of the matrix of each group
+        auto transpose_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t b = i / EFFECTIVE_WIDTH;
+                const size_t w = i % EFFECTIVE_WIDTH;
+                for (size_t group = 0; group < GROUPS; group++) {
+                    DType *row = matrix_data + (group * N_ROWS + i) * GROUP_OUT_CHANNELS;
+                    const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                    if (channels_last) {
+                        std::copy_n(grad_data + i * OUT_CHANNELS + first_channel,
+                                    GROUP_OUT_CHANNELS,
+                                    row);
+                        continue;
+                    }
+                    const DType *grad_group =
+                        grad_data + (b * OUT_CHANNELS + first_channel) * EFFECTIVE_WIDTH;
+                    for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; oc++) {
+                        row[oc] = grad_group[oc * EFFECTIVE_WIDTH + w];
+                    }
+                }
+            }
+        };
+        threading::parallel_for(N_ROWS, OUT_CHANNELS, transpose_rows);
+
+        res_grad_im2col.wrap_for_broadcasting();
+        return res_grad_im2col;
+    }
+
+    // Inverse trasnformations for backpropagation
+    Tensor<DType> kernel_col2im(const ConstTensor<DType> &grad_matrix) const {
+        const Shape &t_shape = grad_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the grad_matrix must have the following shape
+        // [OUT_CHANNELS, IN_CHANNELS / GROUPS * KERNEL_SIZE]
+        assert(t_shape.get_dimension() == 2);
+        assert(OUT_CHANNELS == t_shape_data[0]);
+        assert(GROUP_IN_CHANNELS * KERNEL_SIZE == t_shape_data[1]);
+
+        Tensor<DType> grad_kernel({OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_SIZE});
+
+        threading::parallel_for(
+            OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE, [&](size_t oc_begin, size_t oc_end) {
+                for (size_t oc = oc_begin; oc < oc_end; ++oc) {
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        for (size_t k = 0; k < KERNEL_SIZE; ++k) {
+                            grad_kernel(oc, ic, k) = grad_matrix(oc, im2col_column(ic, k));
+                        }
+                    }
+                }
+            });
+
+        grad_kernel.wrap_for_broadcasting();
+        return grad_kernel;
+    }
+
+    Tensor<DType> x_col2im(const ConstTensor<DType> &grad_x_matrix) const {
+        const Shape &t_shape = grad_x_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the grad_matrix must have the following shape
+        // [GROUPS * BATCH_SIZE * EFFECTIVE_WIDTH, IN_CHANNELS / GROUPS * KERNEL_SIZE]
+
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        const size_t N_ROWS = BATCH_SIZE * EFFECTIVE_WIDTH;
+        assert(t_shape.get_dimension() == 2);
+        assert(GROUPS * N_ROWS == t_shape_data[0]);
+        assert(ROW_SIZE == t_shape_data[1]);
+
+        // The gradient of the padding is dropped: only the part of each window inside x is added
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+        const bool contiguous_windows = GROUPS == 1 && DILATION == 1;
+        Tensor<DType> grad_x{channels_last ? Shape{BATCH_SIZE, FEATURE_SIZE, IN_CHANNELS}
+                                           : Shape{BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE}};
+        grad_x.set_zero();
+        const DType *matrix_data = &grad_x_matrix[0];
+        DType *grad_x_data = &grad_x[0];
+        // The windows overlap, each thread adds to its own samples, and in the channels-first
+        // layout to its own channels
+        const size_t n_channel_groups = channels_last ? 1 : IN_CHANNELS;
+        auto add_windows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t b = i / n_channel_groups;
+                DType *grad_x_batch = grad_x_data + b * IN_CHANNELS * FEATURE_SIZE;
+                for (size_t w = 0; w < EFFECTIVE_WIDTH; w++) {
+                    auto [k_begin, k_end] = direct_conv::valid_window(
+                        w * STRIDE, PADDING, FEATURE_SIZE, KERNEL_SIZE, DILATION);
+                    const DType *rows = matrix_data + (b * EFFECTIVE_WIDTH + w) * ROW_SIZE;
+                    if (channels_last) {
+                        if (contiguous_windows && k_begin < k_end) {
+                            DType *grad_x_window =
+                                grad_x_batch + (w * STRIDE + k_begin - PADDING) * IN_CHANNELS;
+                            const DType *window = rows + k_begin * IN_CHANNELS;
+                            for (size_t j = 0; j < (k_end - k_begin) * IN_CHANNELS; j++) {
+                                grad_x_window[j] += window[j];
+                            }
+                        }
+                        for (size_t group = 0; group < GROUPS && !contiguous_windows; group++) {
+                            const DType *row = rows + group * N_ROWS * ROW_SIZE;
+                            for (size_t k = k_begin; k < k_end; k++) {
+                                DType *grad_x_position =
+                                    grad_x_batch +
+                                    (w * STRIDE + k * DILATION - PADDING) * IN_CHANNELS +
+                                    group * GROUP_IN_CHANNELS;
+                                const DType *window = row + k * GROUP_IN_CHANNELS;
+                                for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ic++) {
+                                    grad_x_position[ic] += window[ic];
+                                }
+                            }
+                        }
+                        continue;
+                    }
+                    const size_t ic = i % IN_CHANNELS;
+                    const size_t group = ic / GROUP_IN_CHANNELS;
+                    DType *grad_x_row = grad_x_batch + ic * FEATURE_SIZE;
+                    const DType *window = rows + group * N_ROWS * ROW_SIZE +
+                                          (ic % GROUP_IN_CHANNELS) * KERNEL_SIZE;
+                    for (size_t k = k_begin; k < k_end; k++) {
+                        grad_x_row[w * STRIDE + k * DILATION - PADDING] += window[k];
+                    }
+                }
+            }
+        };
+        threading::parallel_for(BATCH_SIZE * n_channel_groups,
+                                EFFECTIVE_WIDTH * IN_CHANNELS * KERNEL_SIZE / n_channel_groups,
+                                add_windows);
+
+        grad_x.wrap_for_broadcasting();
+        return grad_x;
+    }
+
+    Shape output_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, EFFECTIVE_WIDTH, OUT_CHANNELS};
+        }
+        return {BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH};
+    }
+
+    Shape input_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, FEATURE_SIZE, IN_CHANNELS};
+        }
+        return {BATCH_SIZE, IN_CHANNELS, FEATURE_SIZE};
+    }
+
+    // Sums of the channels of grad, the gradient of the bias: the output of the convolution (the
+    // input for the transposed convolution) has n_channels channels of plane_size elements
+    Tensor<DType>
+    channel_sums(const ConstTensor<DType> &grad, size_t n_channels, size_t plane_size) const {
+        Tensor<DType> sums({n_channels});
+        conv_epilogue::channel_sums(
+            LAYOUT, &grad[0], &sums[0], BATCH_SIZE, n_channels, plane_size);
+        sums.wrap_for_broadcasting();
+        return sums;
+    }
+
+    // bias (if not null) and relu are applied while the matrix is written to the output
+    template <bool relu = false>
+    Tensor<DType> res_col2im(Tensor<DType> res_matrix, const DType *bias = nullptr) {
+        const Shape &t_shape = res_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the input has shape
+        // [GROUPS * BATCH_SIZE * EFFECTIVE_WIDTH, OUT_CHANNELS / GROUPS]
+        assert(t_shape.get_dimension() == 2);
+        assert(GROUPS * BATCH_SIZE * EFFECTIVE_WIDTH == t_shape_data[0]);
+        assert(GROUP_OUT_CHANNELS == t_shape_data[1]);
+
+        // which is already the output in the channels-last layout, without groups
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST && GROUPS == 1) {
+            if (relu || bias != nullptr) {
+                conv_epilogue::bias_activation<relu>(
+                    LAYOUT, &res_matrix[0], bias, BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH);
+            }
+            res_matrix.set_shape(output_shape());
+            return res_matrix;
+        }
+
+        Tensor<DType> res{output_shape()};
+        fill_res_col2im<relu>(&res_matrix[0], &res[0], bias, 0, BATCH_SIZE);
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    /**
+     * Writes the rows of the samples [b_begin, b_end) of the output matrices of the groups, from
+     * matrix_rows, to the output res_data, adding the bias (if not null) and applying the relu
+     */
+    template <bool relu>
+    void fill_res_col2im(const DType *matrix_rows,
+                         DType *res_data,
+                         const DType *bias,
+                         size_t b_begin,
+                         size_t b_end) const {
+        const size_t N_ROWS = (b_end - b_begin) * EFFECTIVE_WIDTH;
+        auto transpose_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t b = b_begin + i / EFFECTIVE_WIDTH;
+                const size_t w = i % EFFECTIVE_WIDTH;
+                for (size_t group = 0; group < GROUPS; group++) {
+                    const DType *row = matrix_rows + (group * N_ROWS + i) * GROUP_OUT_CHANNELS;
+                    const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                    const DType *group_bias = bias != nullptr ? bias + first_channel : nullptr;
+                    if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+                        conv_epilogue::bias_activation_row<relu>(
+                            row,
+                            res_data + (b * EFFECTIVE_WIDTH + w) * OUT_CHANNELS + first_channel,
+                            group_bias,
+                            GROUP_OUT_CHANNELS);
+                        continue;
+                    }
+                    DType *res_group =
+                        res_data + (b * OUT_CHANNELS + first_channel) * EFFECTIVE_WIDTH;
+                    for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; oc++) {
+                        res_group[oc * EFFECTIVE_WIDTH + w] = conv_epilogue::activation<relu>(
+                            row[oc] + (group_bias != nullptr ? group_bias[oc] : DType{0}));
+                    }
+                }
+            }
+        };
+        threading::parallel_for(N_ROWS, OUT_CHANNELS, transpose_rows);
+    }
+};
@@ -0,0 +1,1028 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "../tensor.h"
+#include "../interpreter.h"
+#include "../gemm/frozen_matrix.h"
+#include "../threading.h"
+#include "direct_convolution.h"
+#include "convolution_epilogue.h"
+#include "winograd_convolution.h"
+
+/**
+ * 2d convolution kernels, shared by the expression node DApConv2d and by the dynamic graphs.
+ *
+ * As for the 1d case the convolution is implemented with the im2col transformation, or directly
+ * on x for small kernels, see Convolution1D. The 3x3 kernels with stride 1 and many channels use
+ * the Winograd transforms instead, see winograd_convolution.h. The im2col transformations are
+ * split between threads, and the grouped convolutions are a GEMM for each group, as in
+ * Convolution1D. The transposed convolution runs them backwards, as in Convolution1D. The bias
+ * and the relu of relu(conv_2d(...)) are applied in the output transform, see
+ * convolution_epilogue.h.
+ */
+template <typename DType>
+class Convolution2D {
+  public:
+    // Stride of the convolution
+    size_t STRIDE_HEIGHT = 1;
+    size_t STRIDE_WIDTH = 1;
+
+    // padding of the convolution
+    // For the moment only zero-padding supported
+    size_t PADDING_HEIGHT{0};
+    size_t PADDING_WIDTH{0};
+    // Distance on x between two consecutive elements of the kernel
+    size_t DILATION_HEIGHT{1};
+    size_t DILATION_WIDTH{1};
+    // The channels are split in GROUPS groups, the output channels of a group read only the input
+    // channels of the same group (GROUPS == IN_CHANNELS is a depthwise convolution)
+    size_t GROUPS{1};
+    // Direct, im2col or Winograd, by default it is chosen from the shape of the kernel
+    ConvolutionAlgorithm ALGORITHM{ConvolutionAlgorithm::AUTOMATIC};
+    // Layout of x and of the output, channels-last requires the im2col kernels
+    ConvolutionLayout LAYOUT{ConvolutionLayout::CHANNELS_FIRST};
+    // If not zero, out of training the im2col matrix is built and multiplied by chunks of samples
+    // of at most this many bytes (e.g. the size of L2), see tiled_forward
+    size_t IM2COL_TILE_BYTES{0};
+    // Transposed convolution only: rows and columns added to the output, smaller than the strides
+    // (see Convolution1D::OUTPUT_PADDING)
+    size_t OUTPUT_PADDING_HEIGHT{0};
+    size_t OUTPUT_PADDING_WIDTH{0};
+
+  private:
+    // We cache the kernel and x in their im2col version for the backpropagation (for the
+    // transposed convolution x is rearranged as the gradient of the output, see res_im2col)
+    ConstTensor<DType> kernel_data_im2col;
+    ConstTensor<DType> x_data_im2col;
+    // or as they are, if the direct kernels were used
+    ConstTensor<DType> kernel_data;
+    ConstTensor<DType> x_data;
+    // or in the Winograd domain
+    std::vector<DType> kernel_winograd{};
+    std::vector<DType> x_winograd{};
+    // Algorithm of the last forward step
+    ConvolutionAlgorithm algorithm_used{ConvolutionAlgorithm::IM2COL};
+
+    // While frozen the im2col kernel matrix of a dense convolution (or the Winograd kernel) is
+    // built and packed only once, for the eval
+    bool is_frozen{false};
+    FrozenMatrix<DType> frozen_kernel{};
+
+    // those variables get a non-zero value in the forward step.
+    // We need to cache them for the backpropagation.
+    size_t KERNEL_HEIGHT{0};
+    size_t KERNEL_WIDTH{0};
+
+    size_t IN_CHANNELS{0};
+    size_t OUT_CHANNELS{0};
+    size_t GROUP_IN_CHANNELS{0};
+    size_t GROUP_OUT_CHANNELS{0};
+
+    size_t BATCH_SIZE{0};
+    size_t DATA_HEIGHT{0};
+    size_t DATA_WIDTH{0};
+    size_t EFFECTIVE_WIDTH{0};
+    size_t EFFECTIVE_HEIGHT{0};
+
+  public:
+    /**
+     * kernel has shape [OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_HEIGHT, KERNEL_WIDTH]
+     * x has shape [BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH]
+     * bias has shape [OUT_CHANNELS]
+     * With the channels-last layout x has shape [BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS]
+     * and the output [BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, OUT_CHANNELS]
+     *
+     * If keep_temporaries is true the im2col matrices (or kernel and x for the direct kernels,
+     * or their Winograd transforms) are cached for the backward step. With relu the output goes
+     * through a relu, the backward step expects the gradient already masked by it
+     */
+    template <bool keep_temporaries, bool relu = false>
+    Tensor<DType> forward(const ConstTensor<DType> &kernel,
+                          const ConstTensor<DType> &x,
+                          const ConstTensor<DType> &bias) {
+        set_shapes(kernel, x, bias);
+        algorithm_used = choose_algorithm();
+        if (algorithm_used == ConvolutionAlgorithm::DIRECT ||
+            algorithm_used == ConvolutionAlgorithm::WINOGRAD) {
+            if (algorithm_used == ConvolutionAlgorithm::DIRECT && keep_temporaries) {
+                kernel_data = kernel;
+                x_data = x;
+            }
+            Tensor<DType> res = algorithm_used == ConvolutionAlgorithm::WINOGRAD
+                                    ? winograd_forward<keep_temporaries>(kernel, x, bias)
+                                    : direct_forward(kernel, x, bias);
+            // These kernels add the bias themselves, only the relu is left
+            if constexpr (relu) {
+                conv_epilogue::bias_activation<relu, DType>(LAYOUT,
+                                                            &res[0],
+                                                            nullptr,
+                                                            BATCH_SIZE,
+                                                            OUT_CHANNELS,
+                                                            EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH);
+            }
+            return res;
+        }
+
+        if constexpr (!keep_temporaries) {
+            if (IM2COL_TILE_BYTES != 0) {
+                return tiled_forward<relu>(kernel, x, bias);
+            }
+            if (is_frozen && GROUPS == 1) {
+                if (frozen_kernel.empty()) {
+                    frozen_kernel.template set</*transpose=*/true>(kernel_im2col(kernel));
+                }
+                Tensor<DType> x_matrix = x_im2col(x);
+                auto res_shape = Shape::get_matmul_shape<false, true>(
+                    x_matrix.get_shape(), frozen_kernel.get_matrix().get_shape());
+                return res_col2im<relu>(
+                    mat_mul_wrapper<DType, false, true>(x_matrix, frozen_kernel, res_shape),
+                    &bias[0]);
+            }
+        }
+
+        Tensor<DType> kernel_matrix = kernel_im2col(kernel);
+        Tensor<DType> x_matrix = x_im2col(x);
+
+        Shape res_shape{x_matrix.get_shape()[0], GROUP_OUT_CHANNELS};
+        Tensor<DType> res = res_col2im<relu>(
+            grouped_mat_mul_wrapper<DType, false, true>(x_matrix, kernel_matrix, res_shape, GROUPS),
+            &bias[0]);
+
+        if constexpr (keep_temporaries) {
+            kernel_data_im2col = kernel_matrix;
+            x_data_im2col = x_matrix;
+        }
+        return res;
+    }
+
+    /**
+     * Returns the gradients of the kernel, of x and of the bias.
+     * Requires a previous call to forward<true>
+     */
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    backward(const ConstTensor<DType> &grad) {
+        if (algorithm_used == ConvolutionAlgorithm::DIRECT) {
+            return direct_backward(grad);
+        }
+        if (algorithm_used == ConvolutionAlgorithm::WINOGRAD) {
+            return winograd_backward(grad);
+        }
+        ConstTensor<DType> grad_im2col = res_im2col(grad);
+
+        Tensor<DType> x_grad = x_col2im(grouped_mat_mul_wrapper<DType, false, false>(
+            grad_im2col, kernel_data_im2col, x_data_im2col.get_shape(), GROUPS));
+        Tensor<DType> kernel_grad = kernel_col2im(grouped_mat_mul_wrapper<DType, true, false>(
+            grad_im2col, x_data_im2col, kernel_data_im2col.get_shape(), GROUPS));
+
+        return {kernel_grad,
+                x_grad,
+                channel_sums(grad, OUT_CHANNELS, EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH)};
+    }
+
+    /**
+     * Transposed convolution, the adjoint of the convolution, see Convolution1D.
+     * kernel has shape [IN_CHANNELS, OUT_CHANNELS / GROUPS, KERNEL_HEIGHT, KERNEL_WIDTH]
+     * x has shape [BATCH_SIZE, IN_CHANNELS, HEIGHT, WIDTH]
+     * bias has shape [OUT_CHANNELS]
+     * The output has shape [BATCH_SIZE, OUT_CHANNELS, OUTPUT_HEIGHT, OUTPUT_WIDTH] with
+     * OUTPUT_HEIGHT equal to (HEIGHT - 1) * STRIDE_HEIGHT - 2 * PADDING_HEIGHT +
+     * DILATION_HEIGHT * (KERNEL_HEIGHT - 1) + 1 + OUTPUT_PADDING_HEIGHT, and the same for the
+     * width. Channels-last as for forward.
+     */
+    template <bool keep_temporaries>
+    Tensor<DType> transposed_forward(const ConstTensor<DType> &kernel,
+                                     const ConstTensor<DType> &x,
+                                     const ConstTensor<DType> &bias) {
+        set_transposed_shapes(kernel, x, bias);
+        algorithm_used = ConvolutionAlgorithm::IM2COL;
+
+        Tensor<DType> kernel_matrix = kernel_im2col(kernel);
+        ConstTensor<DType> x_matrix = res_im2col(x);
+
+        Shape windows_shape{x_matrix.get_shape()[0],
+                            GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH};
+        Tensor<DType> res = x_col2im(grouped_mat_mul_wrapper<DType, false, false>(
+            x_matrix, kernel_matrix, windows_shape, GROUPS));
+        // The windows overlap, the bias is added once they are all summed
+        conv_epilogue::bias_activation</*relu=*/false, DType>(
+            LAYOUT, &res[0], &bias[0], BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT * DATA_WIDTH);
+
+        if constexpr (keep_temporaries) {
+            kernel_data_im2col = kernel_matrix;
+            x_data_im2col = x_matrix;
+        }
+        return res;
+    }
+
+    /**
+     * Returns the gradients of the kernel, of x and of the bias of the transposed convolution.
+     * Requires a previous call to transposed_forward<true>
+     */
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    transposed_backward(const ConstTensor<DType> &grad) {
+        // The gradient is the input of a convolution
+        assert(grad.get_shape() == input_shape());
+        ConstTensor<DType> grad_im2col = x_im2col(grad);
+
+        Shape x_grad_shape{grad_im2col.get_shape()[0], GROUP_OUT_CHANNELS};
+        Tensor<DType> x_grad = res_col2im(grouped_mat_mul_wrapper<DType, false, true>(
+            grad_im2col, kernel_data_im2col, x_grad_shape, GROUPS));
+        Tensor<DType> kernel_grad = kernel_col2im(grouped_mat_mul_wrapper<DType, true, false>(
+            x_data_im2col, grad_im2col, kernel_data_im2col.get_shape(), GROUPS));
+
+        return {kernel_grad, x_grad, channel_sums(grad, IN_CHANNELS, DATA_HEIGHT * DATA_WIDTH)};
+    }
+
+    void release_temporaries() {
+        kernel_data_im2col = ConstTensor<DType>{};
+        x_data_im2col = ConstTensor<DType>{};
+        kernel_data = ConstTensor<DType>{};
+        x_data = ConstTensor<DType>{};
+        kernel_winograd = {};
+        x_winograd = {};
+    }
+
+    /**
+     * While frozen the kernel and the bias must not change, a new call to freeze drops the
+     * prepared kernel matrix
+     */
+    void freeze(bool frozen = true) {
+        is_frozen = frozen;
+        frozen_kernel.clear();
+        kernel_winograd = {};
+    }
+
+  private:
+    void set_kernel_shapes(const ConstTensor<DType> &kernel) {
+        const Shape &kernel_shape = kernel.get_shape();
+        const auto &kernel_shape_data = kernel_shape.get_shape();
+
+        // By convention we assume that the kernel must have the following shape
+        // [OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_HEIGHT, KERNEL_WIDTH]
+        assert(kernel_shape.get_dimension() == 4);
+        assert(GROUPS > 0 && DILATION_HEIGHT > 0 && DILATION_WIDTH > 0);
+
+        OUT_CHANNELS = kernel_shape_data[0];
+        GROUP_IN_CHANNELS = kernel_shape_data[1];
+        IN_CHANNELS = GROUPS * GROUP_IN_CHANNELS;
+        KERNEL_HEIGHT = kernel_shape_data[2];
+        KERNEL_WIDTH = kernel_shape_data[3];
+        assert(OUT_CHANNELS % GROUPS == 0);
+        GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
+    }
+
+    void set_shapes(const ConstTensor<DType> &kernel,
+                    const ConstTensor<DType> &x,
+                    const ConstTensor<DType> &bias) {
+        set_kernel_shapes(kernel);
+        assert(bias.get_shape().get_dimension() == 1);
+        assert(OUT_CHANNELS == bias.get_shape()[0]);
+
+        const Shape &t_shape = x.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the input x must have the following shape
+        // [BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH], or channels-last
+        // [BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS]
+        assert(t_shape.get_dimension() == 4);
+        BATCH_SIZE = t_shape_data[0];
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            DATA_HEIGHT = t_shape_data[1];
+            DATA_WIDTH = t_shape_data[2];
+            assert(IN_CHANNELS == t_shape_data[3]);
+        } else {
+            assert(IN_CHANNELS == t_shape_data[1]);
+            DATA_HEIGHT = t_shape_data[2];
+            DATA_WIDTH = t_shape_data[3];
+        }
+
+        const size_t KERNEL_EXTENT_HEIGHT = (KERNEL_HEIGHT - 1) * DILATION_HEIGHT + 1;
+        const size_t KERNEL_EXTENT_WIDTH = (KERNEL_WIDTH - 1) * DILATION_WIDTH + 1;
+        assert(DATA_WIDTH + 2 * PADDING_WIDTH >= KERNEL_EXTENT_WIDTH);
+        assert(DATA_HEIGHT + 2 * PADDING_HEIGHT >= KERNEL_EXTENT_HEIGHT);
+
+        // Residual number of features after the application of the 2d convolution
+        EFFECTIVE_HEIGHT =
+            (DATA_HEIGHT - KERNEL_EXTENT_HEIGHT + 2 * PADDING_HEIGHT) / STRIDE_HEIGHT + 1;
+        EFFECTIVE_WIDTH = (DATA_WIDTH - KERNEL_EXTENT_WIDTH + 2 * PADDING_WIDTH) / STRIDE_WIDTH + 1;
+    }
+
+    // The shapes of the convolution transposed by transposed_forward: x has the shape of its
+    // output, and the output the shape of its input
+    void set_transposed_shapes(const ConstTensor<DType> &kernel,
+                               const ConstTensor<DType> &x,
+                               const ConstTensor<DType> &bias) {
+        set_kernel_shapes(kernel);
+        assert(bias.get_shape().get_dimension() == 1);
+        assert(IN_CHANNELS == bias.get_shape()[0]);
+
+        const Shape &t_shape = x.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // x has shape [BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH], or
+        // channels-last [BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, OUT_CHANNELS]
+        assert(t_shape.get_dimension() == 4);
+        BATCH_SIZE = t_shape_data[0];
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            EFFECTIVE_HEIGHT = t_shape_data[1];
+            EFFECTIVE_WIDTH = t_shape_data[2];
+            assert(OUT_CHANNELS == t_shape_data[3]);
+        } else {
+            assert(OUT_CHANNELS == t_shape_data[1]);
+            EFFECTIVE_HEIGHT = t_shape_data[2];
+            EFFECTIVE_WIDTH = t_shape_data[3];
+        }
+        assert(EFFECTIVE_HEIGHT > 0 && EFFECTIVE_WIDTH > 0);
+
+        if (OUTPUT_PADDING_HEIGHT >= STRIDE_HEIGHT || OUTPUT_PADDING_WIDTH >= STRIDE_WIDTH) {
+            throw std::runtime_error(
+                "The output padding of a transposed convolution must be smaller than the stride");
+        }
+        const size_t PADDED_HEIGHT = (EFFECTIVE_HEIGHT - 1) * STRIDE_HEIGHT +
+                                     (KERNEL_HEIGHT - 1) * DILATION_HEIGHT + 1 +
+                                     OUTPUT_PADDING_HEIGHT;
+        const size_t PADDED_WIDTH = (EFFECTIVE_WIDTH - 1) * STRIDE_WIDTH +
+                                    (KERNEL_WIDTH - 1) * DILATION_WIDTH + 1 + OUTPUT_PADDING_WIDTH;
+        if (PADDED_HEIGHT <= 2 * PADDING_HEIGHT || PADDED_WIDTH <= 2 * PADDING_WIDTH) {
+            throw std::runtime_error("The padding of a transposed convolution removes its output");
+        }
+        DATA_HEIGHT = PADDED_HEIGHT - 2 * PADDING_HEIGHT;
+        DATA_WIDTH = PADDED_WIDTH - 2 * PADDING_WIDTH;
+    }
+
+    ConvolutionAlgorithm choose_algorithm() const {
+        const direct_conv::Geometry g = geometry();
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            if (ALGORITHM != ConvolutionAlgorithm::AUTOMATIC &&
+                ALGORITHM != ConvolutionAlgorithm::IM2COL) {
+                throw std::runtime_error("The channels-last layout requires the im2col kernels");
+            }
+            return ConvolutionAlgorithm::IM2COL;
+        }
+        if (ALGORITHM == ConvolutionAlgorithm::FFT) {
+            throw std::runtime_error("The FFT convolution is available only in 1d");
+        }
+        if (ALGORITHM == ConvolutionAlgorithm::WINOGRAD) {
+            if (!winograd::qualifies(g)) {
+                throw std::runtime_error("The Winograd convolution requires a dense 3x3 kernel "
+                                         "with stride 1, without groups and dilation");
+            }
+            return ConvolutionAlgorithm::WINOGRAD;
+        }
+        // The depthwise convolutions always use the direct kernels
+        if (ALGORITHM == ConvolutionAlgorithm::AUTOMATIC && GROUPS > 1 && GROUP_IN_CHANNELS == 1) {
+            return ConvolutionAlgorithm::DIRECT;
+        }
+        if (direct_conv::use_direct(ALGORITHM, g.n_taps())) {
+            return ConvolutionAlgorithm::DIRECT;
+        }
+        if (ALGORITHM == ConvolutionAlgorithm::AUTOMATIC && winograd::qualifies(g)) {
+            return ConvolutionAlgorithm::WINOGRAD;
+        }
+        return ConvolutionAlgorithm::IM2COL;
+    }
+
+    direct_conv::Geometry geometry() const {
+        return {.batch = BATCH_SIZE,
+                .in_channels = IN_CHANNELS,
+                .out_channels = OUT_CHANNELS,
+                .kernel_height = KERNEL_HEIGHT,
+                .kernel_width = KERNEL_WIDTH,
+                .stride_height = STRIDE_HEIGHT,
+                .stride_width = STRIDE_WIDTH,
+                .padding_height = PADDING_HEIGHT,
+                .padding_width = PADDING_WIDTH,
+                .data_height = DATA_HEIGHT,
+                .data_width = DATA_WIDTH,
+                .effective_height = EFFECTIVE_HEIGHT,
+                .effective_width = EFFECTIVE_WIDTH,
+                .dilation_height = DILATION_HEIGHT,
+                .dilation_width = DILATION_WIDTH,
+                .groups = GROUPS};
+    }
+
+    Tensor<DType> direct_forward(const ConstTensor<DType> &kernel,
+                                 const ConstTensor<DType> &x,
+                                 const ConstTensor<DType> &bias) const {
+        Tensor<DType> res{{BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH}};
+        direct_conv::forward<DType>(geometry(), &x[0], &kernel[0], &bias[0], &res[0]);
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    direct_backward(const ConstTensor<DType> &grad) const {
+        assert(grad.get_shape() ==
+               Shape({BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH}));
+        Tensor<DType> kernel_grad(
+            {OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Tensor<DType> x_grad({BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Tensor<DType> bias_grad({OUT_CHANNELS});
+        direct_conv::backward<DType>(geometry(),
+                                     &x_data[0],
+                                     &kernel_data[0],
+                                     &grad[0],
+                                     &kernel_grad[0],
+                                     &x_grad[0],
+                                     &bias_grad[0]);
+
+        kernel_grad.wrap_for_broadcasting();
+        x_grad.wrap_for_broadcasting();
+        bias_grad.wrap_for_broadcasting();
+        return {kernel_grad, x_grad, bias_grad};
+    }
+
+    /**
+     * While frozen (and out of training) the transformed kernel is kept from a call to the next,
+     * otherwise it is rebuilt and, with keep_temporaries, kept for the backward step
+     */
+    template <bool keep_temporaries>
+    Tensor<DType> winograd_forward(const ConstTensor<DType> &kernel,
+                                   const ConstTensor<DType> &x,
+                                   const ConstTensor<DType> &bias) {
+        const direct_conv::Geometry g = geometry();
+        if (keep_temporaries || !is_frozen || kernel_winograd.empty()) {
+            kernel_winograd.resize(winograd::N_ELEMENTS * OUT_CHANNELS * IN_CHANNELS);
+            winograd::transform_kernel<DType>(g, &kernel[0], kernel_winograd.data());
+        }
+        x_winograd.resize(winograd::N_ELEMENTS * IN_CHANNELS * winograd::n_tiles(g));
+        winograd::transform_x<DType>(g, &x[0], x_winograd.data());
+
+        Tensor<DType> res{{BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH}};
+        winograd::forward<DType>(
+            g, kernel_winograd.data(), x_winograd.data(), &bias[0], &res[0]);
+        if constexpr (!keep_temporaries) {
+            x_winograd = {};
+            if (!is_frozen) {
+                kernel_winograd = {};
+            }
+        }
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    std::tuple<Tensor<DType>, Tensor<DType>, Tensor<DType>>
+    winograd_backward(const ConstTensor<DType> &grad) const {
+        assert(grad.get_shape() ==
+               Shape({BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH}));
+        Tensor<DType> kernel_grad({OUT_CHANNELS, IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Tensor<DType> x_grad({BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Tensor<DType> bias_grad({OUT_CHANNELS});
+        winograd::backward<DType>(geometry(),
+                                  kernel_winograd.data(),
+                                  x_winograd.data(),
+                                  &grad[0],
+                                  &kernel_grad[0],
+                                  &x_grad[0],
+                                  &bias_grad[0]);
+
+        kernel_grad.wrap_for_broadcasting();
+        x_grad.wrap_for_broadcasting();
+        bias_grad.wrap_for_broadcasting();
+        return {kernel_grad, x_grad, bias_grad};
+    }
+
+    // Column of the element (ic, kh, kw) of a window in the im2col matrices, ic is a channel of
+    // the group. In the channels-last layout the channels of a position are contiguous in x, and
+    // so in a window.
+    size_t im2col_column(size_t ic, size_t kh, size_t kw) const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return (kh * KERNEL_WIDTH + kw) * GROUP_IN_CHANNELS + ic;
+        }
+        return (ic * KERNEL_HEIGHT + kh) * KERNEL_WIDTH + kw;
+    }
+
+    /**
+     * im2col and matrix multiplication by chunks of samples, the im2col matrix of a chunk takes
+     * at most IM2COL_TILE_BYTES (but a chunk has at least one sample). The im2col matrix of the
+     * whole batch is never built, and the matrix of a chunk is still in cache when it is
+     * multiplied.
+     */
+    template <bool relu>
+    Tensor<DType> tiled_forward(const ConstTensor<DType> &kernel,
+                                const ConstTensor<DType> &x,
+                                const ConstTensor<DType> &bias) {
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH;
+        const size_t TILE_SAMPLES = std::clamp<size_t>(
+            IM2COL_TILE_BYTES / (GROUPS * EFFECTIVE_SIZE * ROW_SIZE * sizeof(DType)),
+            1,
+            BATCH_SIZE);
+        const bool use_frozen = is_frozen && GROUPS == 1;
+        // In the channels-last layout, without groups, the rows of the product are the output of
+        // the chunk
+        const bool rows_are_output = LAYOUT == ConvolutionLayout::CHANNELS_LAST && GROUPS == 1;
+
+        ConstTensor<DType> kernel_matrix{};
+        if (!use_frozen) {
+            kernel_matrix = kernel_im2col(kernel);
+        } else if (frozen_kernel.empty()) {
+            frozen_kernel.template set</*transpose=*/true>(kernel_im2col(kernel));
+        }
+
+        Tensor<DType> res(output_shape());
+        std::vector<DType> x_tile(GROUPS * TILE_SAMPLES * EFFECTIVE_SIZE * ROW_SIZE);
+        const size_t RES_TILE_SIZE = TILE_SAMPLES * EFFECTIVE_SIZE * OUT_CHANNELS;
+        std::vector<DType> res_tile(rows_are_output ? 0 : RES_TILE_SIZE);
+        for (size_t b = 0; b < BATCH_SIZE; b += TILE_SAMPLES) {
+            const size_t b_end = std::min(b + TILE_SAMPLES, BATCH_SIZE);
+            const size_t n_rows = (b_end - b) * EFFECTIVE_SIZE;
+            fill_x_im2col(&x[0], x_tile.data(), b, b_end);
+            DType *res_rows =
+                rows_are_output ? &res[b * EFFECTIVE_SIZE * OUT_CHANNELS] : res_tile.data();
+            if (use_frozen) {
+                frozen_kernel.template mat_mul<false, true>(x_tile.data(),
+                                                            res_rows,
+                                                            static_cast<int>(n_rows),
+                                                            static_cast<int>(ROW_SIZE),
+                                                            false);
+            }
+            for (size_t group = 0; group < GROUPS && !use_frozen; ++group) {
+                const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                blas_mat_mul<DType, false, true>(x_tile.data() + group * n_rows * ROW_SIZE,
+                                                 &kernel_matrix[first_channel * ROW_SIZE],
+                                                 res_rows + group * n_rows * GROUP_OUT_CHANNELS,
+                                                 static_cast<int>(n_rows),
+                                                 static_cast<int>(ROW_SIZE),
+                                                 static_cast<int>(GROUP_OUT_CHANNELS),
+                                                 static_cast<int>(ROW_SIZE));
+            }
+            if (rows_are_output) {
+                conv_epilogue::bias_activation<relu>(
+                    LAYOUT, res_rows, &bias[0], b_end - b, OUT_CHANNELS, EFFECTIVE_SIZE);
+            } else {
+                fill_res_col2im<relu>(res_tile.data(), &res[0], &bias[0], b, b_end);
+            }
+        }
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    // we implement the convolution with the im2col transformation. The rows of a group are its
+    // output channels, so the matrices of the groups are already stacked.
+    Tensor<DType> kernel_im2col(const ConstTensor<DType> &kernel) {
+        const size_t KERNEL_SIZE = KERNEL_HEIGHT * KERNEL_WIDTH;
+
+        Tensor<DType> res({OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE});
+
+        threading::parallel_for(
+            OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE, [&](size_t oc_begin, size_t oc_end) {
+                for (size_t oc = oc_begin; oc < oc_end; ++oc) {
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        for (size_t kh = 0; kh < KERNEL_HEIGHT; ++kh) {
+                            for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                                res(oc, im2col_column(ic, kh, kw)) = kernel(oc, ic, kh, kw);
+                            }
+                        }
+                    }
+                }
+            });
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    Tensor<DType> x_im2col(const ConstTensor<DType> &tensor) const {
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH;
+        Tensor<DType> tensor_im2col({GROUPS * BATCH_SIZE * EFFECTIVE_SIZE, ROW_SIZE});
+        fill_x_im2col(&tensor[0], &tensor_im2col[0], 0, BATCH_SIZE);
+
+        tensor_im2col.wrap_for_broadcasting();
+        return tensor_im2col;
+    }
+
+    /**
+     * Writes the im2col rows of the samples [b_begin, b_end) of x to im2col_rows, the matrix of a
+     * group after the other. The rows of a row of the output are filled by the same thread, they
+     * stay in its cache while they are filled.
+     */
+    void
+    fill_x_im2col(const DType *x_data, DType *im2col_rows, size_t b_begin, size_t b_end) const {
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH;
+        const size_t N_ROWS = (b_end - b_begin) * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        auto fill_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t b = b_begin + i / EFFECTIVE_HEIGHT;
+                size_t eff_h = i % EFFECTIVE_HEIGHT;
+                for (size_t group = 0; group < GROUPS; ++group) {
+                    DType *rows = im2col_rows + (group * N_ROWS + i * EFFECTIVE_WIDTH) * ROW_SIZE;
+                    if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+                        output_row_im2col_channels_last(x_data, rows, b, eff_h, group);
+                    } else {
+                        output_row_im2col(x_data, rows, b, eff_h, group);
+                    }
+                }
+            }
+        };
+        threading::parallel_for(
+            (b_end - b_begin) * EFFECTIVE_HEIGHT, GROUPS * EFFECTIVE_WIDTH * ROW_SIZE, fill_rows);
+    }
+
+    // im2col rows of the row eff_h of the output of the sample b, for a group
+    void output_row_im2col(
+        const DType *x_data, DType *rows, size_t b, size_t eff_h, size_t group) const {
+        const size_t KERNEL_SIZE = KERNEL_HEIGHT * KERNEL_WIDTH;
+
+        // The padding is never materialized: for each position of the kernel only the outputs
+        // that read inside x are copied, the others are set to zero directly
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        const size_t DATA_SIZE = DATA_HEIGHT * DATA_WIDTH;
+        for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+            const DType *x_channel =
+                x_data + (b * IN_CHANNELS + group * GROUP_IN_CHANNELS + ic) * DATA_SIZE;
+            for (size_t kh = 0; kh < KERNEL_HEIGHT; ++kh) {
+                DType *columns = rows + ic * KERNEL_SIZE + kh * KERNEL_WIDTH;
+                // Row of x read by this row of the kernel
+                size_t h = eff_h * STRIDE_HEIGHT + kh * DILATION_HEIGHT;
+                if (h < PADDING_HEIGHT || h >= DATA_HEIGHT + PADDING_HEIGHT) {
+                    for (size_t w = 0; w < EFFECTIVE_WIDTH; ++w) {
+                        std::fill_n(columns + w * ROW_SIZE, KERNEL_WIDTH, DType{0});
+                    }
+                    continue;
+                }
+                const DType *x_row = x_channel + (h - PADDING_HEIGHT) * DATA_WIDTH;
+                for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                    const size_t offset = kw * DILATION_WIDTH;
+                    auto [w_begin, w_end] = direct_conv::valid_outputs(
+                        offset, STRIDE_WIDTH, PADDING_WIDTH, DATA_WIDTH, EFFECTIVE_WIDTH);
+                    DType *column = columns + kw;
+                    for (size_t w = 0; w < w_begin; ++w) {
+                        column[w * ROW_SIZE] = DType{0};
+                    }
+                    for (size_t w = w_begin; w < w_end; ++w) {
+                        column[w * ROW_SIZE] = x_row[w * STRIDE_WIDTH + offset - PADDING_WIDTH];
+                    }
+                    for (size_t w = w_end; w < EFFECTIVE_WIDTH; ++w) {
+                        column[w * ROW_SIZE] = DType{0};
+                    }
+                }
+            }
+        }
+    }
+
+    // In the channels-last layout, with neither groups nor dilation, the part of a row of the
+    // window inside x is a single block of x
+    void output_row_im2col_channels_last(
+        const DType *x_data, DType *row, size_t b, size_t eff_h, size_t group) const {
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH;
+        const size_t KERNEL_ROW_SIZE = KERNEL_WIDTH * GROUP_IN_CHANNELS;
+        const size_t DATA_ROW_SIZE = DATA_WIDTH * IN_CHANNELS;
+        const bool contiguous_windows = GROUPS == 1 && DILATION_WIDTH == 1;
+        const DType *x_group =
+            x_data + b * DATA_HEIGHT * DATA_ROW_SIZE + group * GROUP_IN_CHANNELS;
+        const size_t start_h = eff_h * STRIDE_HEIGHT;
+        auto [kh_begin, kh_end] = direct_conv::valid_window(
+            start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT, DILATION_HEIGHT);
+        for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w, row += ROW_SIZE) {
+            const size_t start_w = eff_w * STRIDE_WIDTH;
+            auto [kw_begin, kw_end] = direct_conv::valid_window(
+                start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH, DILATION_WIDTH);
+            std::fill_n(row, kh_begin * KERNEL_ROW_SIZE, DType{0});
+            for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                DType *kernel_row = row + kh * KERNEL_ROW_SIZE;
+                const DType *x_row =
+                    x_group + (start_h + kh * DILATION_HEIGHT - PADDING_HEIGHT) * DATA_ROW_SIZE;
+                std::fill_n(kernel_row, kw_begin * GROUP_IN_CHANNELS, DType{0});
+                if (contiguous_windows && kw_begin < kw_end) {
+                    std::copy_n(x_row + (start_w + kw_begin - PADDING_WIDTH) * IN_CHANNELS,
+                                (kw_end - kw_begin) * IN_CHANNELS,
+                                kernel_row + kw_begin * IN_CHANNELS);
+                }
+                for (size_t kw = kw_begin; kw < kw_end && !contiguous_windows; ++kw) {
+                    std::copy_n(
+                        x_row + (start_w + kw * DILATION_WIDTH - PADDING_WIDTH) * IN_CHANNELS,
+                        GROUP_IN_CHANNELS,
+                        kernel_row + kw * GROUP_IN_CHANNELS);
+                }
+                std::fill_n(kernel_row + kw_end * GROUP_IN_CHANNELS,
+                            (KERNEL_WIDTH - kw_end) * GROUP_IN_CHANNELS,
+                            DType{0});
+            }
+            std::fill_n(row + kh_end * KERNEL_ROW_SIZE,
+                        (KERNEL_HEIGHT - kh_end) * KERNEL_ROW_SIZE,
+                        DType{0});
+        }
+    }
+
+    ConstTensor<DType> res_im2col(const ConstTensor<DType> &res_grad) {
+        // By convention we assume that the gradient has the shape of the output
+        assert(res_grad.get_shape() == output_shape());
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+        const size_t N_ROWS = BATCH_SIZE * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        if (channels_last && GROUPS == 1) {
+            // [BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, OUT_CHANNELS] is already the
+            // gradient matrix
+            ConstTensor<DType> res_grad_im2col = res_grad;
+            res_grad_im2col.set_shape({N_ROWS, OUT_CHANNELS});
+            return res_grad_im2col;
+        }
+
+        Tensor<DType> res_grad_im2col({GROUPS * N_ROWS, GROUP_OUT_CHANNELS});
+        const DType *grad_data = &res_grad[0];
+        DType *matrix_data = &res_grad_im2col[0];
+        // Each thread transposes whole rows of the output
+        auto transpose_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t b = i / EFFECTIVE_HEIGHT;
+                size_t eff_h = i % EFFECTIVE_HEIGHT;
+                for (size_t group = 0; group < GROUPS; ++group) {
+                    DType *rows =
+                        matrix_data + (group * N_ROWS + i * EFFECTIVE_WIDTH) * GROUP_OUT_CHANNELS;
+                    const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                    if (channels_last) {
+                        for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
+                            std::copy_n(grad_data + (i * EFFECTIVE_WIDTH + eff_w) * OUT_CHANNELS +
+                                            first_channel,
+                                        GROUP_OUT_CHANNELS,
+                                        rows + eff_w * GROUP_OUT_CHANNELS);
+                        }
+                        continue;
+                    }
+                    for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; ++oc) {
+                        const size_t channel = b * OUT_CHANNELS + first_channel + oc;
+                        const DType *grad_row =
+                            grad_data + (channel * EFFECTIVE_HEIGHT + eff_h) * EFFECTIVE_WIDTH;
+                        for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
+                            rows[eff_w * GROUP_OUT_CHANNELS + oc] = grad_row[eff_w];
+                        }
+                    }
+                }
+            }
+        };
+        threading::parallel_for(
+            BATCH_SIZE * EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH * OUT_CHANNELS, transpose_rows);
+
+        res_grad_im2col.wrap_for_broadcasting();
+        return res_grad_im2col;
+    }
+
+    // Inverse trasnformations for backpropagation
+    Tensor<DType> kernel_col2im(const ConstTensor<DType> &grad_matrix) const {
+        const Shape &t_shape = grad_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the grad_matrix must have the following shape
+        // [OUT_CHANNELS, IN_CHANNELS / GROUPS * KERNEL_HEIGHT * KERNEL_WIDTH]
+        const size_t KERNEL_SIZE = KERNEL_WIDTH * KERNEL_HEIGHT;
+        assert(t_shape.get_dimension() == 2);
+
+        assert(OUT_CHANNELS == t_shape_data[0]);
+        assert(GROUP_IN_CHANNELS * KERNEL_SIZE == t_shape_data[1]);
+
+        Tensor<DType> grad_kernel({OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH});
+
+        threading::parallel_for(
+            OUT_CHANNELS, GROUP_IN_CHANNELS * KERNEL_SIZE, [&](size_t oc_begin, size_t oc_end) {
+                for (size_t oc = oc_begin; oc < oc_end; ++oc) {
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        for (size_t kh = 0; kh < KERNEL_HEIGHT; ++kh) {
+                            for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                                grad_kernel(oc, ic, kh, kw) =
+                                    grad_matrix(oc, im2col_column(ic, kh, kw));
+                            }
+                        }
+                    }
+                }
+            });
+
+        grad_kernel.wrap_for_broadcasting();
+        return grad_kernel;
+    }
+
+    Tensor<DType> x_col2im(const ConstTensor<DType> &grad_x_matrix) const {
+        const Shape &t_shape = grad_x_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the grad_matrix must have the following shape
+        // [GROUPS * BATCH_SIZE * EFFECTIVE_DATA_HEIGHT * EFFECTIVE_DATA_WIDTH,
+        // IN_CHANNELS / GROUPS * KERNEL_HEIGHT * KERNEL_WIDTH]
+        assert(t_shape.get_dimension() == 2);
+        const size_t KERNEL_SIZE = KERNEL_WIDTH * KERNEL_HEIGHT;
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+
+        assert(GROUPS * BATCH_SIZE * EFFECTIVE_SIZE == t_shape_data[0]);
+        assert(GROUP_IN_CHANNELS * KERNEL_SIZE == t_shape_data[1]);
+
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+        Tensor<DType> grad_x(channels_last
+                                 ? Shape{BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS}
+                                 : Shape{BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        grad_x.set_zero();
+        const DType *matrix_data = &grad_x_matrix[0];
+        DType *grad_x_data = &grad_x[0];
+        // The windows overlap, each thread adds to its own samples, and in the channels-first
+        // layout to its own channels
+        const size_t n_channel_groups = channels_last ? 1 : IN_CHANNELS;
+        auto add_windows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (channels_last) {
+                    sample_col2im_channels_last(matrix_data, grad_x_data, i);
+                } else {
+                    sample_col2im(matrix_data, grad_x_data, i / IN_CHANNELS, i % IN_CHANNELS);
+                }
+            }
+        };
+        threading::parallel_for(BATCH_SIZE * n_channel_groups,
+                                EFFECTIVE_SIZE * IN_CHANNELS * KERNEL_SIZE / n_channel_groups,
+                                add_windows);
+
+        grad_x.wrap_for_broadcasting();
+        return grad_x;
+    }
+
+    // Adds the gradients of the windows of the sample b to the channel ic of grad_x. The gradient
+    // of the padding is dropped: only the part of each window inside x is added.
+    void sample_col2im(const DType *matrix_data, DType *grad_x_data, size_t b, size_t ic) const {
+        const size_t KERNEL_SIZE = KERNEL_WIDTH * KERNEL_HEIGHT;
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_SIZE;
+        const size_t DATA_SIZE = DATA_HEIGHT * DATA_WIDTH;
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        const size_t group = ic / GROUP_IN_CHANNELS;
+        DType *grad_x_channel = grad_x_data + (b * IN_CHANNELS + ic) * DATA_SIZE;
+        const DType *row = matrix_data + ((group * BATCH_SIZE + b) * EFFECTIVE_SIZE) * ROW_SIZE +
+                           (ic % GROUP_IN_CHANNELS) * KERNEL_SIZE;
+        for (size_t eff_h = 0; eff_h < EFFECTIVE_HEIGHT; ++eff_h) {
+            const size_t start_h = eff_h * STRIDE_HEIGHT;
+            auto [kh_begin, kh_end] = direct_conv::valid_window(
+                start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT, DILATION_HEIGHT);
+            for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w, row += ROW_SIZE) {
+                const size_t start_w = eff_w * STRIDE_WIDTH;
+                auto [kw_begin, kw_end] = direct_conv::valid_window(
+                    start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH, DILATION_WIDTH);
+                for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                    const DType *window = row + kh * KERNEL_WIDTH;
+                    DType *grad_x_row =
+                        grad_x_channel +
+                        (start_h + kh * DILATION_HEIGHT - PADDING_HEIGHT) * DATA_WIDTH;
+                    for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                        grad_x_row[start_w + kw * DILATION_WIDTH - PADDING_WIDTH] += window[kw];
+                    }
+                }
+            }
+        }
+    }
+
+    // In the channels-last layout, with neither groups nor dilation, the part of a row of the
+    // window inside x is a single block of x
+    void sample_col2im_channels_last(const DType *matrix_data, DType *grad_x_data, size_t b) const {
+        const size_t ROW_SIZE = GROUP_IN_CHANNELS * KERNEL_HEIGHT * KERNEL_WIDTH;
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        const bool contiguous_windows = GROUPS == 1 && DILATION_WIDTH == 1;
+        DType *grad_x_batch = grad_x_data + b * DATA_HEIGHT * DATA_WIDTH * IN_CHANNELS;
+        for (size_t group = 0; group < GROUPS; ++group) {
+            const DType *row = matrix_data + ((group * BATCH_SIZE + b) * EFFECTIVE_SIZE) * ROW_SIZE;
+            DType *grad_x_group = grad_x_batch + group * GROUP_IN_CHANNELS;
+            for (size_t eff_h = 0; eff_h < EFFECTIVE_HEIGHT; ++eff_h) {
+                const size_t start_h = eff_h * STRIDE_HEIGHT;
+                auto [kh_begin, kh_end] = direct_conv::valid_window(
+                    start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT, DILATION_HEIGHT);
+                for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w, row += ROW_SIZE) {
+                    const size_t start_w = eff_w * STRIDE_WIDTH;
+                    auto [kw_begin, kw_end] = direct_conv::valid_window(
+                        start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH, DILATION_WIDTH);
+                    for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                        const size_t h = start_h + kh * DILATION_HEIGHT - PADDING_HEIGHT;
+                        DType *grad_x_row = grad_x_group + h * DATA_WIDTH * IN_CHANNELS;
+                        const DType *kernel_row = row + kh * KERNEL_WIDTH * GROUP_IN_CHANNELS;
+                        if (contiguous_windows) {
+                            const size_t block_size = (kw_end - kw_begin) * IN_CHANNELS;
+                            const DType *window = kernel_row + kw_begin * IN_CHANNELS;
+                            DType *grad_x_block =
+                                grad_x_row + (start_w + kw_begin - PADDING_WIDTH) * IN_CHANNELS;
+                            for (size_t i = 0; i < block_size; ++i) {
+                                grad_x_block[i] += window[i];
+                            }
+                            continue;
+                        }
+                        for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                            const DType *window = kernel_row + kw * GROUP_IN_CHANNELS;
+                            DType *grad_x_position =
+                                grad_x_row +
+                                (start_w + kw * DILATION_WIDTH - PADDING_WIDTH) * IN_CHANNELS;
+                            for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                                grad_x_position[ic] += window[ic];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    Shape output_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, OUT_CHANNELS};
+        }
+        return {BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH};
+    }
+
+    Shape input_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS};
+        }
+        return {BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH};
+    }
+
+    // Sums of the channels of grad, the gradient of the bias: the output of the convolution (the
+    // input for the transposed convolution) has n_channels channels of plane_size elements
+    Tensor<DType>
+    channel_sums(const ConstTensor<DType> &grad, size_t n_channels, size_t plane_size) const {
+        Tensor<DType> sums({n_channels});
+        conv_epilogue::channel_sums(
+            LAYOUT, &grad[0], &sums[0], BATCH_SIZE, n_channels, plane_size);
+        sums.wrap_for_broadcasting();
+        return sums;
+    }
+
+    // bias (if not null) and relu are applied while the matrix is written to the output
+    template <bool relu = false>
+    Tensor<DType> res_col2im(Tensor<DType> res_matrix, const DType *bias = nullptr) {
+        const Shape &t_shape = res_matrix.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the input has shape
+        // [GROUPS * BATCH_SIZE * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH, OUT_CHANNELS / GROUPS]
+        assert(t_shape.get_dimension() == 2);
+        const size_t EFFECTIVE_SIZE = EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        assert(GROUPS * BATCH_SIZE * EFFECTIVE_SIZE == t_shape_data[0]);
+        assert(GROUP_OUT_CHANNELS == t_shape_data[1]);
+
+        // which is already the output in the channels-last layout, without groups
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST && GROUPS == 1) {
+            if (relu || bias != nullptr) {
+                conv_epilogue::bias_activation<relu>(
+                    LAYOUT, &res_matrix[0], bias, BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_SIZE);
+            }
+            res_matrix.set_shape(output_shape());
+            return res_matrix;
+        }
+
+        Tensor<DType> res(output_shape());
+        fill_res_col2im<relu>(&res_matrix[0], &res[0], bias, 0, BATCH_SIZE);
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    /**
+     * Writes the rows of the samples [b_begin, b_end) of the output matrices of the groups, from
+     * matrix_rows, to the output res_data, adding the bias (if not null) and applying the relu
+     */
+    template <bool relu>
+    void fill_res_col2im(const DType *matrix_rows,
+                         DType *res_data,
+                         const DType *bias,
+                         size_t b_begin,
+                         size_t b_end) const {
+        const size_t N_ROWS = (b_end - b_begin) * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        // Each thread transposes whole rows of the output
+        auto transpose_rows = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t b = b_begin + i / EFFECTIVE_HEIGHT;
+                size_t eff_h = i % EFFECTIVE_HEIGHT;
+                for (size_t group = 0; group < GROUPS; ++group) {
+                    const DType *rows =
+                        matrix_rows + (group * N_ROWS + i * EFFECTIVE_WIDTH) * GROUP_OUT_CHANNELS;
+                    const size_t first_channel = group * GROUP_OUT_CHANNELS;
+                    const DType *group_bias = bias != nullptr ? bias + first_channel : nullptr;
+                    if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+                        DType *res_row = res_data + (b * EFFECTIVE_HEIGHT + eff_h) *
+                                                        EFFECTIVE_WIDTH * OUT_CHANNELS;
+                        for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
+                            conv_epilogue::bias_activation_row<relu>(
+                                rows + eff_w * GROUP_OUT_CHANNELS,
+                                res_row + eff_w * OUT_CHANNELS + first_channel,
+                                group_bias,
+                                GROUP_OUT_CHANNELS);
+                        }
+                        continue;
+                    }
+                    for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; ++oc) {
+                        const size_t channel = b * OUT_CHANNELS + first_channel + oc;
+                        DType *res_row =
+                            res_data + (channel * EFFECTIVE_HEIGHT + eff_h) * EFFECTIVE_WIDTH;
+                        for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
+                            res_row[eff_w] = rows[eff_w * GROUP_OUT_CHANNELS + oc];
+                        }
+                        // The row of the channel is still in cache
+                        if (relu || group_bias != nullptr) {
+                            conv_epilogue::bias_activation_plane<relu>(
+                                res_row,
+                                group_bias != nullptr ? group_bias[oc] : DType{0},
+                                EFFECTIVE_WIDTH);
+                        }
+                    }
+                }
+            }
+        };
+        threading::parallel_for(
+            (b_end - b_begin) * EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH * OUT_CHANNELS, transpose_rows);
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "../avx/avx_wrapper.h"
+#include "../threading.h"
+#include "direct_convolution.h"
+
+/**
+ * Output transform of the convolutions, shared by the 1d and 2d convolutions.
+ *
+ * The im2col product does not carry the bias (no column of ones in the im2col matrix of x): the
+ * bias, and the relu of the fused nodes, are applied while the rows of the product are written to
+ * the output, or in place when the rows already are the output. The gradient of the bias is the
+ * sum of each channel of the gradient, reduced in AVX registers.
+ *
+ * The data is [batch, n_channels, plane_size] in the channels-first layout, and
+ * [batch, plane_size, n_channels] in the channels-last one. A null bias only applies the relu.
+ */
+namespace conv_epilogue {
+    template <bool relu, typename DType>
+    inline DType activation(DType value) {
+        if constexpr (relu) {
+            return std::max(value, DType{0});
+        }
+        return value;
+    }
+
+    /**
+     * dst[j] = activation(src[j] + bias[j]) for j in [0, n), src and dst may be the same row
+     */
+    template <bool relu, typename DType>
+    inline void bias_activation_row(const DType *src, DType *dst, const DType *bias, size_t n) {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        size_t j = 0;
+        for (; j + W <= n; j += W) {
+            simd_type<DType> v = _mm256_loadu_px(src + j);
+            if (bias != nullptr) {
+                v = _mm256_add_px<DType>(v, _mm256_loadu_px(bias + j));
+            }
+            if constexpr (relu) {
+                v = _mm256_max_px<DType>(v, avx_constants::zero<DType>);
+            }
+            _mm256_storeu_px(dst + j, v);
+        }
+        for (; j < n; j++) {
+            dst[j] = activation<relu>(src[j] + (bias != nullptr ? bias[j] : DType{0}));
+        }
+    }
+
+    // row[j] = activation(row[j] + bias) for j in [0, n)
+    template <bool relu, typename DType>
+    inline void bias_activation_plane(DType *row, DType bias, size_t n) {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        const simd_type<DType> v_bias = _mm256_set1_px(bias);
+        size_t j = 0;
+        for (; j + W <= n; j += W) {
+            simd_type<DType> v = _mm256_add_px<DType>(_mm256_loadu_px(row + j), v_bias);
+            if constexpr (relu) {
+                v = _mm256_max_px<DType>(v, avx_constants::zero<DType>);
+            }
+            _mm256_storeu_px(row + j, v);
+        }
+        for (; j < n; j++) {
+            row[j] = activation<relu>(row[j] + bias);
+        }
+    }
+
+    // Adds the bias of each channel to data, in place, and applies the relu
+    template <bool relu, typename DType>
+    void bias_activation(ConvolutionLayout layout,
+                         DType *data,
+                         const DType *bias,
+                         size_t batch,
+                         size_t n_channels,
+                         size_t plane_size) {
+        if (layout == ConvolutionLayout::CHANNELS_LAST) {
+            threading::parallel_for(batch * plane_size, n_channels, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    DType *row = data + i * n_channels;
+                    bias_activation_row<relu>(row, row, bias, n_channels);
+                }
+            });
+            return;
+        }
+        threading::parallel_for(batch * n_channels, plane_size, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                DType channel_bias = bias != nullptr ? bias[i % n_channels] : DType{0};
+                bias_activation_plane<relu>(data + i * plane_size, channel_bias, plane_size);
+            }
+        });
+    }
+
+    // Sum of the n elements of row
+    template <typename DType>
+    inline DType row_sum(const DType *row, size_t n) {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        simd_type<DType> acc0 = avx_constants::zero<DType>;
+        simd_type<DType> acc1 = avx_constants::zero<DType>;
+        size_t j = 0;
+        for (; j + 2 * W <= n; j += 2 * W) {
+            acc0 = _mm256_add_px<DType>(acc0, _mm256_loadu_px(row + j));
+            acc1 = _mm256_add_px<DType>(acc1, _mm256_loadu_px(row + j + W));
+        }
+        alignas(32) DType lanes[W];
+        _mm256_store_px(lanes, _mm256_add_px<DType>(acc0, acc1));
+        DType sum{0};
+        for (size_t l = 0; l < W; l++) {
+            sum += lanes[l];
+        }
+        for (; j < n; j++) {
+            sum += row[j];
+        }
+        return sum;
+    }
+
+    // sums[c] is the sum of the channel c of data, the gradient of the bias
+    template <typename DType>
+    void channel_sums(ConvolutionLayout layout,
+                      const DType *data,
+                      DType *sums,
+                      size_t batch,
+                      size_t n_channels,
+                      size_t plane_size) {
+        if (layout == ConvolutionLayout::CHANNELS_LAST) {
+            // Each thread sums a few vectors of channels over all the positions
+            constexpr size_t W = avx_constants::intrinsic_size<DType>;
+            const size_t n_rows = batch * plane_size;
+            const size_t n_blocks = (n_channels + W - 1) / W;
+            threading::parallel_for(n_blocks, n_rows * W, [&](size_t begin, size_t end) {
+                for (size_t block = begin; block < end; block++) {
+                    const size_t c = block * W;
+                    if (c + W > n_channels) {
+                        for (size_t tail = c; tail < n_channels; tail++) {
+                            DType sum{0};
+                            for (size_t i = 0; i < n_rows; i++) {
+                                sum += data[i * n_channels + tail];
+                            }
+                            sums[tail] = sum;
+                        }
+                        continue;
+                    }
+                    simd_type<DType> acc = avx_constants::zero<DType>;
+                    for (size_t i = 0; i < n_rows; i++) {
+                        acc = _mm256_add_px<DType>(acc, _mm256_loadu_px(data + i * n_channels + c));
+                    }
+                    _mm256_storeu_px(sums + c, acc);
+                }
+            });
+            return;
+        }
+        threading::parallel_for(n_channels, batch * plane_size, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                DType sum{0};
+                for (size_t b = 0; b < batch; b++) {
+                    sum += row_sum(data + (b * n_channels + c) * plane_size, plane_size);
+                }
+                sums[c] = sum;
+            }
+        });
+    }
+} // namespace conv_epilogue
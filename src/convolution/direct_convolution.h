@@ -0,0 +1,536 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "../gemm/gemm.h"
+#include "../threading.h"
+
+/**
+ * Helpers shared by the 1d and 2d convolutions, and the direct convolution kernels.
+ *
+ * With few channels the im2col matrix, KERNEL_SIZE times bigger than x, costs more to build than
+ * the product itself. The direct kernels never build it: each sample of x is split into its stride
+ * phases (the element (i, j) of the padded channel goes to the phase (i % STRIDE_HEIGHT,
+ * j % STRIDE_WIDTH), at (i / STRIDE_HEIGHT, j / STRIDE_WIDTH)), a buffer as big as the sample.
+ * Then, for any stride, a position of the kernel (a tap) reads a contiguous row of a phase for a
+ * row of outputs, and the outputs are computed a few channels and a few vectors at a time, as in a
+ * GEMM micro kernel.
+ *
+ * Dilation only spreads the taps on the phases, and a grouped convolution is a convolution for
+ * each group of channels. In particular the depthwise convolutions (one input channel per group)
+ * always use these kernels: a GEMM for each channel would be degenerate.
+ *
+ * The 1d convolution is a 2d convolution with a single row.
+ */
+// WINOGRAD is available only for the 2d convolutions with a 3x3 kernel and stride 1, FFT only for
+// the 1d convolutions
+enum class ConvolutionAlgorithm { AUTOMATIC, IM2COL, DIRECT, WINOGRAD, FFT };
+
+// Layout of x and of the output: [B, C, (H,) W] or [B, (H,) W, C]. The channels-last layout is the
+// natural layout of the im2col matrix multiplication, only the im2col kernels support it.
+enum class ConvolutionLayout { CHANNELS_FIRST, CHANNELS_LAST };
+
+namespace direct_conv {
+    // With AUTOMATIC the direct kernels are used when an output reads at most this many elements
+    // of x (IN_CHANNELS * KERNEL_SIZE), above that the GEMM of im2col is faster
+    inline constexpr size_t MAX_DIRECT_TAPS = 256;
+
+    inline bool use_direct(ConvolutionAlgorithm algorithm, size_t n_taps) {
+        if (algorithm == ConvolutionAlgorithm::AUTOMATIC) {
+            return n_taps <= MAX_DIRECT_TAPS;
+        }
+        return algorithm == ConvolutionAlgorithm::DIRECT;
+    }
+
+    /**
+     * Range [begin, end) of the positions of a window of kernel_size elements, dilation apart, that
+     * fall inside x (i.e. not on the padding), for a window that starts at start on the padded data
+     */
+    inline std::pair<size_t, size_t> valid_window(
+        size_t start, size_t padding, size_t data_size, size_t kernel_size, size_t dilation = 1) {
+        // The position k reads start + k * dilation, that must be in [padding, data_size + padding)
+        size_t begin = std::min(
+            kernel_size, padding > start ? (padding - start + dilation - 1) / dilation : 0);
+        size_t data_end = data_size + padding;
+        size_t end = std::min(
+            kernel_size, data_end > start ? (data_end - start + dilation - 1) / dilation : 0);
+        return {begin, std::max(begin, end)};
+    }
+
+    /**
+     * Range [begin, end) of the outputs for which the element k of the (dilated) window falls
+     * inside x (i.e. not on the padding), along a dimension of data_size elements
+     */
+    inline std::pair<size_t, size_t> valid_outputs(
+        size_t k, size_t stride, size_t padding, size_t data_size, size_t effective_size) {
+        // The output o reads o * stride + k - padding, that must be in [0, data_size)
+        size_t begin = k >= padding ? 0 : (padding - k + stride - 1) / stride;
+        size_t data_end = data_size + padding;
+        size_t end = data_end > k ? (data_end - k + stride - 1) / stride : 0;
+        end = std::min(end, effective_size);
+        return {std::min(begin, end), end};
+    }
+
+    /**
+     * out[c][o] += sum over the taps t of weights[t][c] * src[taps[t] + o], for the channels
+     * c in [0, OCB) and the outputs o in [0, n), n is a multiple of the vector size. Channel c of
+     * out starts at out + c * out_stride, weights has a row of n_channels for each tap.
+     */
+    template <typename T, size_t OCB>
+    inline void tap_block(const T *src,
+                          const std::vector<ptrdiff_t> &taps,
+                          const T *weights,
+                          size_t n_channels,
+                          T *out,
+                          size_t out_stride,
+                          size_t n) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        size_t o = 0;
+        for (; o + 2 * W <= n; o += 2 * W) {
+            simd_type<T> acc[OCB][2];
+            for (size_t c = 0; c < OCB; ++c) {
+                acc[c][0] = _mm256_loadu_px(out + c * out_stride + o);
+                acc[c][1] = _mm256_loadu_px(out + c * out_stride + o + W);
+            }
+            for (size_t t = 0; t < taps.size(); ++t) {
+                const T *s = src + taps[t] + o;
+                simd_type<T> x0 = _mm256_loadu_px(s);
+                simd_type<T> x1 = _mm256_loadu_px(s + W);
+                const T *w = weights + t * n_channels;
+                for (size_t c = 0; c < OCB; ++c) {
+                    simd_type<T> v = _mm256_set1_px(w[c]);
+                    acc[c][0] = _mm256_fmadd_px<T>(v, x0, acc[c][0]);
+                    acc[c][1] = _mm256_fmadd_px<T>(v, x1, acc[c][1]);
+                }
+            }
+            for (size_t c = 0; c < OCB; ++c) {
+                _mm256_storeu_px(out + c * out_stride + o, acc[c][0]);
+                _mm256_storeu_px(out + c * out_stride + o + W, acc[c][1]);
+            }
+        }
+        if (o < n) {
+            simd_type<T> acc[OCB];
+            for (size_t c = 0; c < OCB; ++c) {
+                acc[c] = _mm256_loadu_px(out + c * out_stride + o);
+            }
+            for (size_t t = 0; t < taps.size(); ++t) {
+                simd_type<T> x0 = _mm256_loadu_px(src + taps[t] + o);
+                const T *w = weights + t * n_channels;
+                for (size_t c = 0; c < OCB; ++c) {
+                    acc[c] = _mm256_fmadd_px<T>(_mm256_set1_px(w[c]), x0, acc[c]);
+                }
+            }
+            for (size_t c = 0; c < OCB; ++c) {
+                _mm256_storeu_px(out + c * out_stride + o, acc[c]);
+            }
+        }
+    }
+
+    // tap_block over all the n_channels channels, 4 at a time
+    template <typename T>
+    inline void tap_rows(const T *src,
+                         const std::vector<ptrdiff_t> &taps,
+                         const T *weights,
+                         size_t n_channels,
+                         T *out,
+                         size_t out_stride,
+                         size_t n) {
+        constexpr size_t OCB = 4;
+        size_t c = 0;
+        for (; c + OCB <= n_channels; c += OCB) {
+            tap_block<T, OCB>(
+                src, taps, weights + c, n_channels, out + c * out_stride, out_stride, n);
+        }
+        for (; c < n_channels; ++c) {
+            tap_block<T, 1>(
+                src, taps, weights + c, n_channels, out + c * out_stride, out_stride, n);
+        }
+    }
+
+    /**
+     * weights_grad[t][c] += sum over o in [0, n) of grad[c][o] * src[taps[t] + o], for the taps
+     * t in [first_tap, first_tap + TB) and the channels c in [0, OCB), n is a multiple of the
+     * vector size. Channel c of grad starts at grad + c * grad_stride.
+     */
+    template <typename T, size_t TB, size_t OCB>
+    inline void tap_grad_block(const T *src,
+                               const ptrdiff_t *taps,
+                               const T *grad,
+                               size_t grad_stride,
+                               size_t n,
+                               T *weights_grad,
+                               size_t n_channels) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        simd_type<T> acc[TB][OCB];
+        for (size_t t = 0; t < TB; ++t) {
+            for (size_t c = 0; c < OCB; ++c) {
+                acc[t][c] = avx_constants::zero<T>;
+            }
+        }
+        for (size_t o = 0; o < n; o += W) {
+            simd_type<T> g[OCB];
+            for (size_t c = 0; c < OCB; ++c) {
+                g[c] = _mm256_loadu_px(grad + c * grad_stride + o);
+            }
+            for (size_t t = 0; t < TB; ++t) {
+                simd_type<T> x0 = _mm256_loadu_px(src + taps[t] + o);
+                for (size_t c = 0; c < OCB; ++c) {
+                    acc[t][c] = _mm256_fmadd_px<T>(g[c], x0, acc[t][c]);
+                }
+            }
+        }
+        for (size_t t = 0; t < TB; ++t) {
+            for (size_t c = 0; c < OCB; ++c) {
+                weights_grad[t * n_channels + c] += gemm::horizontal_sum<T>(acc[t][c]);
+            }
+        }
+    }
+
+    // tap_grad_block over all the taps, 3 at a time, and all the n_channels channels, 4 at a time
+    template <typename T>
+    inline void tap_grad_rows(const T *src,
+                              const std::vector<ptrdiff_t> &taps,
+                              const T *grad,
+                              size_t grad_stride,
+                              size_t n,
+                              T *weights_grad,
+                              size_t n_channels) {
+        constexpr size_t TB = 3;
+        constexpr size_t OCB = 4;
+        for (size_t c = 0; c < n_channels; c += OCB) {
+            const T *grad_block = grad + c * grad_stride;
+            size_t t = 0;
+            for (; t + TB <= taps.size(); t += TB) {
+                T *w = weights_grad + t * n_channels + c;
+                if (c + OCB <= n_channels) {
+                    tap_grad_block<T, TB, OCB>(
+                        src, &taps[t], grad_block, grad_stride, n, w, n_channels);
+                } else {
+                    for (size_t cc = 0; cc < n_channels - c; ++cc) {
+                        tap_grad_block<T, TB, 1>(src,
+                                                 &taps[t],
+                                                 grad_block + cc * grad_stride,
+                                                 grad_stride,
+                                                 n,
+                                                 w + cc,
+                                                 n_channels);
+                    }
+                }
+            }
+            for (; t < taps.size(); ++t) {
+                T *w = weights_grad + t * n_channels + c;
+                for (size_t cc = 0; cc < std::min(OCB, n_channels - c); ++cc) {
+                    tap_grad_block<T, 1, 1>(
+                        src, &taps[t], grad_block + cc * grad_stride, grad_stride, n, w + cc, 1);
+                }
+            }
+        }
+    }
+
+    /**
+     * Shapes of a convolution, x is [batch, in_channels, data_height, data_width], the kernel is
+     * [out_channels, in_channels / groups, kernel_height, kernel_width] and the result is
+     * [batch, out_channels, effective_height, effective_width]. The output channels of a group
+     * read only the input channels of the same group.
+     */
+    struct Geometry {
+        size_t batch;
+        size_t in_channels;
+        size_t out_channels;
+        size_t kernel_height;
+        size_t kernel_width;
+        size_t stride_height;
+        size_t stride_width;
+        size_t padding_height;
+        size_t padding_width;
+        size_t data_height;
+        size_t data_width;
+        size_t effective_height;
+        size_t effective_width;
+        size_t dilation_height{1};
+        size_t dilation_width{1};
+        size_t groups{1};
+
+        size_t kernel_size() const { return kernel_height * kernel_width; }
+        size_t data_size() const { return data_height * data_width; }
+        size_t effective_size() const { return effective_height * effective_width; }
+        size_t group_in_channels() const { return in_channels / groups; }
+        size_t group_out_channels() const { return out_channels / groups; }
+        // Taps of an output channel
+        size_t n_taps() const { return group_in_channels() * kernel_size(); }
+        // Span of the dilated kernel on the padded data
+        size_t kernel_extent_height() const { return (kernel_height - 1) * dilation_height + 1; }
+        size_t kernel_extent_width() const { return (kernel_width - 1) * dilation_width + 1; }
+
+        // Size of a stride phase of a padded channel
+        size_t phase_height() const {
+            return (data_height + 2 * padding_height + stride_height - 1) / stride_height;
+        }
+        size_t phase_width() const {
+            return (data_width + 2 * padding_width + stride_width - 1) / stride_width;
+        }
+        size_t phase_size() const { return phase_height() * phase_width(); }
+        size_t channel_phases_size() const {
+            return stride_height * stride_width * phase_size();
+        }
+
+        // Position in the phases of a channel of the element (i, j) of the padded channel
+        size_t phase_index(size_t i, size_t j) const {
+            return ((i % stride_height) * stride_width + j % stride_width) * phase_size() +
+                   (i / stride_height) * phase_width() + j / stride_width;
+        }
+
+        /**
+         * The outputs of a sample are computed as a single row, with phase_width() outputs for each
+         * row of outputs (the last ones are dropped), rounded up to a multiple of the vector size
+         */
+        template <typename T>
+        size_t output_row_size() const {
+            constexpr size_t W = avx_constants::intrinsic_size<T>;
+            return (effective_height * phase_width() + W - 1) / W * W;
+        }
+
+        // Zeros after the phases of a sample, for the outputs that are dropped
+        template <typename T>
+        size_t phases_slack() const {
+            return kernel_extent_width() + 2 * avx_constants::intrinsic_size<T>;
+        }
+
+        // Offsets in the phases of a group of the taps (ic, kh, kw), for the first output
+        std::vector<ptrdiff_t> taps() const {
+            std::vector<ptrdiff_t> res;
+            res.reserve(n_taps());
+            for (size_t ic = 0; ic < group_in_channels(); ++ic) {
+                for (size_t kh = 0; kh < kernel_height; ++kh) {
+                    for (size_t kw = 0; kw < kernel_width; ++kw) {
+                        res.push_back(static_cast<ptrdiff_t>(
+                            ic * channel_phases_size() +
+                            phase_index(kh * dilation_height, kw * dilation_width)));
+                    }
+                }
+            }
+            return res;
+        }
+    };
+
+    // Splits the channels of a group of a sample, x [group_in_channels, data_height, data_width],
+    // into the stride phases of its padded channels
+    template <typename T>
+    inline void split_phases(const Geometry &g, const T *x, T *phases) {
+        for (size_t ic = 0; ic < g.group_in_channels(); ++ic) {
+            T *channel = phases + ic * g.channel_phases_size();
+            for (size_t h = 0; h < g.data_height; ++h) {
+                const T *x_row = x + (ic * g.data_height + h) * g.data_width;
+                for (size_t w = 0; w < g.data_width; ++w) {
+                    channel[g.phase_index(h + g.padding_height, w + g.padding_width)] = x_row[w];
+                }
+            }
+        }
+    }
+
+
+    // Weights with a row for each tap, for each group: weights[group][t][oc] = kernel[oc][t], for
+    // the output channels oc of the group
+    template <typename T>
+    inline std::vector<T> tap_weights(const Geometry &g, const T *kernel) {
+        const size_t GOC = g.group_out_channels();
+        std::vector<T> weights(g.n_taps() * g.out_channels);
+        for (size_t oc = 0; oc < g.out_channels; ++oc) {
+            T *group_weights = weights.data() + (oc / GOC) * g.n_taps() * GOC;
+            for (size_t t = 0; t < g.n_taps(); ++t) {
+                group_weights[t * GOC + oc % GOC] = kernel[oc * g.n_taps() + t];
+            }
+        }
+        return weights;
+    }
+
+    template <typename T>
+    inline void forward(const Geometry &g, const T *x, const T *kernel, const T *bias, T *res) {
+        const std::vector<ptrdiff_t> taps = g.taps();
+        const std::vector<T> weights = tap_weights(g, kernel);
+        const size_t GIC = g.group_in_channels();
+        const size_t GOC = g.group_out_channels();
+        const size_t PHASE_WIDTH = g.phase_width();
+        const size_t OUT_SIZE = g.output_row_size<T>();
+        // Each thread computes its own groups of its own samples, in its own buffers
+        auto compute_groups = [&](size_t begin, size_t end) {
+            // The padding is never written, it stays zero
+            std::vector<T> phases(GIC * g.channel_phases_size() + g.phases_slack<T>(), T{0});
+            std::vector<T> out(GOC * OUT_SIZE);
+            for (size_t i = begin; i < end; ++i) {
+                const size_t b = i / g.groups;
+                const size_t group = i % g.groups;
+                split_phases(
+                    g, x + (b * g.in_channels + group * GIC) * g.data_size(), phases.data());
+                for (size_t oc = 0; oc < GOC; ++oc) {
+                    std::fill_n(out.data() + oc * OUT_SIZE, OUT_SIZE, bias[group * GOC + oc]);
+                }
+                tap_rows<T>(phases.data(),
+                            taps,
+                            weights.data() + group * g.n_taps() * GOC,
+                            GOC,
+                            out.data(),
+                            OUT_SIZE,
+                            OUT_SIZE);
+
+                T *res_group = res + (b * g.out_channels + group * GOC) * g.effective_size();
+                for (size_t oc = 0; oc < GOC; ++oc) {
+                    for (size_t h = 0; h < g.effective_height; ++h) {
+                        std::copy_n(out.data() + oc * OUT_SIZE + h * PHASE_WIDTH,
+                                    g.effective_width,
+                                    res_group + (oc * g.effective_height + h) * g.effective_width);
+                    }
+                }
+            }
+        };
+        threading::parallel_for(g.batch * g.groups, g.n_taps() * GOC * OUT_SIZE, compute_groups);
+    }
+
+    /**
+     * Gradients of the kernel, of x and of the bias. The gradient of x goes through the phases:
+     * the element of a phase gets the contribution of the taps of that phase only, each output
+     * shifted by the position of the tap in the phase, so it is computed by tap_rows on the
+     * gradient padded by the extent of the kernel. The groups are split between threads, the
+     * gradient of the kernel of a group is accumulated over the samples by a single thread.
+     */
+    template <typename T>
+    inline void backward(const Geometry &g,
+                         const T *x,
+                         const T *kernel,
+                         const T *grad,
+                         T *kernel_grad,
+                         T *x_grad,
+                         T *bias_grad) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        const std::vector<ptrdiff_t> taps = g.taps();
+        const size_t GIC = g.group_in_channels();
+        const size_t GOC = g.group_out_channels();
+        const size_t PHASE_WIDTH = g.phase_width();
+        const size_t PHASE_HEIGHT = g.phase_height();
+        const size_t OUT_SIZE = g.output_row_size<T>();
+        const size_t PHASE_SIZE = (g.phase_size() + W - 1) / W * W;
+
+        // The gradient of a group, with rows of PHASE_WIDTH elements as the outputs, and
+        // pad_height rows of zeros before each channel. The columns after effective_width are
+        // zeros too, at least pad_width of them, so that a tap never reads the gradient of the
+        // previous row.
+        const size_t pad_height = (g.kernel_extent_height() - 1) / g.stride_height;
+        const size_t grad_size = (pad_height + PHASE_HEIGHT) * PHASE_WIDTH;
+        // Zeros before the first channel and after the last one
+        const size_t grad_lead = PHASE_WIDTH;
+        const size_t grad_slack = PHASE_SIZE + 2 * W;
+
+        // For each phase the taps that fall on it, on the padded gradient, and their weights for
+        // each group
+        const size_t n_phases = g.stride_height * g.stride_width;
+        std::vector<std::vector<ptrdiff_t>> phase_taps(n_phases);
+        std::vector<std::vector<T>> phase_weights(g.groups * n_phases);
+        for (size_t oc = 0; oc < GOC; ++oc) {
+            for (size_t kh = 0; kh < g.kernel_height; ++kh) {
+                for (size_t kw = 0; kw < g.kernel_width; ++kw) {
+                    // Position of the tap on the padded data
+                    const size_t i = kh * g.dilation_height;
+                    const size_t j = kw * g.dilation_width;
+                    size_t p = (i % g.stride_height) * g.stride_width + j % g.stride_width;
+                    phase_taps[p].push_back(
+                        static_cast<ptrdiff_t>(oc * grad_size +
+                                               (pad_height - i / g.stride_height) * PHASE_WIDTH) -
+                        static_cast<ptrdiff_t>(j / g.stride_width));
+                    for (size_t group = 0; group < g.groups; ++group) {
+                        for (size_t ic = 0; ic < GIC; ++ic) {
+                            phase_weights[group * n_phases + p].push_back(
+                                kernel[((group * GOC + oc) * GIC + ic) * g.kernel_size() +
+                                       kh * g.kernel_width + kw]);
+                        }
+                    }
+                }
+            }
+        }
+
+        std::vector<T> weights_grad(g.n_taps() * g.out_channels, T{0});
+        auto compute_groups = [&](size_t group_begin, size_t group_end) {
+            std::vector<T> phases(GIC * g.channel_phases_size() + g.phases_slack<T>(), T{0});
+            std::vector<T> out_grad(GOC * OUT_SIZE, T{0});
+            std::vector<T> padded_grad(grad_lead + GOC * grad_size + grad_slack, T{0});
+            // For each phase, the gradient of the phase of each input channel
+            std::vector<T> grad_phases(n_phases * GIC * PHASE_SIZE);
+            for (size_t group = group_begin; group < group_end; ++group) {
+                T *group_bias_grad = bias_grad + group * GOC;
+                std::fill_n(group_bias_grad, GOC, T{0});
+                for (size_t b = 0; b < g.batch; ++b) {
+                    const T *grad_group =
+                        grad + (b * g.out_channels + group * GOC) * g.effective_size();
+                    for (size_t oc = 0; oc < GOC; ++oc) {
+                        const T *grad_channel = grad_group + oc * g.effective_size();
+                        for (size_t i = 0; i < g.effective_size(); ++i) {
+                            group_bias_grad[oc] += grad_channel[i];
+                        }
+                    }
+
+                    // Kernel, the outputs that are dropped have a zero gradient
+                    split_phases(
+                        g, x + (b * g.in_channels + group * GIC) * g.data_size(), phases.data());
+                    for (size_t oc = 0; oc < GOC; ++oc) {
+                        for (size_t h = 0; h < g.effective_height; ++h) {
+                            const T *grad_row =
+                                grad_group + (oc * g.effective_height + h) * g.effective_width;
+                            std::copy_n(grad_row,
+                                        g.effective_width,
+                                        out_grad.data() + oc * OUT_SIZE + h * PHASE_WIDTH);
+                            std::copy_n(grad_row,
+                                        g.effective_width,
+                                        padded_grad.data() + grad_lead + oc * grad_size +
+                                            (pad_height + h) * PHASE_WIDTH);
+                        }
+                    }
+                    tap_grad_rows<T>(phases.data(),
+                                     taps,
+                                     out_grad.data(),
+                                     OUT_SIZE,
+                                     OUT_SIZE,
+                                     weights_grad.data() + group * g.n_taps() * GOC,
+                                     GOC);
+
+                    // x
+                    std::fill(grad_phases.begin(), grad_phases.end(), T{0});
+                    for (size_t p = 0; p < n_phases; ++p) {
+                        tap_rows<T>(padded_grad.data() + grad_lead,
+                                    phase_taps[p],
+                                    phase_weights[group * n_phases + p].data(),
+                                    GIC,
+                                    grad_phases.data() + p * GIC * PHASE_SIZE,
+                                    PHASE_SIZE,
+                                    PHASE_SIZE);
+                    }
+                    T *x_grad_group = x_grad + (b * g.in_channels + group * GIC) * g.data_size();
+                    for (size_t ic = 0; ic < GIC; ++ic) {
+                        for (size_t h = 0; h < g.data_height; ++h) {
+                            size_t i = h + g.padding_height;
+                            T *x_grad_row = x_grad_group + (ic * g.data_height + h) * g.data_width;
+                            for (size_t w = 0; w < g.data_width; ++w) {
+                                size_t j = w + g.padding_width;
+                                size_t p =
+                                    (i % g.stride_height) * g.stride_width + j % g.stride_width;
+                                x_grad_row[w] = grad_phases[(p * GIC + ic) * PHASE_SIZE +
+                                                            (i / g.stride_height) * PHASE_WIDTH +
+                                                            j / g.stride_width];
+                            }
+                        }
+                    }
+                }
+            }
+        };
+        threading::parallel_for(
+            g.groups, 2 * g.batch * g.n_taps() * GOC * OUT_SIZE, compute_groups);
+
+        for (size_t oc = 0; oc < g.out_channels; ++oc) {
+            const T *group_weights_grad = weights_grad.data() + (oc / GOC) * g.n_taps() * GOC;
+            for (size_t t = 0; t < g.n_taps(); ++t) {
+                kernel_grad[oc * g.n_taps() + t] = group_weights_grad[t * GOC + oc % GOC];
+            }
+        }
+    }
+} // namespace direct_conv
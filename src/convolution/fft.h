@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <vector>
+
+/**
+ * Fast Fourier transform of real signals, radix 2.
+ *
+ * A real signal of n elements is transformed as a complex signal of n / 2 elements (the even
+ * elements are the real parts, the odd ones the imaginary parts), then the spectrum of the real
+ * signal is split from it: only the n / 2 + 1 bins that are not the conjugate of another are
+ * kept. The spectra are stored as two arrays, the real and the imaginary parts, so that the
+ * products between them are plain vectorized loops.
+ */
+namespace fft {
+    inline bool is_power_of_two(size_t n) { return n > 0 && (n & (n - 1)) == 0; }
+
+    inline size_t next_power_of_two(size_t n) {
+        size_t res = 1;
+        while (res < n) {
+            res *= 2;
+        }
+        return res;
+    }
+
+    template <typename T>
+    class RealFFT {
+        // Size of the real signal and of the complex transform
+        size_t n;
+        size_t m;
+        // Twiddles exp(-2 pi i k / len) of each stage of the complex transform (len = 4, 8, ...,
+        // m), k in [0, len / 2), one stage after the other
+        std::vector<T> twiddles_re;
+        std::vector<T> twiddles_im;
+        // exp(-2 pi i k / n), to split the spectrum of the real signal
+        std::vector<T> split_re;
+        std::vector<T> split_im;
+        std::vector<size_t> bit_reversal;
+        // The complex signal, written in bit reversed order and transformed in place
+        std::vector<T> buffer_re;
+        std::vector<T> buffer_im;
+
+        // In place transform of the buffer, the inverse transform has no 1 / m factor. The
+        // butterflies of a stage are independent, on contiguous elements, so they are vectorized.
+        template <bool inverse>
+        void transform() {
+            T *re = buffer_re.data();
+            T *im = buffer_im.data();
+            for (size_t i = 0; i < m; i += 2) {
+                T a_re = re[i];
+                T a_im = im[i];
+                re[i] = a_re + re[i + 1];
+                im[i] = a_im + im[i + 1];
+                re[i + 1] = a_re - re[i + 1];
+                im[i + 1] = a_im - im[i + 1];
+            }
+            const T sign = inverse ? T{-1} : T{1};
+            size_t offset = 0;
+            for (size_t len = 4; len <= m; len *= 2) {
+                const size_t half = len / 2;
+                const T *w_re = twiddles_re.data() + offset;
+                const T *w_im = twiddles_im.data() + offset;
+                for (size_t start = 0; start < m; start += len) {
+                    T *a_re = re + start;
+                    T *a_im = im + start;
+                    T *b_re = a_re + half;
+                    T *b_im = a_im + half;
+                    for (size_t k = 0; k < half; ++k) {
+                        T wi = sign * w_im[k];
+                        T t_re = b_re[k] * w_re[k] - b_im[k] * wi;
+                        T t_im = b_re[k] * wi + b_im[k] * w_re[k];
+                        b_re[k] = a_re[k] - t_re;
+                        b_im[k] = a_im[k] - t_im;
+                        a_re[k] += t_re;
+                        a_im[k] += t_im;
+                    }
+                }
+                offset += half;
+            }
+        }
+
+      public:
+        // n must be a power of two, at least 4
+        explicit RealFFT(size_t n) : n{n}, m{n / 2} {
+            assert(is_power_of_two(n) && n >= 4);
+            for (size_t len = 4; len <= m; len *= 2) {
+                for (size_t k = 0; k < len / 2; ++k) {
+                    double angle = -2 * std::numbers::pi * static_cast<double>(k) / len;
+                    twiddles_re.push_back(static_cast<T>(std::cos(angle)));
+                    twiddles_im.push_back(static_cast<T>(std::sin(angle)));
+                }
+            }
+            split_re.resize(m + 1);
+            split_im.resize(m + 1);
+            for (size_t k = 0; k <= m; ++k) {
+                double angle = -2 * std::numbers::pi * static_cast<double>(k) / n;
+                split_re[k] = static_cast<T>(std::cos(angle));
+                split_im[k] = static_cast<T>(std::sin(angle));
+            }
+            bit_reversal.resize(m);
+            size_t bits = 0;
+            while ((size_t{1} << bits) < m) {
+                ++bits;
+            }
+            for (size_t i = 0; i < m; ++i) {
+                size_t r = 0;
+                for (size_t b = 0; b < bits; ++b) {
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                }
+                bit_reversal[i] = r;
+            }
+            buffer_re.resize(m);
+            buffer_im.resize(m);
+        }
+
+        size_t size() const { return n; }
+        // Number of bins of the spectrum
+        size_t bins() const { return m + 1; }
+
+        // Spectrum (re, im) [bins()] of x [size()]
+        void forward(const T *x, T *re, T *im) {
+            for (size_t k = 0; k < m; ++k) {
+                buffer_re[bit_reversal[k]] = x[2 * k];
+                buffer_im[bit_reversal[k]] = x[2 * k + 1];
+            }
+            transform<false>();
+            // X[k] = E[k] + w^k O[k], with E and O the spectra of the even and odd elements:
+            // E[k] = (Z[k] + conj(Z[m - k])) / 2, O[k] = (Z[k] - conj(Z[m - k])) / 2i
+            for (size_t k = 0; k <= m; ++k) {
+                size_t i = k == m ? 0 : k;
+                size_t j = k == 0 ? 0 : m - k;
+                T even_re = T{0.5} * (buffer_re[i] + buffer_re[j]);
+                T even_im = T{0.5} * (buffer_im[i] - buffer_im[j]);
+                T odd_re = T{0.5} * (buffer_im[i] + buffer_im[j]);
+                T odd_im = T{0.5} * (buffer_re[j] - buffer_re[i]);
+                re[k] = even_re + split_re[k] * odd_re - split_im[k] * odd_im;
+                im[k] = even_im + split_re[k] * odd_im + split_im[k] * odd_re;
+            }
+        }
+
+        // x [size()] from its spectrum (re, im) [bins()], the inverse of forward
+        void inverse(const T *re, const T *im, T *x) {
+            // E[k] = (X[k] + conj(X[m - k])) / 2, O[k] = (X[k] - conj(X[m - k])) / 2 w^-k,
+            // Z[k] = E[k] + i O[k]
+            for (size_t k = 0; k < m; ++k) {
+                T even_re = T{0.5} * (re[k] + re[m - k]);
+                T even_im = T{0.5} * (im[k] - im[m - k]);
+                T diff_re = T{0.5} * (re[k] - re[m - k]);
+                T diff_im = T{0.5} * (im[k] + im[m - k]);
+                T odd_re = diff_re * split_re[k] + diff_im * split_im[k];
+                T odd_im = diff_im * split_re[k] - diff_re * split_im[k];
+                size_t r = bit_reversal[k];
+                buffer_re[r] = even_re - odd_im;
+                buffer_im[r] = even_im + odd_re;
+            }
+            transform<true>();
+            T scale = T{1} / static_cast<T>(m);
+            for (size_t k = 0; k < m; ++k) {
+                x[2 * k] = buffer_re[k] * scale;
+                x[2 * k + 1] = buffer_im[k] * scale;
+            }
+        }
+    };
+} // namespace fft
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "fft.h"
+
+/**
+ * 1d convolution through the FFT, for long kernels (the cost of im2col grows with the kernel size,
+ * with the FFT it is almost constant).
+ *
+ * The padded x is cut in overlapping segments of FFT_SIZE elements, one for each block of
+ * FFT_SIZE - KERNEL_SIZE + 1 outputs (overlap-save: the circular convolution of a segment is
+ * exact on these outputs, and nothing is accumulated between the blocks). For a block the spectra
+ * of the IN_CHANNELS segments are multiplied by the spectra of the kernels and summed over the
+ * input channels, then OUT_CHANNELS inverse transforms give the outputs. With a stride the outputs
+ * of stride 1 are computed, and one every STRIDE is kept.
+ *
+ * The backward step uses the same blocks: the gradient of x is the convolution of the gradient
+ * with the kernel, the gradient of the kernel is summed in the frequency domain over all the blocks
+ * and transformed back once.
+ */
+namespace fft_conv {
+    // With AUTOMATIC the FFT is used for the kernels with at least this many elements, unless they
+    // are small enough for the direct kernels
+    inline constexpr size_t MIN_FFT_KERNEL_SIZE = 32;
+
+    /**
+     * Shapes of a 1d convolution, x is [batch, in_channels, data_size], the kernel is
+     * [out_channels, in_channels, kernel_size] and the result is
+     * [batch, out_channels, effective_size]
+     */
+    struct Geometry {
+        size_t batch;
+        size_t in_channels;
+        size_t out_channels;
+        size_t kernel_size;
+        size_t stride;
+        size_t padding;
+        size_t data_size;
+        size_t effective_size;
+
+        size_t padded_size() const { return data_size + 2 * padding; }
+        // Outputs with stride 1
+        size_t full_size() const { return padded_size() - kernel_size + 1; }
+
+        // A segment is 4 times the kernel, or the whole padded x if it is shorter
+        size_t fft_size() const {
+            return std::max<size_t>(4,
+                                    std::min(fft::next_power_of_two(4 * kernel_size),
+                                             fft::next_power_of_two(padded_size())));
+        }
+        size_t block_size() const { return fft_size() - kernel_size + 1; }
+        size_t n_blocks() const { return (full_size() + block_size() - 1) / block_size(); }
+    };
+
+    /**
+     * Spectra (split in real and imaginary parts) of n_signals signals. Signal s occupies
+     * [s * bins, (s + 1) * bins) in re and im.
+     */
+    template <typename T>
+    struct Spectra {
+        size_t bins;
+        std::vector<T> re;
+        std::vector<T> im;
+
+        Spectra(size_t n_signals, size_t bins)
+            : bins{bins}, re(n_signals * bins, T{0}), im(n_signals * bins, T{0}) {}
+
+        T *re_of(size_t s) { return re.data() + s * bins; }
+        T *im_of(size_t s) { return im.data() + s * bins; }
+        const T *re_of(size_t s) const { return re.data() + s * bins; }
+        const T *im_of(size_t s) const { return im.data() + s * bins; }
+
+        void set_zero() {
+            std::fill(re.begin(), re.end(), T{0});
+            std::fill(im.begin(), im.end(), T{0});
+        }
+    };
+
+    // res += a * b, or a * conj(b), bin by bin
+    template <bool conjugate, typename T>
+    inline void multiply_accumulate(const T *a_re,
+                                    const T *a_im,
+                                    const T *b_re,
+                                    const T *b_im,
+                                    T *res_re,
+                                    T *res_im,
+                                    size_t bins) {
+        for (size_t f = 0; f < bins; ++f) {
+            if constexpr (conjugate) {
+                res_re[f] += a_re[f] * b_re[f] + a_im[f] * b_im[f];
+                res_im[f] += a_im[f] * b_re[f] - a_re[f] * b_im[f];
+            } else {
+                res_re[f] += a_re[f] * b_re[f] - a_im[f] * b_im[f];
+                res_im[f] += a_im[f] * b_re[f] + a_re[f] * b_im[f];
+            }
+        }
+    }
+
+    // Spectra of the kernels [out_channels * in_channels], zero padded to fft_size()
+    template <typename T>
+    inline Spectra<T>
+    kernel_spectra(const Geometry &g, fft::RealFFT<T> &transform, const T *kernel) {
+        const size_t n_kernels = g.out_channels * g.in_channels;
+        Spectra<T> res(n_kernels, transform.bins());
+        std::vector<T> padded(g.fft_size(), T{0});
+        for (size_t k = 0; k < n_kernels; ++k) {
+            std::copy_n(kernel + k * g.kernel_size, g.kernel_size, padded.begin());
+            transform.forward(padded.data(), res.re_of(k), res.im_of(k));
+        }
+        return res;
+    }
+
+    /**
+     * Copies the elements [begin, begin + size) of the channel, after padding elements of padding,
+     * into segment. The padding and the elements after the channel are zeros.
+     */
+    template <typename T>
+    inline void read_segment(const T *channel,
+                             size_t channel_size,
+                             size_t padding,
+                             ptrdiff_t begin,
+                             size_t size,
+                             T *segment) {
+        // The channel covers [channel_begin, channel_end) of the segment
+        const ptrdiff_t end = static_cast<ptrdiff_t>(size);
+        const ptrdiff_t first = static_cast<ptrdiff_t>(padding) - begin;
+        const ptrdiff_t channel_begin = std::clamp<ptrdiff_t>(first, 0, end);
+        const ptrdiff_t channel_end = std::clamp<ptrdiff_t>(
+            first + static_cast<ptrdiff_t>(channel_size), channel_begin, end);
+        std::fill(segment, segment + channel_begin, T{0});
+        std::copy(channel + (channel_begin - first),
+                  channel + (channel_end - first),
+                  segment + channel_begin);
+        std::fill(segment + channel_end, segment + end, T{0});
+    }
+
+    // Spectra of the segments of the block that starts at the output o0, for each input channel
+    template <typename T>
+    inline void x_block_spectra(const Geometry &g,
+                                fft::RealFFT<T> &transform,
+                                const T *x_batch,
+                                size_t o0,
+                                std::vector<T> &segment,
+                                Spectra<T> &res) {
+        for (size_t ic = 0; ic < g.in_channels; ++ic) {
+            read_segment(x_batch + ic * g.data_size,
+                         g.data_size,
+                         g.padding,
+                         static_cast<ptrdiff_t>(o0),
+                         segment.size(),
+                         segment.data());
+            transform.forward(segment.data(), res.re_of(ic), res.im_of(ic));
+        }
+    }
+
+    template <typename T>
+    inline void forward(const Geometry &g, const T *x, const T *kernel, const T *bias, T *res) {
+        fft::RealFFT<T> transform(g.fft_size());
+        const size_t BINS = transform.bins();
+        const size_t BLOCK = g.block_size();
+        const Spectra<T> kernels = kernel_spectra(g, transform, kernel);
+
+        std::vector<T> segment(g.fft_size());
+        Spectra<T> x_spectra(g.in_channels, BINS);
+        Spectra<T> out_spectra(g.out_channels, BINS);
+        for (size_t b = 0; b < g.batch; ++b) {
+            const T *x_batch = x + b * g.in_channels * g.data_size;
+            T *res_batch = res + b * g.out_channels * g.effective_size;
+            for (size_t block = 0; block < g.n_blocks(); ++block) {
+                const size_t o0 = block * BLOCK;
+                x_block_spectra(g, transform, x_batch, o0, segment, x_spectra);
+
+                // The correlation with the kernel is the product with its conjugate
+                out_spectra.set_zero();
+                for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                    for (size_t ic = 0; ic < g.in_channels; ++ic) {
+                        size_t k = oc * g.in_channels + ic;
+                        multiply_accumulate<true>(x_spectra.re_of(ic),
+                                                  x_spectra.im_of(ic),
+                                                  kernels.re_of(k),
+                                                  kernels.im_of(k),
+                                                  out_spectra.re_of(oc),
+                                                  out_spectra.im_of(oc),
+                                                  BINS);
+                    }
+                }
+
+                // Outputs of stride 1 in [o0, o0 + BLOCK), of which only the multiples of the
+                // stride are kept
+                const size_t first = (o0 + g.stride - 1) / g.stride;
+                const size_t end =
+                    std::min(g.effective_size, (o0 + BLOCK + g.stride - 1) / g.stride);
+                for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                    transform.inverse(out_spectra.re_of(oc), out_spectra.im_of(oc), segment.data());
+                    T *res_channel = res_batch + oc * g.effective_size;
+                    for (size_t o = first; o < end; ++o) {
+                        res_channel[o] = segment[o * g.stride - o0] + bias[oc];
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Gradients of the kernel, of x and of the bias.
+     */
+    template <typename T>
+    inline void backward(const Geometry &g,
+                         const T *x,
+                         const T *kernel,
+                         const T *grad,
+                         T *kernel_grad,
+                         T *x_grad,
+                         T *bias_grad) {
+        fft::RealFFT<T> transform(g.fft_size());
+        const size_t FFT_SIZE = g.fft_size();
+        const size_t BINS = transform.bins();
+        const size_t BLOCK = g.block_size();
+        const size_t K = g.kernel_size;
+        const Spectra<T> kernels = kernel_spectra(g, transform, kernel);
+
+        std::vector<T> segment(FFT_SIZE);
+        Spectra<T> x_spectra(g.in_channels, BINS);
+        Spectra<T> grad_spectra(g.out_channels, BINS);
+        Spectra<T> x_grad_spectra(g.in_channels, BINS);
+        Spectra<T> kernel_grad_spectra(g.out_channels * g.in_channels, BINS);
+        // The gradient of the outputs of stride 1 (zero on the outputs dropped by the stride)
+        std::vector<T> full_grads(g.out_channels * g.full_size());
+
+        std::fill_n(bias_grad, g.out_channels, T{0});
+        for (size_t b = 0; b < g.batch; ++b) {
+            const T *x_batch = x + b * g.in_channels * g.data_size;
+            const T *grad_batch = grad + b * g.out_channels * g.effective_size;
+            T *x_grad_batch = x_grad + b * g.in_channels * g.data_size;
+
+            std::fill(full_grads.begin(), full_grads.end(), T{0});
+            for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                for (size_t o = 0; o < g.effective_size; ++o) {
+                    bias_grad[oc] += grad_batch[oc * g.effective_size + o];
+                    full_grads[oc * g.full_size() + o * g.stride] =
+                        grad_batch[oc * g.effective_size + o];
+                }
+            }
+
+            // Kernel: sum over the blocks of the correlation of the segment of x with the block
+            // of the gradient
+            for (size_t block = 0; block < g.n_blocks(); ++block) {
+                const size_t o0 = block * BLOCK;
+                const size_t n_outputs = std::min(BLOCK, g.full_size() - o0);
+                x_block_spectra(g, transform, x_batch, o0, segment, x_spectra);
+                for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                    std::fill(segment.begin(), segment.end(), T{0});
+                    std::copy_n(
+                        full_grads.data() + oc * g.full_size() + o0, n_outputs, segment.begin());
+                    transform.forward(
+                        segment.data(), grad_spectra.re_of(oc), grad_spectra.im_of(oc));
+                    for (size_t ic = 0; ic < g.in_channels; ++ic) {
+                        size_t k = oc * g.in_channels + ic;
+                        multiply_accumulate<true>(x_spectra.re_of(ic),
+                                                  x_spectra.im_of(ic),
+                                                  grad_spectra.re_of(oc),
+                                                  grad_spectra.im_of(oc),
+                                                  kernel_grad_spectra.re_of(k),
+                                                  kernel_grad_spectra.im_of(k),
+                                                  BINS);
+                    }
+                }
+            }
+
+            // x: the padded position p gets sum over k of kernel[k] * full_grad[p - k]. A block
+            // of positions [p0, p0 + BLOCK) reads the gradient in [p0 - K + 1, p0 + BLOCK), the
+            // positions on the padding are skipped.
+            const size_t x_end = g.padding + g.data_size;
+            for (size_t p0 = g.padding; p0 < x_end; p0 += BLOCK) {
+                for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                    read_segment(full_grads.data() + oc * g.full_size(),
+                                 g.full_size(),
+                                 K - 1,
+                                 static_cast<ptrdiff_t>(p0),
+                                 FFT_SIZE,
+                                 segment.data());
+                    transform.forward(
+                        segment.data(), grad_spectra.re_of(oc), grad_spectra.im_of(oc));
+                }
+                x_grad_spectra.set_zero();
+                for (size_t ic = 0; ic < g.in_channels; ++ic) {
+                    for (size_t oc = 0; oc < g.out_channels; ++oc) {
+                        size_t k = oc * g.in_channels + ic;
+                        multiply_accumulate<false>(grad_spectra.re_of(oc),
+                                                   grad_spectra.im_of(oc),
+                                                   kernels.re_of(k),
+                                                   kernels.im_of(k),
+                                                   x_grad_spectra.re_of(ic),
+                                                   x_grad_spectra.im_of(ic),
+                                                   BINS);
+                    }
+                }
+                const size_t end = std::min(p0 + BLOCK, x_end);
+                for (size_t ic = 0; ic < g.in_channels; ++ic) {
+                    transform.inverse(
+                        x_grad_spectra.re_of(ic), x_grad_spectra.im_of(ic), segment.data());
+                    T *x_grad_channel = x_grad_batch + ic * g.data_size;
+                    for (size_t p = p0; p < end; ++p) {
+                        x_grad_channel[p - g.padding] = segment[p - p0 + K - 1];
+                    }
+                }
+            }
+        }
+
+        for (size_t k = 0; k < g.out_channels * g.in_channels; ++k) {
+            transform.inverse(
+                kernel_grad_spectra.re_of(k), kernel_grad_spectra.im_of(k), segment.data());
+            std::copy_n(segment.begin(), K, kernel_grad + k * K);
+        }
+    }
+} // namespace fft_conv
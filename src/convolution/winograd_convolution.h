@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "../blas_wrapper.h"
+#include "direct_convolution.h"
+
+/**
+ * Winograd F(2x2, 3x3) for the 3x3 convolutions with stride 1.
+ *
+ * The output is split into tiles of 2x2 elements, each computed from a tile of 4x4 elements of the
+ * padded x. In the transform domain a tile of the output is the element-wise product of the
+ * transformed kernel (U = G g G^T) and the transformed x (V = B^T d B), summed over the input
+ * channels, so each of the 16 elements of the transform domain is a GEMM
+ * M[OUT_CHANNELS, tiles] = U[OUT_CHANNELS, IN_CHANNELS] * V[IN_CHANNELS, tiles], and the output
+ * tile is A^T M A. That is 16 multiplications for 4 outputs instead of 36.
+ *
+ * The backward step goes through the same transforms, transposed: the gradient of M is
+ * A dY A^T, then the gradients of U and V are two more GEMMs for each element.
+ *
+ * F(4x4, 3x3) saves more multiplications, but its transforms lose too much precision in float.
+ */
+namespace winograd {
+    // Size of the input tiles, of the output tiles and of the transform domain
+    inline constexpr size_t TILE = 4;
+    inline constexpr size_t OUT_TILE = 2;
+    inline constexpr size_t N_ELEMENTS = TILE * TILE;
+
+    inline bool qualifies(const direct_conv::Geometry &g) {
+        return g.kernel_height == 3 && g.kernel_width == 3 && g.stride_height == 1 &&
+               g.stride_width == 1 && g.dilation_height == 1 && g.dilation_width == 1 &&
+               g.groups == 1;
+    }
+
+    inline size_t tiles_height(const direct_conv::Geometry &g) {
+        return (g.effective_height + OUT_TILE - 1) / OUT_TILE;
+    }
+    inline size_t tiles_width(const direct_conv::Geometry &g) {
+        return (g.effective_width + OUT_TILE - 1) / OUT_TILE;
+    }
+    inline size_t n_tiles(const direct_conv::Geometry &g) {
+        return g.batch * tiles_height(g) * tiles_width(g);
+    }
+
+    /**
+     * F m F^T for a square matrix m [N_IN, N_IN] (row major), f(v, stride) returns F v for the
+     * vector of N_IN elements that starts at v
+     */
+    template <size_t N_IN, size_t N_OUT, typename T, typename F>
+    inline std::array<T, N_OUT * N_OUT> sandwich(const T *m, F f) {
+        std::array<T, N_OUT * N_IN> tmp;
+        for (size_t c = 0; c < N_IN; ++c) {
+            std::array<T, N_OUT> column = f(m + c, N_IN);
+            for (size_t r = 0; r < N_OUT; ++r) {
+                tmp[r * N_IN + c] = column[r];
+            }
+        }
+        std::array<T, N_OUT * N_OUT> res;
+        for (size_t r = 0; r < N_OUT; ++r) {
+            std::array<T, N_OUT> row = f(tmp.data() + r * N_IN, 1);
+            std::copy(row.begin(), row.end(), res.begin() + r * N_OUT);
+        }
+        return res;
+    }
+
+    // G g, B^T d and A^T m, and their transposes for the backward step
+    template <typename T>
+    inline std::array<T, 4> kernel_transform(const T *v, size_t s) {
+        T half = static_cast<T>(0.5);
+        return {v[0], half * (v[0] + v[s] + v[2 * s]), half * (v[0] - v[s] + v[2 * s]), v[2 * s]};
+    }
+    template <typename T>
+    inline std::array<T, 3> kernel_transform_transposed(const T *v, size_t s) {
+        T half = static_cast<T>(0.5);
+        return {v[0] + half * (v[s] + v[2 * s]),
+                half * (v[s] - v[2 * s]),
+                half * (v[s] + v[2 * s]) + v[3 * s]};
+    }
+    template <typename T>
+    inline std::array<T, 4> x_transform(const T *v, size_t s) {
+        return {v[0] - v[2 * s], v[s] + v[2 * s], v[2 * s] - v[s], v[s] - v[3 * s]};
+    }
+    template <typename T>
+    inline std::array<T, 4> x_transform_transposed(const T *v, size_t s) {
+        return {v[0], v[s] - v[2 * s] + v[3 * s], v[s] + v[2 * s] - v[0], -v[3 * s]};
+    }
+    template <typename T>
+    inline std::array<T, 2> output_transform(const T *v, size_t s) {
+        return {v[0] + v[s] + v[2 * s], v[s] - v[2 * s] - v[3 * s]};
+    }
+    template <typename T>
+    inline std::array<T, 4> output_transform_transposed(const T *v, size_t s) {
+        return {v[0], v[0] + v[s], v[0] - v[s], -v[s]};
+    }
+
+    // u [N_ELEMENTS, out_channels, in_channels] from the kernel [out_channels, in_channels, 3, 3]
+    template <typename T>
+    inline void transform_kernel(const direct_conv::Geometry &g, const T *kernel, T *u) {
+        const size_t n_kernels = g.out_channels * g.in_channels;
+        for (size_t k = 0; k < n_kernels; ++k) {
+            auto transformed = sandwich<3, TILE, T>(kernel + k * 9, kernel_transform<T>);
+            for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                u[e * n_kernels + k] = transformed[e];
+            }
+        }
+    }
+
+    // v [N_ELEMENTS, in_channels, n_tiles] from x [batch, in_channels, data_height, data_width]
+    template <typename T>
+    inline void transform_x(const direct_conv::Geometry &g, const T *x, T *v) {
+        const size_t TH = tiles_height(g);
+        const size_t TW = tiles_width(g);
+        const size_t N_TILES = n_tiles(g);
+        std::array<T, N_ELEMENTS> d;
+        for (size_t b = 0; b < g.batch; ++b) {
+            for (size_t ic = 0; ic < g.in_channels; ++ic) {
+                const T *channel = x + (b * g.in_channels + ic) * g.data_size();
+                for (size_t th = 0; th < TH; ++th) {
+                    for (size_t tw = 0; tw < TW; ++tw) {
+                        // The tile starts at (th * OUT_TILE, tw * OUT_TILE) on the padded x
+                        for (size_t r = 0; r < TILE; ++r) {
+                            size_t i = th * OUT_TILE + r;
+                            bool row_inside =
+                                i >= g.padding_height && i - g.padding_height < g.data_height;
+                            for (size_t c = 0; c < TILE; ++c) {
+                                size_t j = tw * OUT_TILE + c;
+                                bool inside = row_inside && j >= g.padding_width &&
+                                              j - g.padding_width < g.data_width;
+                                d[r * TILE + c] =
+                                    inside ? channel[(i - g.padding_height) * g.data_width + j -
+                                                     g.padding_width]
+                                           : T{0};
+                            }
+                        }
+                        auto transformed = sandwich<TILE, TILE, T>(d.data(), x_transform<T>);
+                        size_t t = (b * TH + th) * TW + tw;
+                        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                            v[(e * g.in_channels + ic) * N_TILES + t] = transformed[e];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * res [batch, out_channels, effective_height, effective_width] from the transformed kernel u
+     * and the transformed x v
+     */
+    template <typename T>
+    inline void
+    forward(const direct_conv::Geometry &g, const T *u, const T *v, const T *bias, T *res) {
+        const size_t TH = tiles_height(g);
+        const size_t TW = tiles_width(g);
+        const size_t N_TILES = n_tiles(g);
+        const size_t OC = g.out_channels;
+        const size_t IC = g.in_channels;
+
+        std::vector<T> m(N_ELEMENTS * OC * N_TILES);
+        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+            blas_mat_mul<T, false, false>(u + e * OC * IC,
+                                          v + e * IC * N_TILES,
+                                          m.data() + e * OC * N_TILES,
+                                          OC,
+                                          IC,
+                                          IC,
+                                          N_TILES);
+        }
+
+        std::array<T, N_ELEMENTS> tile;
+        for (size_t b = 0; b < g.batch; ++b) {
+            for (size_t oc = 0; oc < OC; ++oc) {
+                T *channel = res + (b * OC + oc) * g.effective_size();
+                for (size_t th = 0; th < TH; ++th) {
+                    for (size_t tw = 0; tw < TW; ++tw) {
+                        size_t t = (b * TH + th) * TW + tw;
+                        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                            tile[e] = m[(e * OC + oc) * N_TILES + t];
+                        }
+                        auto y = sandwich<TILE, OUT_TILE, T>(tile.data(), output_transform<T>);
+                        // The last tiles can be partially outside the output
+                        size_t rows = std::min(OUT_TILE, g.effective_height - th * OUT_TILE);
+                        size_t cols = std::min(OUT_TILE, g.effective_width - tw * OUT_TILE);
+                        for (size_t r = 0; r < rows; ++r) {
+                            for (size_t c = 0; c < cols; ++c) {
+                                channel[(th * OUT_TILE + r) * g.effective_width + tw * OUT_TILE +
+                                        c] = y[r * OUT_TILE + c] + bias[oc];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Gradients of the kernel, of x and of the bias, from the transformed kernel u and the
+     * transformed x v of the forward step
+     */
+    template <typename T>
+    inline void backward(const direct_conv::Geometry &g,
+                         const T *u,
+                         const T *v,
+                         const T *grad,
+                         T *kernel_grad,
+                         T *x_grad,
+                         T *bias_grad) {
+        const size_t TH = tiles_height(g);
+        const size_t TW = tiles_width(g);
+        const size_t N_TILES = n_tiles(g);
+        const size_t OC = g.out_channels;
+        const size_t IC = g.in_channels;
+
+        // Gradient of m, A dY A^T, with the outputs outside the result at zero
+        std::fill_n(bias_grad, OC, T{0});
+        std::vector<T> m_grad(N_ELEMENTS * OC * N_TILES);
+        std::array<T, OUT_TILE * OUT_TILE> y;
+        for (size_t b = 0; b < g.batch; ++b) {
+            for (size_t oc = 0; oc < OC; ++oc) {
+                const T *channel = grad + (b * OC + oc) * g.effective_size();
+                for (size_t th = 0; th < TH; ++th) {
+                    for (size_t tw = 0; tw < TW; ++tw) {
+                        for (size_t r = 0; r < OUT_TILE; ++r) {
+                            size_t i = th * OUT_TILE + r;
+                            for (size_t c = 0; c < OUT_TILE; ++c) {
+                                size_t j = tw * OUT_TILE + c;
+                                bool inside = i < g.effective_height && j < g.effective_width;
+                                y[r * OUT_TILE + c] =
+                                    inside ? channel[i * g.effective_width + j] : T{0};
+                                bias_grad[oc] += y[r * OUT_TILE + c];
+                            }
+                        }
+                        auto tile = sandwich<OUT_TILE, TILE, T>(
+                            y.data(), output_transform_transposed<T>);
+                        size_t t = (b * TH + th) * TW + tw;
+                        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                            m_grad[(e * OC + oc) * N_TILES + t] = tile[e];
+                        }
+                    }
+                }
+            }
+        }
+
+        // Gradients of u and of v, for each element of the transform domain
+        std::vector<T> u_grad(N_ELEMENTS * OC * IC);
+        std::vector<T> v_grad(N_ELEMENTS * IC * N_TILES);
+        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+            const T *m_grad_e = m_grad.data() + e * OC * N_TILES;
+            blas_mat_mul<T, false, true>(m_grad_e,
+                                         v + e * IC * N_TILES,
+                                         u_grad.data() + e * OC * IC,
+                                         OC,
+                                         N_TILES,
+                                         IC,
+                                         N_TILES);
+            blas_mat_mul<T, true, false>(u + e * OC * IC,
+                                         m_grad_e,
+                                         v_grad.data() + e * IC * N_TILES,
+                                         OC,
+                                         IC,
+                                         OC,
+                                         N_TILES);
+        }
+
+        // Kernel, G^T dU G
+        std::array<T, N_ELEMENTS> tile;
+        const size_t n_kernels = OC * IC;
+        for (size_t k = 0; k < n_kernels; ++k) {
+            for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                tile[e] = u_grad[e * n_kernels + k];
+            }
+            auto kernel = sandwich<TILE, 3, T>(tile.data(), kernel_transform_transposed<T>);
+            std::copy(kernel.begin(), kernel.end(), kernel_grad + k * 9);
+        }
+
+        // x, B dV B^T, the tiles overlap and the padding is dropped
+        std::fill_n(x_grad, g.batch * IC * g.data_size(), T{0});
+        for (size_t b = 0; b < g.batch; ++b) {
+            for (size_t ic = 0; ic < IC; ++ic) {
+                T *channel = x_grad + (b * IC + ic) * g.data_size();
+                for (size_t th = 0; th < TH; ++th) {
+                    for (size_t tw = 0; tw < TW; ++tw) {
+                        size_t t = (b * TH + th) * TW + tw;
+                        for (size_t e = 0; e < N_ELEMENTS; ++e) {
+                            tile[e] = v_grad[(e * IC + ic) * N_TILES + t];
+                        }
+                        auto d = sandwich<TILE, TILE, T>(tile.data(), x_transform_transposed<T>);
+                        for (size_t r = 0; r < TILE; ++r) {
+                            size_t i = th * OUT_TILE + r;
+                            if (i < g.padding_height || i - g.padding_height >= g.data_height) {
+                                continue;
+                            }
+                            for (size_t c = 0; c < TILE; ++c) {
+                                size_t j = tw * OUT_TILE + c;
+                                if (j < g.padding_width || j - g.padding_width >= g.data_width) {
+                                    continue;
+                                }
+                                channel[(i - g.padding_height) * g.data_width + j -
+                                        g.padding_width] += d[r * TILE + c];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+} // namespace winograd
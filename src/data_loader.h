@@ -5,6 +5,7 @@
 #include <type_traits>
 
 #include "random.h"
+#include "sparse_tensor.h"
 
 template <typename Tx, typename Ty>
 class DataLoader {
@@ -30,4 +31,17 @@ class DataLoader {
         }
     }
     std::span<DataPair> getData() { return std::span<DataPair>(data.data(), data.size()); }
-};
\ No newline at end of file
+};
+
+/**
+ * The sparse samples of a batch, stacked in a single matrix with one row for each sample
+ */
+template <typename T, typename Ty>
+SparseTensor<T> stack_samples(std::span<std::pair<SparseTensor<T>, Ty>> batch) {
+    std::vector<const SparseTensor<T> *> samples;
+    samples.reserve(batch.size());
+    for (const auto &[x, _] : batch) {
+        samples.push_back(&x);
+    }
+    return SparseTensor<T>::stack(samples);
+}
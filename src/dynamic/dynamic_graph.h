@@ -0,0 +1,618 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../tensor.h"
+#include "../tensor_variable.h"
+#include "../interpreter.h"
+#include "../convolution/convolution_1d.h"
+#include "../convolution/convolution_2d.h"
+#include "runtime_interpreter.h"
+
+/**
+ * Computational graph built at runtime.
+ *
+ * This is the runtime counterpart of the expression templates: every node has the opcode of the
+ * corresponding DAp operator (DApSum, DApMatMul, DApConv1d, ...), and its operands are the
+ * indices of previously added nodes, so the nodes are always stored in topological order.
+ * The leaves are the inputs and the parameters (ops::VARIABLE_OP).
+ *
+ * Once all the nodes have been added, compile() builds two execution plans:
+ * - the forward plan evaluates and keeps every node, as needed by the backward step.
+ * - the eval plan fuses every chain of elementwise nodes used only once into a single bytecode
+ *   program, run by the same kernels of the fused interpreter. (a * b) + c, a + (b * c),
+ *   (a * b) - c and a - (b * c) are turned into FMA/FAM/FMS/FNMA, and a / sqrt(b) into
+ *   DIVIDE_SQRT, as done by the BinarySimplifier.
+ */
+template <typename DType>
+class DynamicGraph {
+  public:
+    struct Node {
+        // Opcode of the operator, ops::VARIABLE_OP for the leaves
+        size_t op;
+        std::vector<size_t> operands;
+        // Shape of the result, computed when the node is added
+        Shape shape;
+        // Index of the leaf in inputs/parameters, or of the convolution in convolutions_1d/2d
+        size_t idx{0};
+        bool is_parameter{false};
+    };
+
+  private:
+    // A step of an execution plan, either a fused elementwise program or (if the program is
+    // empty) a kernel of the node (matmul, convolution, ...)
+    struct Step {
+        size_t node;
+        std::vector<size_t> program{};
+        std::vector<size_t> data_nodes{};
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Variable<DType, false>> inputs;
+    std::vector<Variable<DType, true>> parameters;
+    std::vector<Convolution1D<DType>> convolutions_1d;
+    std::vector<Convolution2D<DType>> convolutions_2d;
+
+    size_t output_node{0};
+    bool is_compiled{false};
+    std::vector<Step> forward_plan;
+    std::vector<Step> eval_plan;
+    // True if the node depends on a parameter
+    std::vector<bool> requires_grad;
+    // Results of the nodes computed by the last run
+    std::vector<Tensor<DType>> values;
+
+  public:
+    size_t add_input(const Variable<DType, false> &x) {
+        inputs.push_back(x);
+        return add_leaf(x.tensor.get_shape(), inputs.size() - 1, /*is_parameter=*/false);
+    }
+
+    size_t add_parameter(const Variable<DType, true> &p) {
+        parameters.push_back(p);
+        return add_leaf(p.tensor.get_shape(), parameters.size() - 1, /*is_parameter=*/true);
+    }
+
+    /**
+     * Adds an elementwise operator, a (batched) matrix multiplication or a flatten.
+     */
+    size_t add_node(size_t op, std::initializer_list<size_t> operands) {
+        std::vector<size_t> operands_vec{operands};
+        check_operands(op, operands_vec);
+
+        const Shape &a_shape = nodes[operands_vec[0]].shape;
+        if (op == ops::MAT_MUL<false, false>) {
+            const Shape &b_shape = nodes[operands_vec[1]].shape;
+            if (a_shape.last() != b_shape.first()) {
+                throw std::runtime_error("DynamicGraph: incompatible shapes for matmul");
+            }
+            Shape res_shape = Shape::get_matmul_shape<false, false>(a_shape, b_shape);
+            return push_node(op, std::move(operands_vec), std::move(res_shape));
+        }
+        if (op == ops::BATCH_MAT_MUL) {
+            const Shape &b_shape = nodes[operands_vec[1]].shape;
+            size_t d = a_shape.get_dimension();
+            bool compatible =
+                d >= 3 && b_shape.get_dimension() == d && a_shape[d - 1] == b_shape[d - 2];
+            for (size_t i = 0; compatible && i < d - 2; ++i) {
+                compatible = a_shape[i] == b_shape[i];
+            }
+            if (!compatible) {
+                throw std::runtime_error("DynamicGraph: incompatible shapes for batch matmul");
+            }
+            Shape res_shape = Shape::get_batch_matmul_shape<false, false>(a_shape, b_shape);
+            return push_node(op, std::move(operands_vec), std::move(res_shape));
+        }
+        if (op == ops::FLATTEN) {
+            if (a_shape.get_dimension() < 2) {
+                throw std::runtime_error("DynamicGraph: flatten needs at least 2 dimensions");
+            }
+            size_t batch_size = a_shape.first();
+            return push_node(
+                op, std::move(operands_vec), Shape{batch_size, a_shape.get_size() / batch_size});
+        }
+        // The fused operators and DUP are produced only by the fusion of the eval plan
+        if (!is_elementwise_op(op) || is_fused_op(op)) {
+            throw std::runtime_error("DynamicGraph: unsupported operator " + std::to_string(op));
+        }
+        if (operands_vec.size() == 2) {
+            const Shape &b_shape = nodes[operands_vec[1]].shape;
+            if (!Shape::are_broadcastable(a_shape, b_shape)) {
+                throw std::runtime_error("DynamicGraph: shapes are not broadcastable");
+            }
+            Shape res_shape = Shape::get_broadcasted_shape(a_shape, b_shape);
+            return push_node(op, std::move(operands_vec), std::move(res_shape));
+        }
+        Shape res_shape = a_shape;
+        return push_node(op, std::move(operands_vec), std::move(res_shape));
+    }
+
+    template <typename Op>
+    size_t add_node(std::initializer_list<size_t> operands) {
+        return add_node(Op::STACK_VAL, operands);
+    }
+
+    size_t
+    add_conv_1d(size_t kernel, size_t x, size_t bias, size_t stride = 1, size_t padding = 0) {
+        std::vector<size_t> operands_vec{kernel, x, bias};
+        check_operands(ops::CONV_1D, operands_vec);
+
+        // kernel [OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE], x [BATCH_SIZE, IN_CHANNELS, WIDTH]
+        const auto &k_shape = nodes[kernel].shape.get_shape();
+        const auto &x_shape = nodes[x].shape.get_shape();
+        const auto &b_shape = nodes[bias].shape.get_shape();
+        if (k_shape.size() != 3 || x_shape.size() != 3 || b_shape.size() != 1 ||
+            k_shape[1] != x_shape[1] || k_shape[0] != b_shape[0] ||
+            x_shape[2] + 2 * padding < k_shape[2] || stride == 0) {
+            throw std::runtime_error("DynamicGraph: incompatible shapes for conv1d");
+        }
+        size_t width = (x_shape[2] - k_shape[2] + 2 * padding) / stride + 1;
+
+        Convolution1D<DType> convolution{};
+        convolution.STRIDE = stride;
+        convolution.PADDING = padding;
+        convolutions_1d.push_back(convolution);
+
+        size_t n = push_node(
+            ops::CONV_1D, std::move(operands_vec), Shape{x_shape[0], k_shape[0], width});
+        nodes[n].idx = convolutions_1d.size() - 1;
+        return n;
+    }
+
+    size_t add_conv_2d(size_t kernel,
+                       size_t x,
+                       size_t bias,
+                       size_t stride_height = 1,
+                       size_t stride_width = 1,
+                       size_t padding_height = 0,
+                       size_t padding_width = 0) {
+        std::vector<size_t> operands_vec{kernel, x, bias};
+        check_operands(ops::CONV_2D, operands_vec);
+
+        // kernel [OUT_CHANNELS, IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH],
+        // x [BATCH_SIZE, IN_CHANNELS, HEIGHT, WIDTH]
+        const auto &k_shape = nodes[kernel].shape.get_shape();
+        const auto &x_shape = nodes[x].shape.get_shape();
+        const auto &b_shape = nodes[bias].shape.get_shape();
+        if (k_shape.size() != 4 || x_shape.size() != 4 || b_shape.size() != 1 ||
+            k_shape[1] != x_shape[1] || k_shape[0] != b_shape[0] ||
+            x_shape[2] + 2 * padding_height < k_shape[2] ||
+            x_shape[3] + 2 * padding_width < k_shape[3] || stride_height == 0 ||
+            stride_width == 0) {
+            throw std::runtime_error("DynamicGraph: incompatible shapes for conv2d");
+        }
+        size_t height = (x_shape[2] - k_shape[2] + 2 * padding_height) / stride_height + 1;
+        size_t width = (x_shape[3] - k_shape[3] + 2 * padding_width) / stride_width + 1;
+
+        Convolution2D<DType> convolution{};
+        convolution.STRIDE_HEIGHT = stride_height;
+        convolution.STRIDE_WIDTH = stride_width;
+        convolution.PADDING_HEIGHT = padding_height;
+        convolution.PADDING_WIDTH = padding_width;
+        convolutions_2d.push_back(convolution);
+
+        size_t n = push_node(
+            ops::CONV_2D, std::move(operands_vec), Shape{x_shape[0], k_shape[0], height, width});
+        nodes[n].idx = convolutions_2d.size() - 1;
+        return n;
+    }
+
+    /**
+     * Builds the execution plans of the graph that computes the given node.
+     * Must be called again if new nodes are added.
+     */
+    void compile(size_t output) {
+        if (output >= nodes.size()) {
+            throw std::runtime_error("DynamicGraph: invalid output node");
+        }
+        output_node = output;
+
+        // Nodes needed to compute the output, and number of uses of every node
+        std::vector<bool> is_needed(nodes.size(), false);
+        std::vector<size_t> n_uses(nodes.size(), 0);
+        is_needed[output] = true;
+        for (size_t n = output + 1; n-- > 0;) {
+            if (is_needed[n]) {
+                for (size_t operand : nodes[n].operands) {
+                    is_needed[operand] = true;
+                    n_uses[operand] += 1;
+                }
+            }
+        }
+
+        // An elementwise node used only by another elementwise node is fused into its user
+        std::vector<bool> is_fused(nodes.size(), false);
+        requires_grad.assign(nodes.size(), false);
+        for (size_t n = 0; n <= output; ++n) {
+            const Node &node = nodes[n];
+            requires_grad[n] = node.is_parameter;
+            for (size_t operand : node.operands) {
+                requires_grad[n] = requires_grad[n] || requires_grad[operand];
+                if (is_needed[n] && is_elementwise_op(node.op) &&
+                    is_elementwise_op(nodes[operand].op) && n_uses[operand] == 1) {
+                    is_fused[operand] = true;
+                }
+            }
+        }
+
+        forward_plan.clear();
+        eval_plan.clear();
+        for (size_t n = 0; n <= output; ++n) {
+            const Node &node = nodes[n];
+            if (!is_needed[n] || node.op == ops::VARIABLE_OP) {
+                continue;
+            }
+            Step forward_step{n};
+            if (is_elementwise_op(node.op)) {
+                emit_fused_program(n, /*is_root=*/true, /*is_fused=*/{}, forward_step);
+            }
+            forward_plan.push_back(std::move(forward_step));
+
+            if (is_fused[n]) {
+                continue;
+            }
+            Step eval_step{n};
+            if (is_elementwise_op(node.op)) {
+                emit_fused_program(n, /*is_root=*/true, is_fused, eval_step);
+                if (get_stack_size(eval_step.program) > RUNTIME_STACK_SIZE) {
+                    throw std::runtime_error("DynamicGraph: elementwise chain too deep");
+                }
+            }
+            eval_plan.push_back(std::move(eval_step));
+        }
+
+        values.assign(nodes.size(), Tensor<DType>{});
+        is_compiled = true;
+    }
+
+    /**
+     * Evaluation with the fused plan, no temporaries are kept for the backward step
+     */
+    Tensor<DType> eval() {
+        run</*keep_temporaries=*/false>(eval_plan);
+        return values[output_node];
+    }
+
+    ConstTensor<DType> forward() {
+        run</*keep_temporaries=*/true>(forward_plan);
+        return values[output_node];
+    }
+
+    /**
+     * Accumulates the gradients of the parameters, requires a previous call to forward()
+     */
+    void backward(const Tensor<DType> &gradient) {
+        std::vector<Tensor<DType>> grads(output_node + 1);
+        std::vector<bool> has_grad(output_node + 1, false);
+        grads[output_node] = gradient;
+        has_grad[output_node] = true;
+
+        for (size_t n = output_node + 1; n-- > 0;) {
+            if (has_grad[n] && requires_grad[n]) {
+                backward_node(n, grads, has_grad);
+            }
+            // The gradient of the node is not needed anymore
+            grads[n] = Tensor<DType>{};
+        }
+    }
+
+    std::vector<Variable<DType, true>> get_parameters() const { return parameters; }
+
+    // The input tensors are shared with the graph, writing in them is enough to feed a new run
+    const Tensor<DType> &get_input(size_t input_idx = 0) const {
+        return inputs[input_idx].tensor;
+    }
+    // Replace an input by a tensor of the same shape, the shapes of the nodes are fixed when they
+    // are added
+    void set_input(size_t input_idx, const Tensor<DType> &x) {
+        if (x.get_shape() != inputs[input_idx].tensor.get_shape()) {
+            throw std::runtime_error("DynamicGraph: the new input must have the old shape");
+        }
+        inputs[input_idx].tensor = x;
+    }
+
+    const Node &get_node(size_t n) const { return nodes[n]; }
+    const Shape &get_shape(size_t n) const { return nodes[n].shape; }
+    size_t get_output_node() const { return output_node; }
+    size_t get_n_nodes() const { return nodes.size(); }
+    size_t get_eval_plan_size() const { return eval_plan.size(); }
+
+  private:
+    size_t add_leaf(const Shape &shape, size_t idx, bool is_parameter) {
+        size_t n = push_node(ops::VARIABLE_OP, {}, shape);
+        nodes[n].idx = idx;
+        nodes[n].is_parameter = is_parameter;
+        return n;
+    }
+
+    size_t push_node(size_t op, std::vector<size_t> operands, Shape shape) {
+        nodes.push_back(Node{op, std::move(operands), std::move(shape)});
+        is_compiled = false;
+        return nodes.size() - 1;
+    }
+
+    void check_operands(size_t op, const std::vector<size_t> &operands) const {
+        if (operands.size() != ops::n_operands(op)) {
+            throw std::runtime_error("DynamicGraph: wrong number of operands for operator " +
+                                     std::to_string(op));
+        }
+        for (size_t operand : operands) {
+            if (operand >= nodes.size()) {
+                throw std::runtime_error("DynamicGraph: invalid operand " +
+                                         std::to_string(operand));
+            }
+        }
+    }
+
+    /**
+     * Appends to the program of step the instructions computing node n, the operands of n that
+     * are not fused are loaded from the values of the nodes.
+     * An empty is_fused means that no node is fused.
+     */
+    void emit_fused_program(size_t n, bool is_root, const std::vector<bool> &is_fused, Step &step) {
+        if (!is_root && (is_fused.empty() || !is_fused[n])) {
+            step.program.push_back(ops::VARIABLE_OP);
+            step.data_nodes.push_back(n);
+            return;
+        }
+        const Node &node = nodes[n];
+        // op(a, a): a is computed (or loaded) only once
+        if (node.operands.size() == 2 && node.operands[0] == node.operands[1]) {
+            emit_fused_program(node.operands[0], false, is_fused, step);
+            step.program.push_back(ops::DUP_OP);
+            step.program.push_back(node.op);
+            return;
+        }
+        bool is_sum = node.op == ops::SUM_OP;
+        if ((is_sum || node.op == ops::DIFF_OP) && !is_fused.empty()) {
+            size_t a = node.operands[0];
+            size_t b = node.operands[1];
+            // (a0 * a1) +/- b
+            if (is_fused[a] && nodes[a].op == ops::MUL_OP) {
+                emit_fused_program(nodes[a].operands[0], false, is_fused, step);
+                emit_fused_program(nodes[a].operands[1], false, is_fused, step);
+                emit_fused_program(b, false, is_fused, step);
+                step.program.push_back(is_sum ? ops::FMA_OP : ops::FMS_OP);
+                return;
+            }
+            // a +/- (b0 * b1)
+            if (is_fused[b] && nodes[b].op == ops::MUL_OP) {
+                emit_fused_program(a, false, is_fused, step);
+                emit_fused_program(nodes[b].operands[0], false, is_fused, step);
+                emit_fused_program(nodes[b].operands[1], false, is_fused, step);
+                step.program.push_back(is_sum ? ops::FAM_OP : ops::FNMA_OP);
+                return;
+            }
+        }
+        // a / sqrt(b0)
+        if (node.op == ops::DIVIDE_OP && !is_fused.empty() && is_fused[node.operands[1]] &&
+            nodes[node.operands[1]].op == ops::SQRT) {
+            emit_fused_program(node.operands[0], false, is_fused, step);
+            emit_fused_program(nodes[node.operands[1]].operands[0], false, is_fused, step);
+            step.program.push_back(ops::DIVIDE_SQRT_OP);
+            return;
+        }
+        for (size_t operand : node.operands) {
+            emit_fused_program(operand, false, is_fused, step);
+        }
+        step.program.push_back(node.op);
+    }
+
+    template <bool keep_temporaries>
+    void run(const std::vector<Step> &plan) {
+        if (!is_compiled) {
+            throw std::runtime_error("DynamicGraph: compile() must be called before running");
+        }
+        for (size_t n = 0; n <= output_node; ++n) {
+            const Node &node = nodes[n];
+            if (node.op == ops::VARIABLE_OP) {
+                values[n] =
+                    node.is_parameter ? parameters[node.idx].tensor : inputs[node.idx].tensor;
+                values[n].wrap_for_broadcasting();
+            }
+        }
+
+        for (const Step &step : plan) {
+            if (step.program.empty()) {
+                values[step.node] = run_kernel<keep_temporaries>(nodes[step.node]);
+                continue;
+            }
+            RuntimeDataBuffer<DType> data_pointers;
+            for (size_t data_node : step.data_nodes) {
+                data_pointers.push_back_variable(values[data_node]);
+            }
+            Tensor<DType> res{data_pointers.get_max_shape()};
+            interpret_runtime(step.program, data_pointers, res);
+            values[step.node] = res;
+        }
+    }
+
+    template <bool keep_temporaries>
+    Tensor<DType> run_kernel(const Node &node) {
+        const auto &operands = node.operands;
+        switch (node.op) {
+        case ops::MAT_MUL<false, false>: {
+            const Tensor<DType> &a = values[operands[0]];
+            const Tensor<DType> &b = values[operands[1]];
+            return mat_mul_wrapper<DType, false, false>(
+                a, b, Shape::get_matmul_shape<false, false>(a.get_shape(), b.get_shape()));
+        }
+        case ops::BATCH_MAT_MUL: {
+            const Tensor<DType> &a = values[operands[0]];
+            const Tensor<DType> &b = values[operands[1]];
+            return batch_mat_mul_wrapper<DType>(
+                a, b, Shape::get_batch_matmul_shape<false, false>(a.get_shape(), b.get_shape()));
+        }
+        case ops::CONV_1D:
+            return convolutions_1d[node.idx].template forward<keep_temporaries>(
+                values[operands[0]], values[operands[1]], values[operands[2]]);
+        case ops::CONV_2D:
+            return convolutions_2d[node.idx].template forward<keep_temporaries>(
+                values[operands[0]], values[operands[1]], values[operands[2]]);
+        case ops::FLATTEN: {
+            Tensor<DType> res = values[operands[0]];
+            size_t batch_size = res.get_shape().first();
+            res.set_shape(Shape{batch_size, res.get_size() / batch_size});
+            return res;
+        }
+        default:
+            throw std::runtime_error("DynamicGraph: unsupported operator " +
+                                     std::to_string(node.op));
+        }
+    }
+
+    // Elementwise operation on tensors with the compile-time interpreter
+    template <size_t... instructions, typename... T>
+    static Tensor<DType> elementwise(const T &...tensors) {
+        auto data_pointers = make_data_buffer<DType>(ConstTensor<DType>(tensors)...);
+        Tensor<DType> res{data_pointers.get_max_shape()};
+        InterpretInternal<DType, Stack<instructions...>>::eval(data_pointers, res);
+        return res;
+    }
+
+    void backward_node(size_t n, std::vector<Tensor<DType>> &grads, std::vector<bool> &has_grad) {
+        using ops::VARIABLE_OP;
+        const Node &node = nodes[n];
+        const Tensor<DType> &grad = grads[n];
+
+        auto operand = [&](size_t i) -> const Tensor<DType> & {
+            return values[node.operands[i]];
+        };
+        auto needs_grad = [&](size_t i) { return requires_grad[node.operands[i]]; };
+        auto accumulate = [&](size_t i, Tensor<DType> contribution) {
+            size_t target = node.operands[i];
+            const Shape &target_shape = values[target].get_shape();
+            // Undo the broadcasting
+            if (!(contribution.get_shape() == target_shape)) {
+                contribution = reduce_axis(contribution, target_shape);
+            }
+            if (has_grad[target]) {
+                grads[target] =
+                    elementwise<VARIABLE_OP, VARIABLE_OP, ops::SUM_OP>(grads[target], contribution);
+            } else {
+                grads[target] = contribution;
+                has_grad[target] = true;
+            }
+        };
+
+        switch (node.op) {
+        case VARIABLE_OP: {
+            const Tensor<DType> &gradient = parameters[node.idx].gradient;
+            InterpretInternal<DType, Stack<VARIABLE_OP, VARIABLE_OP, ops::SUM_OP>>::eval(
+                make_data_buffer<DType>(gradient, grad), gradient);
+            break;
+        }
+        case ops::SUM_OP:
+            if (needs_grad(0)) {
+                accumulate(0, grad);
+            }
+            if (needs_grad(1)) {
+                accumulate(1, grad);
+            }
+            break;
+        case ops::DIFF_OP:
+            if (needs_grad(0)) {
+                accumulate(0, grad);
+            }
+            if (needs_grad(1)) {
+                accumulate(1, elementwise<VARIABLE_OP, ops::FLIP_SIGN>(grad));
+            }
+            break;
+        case ops::MUL_OP:
+            if (needs_grad(0)) {
+                accumulate(0, elementwise<VARIABLE_OP, VARIABLE_OP, ops::MUL_OP>(grad, operand(1)));
+            }
+            if (needs_grad(1)) {
+                accumulate(1, elementwise<VARIABLE_OP, VARIABLE_OP, ops::MUL_OP>(grad, operand(0)));
+            }
+            break;
+        case ops::DIVIDE_OP: {
+            // d(a / b) = da / b - (a / b) * db / b
+            Tensor<DType> a_grad =
+                elementwise<VARIABLE_OP, VARIABLE_OP, ops::DIVIDE_OP>(grad, operand(1));
+            if (needs_grad(1)) {
+                accumulate(1,
+                           elementwise<VARIABLE_OP, VARIABLE_OP, ops::MUL_OP, ops::FLIP_SIGN>(
+                               a_grad, values[n]));
+            }
+            if (needs_grad(0)) {
+                accumulate(0, a_grad);
+            }
+            break;
+        }
+        case ops::RELU: {
+            Tensor<DType> a_grad = grad.clone();
+            relu_backprop<DType>(a_grad, operand(0));
+            accumulate(0, a_grad);
+            break;
+        }
+        case ops::EXP:
+            accumulate(0, elementwise<VARIABLE_OP, VARIABLE_OP, ops::MUL_OP>(grad, values[n]));
+            break;
+        case ops::LOG:
+            accumulate(0, elementwise<VARIABLE_OP, VARIABLE_OP, ops::DIVIDE_OP>(grad, operand(0)));
+            break;
+        case ops::FLIP_SIGN:
+            accumulate(0, elementwise<VARIABLE_OP, ops::FLIP_SIGN>(grad));
+            break;
+        case ops::SQRT:
+            // d(sqrt(a)) = da / (2 * sqrt(a))
+            accumulate(
+                0,
+                elementwise<VARIABLE_OP, VARIABLE_OP, ops::DUP_OP, ops::SUM_OP, ops::DIVIDE_OP>(
+                    grad, values[n]));
+            break;
+        case ops::MAT_MUL<false, false>:
+            if (needs_grad(0)) {
+                accumulate(0,
+                           mat_mul_wrapper<DType, false, true>(
+                               grad, operand(1), operand(0).get_shape()));
+            }
+            if (needs_grad(1)) {
+                accumulate(1,
+                           mat_mul_wrapper<DType, true, false>(
+                               operand(0), grad, operand(1).get_shape()));
+            }
+            break;
+        case ops::BATCH_MAT_MUL:
+            if (needs_grad(0)) {
+                accumulate(0,
+                           batch_mat_mul_wrapper<DType, false, true>(
+                               grad, operand(1), operand(0).get_shape()));
+            }
+            if (needs_grad(1)) {
+                accumulate(1,
+                           batch_mat_mul_wrapper<DType, true, false>(
+                               operand(0), grad, operand(1).get_shape()));
+            }
+            break;
+        case ops::CONV_1D:
+        case ops::CONV_2D: {
+            auto [kernel_grad, x_grad, bias_grad] = node.op == ops::CONV_1D
+                                                        ? convolutions_1d[node.idx].backward(grad)
+                                                        : convolutions_2d[node.idx].backward(grad);
+            if (needs_grad(0)) {
+                accumulate(0, kernel_grad);
+            }
+            if (needs_grad(1)) {
+                accumulate(1, x_grad);
+            }
+            if (needs_grad(2)) {
+                accumulate(2, bias_grad);
+            }
+            break;
+        }
+        case ops::FLATTEN: {
+            Tensor<DType> a_grad = grad;
+            a_grad.set_shape(operand(0).get_shape());
+            accumulate(0, a_grad);
+            break;
+        }
+        default:
+            throw std::runtime_error("DynamicGraph: no backward for operator " +
+                                     std::to_string(node.op));
+        }
+    }
+};
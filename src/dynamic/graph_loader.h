@@ -0,0 +1,139 @@
+#pragma once
+
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../expressions/operations.h"
+#include "dynamic_graph.h"
+
+/**
+ * Builds a sequential DynamicGraph from a text description, one layer per line:
+ *
+ *   input <channels> <width>                     (or <channels> <height> <width>)
+ *   conv1d <out_channels> <kernel_size> <stride> <padding>
+ *   conv2d <out_channels> <kernel_height> <kernel_width> <stride_height> <stride_width>
+ *          <padding_height> <padding_width>
+ *   linear <out_size>
+ *   relu | exp | log | sqrt | flatten
+ *
+ * The batch dimension of the input is not part of the description. Empty lines and lines
+ * starting with '#' are ignored. The parameters are created (zero initialized) by the loader, and
+ * can be retrieved with get_parameters().
+ */
+template <typename DType>
+DynamicGraph<DType> parse_dynamic_graph(std::istream &stream, size_t batch_size) {
+    DynamicGraph<DType> graph;
+    std::optional<size_t> current{};
+
+    std::string line;
+    size_t line_number{0};
+    while (std::getline(stream, line)) {
+        line_number += 1;
+        auto error = [&](const std::string &message) {
+            return std::runtime_error("Line " + std::to_string(line_number) + ": " + message);
+        };
+
+        std::istringstream tokens{line};
+        std::string layer;
+        if (!(tokens >> layer) || layer[0] == '#') {
+            continue;
+        }
+        std::vector<size_t> args;
+        size_t arg;
+        while (tokens >> arg) {
+            args.push_back(arg);
+        }
+        if (!tokens.eof()) {
+            throw error("invalid argument");
+        }
+        auto expect_args = [&](size_t n_args) {
+            if (args.size() != n_args) {
+                throw error(layer + " expects " + std::to_string(n_args) + " arguments");
+            }
+        };
+
+        if (layer == "input") {
+            if (current) {
+                throw error("only one input is supported");
+            }
+            if (args.size() == 2) {
+                current = graph.add_input(Variable<DType, false>({batch_size, args[0], args[1]}));
+            } else if (args.size() == 3) {
+                current = graph.add_input(
+                    Variable<DType, false>({batch_size, args[0], args[1], args[2]}));
+            } else {
+                throw error("input expects 2 or 3 arguments");
+            }
+            continue;
+        }
+        if (!current) {
+            throw error("the first layer must be the input");
+        }
+
+        const auto &shape = graph.get_shape(*current).get_shape();
+        if (layer == "conv1d") {
+            expect_args(4);
+            if (shape.size() != 3) {
+                throw error("conv1d expects an input of shape [batch, channels, width]");
+            }
+            size_t k = graph.add_parameter(Variable<DType, true>({args[0], shape[1], args[1]}));
+            size_t q = graph.add_parameter(Variable<DType, true>({args[0]}));
+            current = graph.add_conv_1d(k, *current, q, args[2], args[3]);
+        } else if (layer == "conv2d") {
+            expect_args(7);
+            if (shape.size() != 4) {
+                throw error("conv2d expects an input of shape [batch, channels, height, width]");
+            }
+            size_t k =
+                graph.add_parameter(Variable<DType, true>({args[0], shape[1], args[1], args[2]}));
+            size_t q = graph.add_parameter(Variable<DType, true>({args[0]}));
+            current = graph.add_conv_2d(k, *current, q, args[3], args[4], args[5], args[6]);
+        } else if (layer == "linear") {
+            expect_args(1);
+            if (shape.size() != 2) {
+                throw error("linear expects an input of shape [batch, features]");
+            }
+            size_t m = graph.add_parameter(Variable<DType, true>({shape[1], args[0]}));
+            size_t q = graph.add_parameter(Variable<DType, true>({args[0]}));
+            size_t y = graph.template add_node<DApMatMul<false, false>>({*current, m});
+            current = graph.template add_node<DApSum>({y, q});
+        } else if (layer == "relu") {
+            expect_args(0);
+            current = graph.template add_node<DApRELU>({*current});
+        } else if (layer == "exp") {
+            expect_args(0);
+            current = graph.template add_node<DApExp>({*current});
+        } else if (layer == "log") {
+            expect_args(0);
+            current = graph.template add_node<DApLog>({*current});
+        } else if (layer == "sqrt") {
+            expect_args(0);
+            current = graph.template add_node<DApSqrt>({*current});
+        } else if (layer == "flatten") {
+            expect_args(0);
+            current = graph.template add_node<DApFlatten>({*current});
+        } else {
+            throw error("unknown layer " + layer);
+        }
+    }
+    if (!current) {
+        throw std::runtime_error("Empty graph description");
+    }
+
+    graph.compile(*current);
+    return graph;
+}
+
+template <typename DType>
+DynamicGraph<DType> load_dynamic_graph(std::string_view path, size_t batch_size) {
+    std::ifstream stream{path.data()};
+    if (!stream) {
+        throw std::runtime_error("Cannot open file " + std::string(path));
+    }
+    return parse_dynamic_graph<DType>(stream, batch_size);
+}
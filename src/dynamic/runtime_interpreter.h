@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "../interpreter.h"
+
+/**
+ * Runtime counterpart of the fused interpreter.
+ *
+ * The compile-time interpreter executes a Stack<instructions...> known by the compiler, here the
+ * program is a std::vector of the same opcodes (see ops::), built while the graph is constructed.
+ * Every instruction is still executed by execute_instruction_avx, so the two interpreters share
+ * the same kernels.
+ */
+
+// Maximum depth of the registers stack of a runtime program
+constexpr size_t RUNTIME_STACK_SIZE = 32;
+
+template <size_t... instructions>
+constexpr bool is_in_instructions(size_t op, Stack<instructions...>) {
+    return ((op == instructions) || ...);
+}
+
+/**
+ * True if the operator can be executed inside the fused loop of the interpreter
+ */
+constexpr bool is_elementwise_op(size_t op) {
+    return op != ops::VARIABLE_OP && is_in_instructions(op, ElementwiseInstructions{});
+}
+
+/**
+ * True for the instructions that are produced only by the fusion of the nodes
+ */
+constexpr bool is_fused_op(size_t op) {
+    return op == ops::FMA_OP || op == ops::FAM_OP || op == ops::FMS_OP || op == ops::FNMA_OP ||
+           op == ops::DIVIDE_SQRT_OP || op == ops::DUP_OP;
+}
+
+/**
+ * Same as DataBuffer, but the number of variables is known only at runtime
+ */
+template <typename DType>
+class RuntimeDataBuffer {
+    std::vector<TensorBroadcastableRef<DType>> expression_variables;
+    size_t expression_variables_idx{0};
+
+  public:
+    void push_back_variable(const ConstTensor<DType> &variable) {
+        expression_variables.push_back(TensorBroadcastableRef<DType>(variable));
+    }
+
+    const TensorBroadcastableRef<DType> &get_next_variable() {
+        return expression_variables[expression_variables_idx++];
+    }
+
+    void reset() { expression_variables_idx = 0; }
+
+    // Returns the biggest shape stored in the buffer
+    const Shape &get_max_shape() {
+        assert(!expression_variables.empty());
+        size_t i_arg_max{0};
+        size_t max_dim = expression_variables[0].t_ref.get_shape().get_dimension();
+
+        for (size_t i = 1; i < expression_variables.size(); ++i) {
+            size_t new_dim = expression_variables[i].t_ref.get_shape().get_dimension();
+            if (new_dim > max_dim) {
+                max_dim = new_dim;
+                i_arg_max = i;
+            }
+        }
+
+        return expression_variables[i_arg_max].t_ref.get_shape();
+    }
+};
+
+/**
+ * Runs the program over all the elements of res.
+ * The program must have been validated with get_stack_size
+ */
+template <typename DType>
+inline void interpret_runtime(const std::vector<size_t> &program,
+                              RuntimeDataBuffer<DType> &data_pointers,
+                              const Tensor<DType> &res) {
+    assert(get_stack_size(program) <= RUNTIME_STACK_SIZE);
+    DataStack<DType, RUNTIME_STACK_SIZE> registers;
+
+    for (size_t i = 0; i < res.get_size(); i += avx_constants::intrinsic_size<DType>) {
+        data_pointers.reset();
+        for (size_t instruction : program) {
+            execute_runtime_instruction_avx<DType>(
+                instruction, data_pointers, registers, i, ElementwiseInstructions{});
+        }
+        _mm256_storeu_px(&res[i], registers.pop());
+    }
+    res.wrap_for_broadcasting();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensor.h"
+
+/**
+ * Gradient of a table in which only a few rows are touched at each step (e.g. an embedding).
+ * Only the touched rows are stored, in the order in which they were first touched.
+ */
+template <typename T>
+class RowSparseGradient {
+    size_t dim;
+    std::vector<size_t> rows{};
+    std::vector<T> values{};
+    // Position of each touched row in rows
+    std::unordered_map<size_t, size_t> slots{};
+
+  public:
+    explicit RowSparseGradient(size_t dim) : dim{dim} {}
+
+    size_t get_dim() const { return dim; }
+    const std::vector<size_t> &get_rows() const { return rows; }
+    bool empty() const { return rows.empty(); }
+
+    // Gradient of the i-th touched row
+    T *slot(size_t i) { return values.data() + i * dim; }
+    const T *slot(size_t i) const { return values.data() + i * dim; }
+
+    // Gradient of row, it is set to zero if the row was not touched yet
+    T *row(size_t row) {
+        auto [it, inserted] = slots.try_emplace(row, rows.size());
+        if (inserted) {
+            rows.push_back(row);
+            values.resize(values.size() + dim, T{0});
+        }
+        return slot(it->second);
+    }
+
+    void set_zero() {
+        rows.clear();
+        values.clear();
+        slots.clear();
+    }
+};
+
+/**
+ * A table of rows {n_rows, dim} that is read by index (see embedding()), with a sparse gradient.
+ * The gradient is shared between the copies, as the tensors.
+ */
+template <typename T>
+class EmbeddingVariable {
+  public:
+    Tensor<T> tensor;
+    std::shared_ptr<RowSparseGradient<T>> gradient;
+
+    EmbeddingVariable(size_t n_rows, size_t dim)
+        : tensor{n_rows, dim}, gradient{std::make_shared<RowSparseGradient<T>>(dim)} {
+        tensor.set_zero();
+    }
+
+    size_t get_rows() const { return tensor.get_shape()[0]; }
+    size_t get_dim() const { return tensor.get_shape()[1]; }
+
+    // The gradient is transient, only the table is stored
+    template <typename Stream>
+    void serialize(Stream &stream) const {
+        tensor.serialize(stream);
+    }
+    template <typename Stream>
+    void deserialize(Stream &stream) {
+        tensor.deserialize(stream);
+        gradient = std::make_shared<RowSparseGradient<T>>(get_dim());
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "binary_operator.h"
+#include "../../blas_wrapper.h"
+
+/**
+ * Partial specialization for the batched matrix multiplication
+ */
+template <typename A, typename B>
+class DBinExprOp<A, B, DApBatchMatMul> : public DExprCommonData<DApBatchMatMul, A, B>,
+                                         public DExpr<DBinExprOp<A, B, DApBatchMatMul>> {
+  private:
+    using CommonData = DExprCommonData<DApBatchMatMul, A, B>;
+    using CommonData::a_;
+    using CommonData::b_;
+
+  public:
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    using Left = A;
+    using Right = B;
+
+    DBinExprOp(const A &a, const B &b) : CommonData{a, b} {}
+
+    struct Simplify {
+        using Type = DBinExprOp<typename A::Simplify::Type, typename B::Simplify::Type, Operator>;
+    };
+
+    void compute_temporaries_for_eval() {
+        using SimplifiedT = Simplify::Type;
+
+        a_().compute_temporaries_for_eval();
+        b_().compute_temporaries_for_eval();
+
+        auto t1 = Interpreter<typename SimplifiedT::Left>::const_interpret(a_());
+        auto t2 = Interpreter<typename SimplifiedT::Right>::const_interpret(b_());
+
+        this->res = batch_mat_mul_wrapper<DType>(
+            t1, t2, Shape::get_batch_matmul_shape<false, false>(t1.get_shape(), t2.get_shape()));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> t1 = a_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> t2 = b_().template compute_temporaries_for_backprop<use_cache>();
+
+            this->res = batch_mat_mul_wrapper<DType>(
+                t1,
+                t2,
+                Shape::get_batch_matmul_shape<false, false>(t1.get_shape(), t2.get_shape()));
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        ConstTensor<DType> a_res =
+            a_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+        ConstTensor<DType> b_res =
+            b_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+
+        Tensor<DType> a_grad =
+            batch_mat_mul_wrapper<DType, false, true>(grad, b_res, a_res.get_shape());
+        Tensor<DType> b_grad =
+            batch_mat_mul_wrapper<DType, true, false>(a_res, grad, b_res.get_shape());
+
+        a_().backward_internal(a_grad);
+        b_().backward_internal(b_grad);
+    }
+};
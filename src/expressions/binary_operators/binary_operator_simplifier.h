@@ -15,18 +15,29 @@ struct OperatorRules;
 template <typename Op>
 struct FlipRules;
 
+template <typename Op, typename RightOp>
+struct UnaryOperandRules;
+
 template <typename Op1, typename Op2>
 using OperatorRulesT = typename OperatorRules<Op1, Op2>::Type;
 
 template <typename Op>
 using FlipRulesT = typename FlipRules<Op>::Type;
 
+template <typename Op, typename RightOp>
+using UnaryOperandRulesT = typename UnaryOperandRules<Op, RightOp>::Type;
+
 template <typename T>
 concept IsBinaryOp = requires {
     typename T::Left;
     typename T::Right;
 };
 
+template <typename T>
+concept IsUnaryOp = requires {
+    typename T::Operand;
+};
+
 template <typename Expr>
 struct BinarySimplifier;
 
@@ -38,6 +49,14 @@ concept AreBinaryAndSimplifiable = IsBinaryOp<T1> && IsBinaryOp<T2> && requires
     typename OperatorRules<OpT<T1>, OpT<T2>>::Type;
 };
 
+/**
+ * Require that the parent is Binary, its right children is Unary, and they are simplifiable
+ */
+template <typename T>
+concept IsSimplifiableWithUnaryRight = IsBinaryOp<T> && IsUnaryOp<RightT<T>> && requires {
+    typename UnaryOperandRules<OpT<T>, OpT<RightT<T>>>::Type;
+};
+
 /**
  * Simplify the parent with its left children
  */
@@ -63,12 +82,24 @@ requires(!AreBinaryAndSimplifiable<T, LeftT<T>> &&
                              ResOp>;
 };
 
+/**
+ * Simplify the parent with its unary right children
+ */
+template <typename T>
+requires(!AreBinaryAndSimplifiable<T, LeftT<T>> && !AreBinaryAndSimplifiable<T, RightT<T>> &&
+         IsSimplifiableWithUnaryRight<T>) struct BinarySimplifier<T> {
+    using ResOp = UnaryOperandRulesT<OpT<T>, OpT<RightT<T>>>;
+    using Type = DBinExprOp<typename LeftT<T>::Simplify::Type,
+                            typename RightT<T>::Operand::Simplify::Type,
+                            ResOp>;
+};
+
 /**
  * No simplification is possible
  */
 template <typename T>
-requires(!AreBinaryAndSimplifiable<T, LeftT<T>> &&
-         !AreBinaryAndSimplifiable<T, RightT<T>>) struct BinarySimplifier<T> {
+requires(!AreBinaryAndSimplifiable<T, LeftT<T>> && !AreBinaryAndSimplifiable<T, RightT<T>> &&
+         !IsSimplifiableWithUnaryRight<T>) struct BinarySimplifier<T> {
     using Type =
         DBinExprOp<typename LeftT<T>::Simplify::Type, typename RightT<T>::Simplify::Type, OpT<T>>;
 };
@@ -84,4 +115,22 @@ struct OperatorRules<DApSum, DApMul> {
 template <>
 struct FlipRules<DApFMA> {
     using Type = DApFAM;
+};
+
+// (a * b) - c
+template <>
+struct OperatorRules<DApDiff, DApMul> {
+    using Type = DApFMS;
+};
+
+// a - (b * c)
+template <>
+struct FlipRules<DApFMS> {
+    using Type = DApFNMA;
+};
+
+// a / sqrt(b)
+template <>
+struct UnaryOperandRules<DApDivide, DApSqrt> {
+    using Type = DApDivideSqrt;
 };
\ No newline at end of file
@@ -6,6 +6,9 @@ class DTernExprOp;
 template <typename A, typename B, typename Op>
 class DBinExprOp;
 
+template <typename A, typename Op>
+class DUnaryExprOp;
+
 template <typename T>
 using LeftT = typename T::Left;
 
@@ -1,8 +1,42 @@
 #pragma once
 
+#include <utility>
+
 #include "binary_operator.h"
 #include "matmul_simplifier.h"
+#include "../variable.h"
 #include "../../blas_wrapper.h"
+#include "../../gemm/frozen_matrix.h"
+
+/**
+ * Operand of a matrix multiplication: the node itself, or the operand of a transpose that is folded
+ * into the GEMM call
+ */
+template <bool folded>
+auto &matmul_operand(auto &node) {
+    if constexpr (folded) {
+        return std::get<0>(node.child_nodes);
+    } else {
+        return node;
+    }
+}
+
+/**
+ * Gradients of op(a) * op(b) with respect to a and b, the transposes are folded into the GEMM calls
+ * also here:
+ * d(a) = grad * op(b)^T, or its transpose op(b) * grad^T if a is transposed
+ * d(b) = op(a)^T * grad, or its transpose grad^T * op(a) if b is transposed
+ */
+template <typename DType, bool tLeft, bool tRight>
+std::pair<Tensor<DType>, Tensor<DType>> mat_mul_backward(const Tensor<DType> &grad,
+                                                         const ConstTensor<DType> &a,
+                                                         const ConstTensor<DType> &b) {
+    Tensor<DType> a_grad = tLeft ? mat_mul_wrapper<DType, tRight, true>(b, grad, a.get_shape())
+                                 : mat_mul_wrapper<DType, false, !tRight>(grad, b, a.get_shape());
+    Tensor<DType> b_grad = tRight ? mat_mul_wrapper<DType, true, tLeft>(grad, a, b.get_shape())
+                                  : mat_mul_wrapper<DType, !tLeft, false>(a, grad, b.get_shape());
+    return {a_grad, b_grad};
+}
 
 /**
  * Partial specialization for matrix multiplication
@@ -30,6 +64,12 @@ class DBinExprOp<A, B, DApMatMul<tLeft, tRight>>
     static constexpr bool transpose_left = tLeft;
     static constexpr bool transpose_right = tRight;
 
+  private:
+    // The right operand, packed once while the expression is frozen if it is a parameter
+    bool is_frozen{false};
+    FrozenMatrix<DType> frozen_right{};
+
+  public:
     DBinExprOp(const A &a, const B &b) : CommonData{a, b} {}
 
     struct Simplify {
@@ -38,44 +78,67 @@ class DBinExprOp<A, B, DApMatMul<tLeft, tRight>>
 
     void compute_temporaries_for_eval() {
         using SimplifiedT = Simplify::Type;
-
-        a_().compute_temporaries_for_eval();
-        b_().compute_temporaries_for_eval();
-
-        auto t1 = Interpreter<typename SimplifiedT::Left>::const_interpret(a_());
-        auto t2 = Interpreter<typename SimplifiedT::Right>::const_interpret(b_());
-
-        auto res_shape =
-            Shape::get_matmul_shape<SimplifiedT::transpose_left, SimplifiedT::transpose_right>(
-                t1.get_shape(), t2.get_shape());
-
-        this->res =
-            mat_mul_wrapper<DType, SimplifiedT::transpose_left, SimplifiedT::transpose_right>(
-                t1, t2, res_shape);
+        constexpr bool tL = SimplifiedT::transpose_left;
+        constexpr bool tR = SimplifiedT::transpose_right;
+
+        // The folded transposes are not evaluated
+        auto &a = matmul_operand<tL>(a_());
+        auto &b = matmul_operand<tR>(b_());
+        a.compute_temporaries_for_eval();
+        b.compute_temporaries_for_eval();
+
+        auto t1 = Interpreter<typename SimplifiedT::Left>::const_interpret(a);
+        auto t2 = Interpreter<typename SimplifiedT::Right>::const_interpret(b);
+
+        auto res_shape = Shape::get_matmul_shape<tL, tR>(t1.get_shape(), t2.get_shape());
+
+        if (is_frozen && is_parameter_leaf<std::remove_cvref_t<decltype(b)>>) {
+            if (frozen_right.empty()) {
+                frozen_right.template set<tR>(t2);
+            }
+            this->res = mat_mul_wrapper<DType, tL, tR>(t1, frozen_right, res_shape);
+            return;
+        }
+        this->res = mat_mul_wrapper<DType, tL, tR>(t1, t2, res_shape);
     }
 
     template <bool use_cache>
     ConstTensor<DType> compute_temporaries_for_backprop() {
+        constexpr bool tL = Simplify::Type::transpose_left;
+        constexpr bool tR = Simplify::Type::transpose_right;
+
         if constexpr (!use_cache) {
-            ConstTensor<DType> t1 = a_().template compute_temporaries_for_backprop<use_cache>();
-            ConstTensor<DType> t2 = b_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> t1 =
+                matmul_operand<tL>(a_()).template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> t2 =
+                matmul_operand<tR>(b_()).template compute_temporaries_for_backprop<use_cache>();
 
-            this->res = mat_mul_wrapper<DType, false, false>(
-                t1, t2, Shape::get_matmul_shape<false, false>(t1.get_shape(), t2.get_shape()));
+            this->res = mat_mul_wrapper<DType, tL, tR>(
+                t1, t2, Shape::get_matmul_shape<tL, tR>(t1.get_shape(), t2.get_shape()));
         }
         return this->res;
     }
 
     void backward_internal(const Tensor<DType> &grad) {
+        constexpr bool tL = Simplify::Type::transpose_left;
+        constexpr bool tR = Simplify::Type::transpose_right;
+
+        auto &a = matmul_operand<tL>(a_());
+        auto &b = matmul_operand<tR>(b_());
         ConstTensor<DType> a_res =
-            a_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+            a.template compute_temporaries_for_backprop</*use_cache=*/true>();
         ConstTensor<DType> b_res =
-            b_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+            b.template compute_temporaries_for_backprop</*use_cache=*/true>();
 
-        Tensor<DType> a_grad = mat_mul_wrapper<DType, false, true>(grad, b_res, a_res.get_shape());
-        Tensor<DType> b_grad = mat_mul_wrapper<DType, true, false>(a_res, grad, b_res.get_shape());
+        auto [a_grad, b_grad] = mat_mul_backward<DType, tL, tR>(grad, a_res, b_res);
+
+        a.backward_internal(a_grad);
+        b.backward_internal(b_grad);
+    }
 
-        a_().backward_internal(a_grad);
-        b_().backward_internal(b_grad);
+    void freeze(bool frozen = true) {
+        is_frozen = frozen;
+        frozen_right.clear();
+        CommonData::freeze(frozen);
     }
 };
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include "../constants.h"
+#include "../metaprogramming/stack.h"
+
+template <typename A, typename Op>
+class DUnaryExprOp;
+
+template <typename A, typename B, typename Op>
+class DBinExprOp;
+
+template <typename A, typename B, typename C, typename Op>
+class DTernExprOp;
+
+/**
+ * Common subexpression elimination for the (simplified) expressions run by the Interpreter.
+ *
+ * Flatten emits a VARIABLE_OP for every occurrence of a leaf, so in
+ * no_grad(x) * no_grad(x)
+ * the same tensor is loaded twice at every step of the interpreter, and it takes two slots of the
+ * DataBuffer. A node whose first two operands have the same type can be flattened as
+ * [operand..., DUP_OP, ...] instead: the operand is computed only once and then duplicated on the
+ * stack, and the handles of the second copy are dropped.
+ *
+ * Having the same type does not mean being the same subexpression (x + y, with x and y two
+ * different variables), this can be checked only at runtime. So every such node is a candidate,
+ * the Interpreter checks which candidates have the same tensors in both copies, and runs the
+ * program in which exactly those candidates are eliminated.
+ *
+ * DUP only reuses the top of the stack, in x * x + x the last x is not next to the first one.
+ * The pairs of leaves of the same type are candidates too, after the ones of op(a, a): a leaf
+ * equal to a previous one is not loaded again, the previous one is loaded with LOAD_KEEP_OP and
+ * pushed again with REUSE_OP.
+ */
+
+// Types of the expressions of the tensor handles, in the order of the handles
+template <typename... Ts>
+struct HandleTypes {};
+
+template <typename... Ts1, typename... Ts2>
+consteval HandleTypes<Ts1..., Ts2...> concat_handles(HandleTypes<Ts1...>, HandleTypes<Ts2...>) {
+    return {};
+}
+
+// Position of the tensor handles of the two copies of a candidate, and their number
+struct RepeatedOperand {
+    size_t first;
+    size_t second;
+    size_t n_handles;
+};
+
+template <size_t N1, size_t N2>
+consteval std::array<RepeatedOperand, N1 + N2>
+concat_repeated(const std::array<RepeatedOperand, N1> &r1,
+                const std::array<RepeatedOperand, N2> &r2,
+                size_t r2_shift) {
+    std::array<RepeatedOperand, N1 + N2> res{};
+    for (size_t i = 0; i < N1; ++i) {
+        res[i] = r1[i];
+    }
+    for (size_t i = 0; i < N2; ++i) {
+        res[N1 + i] = {r2[i].first + r2_shift, r2[i].second + r2_shift, r2[i].n_handles};
+    }
+    return res;
+}
+
+template <size_t N1, size_t N2>
+consteval std::array<bool, N1 + N2> concat_kept(const std::array<bool, N1> &k1,
+                                                const std::array<bool, N2> &k2) {
+    std::array<bool, N1 + N2> res{};
+    for (size_t i = 0; i < N1; ++i) {
+        res[i] = k1[i];
+    }
+    for (size_t i = 0; i < N2; ++i) {
+        res[N1 + i] = k2[i];
+    }
+    return res;
+}
+
+template <size_t N>
+consteval std::array<bool, N> all_kept(bool kept) {
+    std::array<bool, N> res{};
+    res.fill(kept);
+    return res;
+}
+
+/**
+ * Candidates of an expression, in pre-order. Leaves and nodes that need a temporary are a single
+ * handle with no candidates.
+ */
+template <typename Expr>
+struct RepeatedOperands {
+    static constexpr size_t N_HANDLES =
+        CountStack<typename Expr::template Flatten<true>::Type, ops::VARIABLE_OP>::value;
+    static constexpr std::array<RepeatedOperand, 0> LIST{};
+    using Handles = HandleTypes<Expr>;
+};
+
+template <typename A, typename Op>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct RepeatedOperands<DUnaryExprOp<A, Op>> {
+    static constexpr size_t N_HANDLES = RepeatedOperands<A>::N_HANDLES;
+    static constexpr auto LIST = RepeatedOperands<A>::LIST;
+    using Handles = typename RepeatedOperands<A>::Handles;
+};
+
+template <typename A, typename B, typename Op>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct RepeatedOperands<DBinExprOp<A, B, Op>> {
+    using RA = RepeatedOperands<A>;
+    using RB = RepeatedOperands<B>;
+    static constexpr size_t N_HANDLES = RA::N_HANDLES + RB::N_HANDLES;
+    static constexpr auto LIST = concat_repeated(RA::LIST, RB::LIST, RA::N_HANDLES);
+    using Handles = decltype(concat_handles(typename RA::Handles{}, typename RB::Handles{}));
+};
+
+template <typename A, typename Op>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct RepeatedOperands<DBinExprOp<A, A, Op>> {
+    using RA = RepeatedOperands<A>;
+    static constexpr size_t N_HANDLES = 2 * RA::N_HANDLES;
+    static constexpr auto LIST = concat_repeated(
+        concat_repeated(std::array<RepeatedOperand, 1>{{{0, RA::N_HANDLES, RA::N_HANDLES}}},
+                        RA::LIST,
+                        0),
+        RA::LIST,
+        RA::N_HANDLES);
+    using Handles = decltype(concat_handles(typename RA::Handles{}, typename RA::Handles{}));
+};
+
+template <typename A, typename B, typename C, typename Op>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct RepeatedOperands<DTernExprOp<A, B, C, Op>> {
+    using RA = RepeatedOperands<A>;
+    using RB = RepeatedOperands<B>;
+    using RC = RepeatedOperands<C>;
+    static constexpr size_t N_HANDLES = RA::N_HANDLES + RB::N_HANDLES + RC::N_HANDLES;
+    static constexpr auto LIST = concat_repeated(concat_repeated(RA::LIST, RB::LIST, RA::N_HANDLES),
+                                                 RC::LIST,
+                                                 RA::N_HANDLES + RB::N_HANDLES);
+    using Handles = decltype(concat_handles(
+        concat_handles(typename RA::Handles{}, typename RB::Handles{}), typename RC::Handles{}));
+};
+
+// op(a, a, c), for example FMA(x, x, y) from x * x + y
+template <typename A, typename C, typename Op>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct RepeatedOperands<DTernExprOp<A, A, C, Op>> {
+    using RA = RepeatedOperands<A>;
+    using RC = RepeatedOperands<C>;
+    static constexpr size_t N_HANDLES = 2 * RA::N_HANDLES + RC::N_HANDLES;
+    static constexpr auto LIST = concat_repeated(
+        concat_repeated(
+            concat_repeated(std::array<RepeatedOperand, 1>{{{0, RA::N_HANDLES, RA::N_HANDLES}}},
+                            RA::LIST,
+                            0),
+            RA::LIST,
+            RA::N_HANDLES),
+        RC::LIST,
+        2 * RA::N_HANDLES);
+    using Handles = decltype(concat_handles(
+        concat_handles(typename RA::Handles{}, typename RA::Handles{}), typename RC::Handles{}));
+};
+
+/**
+ * Program of the expression in which the candidates selected by MASK are eliminated.
+ * OFFSET is the index of the first candidate of the expression. KEPT tells which tensor handles
+ * are used by the program.
+ */
+template <typename Expr, size_t MASK, size_t OFFSET = 0>
+struct EliminateCommonSubexpressions {
+    using Type = typename Expr::template Flatten<true>::Type;
+    static constexpr auto KEPT = all_kept<RepeatedOperands<Expr>::N_HANDLES>(true);
+};
+
+template <size_t MASK, size_t OFFSET>
+constexpr bool is_candidate_enabled = OFFSET < 64 && ((MASK >> OFFSET) & 1);
+
+template <typename A, typename Op, size_t MASK, size_t OFFSET>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct EliminateCommonSubexpressions<DUnaryExprOp<A, Op>,
+                                                                            MASK,
+                                                                            OFFSET> {
+    using EA = EliminateCommonSubexpressions<A, MASK, OFFSET>;
+    using Type = MergeStacksT<typename EA::Type, Stack<Op::STACK_VAL>>;
+    static constexpr auto KEPT = EA::KEPT;
+};
+
+template <typename A, typename B, typename Op, size_t MASK, size_t OFFSET>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct EliminateCommonSubexpressions<DBinExprOp<A, B, Op>,
+                                                                            MASK,
+                                                                            OFFSET> {
+    using EA = EliminateCommonSubexpressions<A, MASK, OFFSET>;
+    using EB = EliminateCommonSubexpressions<B, MASK, OFFSET + RepeatedOperands<A>::LIST.size()>;
+    using Type = MergeStacksT<typename EA::Type, typename EB::Type, Stack<Op::STACK_VAL>>;
+    static constexpr auto KEPT = concat_kept(EA::KEPT, EB::KEPT);
+};
+
+template <typename A, typename Op, size_t MASK, size_t OFFSET>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct EliminateCommonSubexpressions<DBinExprOp<A, A, Op>,
+                                                                            MASK,
+                                                                            OFFSET> {
+    static constexpr size_t N_CANDIDATES_A = RepeatedOperands<A>::LIST.size();
+    using EA1 = EliminateCommonSubexpressions<A, MASK, OFFSET + 1>;
+    using EA2 = EliminateCommonSubexpressions<A, MASK, OFFSET + 1 + N_CANDIDATES_A>;
+
+    static constexpr bool enabled = is_candidate_enabled<MASK, OFFSET>;
+    using Type = std::conditional_t<
+        enabled,
+        MergeStacksT<typename EA1::Type, Stack<ops::DUP_OP, Op::STACK_VAL>>,
+        MergeStacksT<typename EA1::Type, typename EA2::Type, Stack<Op::STACK_VAL>>>;
+    static constexpr auto KEPT = concat_kept(
+        EA1::KEPT,
+        enabled ? all_kept<RepeatedOperands<A>::N_HANDLES>(false) : EA2::KEPT);
+};
+
+template <typename A, typename B, typename C, typename Op, size_t MASK, size_t OFFSET>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct EliminateCommonSubexpressions<
+    DTernExprOp<A, B, C, Op>,
+    MASK,
+    OFFSET> {
+    using EA = EliminateCommonSubexpressions<A, MASK, OFFSET>;
+    using EB = EliminateCommonSubexpressions<B, MASK, OFFSET + RepeatedOperands<A>::LIST.size()>;
+    using EC = EliminateCommonSubexpressions<C,
+                                             MASK,
+                                             OFFSET + RepeatedOperands<A>::LIST.size() +
+                                                 RepeatedOperands<B>::LIST.size()>;
+    using Type = MergeStacksT<typename EA::Type,
+                              typename EB::Type,
+                              typename EC::Type,
+                              Stack<Op::STACK_VAL>>;
+    static constexpr auto KEPT = concat_kept(concat_kept(EA::KEPT, EB::KEPT), EC::KEPT);
+};
+
+template <typename A, typename C, typename Op, size_t MASK, size_t OFFSET>
+requires(!Op::NEEDS_TEMPORARY_FOR_EVAL) struct EliminateCommonSubexpressions<
+    DTernExprOp<A, A, C, Op>,
+    MASK,
+    OFFSET> {
+    static constexpr size_t N_CANDIDATES_A = RepeatedOperands<A>::LIST.size();
+    using EA1 = EliminateCommonSubexpressions<A, MASK, OFFSET + 1>;
+    using EA2 = EliminateCommonSubexpressions<A, MASK, OFFSET + 1 + N_CANDIDATES_A>;
+    using EC = EliminateCommonSubexpressions<C, MASK, OFFSET + 1 + 2 * N_CANDIDATES_A>;
+
+    static constexpr bool enabled = is_candidate_enabled<MASK, OFFSET>;
+    using Type = std::conditional_t<
+        enabled,
+        MergeStacksT<typename EA1::Type,
+                     Stack<ops::DUP_OP>,
+                     typename EC::Type,
+                     Stack<Op::STACK_VAL>>,
+        MergeStacksT<typename EA1::Type,
+                     typename EA2::Type,
+                     typename EC::Type,
+                     Stack<Op::STACK_VAL>>>;
+    static constexpr auto KEPT = concat_kept(
+        concat_kept(EA1::KEPT,
+                    enabled ? all_kept<RepeatedOperands<A>::N_HANDLES>(false) : EA2::KEPT),
+        EC::KEPT);
+};
+
+template <typename T>
+constexpr bool is_leaf_handle = !requires { typename T::Operator; };
+
+/**
+ * Pairs of handles of leaves with the same type, ordered by their first handle. The pairs that
+ * already are the candidate of an op(a, a) are left out, and so are the handles of the nodes
+ * that need a temporary: they are never shared.
+ */
+template <typename Handles, auto REPEATED_OPERANDS>
+struct RepeatedLeaves;
+
+template <typename... Ts, auto REPEATED_OPERANDS>
+struct RepeatedLeaves<HandleTypes<Ts...>, REPEATED_OPERANDS> {
+  private:
+    static constexpr size_t N = sizeof...(Ts);
+    template <typename T>
+    static constexpr std::array<bool, N> SAME_TYPE{std::is_same_v<T, Ts>...};
+    static constexpr std::array<std::array<bool, N>, N> SAME_TYPES{SAME_TYPE<Ts>...};
+    static constexpr std::array<bool, N> IS_LEAF{is_leaf_handle<Ts>...};
+
+    static consteval bool is_candidate(size_t first, size_t second) {
+        if (!IS_LEAF[first] || !SAME_TYPES[first][second]) {
+            return false;
+        }
+        for (const RepeatedOperand &operand : REPEATED_OPERANDS) {
+            if (operand.first == first && operand.second == second && operand.n_handles == 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static consteval size_t count_candidates() {
+        size_t res{0};
+        for (size_t first = 0; first < N; ++first) {
+            for (size_t second = first + 1; second < N; ++second) {
+                res += static_cast<size_t>(is_candidate(first, second));
+            }
+        }
+        return res;
+    }
+
+  public:
+    static constexpr auto LIST = []() consteval {
+        std::array<RepeatedOperand, count_candidates()> res{};
+        size_t c{0};
+        for (size_t first = 0; first < N; ++first) {
+            for (size_t second = first + 1; second < N; ++second) {
+                if (is_candidate(first, second)) {
+                    res[c++] = {first, second, 1};
+                }
+            }
+        }
+        return res;
+    }();
+};
+
+/**
+ * All the candidates of an expression: the ones of op(a, a), then the repeated leaves
+ */
+template <typename Expr>
+struct CommonSubexpressions {
+    using Operands = RepeatedOperands<Expr>;
+    using Leaves = RepeatedLeaves<typename Operands::Handles, Operands::LIST>;
+    static constexpr size_t N_HANDLES = Operands::N_HANDLES;
+    static constexpr auto LIST = concat_repeated(Operands::LIST, Leaves::LIST, 0);
+};
+
+template <size_t L, size_t N>
+struct ProgramHandles {
+    std::array<size_t, L> program;
+    std::array<bool, N> kept;
+};
+
+/**
+ * Loads only once the leaves of the enabled pairs (their bits in mask start at offset): the first
+ * load of a repeated leaf becomes a LOAD_KEEP_OP, and the next ones REUSE_OP. Only
+ * N_SAVED_REGISTERS leaves are kept, the other ones are loaded again.
+ */
+template <size_t L, size_t N, size_t M>
+consteval ProgramHandles<L, N> reuse_leaves(const std::array<size_t, L> &program,
+                                            const std::array<bool, N> &kept,
+                                            const std::array<RepeatedOperand, M> &leaves,
+                                            size_t mask,
+                                            size_t offset) {
+    // First kept handle with the same tensor, the pairs of a handle come after the ones in
+    // which it is the second handle
+    std::array<size_t, N> source{};
+    for (size_t h = 0; h < N; ++h) {
+        source[h] = h;
+    }
+    for (size_t c = 0; c < M; ++c) {
+        const RepeatedOperand &pair = leaves[c];
+        bool enabled = offset + c < 64 && ((mask >> (offset + c)) & 1);
+        if (enabled && kept[pair.first] && kept[pair.second]) {
+            source[pair.second] = std::min(source[pair.second], source[pair.first]);
+        }
+    }
+
+    constexpr size_t no_slot = ops::N_SAVED_REGISTERS;
+    std::array<size_t, N> slot{};
+    slot.fill(no_slot);
+    size_t n_slots{0};
+    for (size_t h = 0; h < N; ++h) {
+        if (source[h] != h && slot[source[h]] == no_slot && n_slots < ops::N_SAVED_REGISTERS) {
+            slot[source[h]] = n_slots++;
+        }
+    }
+
+    // The loads of the program are the kept handles, in order
+    ProgramHandles<L, N> res{program, kept};
+    size_t h{0};
+    for (size_t &instruction : res.program) {
+        if (instruction != ops::VARIABLE_OP) {
+            continue;
+        }
+        while (!kept[h]) {
+            ++h;
+        }
+        if (slot[h] != no_slot) {
+            instruction = ops::LOAD_KEEP_OP<0> + slot[h];
+        } else if (slot[source[h]] != no_slot) {
+            instruction = ops::REUSE_OP<0> + slot[source[h]];
+            res.kept[h] = false;
+        }
+        ++h;
+    }
+    return res;
+}
+
+template <size_t... instructions>
+consteval std::array<size_t, sizeof...(instructions)> stack_to_array(Stack<instructions...>) {
+    return {instructions...};
+}
+
+template <auto PROGRAM, typename Indices = std::make_index_sequence<PROGRAM.size()>>
+struct ArrayToStack;
+
+template <auto PROGRAM, size_t... indices>
+struct ArrayToStack<PROGRAM, std::index_sequence<indices...>> {
+    using Type = Stack<PROGRAM[indices]...>;
+};
+
+/**
+ * Program of the expression for the candidates of CommonSubexpressions selected by MASK
+ */
+template <typename Expr, size_t MASK>
+struct CommonSubexpressionsProgram {
+  private:
+    using Candidates = CommonSubexpressions<Expr>;
+    using Eliminated = EliminateCommonSubexpressions<Expr, MASK>;
+    static constexpr auto RES = reuse_leaves(stack_to_array(typename Eliminated::Type{}),
+                                             Eliminated::KEPT,
+                                             Candidates::Leaves::LIST,
+                                             MASK,
+                                             Candidates::Operands::LIST.size());
+
+  public:
+    using Type = typename ArrayToStack<RES.program>::Type;
+    static constexpr auto KEPT = RES.kept;
+};
+
+/**
+ * Indices of the handles used by a program
+ */
+template <size_t N, std::array<bool, N> KEPT>
+consteval auto get_kept_handles() {
+    constexpr size_t n_kept = [] {
+        size_t res{0};
+        for (size_t i = 0; i < N; ++i) {
+            res += static_cast<size_t>(KEPT[i]);
+        }
+        return res;
+    }();
+    std::array<size_t, n_kept> res{};
+    size_t j{0};
+    for (size_t i = 0; i < N; ++i) {
+        if (KEPT[i]) {
+            res[j++] = i;
+        }
+    }
+    return res;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "expression_base.h"
+
+#include "../avx/avx_wrapper.h"
+#include "../embedding_variable.h"
+
+/**
+ * Rows of an embedding table gathered by index, indices [n] -> [n, dim].
+ * It is a leaf of the expression, with a temporary as the operators that need one. The backward
+ * step accumulates the gradient of the touched rows only (see RowSparseGradient).
+ */
+template <typename T>
+requires(std::is_same_v<T, double> || std::is_same_v<T, float>) class DExprEmbedding
+    : public DExpr<DExprEmbedding<T>> {
+  public:
+    using This = DExprEmbedding<T>;
+    using DType = T;
+    using Operator = DApEmbedding;
+
+    EmbeddingVariable<DType> table;
+    std::vector<size_t> indices;
+    ConstTensor<DType> res{};
+
+    DExprEmbedding(const EmbeddingVariable<DType> &table, std::vector<size_t> indices)
+        : table{table}, indices{std::move(indices)} {
+        if (this->indices.empty()) {
+            throw std::runtime_error("An embedding lookup needs at least one index");
+        }
+        for (size_t index : this->indices) {
+            if (index >= table.get_rows()) {
+                throw std::runtime_error("Embedding index out of bounds");
+            }
+        }
+    }
+
+    template <bool recursive>
+    struct Flatten {
+        using Type = Stack<ops::VARIABLE_OP>;
+    };
+
+    struct Simplify {
+        using Type = This;
+    };
+
+    Tensor<DType> gather() const {
+        size_t dim = table.get_dim();
+        Tensor<DType> rows{indices.size(), dim};
+        for (size_t i = 0; i < indices.size(); ++i) {
+            std::copy_n(&table.tensor[indices[i] * dim], dim, &rows[i * dim]);
+        }
+        rows.wrap_for_broadcasting();
+        return rows;
+    }
+
+    void compute_temporaries_for_eval() { res = gather(); }
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            res = gather();
+        }
+        return res;
+    }
+
+    void release_temporaries() { res = ConstTensor<DType>{}; }
+    void freeze(bool) {}
+
+    void backward_internal(const Tensor<DType> &gradient) {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        size_t dim = table.get_dim();
+        RowSparseGradient<DType> &table_gradient = *table.gradient;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            DType *row = table_gradient.row(indices[i]);
+            const DType *g = &gradient[i * dim];
+            size_t j = 0;
+            for (; j + W <= dim; j += W) {
+                simd_type<DType> sum =
+                    _mm256_add_px<DType>(_mm256_loadu_px(row + j), _mm256_loadu_px(g + j));
+                _mm256_storeu_px(row + j, sum);
+            }
+            for (; j < dim; ++j) {
+                row[j] += g[j];
+            }
+        }
+    }
+
+    template <typename Visitor>
+    void traverse(Visitor &v) {
+        v(*this);
+    }
+    template <typename Visitor>
+    void traverse(Visitor &v) const {
+        v(*this);
+    }
+
+    template <typename Visitor>
+    static consteval auto traverse() {
+        return Visitor::template Visit<This>();
+    }
+};
@@ -11,6 +11,8 @@
 #include "expression_base_impl.h"
 
 #include "../tensor_variable.h"
+#include "../sparse_variable.h"
+#include "../sparse_tensor.h"
 
 template <typename T, bool require_gradient>
 DExprTensor<T, require_gradient> to_dexpr_internal(const Variable<T, require_gradient> &x) {
@@ -90,6 +92,22 @@ requires(HasToDexpr<A>) && (HasToDexpr<B>)auto matmul(const A &x, const B &y) {
     return matmul(to_dexpr(x), to_dexpr(y));
 }
 
+template <typename A, typename B>
+requires(HasToDexpr<A>) && (HasToDexpr<B>)auto batch_matmul(const A &x, const B &y) {
+    return batch_matmul(to_dexpr(x), to_dexpr(y));
+}
+
+template <typename A, typename T, bool requires_gradient>
+requires(HasToDexpr<A>) auto sparse_matmul(const A &x,
+                                           const SparseVariable<T, requires_gradient> &m) {
+    return sparse_matmul(to_dexpr(x), m);
+}
+
+template <typename T, typename B>
+requires(HasToDexpr<B>) auto matmul(const SparseTensor<T> &x, const B &y) {
+    return matmul(x, to_dexpr(y));
+}
+
 template <typename A, typename B, typename C>
 requires(HasToDexpr<A>) &&
     (HasToDexpr<B>)&&(HasToDexpr<C>)auto conv_1d(const A &x, const B &y, const C &z) {
@@ -102,6 +120,18 @@ requires(HasToDexpr<A>) &&
     return conv_2d(to_dexpr(x), to_dexpr(y), to_dexpr(z));
 }
 
+template <typename A, typename B, typename C>
+requires(HasToDexpr<A>) &&
+    (HasToDexpr<B>)&&(HasToDexpr<C>)auto conv_transpose_1d(const A &x, const B &y, const C &z) {
+    return conv_transpose_1d(to_dexpr(x), to_dexpr(y), to_dexpr(z));
+}
+
+template <typename A, typename B, typename C>
+requires(HasToDexpr<A>) &&
+    (HasToDexpr<B>)&&(HasToDexpr<C>)auto conv_transpose_2d(const A &x, const B &y, const C &z) {
+    return conv_transpose_2d(to_dexpr(x), to_dexpr(y), to_dexpr(z));
+}
+
 template <typename A>
 requires(HasToDexpr<A>) auto relu(const A &x) { return relu(to_dexpr(x)); }
 
@@ -123,6 +153,50 @@ requires(HasToDexpr<A>) auto flatten(const A &x) { return flatten(to_dexpr(x));
 template <typename A>
 requires(HasToDexpr<A>) auto indexer(const A &x, size_t idx) { return indexer(to_dexpr(x), idx); }
 
+template <typename A>
+requires(HasToDexpr<A>) auto checkpoint(const A &x) { return checkpoint(to_dexpr(x)); }
+
+template <typename A>
+requires(HasToDexpr<A>) auto pool_1d(const A &x, PoolingMode mode, size_t window) {
+    return pool_1d(to_dexpr(x), mode, window);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto max_pool_1d(const A &x, size_t window) {
+    return max_pool_1d(to_dexpr(x), window);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto avg_pool_1d(const A &x, size_t window) {
+    return avg_pool_1d(to_dexpr(x), window);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto global_avg_pool_1d(const A &x) {
+    return global_avg_pool_1d(to_dexpr(x));
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto pool_2d(const A &x, PoolingMode mode, size_t window_height,
+                                     size_t window_width) {
+    return pool_2d(to_dexpr(x), mode, window_height, window_width);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto max_pool_2d(const A &x, size_t window_height, size_t window_width) {
+    return max_pool_2d(to_dexpr(x), window_height, window_width);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto avg_pool_2d(const A &x, size_t window_height, size_t window_width) {
+    return avg_pool_2d(to_dexpr(x), window_height, window_width);
+}
+
+template <typename A>
+requires(HasToDexpr<A>) auto global_avg_pool_2d(const A &x) {
+    return global_avg_pool_2d(to_dexpr(x));
+}
+
 template <typename A>
 requires(HasToDexpr<A>) auto operator-(const A &x) { return -to_dexpr(x); }
 
@@ -131,6 +205,16 @@ auto operator/(const DExpr<A> &x, const DExpr<B> &y) {
     return DBinExprOp<A, B, DApDivide>(static_cast<const A &>(x), static_cast<const B &>(y));
 }
 
+/**
+ * Division by a constant, the reciprocal is computed once and the interpreter runs a
+ * multiplication instead of a division
+ */
+template <typename A>
+auto operator/(const DExpr<A> &x, typename A::DType c) {
+    using DType = typename A::DType;
+    return x * no_grad(static_cast<DType>(1) / c);
+}
+
 template <typename A, typename B>
 auto operator*(const DExpr<A> &x, const DExpr<B> &y) {
     return DBinExprOp<A, B, DApMul>(static_cast<const A &>(x), static_cast<const B &>(y));
@@ -141,6 +225,18 @@ auto operator+(const DExpr<A> &x, const DExpr<B> &y) {
     return DBinExprOp<A, B, DApSum>(static_cast<const A &>(x), static_cast<const B &>(y));
 }
 
+/**
+ * matmul(a, b) + c is built as a single fused node, the bias is added by the matrix
+ * multiplication itself
+ */
+template <typename A, typename B, typename C>
+auto operator+(const DExpr<DBinExprOp<A, B, DApMatMul<false, false>>> &x, const DExpr<C> &y) {
+    const auto &product = static_cast<const DBinExprOp<A, B, DApMatMul<false, false>> &>(x);
+    return DTernExprOp<A, B, C, DApLinear<false>>(std::get<0>(product.child_nodes),
+                                                  std::get<1>(product.child_nodes),
+                                                  static_cast<const C &>(y));
+}
+
 template <typename A, typename B>
 auto operator-(const DExpr<A> &x, const DExpr<B> &y) {
     return DBinExprOp<A, B, DApDiff>(static_cast<const A &>(x), static_cast<const B &>(y));
@@ -152,15 +248,59 @@ auto matmul(const DExpr<A> &x, const DExpr<B> &y) {
                                                      static_cast<const B &>(y));
 }
 
+/**
+ * Sparse input x [rows, K] times y [K, N], only the non zeros of x are multiplied
+ */
+template <typename B>
+auto matmul(const SparseTensor<typename B::DType> &x, const DExpr<B> &y) {
+    return DUnaryExprOp<B, DApSparseInputMatMul>(static_cast<const B &>(y), x);
+}
+
+/**
+ * Matrix multiplication for each item of a batch: x [..., N, K], y [..., K, M] -> [..., N, M]
+ */
+template <typename A, typename B>
+auto batch_matmul(const DExpr<A> &x, const DExpr<B> &y) {
+    return DBinExprOp<A, B, DApBatchMatMul>(static_cast<const A &>(x), static_cast<const B &>(y));
+}
+
+/**
+ * x [..., K] times the sparse matrix m [K, N], only the non zeros of m are multiplied
+ */
+template <typename A, bool requires_gradient>
+auto sparse_matmul(const DExpr<A> &x,
+                   const SparseVariable<typename A::DType, requires_gradient> &m) {
+    return DUnaryExprOp<A, DApSparseMatMul<requires_gradient>>(static_cast<const A &>(x), m);
+}
+
 template <typename A, typename B, typename C>
 auto conv_1d(const DExpr<A> &x, const DExpr<B> &y, const DExpr<C> &z) {
-    return DTernExprOp<A, B, C, DApConv1d>(
+    return DTernExprOp<A, B, C, DApConv1d<false>>(
         static_cast<const A &>(x), static_cast<const B &>(y), static_cast<const C &>(z));
 }
 
 template <typename A, typename B, typename C>
 auto conv_2d(const DExpr<A> &x, const DExpr<B> &y, const DExpr<C> &z) {
-    return DTernExprOp<A, B, C, DApConv2d>(
+    return DTernExprOp<A, B, C, DApConv2d<false>>(
+        static_cast<const A &>(x), static_cast<const B &>(y), static_cast<const C &>(z));
+}
+
+/**
+ * Transposed convolution of the kernel x on y, plus the bias z: the adjoint of conv_1d, it
+ * upsamples y by the stride. x has shape [IN_CHANNELS, OUT_CHANNELS / groups, KERNEL_SIZE].
+ */
+template <typename A, typename B, typename C>
+auto conv_transpose_1d(const DExpr<A> &x, const DExpr<B> &y, const DExpr<C> &z) {
+    return DTernExprOp<A, B, C, DApConvTranspose1d>(
+        static_cast<const A &>(x), static_cast<const B &>(y), static_cast<const C &>(z));
+}
+
+/**
+ * Transposed convolution, the adjoint of conv_2d, as conv_transpose_1d
+ */
+template <typename A, typename B, typename C>
+auto conv_transpose_2d(const DExpr<A> &x, const DExpr<B> &y, const DExpr<C> &z) {
+    return DTernExprOp<A, B, C, DApConvTranspose2d>(
         static_cast<const A &>(x), static_cast<const B &>(y), static_cast<const C &>(z));
 }
 
@@ -169,6 +309,50 @@ auto relu(const DExpr<A> &x) {
     return DUnaryExprOp<A, DApRELU>(static_cast<const A &>(x));
 }
 
+/**
+ * relu(matmul(a, b) + c), the relu is applied in the same pass of the bias
+ */
+template <typename A, typename B, typename C>
+auto relu(const DExpr<DTernExprOp<A, B, C, DApLinear<false>>> &x) {
+    const auto &linear = static_cast<const DTernExprOp<A, B, C, DApLinear<false>> &>(x);
+    return DTernExprOp<A, B, C, DApLinear<true>>(std::get<0>(linear.child_nodes),
+                                                 std::get<1>(linear.child_nodes),
+                                                 std::get<2>(linear.child_nodes));
+}
+
+/**
+ * relu(conv_1d(x, y, z)), the relu is applied with the bias while the output of the convolution is
+ * written. The settings of the convolution (stride, padding, ...) are kept.
+ */
+template <typename A, typename B, typename C>
+auto relu(const DExpr<DTernExprOp<A, B, C, DApConv1d<false>>> &x) {
+    const auto &conv = static_cast<const DTernExprOp<A, B, C, DApConv1d<false>> &>(x);
+    return DTernExprOp<A, B, C, DApConv1d<true>>(std::get<0>(conv.child_nodes),
+                                                 std::get<1>(conv.child_nodes),
+                                                 std::get<2>(conv.child_nodes),
+                                                 conv.get_convolution());
+}
+
+/**
+ * relu(conv_2d(x, y, z)), as for conv_1d
+ */
+template <typename A, typename B, typename C>
+auto relu(const DExpr<DTernExprOp<A, B, C, DApConv2d<false>>> &x) {
+    const auto &conv = static_cast<const DTernExprOp<A, B, C, DApConv2d<false>> &>(x);
+    return DTernExprOp<A, B, C, DApConv2d<true>>(std::get<0>(conv.child_nodes),
+                                                 std::get<1>(conv.child_nodes),
+                                                 std::get<2>(conv.child_nodes),
+                                                 conv.get_convolution());
+}
+
+/**
+ * Rows of the table gathered by index: indices [n] -> [n, dim]
+ */
+template <typename T>
+auto embedding(const EmbeddingVariable<T> &table, std::vector<size_t> indices) {
+    return DExprEmbedding<T>(table, std::move(indices));
+}
+
 template <typename A>
 auto transpose(const DExpr<A> &x) {
     return DUnaryExprOp<A, DApTranspose>(static_cast<const A &>(x));
@@ -197,11 +381,83 @@ auto flatten(const DExpr<A> &x) {
     return DUnaryExprOp<A, DApFlatten>(static_cast<const A &>(x));
 }
 
+/**
+ * flatten(pooling): the pooling writes its output already flat
+ */
+template <typename A, size_t dims>
+auto flatten(const DExpr<DUnaryExprOp<A, DApPool<dims, false>>> &x) {
+    const auto &pool = static_cast<const DUnaryExprOp<A, DApPool<dims, false>> &>(x);
+    return DUnaryExprOp<A, DApPool<dims, true>>(std::get<0>(pool.child_nodes), pool.get_pooling());
+}
+
+/**
+ * Pooling of x [B, C, W] on windows of window elements, by default the windows do not overlap.
+ * A window of 0 elements is the whole width (global pooling), the output is then [B, C, 1].
+ */
+template <typename A>
+auto pool_1d(const DExpr<A> &x, PoolingMode mode, size_t window) {
+    Pooling1D<typename A::DType> pooling{};
+    pooling.MODE = mode;
+    pooling.WINDOW = window;
+    return DUnaryExprOp<A, DApPool<1, false>>(static_cast<const A &>(x), pooling);
+}
+
+template <typename A>
+auto max_pool_1d(const DExpr<A> &x, size_t window) {
+    return pool_1d(x, PoolingMode::MAX, window);
+}
+
+template <typename A>
+auto avg_pool_1d(const DExpr<A> &x, size_t window) {
+    return pool_1d(x, PoolingMode::AVERAGE, window);
+}
+
+template <typename A>
+auto global_avg_pool_1d(const DExpr<A> &x) {
+    return pool_1d(x, PoolingMode::AVERAGE, 0);
+}
+
+/**
+ * Pooling of x [B, C, H, W] on windows of window_height x window_width elements, as pool_1d
+ */
+template <typename A>
+auto pool_2d(const DExpr<A> &x, PoolingMode mode, size_t window_height, size_t window_width) {
+    Pooling2D<typename A::DType> pooling{};
+    pooling.MODE = mode;
+    pooling.WINDOW_HEIGHT = window_height;
+    pooling.WINDOW_WIDTH = window_width;
+    return DUnaryExprOp<A, DApPool<2, false>>(static_cast<const A &>(x), pooling);
+}
+
+template <typename A>
+auto max_pool_2d(const DExpr<A> &x, size_t window_height, size_t window_width) {
+    return pool_2d(x, PoolingMode::MAX, window_height, window_width);
+}
+
+template <typename A>
+auto avg_pool_2d(const DExpr<A> &x, size_t window_height, size_t window_width) {
+    return pool_2d(x, PoolingMode::AVERAGE, window_height, window_width);
+}
+
+template <typename A>
+auto global_avg_pool_2d(const DExpr<A> &x) {
+    return pool_2d(x, PoolingMode::AVERAGE, 0, 0);
+}
+
 template <typename A>
 auto indexer(const DExpr<A> &x, size_t idx) {
     return DUnaryExprOp<A, DApIndexer>(static_cast<const A &>(x), idx);
 }
 
+/**
+ * Gradient checkpointing: the temporaries of x are not kept in memory between the forward and the
+ * backward step, they are recomputed when needed.
+ */
+template <typename A>
+auto checkpoint(const DExpr<A> &x) {
+    return DUnaryExprOp<A, DApCheckpoint>(static_cast<const A &>(x));
+}
+
 template <typename A>
 auto operator-(const DExpr<A> &x) {
     return DUnaryExprOp<A, DApFlipSign>(static_cast<const A &>(x));
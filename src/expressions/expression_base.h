@@ -52,6 +52,9 @@ class DExpr {
     // Vector of pairs <Tensor, Gradient>
     auto get_parameters() const;
 
+    // Parameters with a sparse gradient (embedding tables)
+    auto get_sparse_parameters() const;
+
     /**
      * simplify, evaluate the expression and return the result as a Tensor
      */
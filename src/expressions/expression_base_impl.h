@@ -4,15 +4,25 @@
 
 #include "binary_operators/binary_operator.h"
 #include "binary_operators/matmul_operator.h"
+#include "binary_operators/batch_matmul_operator.h"
 
 #include "ternary_operators/ternary_operator.h"
 #include "ternary_operators/convolution_1d_operator.h"
 #include "ternary_operators/convolution_2d_operator.h"
+#include "ternary_operators/convolution_transpose_1d_operator.h"
+#include "ternary_operators/convolution_transpose_2d_operator.h"
+#include "ternary_operators/linear_operator.h"
 
 #include "unary_operators/unary_operator.h"
 #include "unary_operators/flattener_operator.h"
+#include "unary_operators/transpose_operator.h"
 #include "unary_operators/indexing_operator.h"
+#include "unary_operators/checkpoint_operator.h"
+#include "unary_operators/sparse_matmul_operator.h"
+#include "unary_operators/sparse_input_matmul_operator.h"
+#include "unary_operators/pooling_operator.h"
 #include "variable.h"
+#include "embedding.h"
 
 #include "visitors/runtime_visitors.h"
 #include "visitors/compile_time_visitors.h"
@@ -26,6 +36,15 @@ auto DExpr<Expr>::get_parameters() const {
     return visitor.res;
 }
 
+template <typename Expr>
+auto DExpr<Expr>::get_sparse_parameters() const {
+    using T = IntrinsicType::Type;
+    GetSparseParametersVisitor<T> visitor{};
+
+    static_cast<const Expr &>(*this).traverse(visitor);
+    return visitor.res;
+}
+
 template <typename Expr>
 auto DExpr<Expr>::collect_tensor_handles() const {
     using T = IntrinsicType::Type;
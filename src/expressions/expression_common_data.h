@@ -67,6 +67,23 @@ requires(sizeof...(ChildNodes) > 0) &&
                                         typename FlattenOpNoTemporary<recursive>::Type>;
     };
 
+    /**
+     * Drop the temporaries cached by this node and by all its children.
+     */
+    void release_temporaries() {
+        res = ConstTensor<DType>{};
+        std::apply([](auto &...nodes) { (nodes.release_temporaries(), ...); }, child_nodes);
+    }
+
+    /**
+     * Freeze (or unfreeze) the parameters of the expression for inference: the nodes that multiply
+     * by a weight matrix prepare its layout once, at the next eval, and then reuse it. The
+     * parameters must not change while the expression is frozen.
+     */
+    void freeze(bool frozen = true) {
+        std::apply([&](auto &...nodes) { (nodes.freeze(frozen), ...); }, child_nodes);
+    }
+
     // By convention, we name the first 3 childs as a, b, c
     auto &a_() requires(n_childs >= 1) { return std::get<0>(this->child_nodes); }
     auto &b_() requires(n_childs >= 2) { return std::get<1>(this->child_nodes); }
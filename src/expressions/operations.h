@@ -37,6 +37,18 @@ class DApFAM {
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
 };
 
+class DApFMS {
+  public:
+    static constexpr size_t STACK_VAL = ops::FMS_OP;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
+};
+
+class DApFNMA {
+  public:
+    static constexpr size_t STACK_VAL = ops::FNMA_OP;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
+};
+
 class DApMul {
   public:
     static constexpr size_t STACK_VAL = ops::MUL_OP;
@@ -49,6 +61,15 @@ class DApDivide {
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
 };
 
+/**
+ * Fused a / sqrt(b), produced by the simplifier
+ */
+class DApDivideSqrt {
+  public:
+    static constexpr size_t STACK_VAL = ops::DIVIDE_SQRT_OP;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
+};
+
 template <bool tLeft, bool tRight>
 class DApMatMul {
   public:
@@ -56,15 +77,87 @@ class DApMatMul {
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
 };
 
+class DApBatchMatMul {
+  public:
+    static constexpr size_t STACK_VAL = ops::BATCH_MAT_MUL;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * Product with a sparse matrix (see SparseVariable), that is stored in the node and not as an
+ * operand: requires_gradient is the one of the matrix.
+ */
+template <bool requires_gradient>
+class DApSparseMatMul {
+  public:
+    static constexpr size_t STACK_VAL = ops::SPARSE_MAT_MUL;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * Product of a sparse input (see SparseTensor) with a matrix, the input is stored in the node
+ */
+class DApSparseInputMatMul {
+  public:
+    static constexpr size_t STACK_VAL = ops::SPARSE_INPUT_MAT_MUL;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * Embedding lookup, the operator of DExprEmbedding (a leaf)
+ */
+class DApEmbedding {
+  public:
+    static constexpr size_t STACK_VAL = ops::EMBEDDING;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * matmul(a, b) + c, optionally followed by a relu, computed in a single pass over the output
+ */
+template <bool relu>
+class DApLinear {
+  public:
+    static constexpr size_t STACK_VAL = ops::LINEAR<relu>;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * 1d convolution plus bias, optionally followed by a relu applied while the output is written
+ */
+template <bool relu>
 class DApConv1d {
   public:
-    static constexpr size_t STACK_VAL = ops::CONV_1D;
+    static constexpr size_t STACK_VAL = relu ? ops::CONV_RELU_1D : ops::CONV_1D;
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
 };
 
+template <bool relu>
 class DApConv2d {
   public:
-    static constexpr size_t STACK_VAL = ops::CONV_2D;
+    static constexpr size_t STACK_VAL = relu ? ops::CONV_RELU_2D : ops::CONV_2D;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+class DApConvTranspose1d {
+  public:
+    static constexpr size_t STACK_VAL = ops::CONV_TRANSPOSE_1D;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+class DApConvTranspose2d {
+  public:
+    static constexpr size_t STACK_VAL = ops::CONV_TRANSPOSE_2D;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * Max or average pooling of a 1d or 2d x, flatten is true when the node also flattens its output
+ */
+template <size_t dims, bool flatten>
+class DApPool {
+  public:
+    static constexpr size_t STACK_VAL = dims == 1 ? ops::POOL_1D : ops::POOL_2D;
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
 };
 
@@ -114,4 +207,13 @@ class DApIndexer {
   public:
     static constexpr size_t STACK_VAL = ops::INDEXER;
     static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = true;
+};
+
+/**
+ * Gradient checkpointing, it is the identity for evaluation.
+ */
+class DApCheckpoint {
+  public:
+    static constexpr size_t STACK_VAL = ops::CHECKPOINT;
+    static constexpr bool NEEDS_TEMPORARY_FOR_EVAL = false;
 };
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ternary_operator.h"
+#include "../../convolution/convolution_1d.h"
+
+/**
+ * Partial specialization for the 1d transposed convolution, the adjoint of DApConv1d. The kernels
+ * of the convolution run backwards, see Convolution1D::transposed_forward.
+ */
+template <typename A, typename B, typename C>
+class DTernExprOp<A, B, C, DApConvTranspose1d>
+    : public DExprCommonData<DApConvTranspose1d, A, B, C>,
+      public DExpr<DTernExprOp<A, B, C, DApConvTranspose1d>> {
+  private:
+    using CommonData = DExprCommonData<DApConvTranspose1d, A, B, C>;
+    // a_ is the kernel
+    using CommonData::a_;
+    // b_ is the data buffer on which we apply the kernel
+    using CommonData::b_;
+    // c_ is the bias vector
+    using CommonData::c_;
+
+    using This = DTernExprOp<A, B, C, DApConvTranspose1d>;
+
+    // The actual kernels, they also cache what is needed for the backpropagation
+    Convolution1D<typename CommonData::DType> convolution{};
+
+  public:
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    using Left = A;
+    using Middle = B;
+    using Right = C;
+
+    DTernExprOp(const A &a, const B &b, const C &c) : CommonData{a, b, c} {}
+
+    void compute_temporaries_for_eval() {
+        using SimplifiedT = Simplify::Type;
+        a_().compute_temporaries_for_eval();
+        b_().compute_temporaries_for_eval();
+        c_().compute_temporaries_for_eval();
+
+        this->res = convolution.template transposed_forward</*keep_temporaries=*/false>(
+            Interpreter<typename SimplifiedT::Left>::const_interpret(a_()),
+            Interpreter<typename SimplifiedT::Middle>::const_interpret(b_()),
+            Interpreter<typename SimplifiedT::Right>::const_interpret(c_()));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> kernel = a_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> x_data = b_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> bias = c_().template compute_temporaries_for_backprop<use_cache>();
+
+            this->res = convolution.template transposed_forward</*keep_temporaries=*/true>(
+                kernel, x_data, bias);
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        auto [a_grad, b_grad, c_grad] = convolution.transposed_backward(grad);
+
+        a_().backward_internal(a_grad);
+        b_().backward_internal(b_grad);
+        c_().backward_internal(c_grad);
+    }
+
+    void release_temporaries() {
+        convolution.release_temporaries();
+        CommonData::release_temporaries();
+    }
+
+    struct Simplify {
+        using Type = DTernExprOp<typename A::Simplify::Type,
+                                 typename B::Simplify::Type,
+                                 typename C::Simplify::Type,
+                                 Operator>;
+    };
+
+    // The stride, padding and dilation of the convolution that is transposed: the stride is the
+    // upsampling factor, and the padding is removed from both ends of the output
+    This &set_stride(size_t stride) {
+        convolution.STRIDE = stride;
+        return *this;
+    }
+    This &set_padding(size_t padding) {
+        convolution.PADDING = padding;
+        return *this;
+    }
+    // Elements added at the end of the output, smaller than the stride
+    This &set_output_padding(size_t output_padding) {
+        convolution.OUTPUT_PADDING = output_padding;
+        return *this;
+    }
+    This &set_dilation(size_t dilation) {
+        convolution.DILATION = dilation;
+        return *this;
+    }
+    // The channels are split in groups, the kernel has shape
+    // [IN_CHANNELS, OUT_CHANNELS / groups, KERNEL_SIZE]
+    This &set_groups(size_t groups) {
+        convolution.GROUPS = groups;
+        return *this;
+    }
+    // Channels-first (default) or channels-last x and output, the kernel keeps its layout
+    This &set_layout(ConvolutionLayout layout) {
+        convolution.LAYOUT = layout;
+        return *this;
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "ternary_operator.h"
+#include "../../convolution/convolution_2d.h"
+
+/**
+ * Partial specialization for the 2d transposed convolution, the adjoint of DApConv2d. The kernels
+ * of the convolution run backwards, see Convolution2D::transposed_forward.
+ */
+template <typename A, typename B, typename C>
+class DTernExprOp<A, B, C, DApConvTranspose2d>
+    : public DExprCommonData<DApConvTranspose2d, A, B, C>,
+      public DExpr<DTernExprOp<A, B, C, DApConvTranspose2d>> {
+  private:
+    using CommonData = DExprCommonData<DApConvTranspose2d, A, B, C>;
+    // a_ is the kernel
+    using CommonData::a_;
+    // b_ is the data buffer on which we apply the kernel
+    using CommonData::b_;
+    // c_ is the bias vector
+    using CommonData::c_;
+
+    using This = DTernExprOp<A, B, C, DApConvTranspose2d>;
+
+    // The actual kernels, they also cache what is needed for the backpropagation
+    Convolution2D<typename CommonData::DType> convolution{};
+
+  public:
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    using Left = A;
+    using Middle = B;
+    using Right = C;
+
+    DTernExprOp(const A &a, const B &b, const C &c) : CommonData{a, b, c} {}
+
+    void compute_temporaries_for_eval() {
+        using SimplifiedT = Simplify::Type;
+        a_().compute_temporaries_for_eval();
+        b_().compute_temporaries_for_eval();
+        c_().compute_temporaries_for_eval();
+
+        this->res = convolution.template transposed_forward</*keep_temporaries=*/false>(
+            Interpreter<typename SimplifiedT::Left>::const_interpret(a_()),
+            Interpreter<typename SimplifiedT::Middle>::const_interpret(b_()),
+            Interpreter<typename SimplifiedT::Right>::const_interpret(c_()));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> kernel = a_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> x_data = b_().template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> bias = c_().template compute_temporaries_for_backprop<use_cache>();
+
+            this->res = convolution.template transposed_forward</*keep_temporaries=*/true>(
+                kernel, x_data, bias);
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        auto [a_grad, b_grad, c_grad] = convolution.transposed_backward(grad);
+
+        a_().backward_internal(a_grad);
+        b_().backward_internal(b_grad);
+        c_().backward_internal(c_grad);
+    }
+
+    void release_temporaries() {
+        convolution.release_temporaries();
+        CommonData::release_temporaries();
+    }
+
+    struct Simplify {
+        using Type = DTernExprOp<typename A::Simplify::Type,
+                                 typename B::Simplify::Type,
+                                 typename C::Simplify::Type,
+                                 Operator>;
+    };
+
+    // The stride, padding and dilation of the convolution that is transposed, see
+    // DApConvTranspose1d
+    This &set_stride(size_t stride_height, size_t stride_width) {
+        convolution.STRIDE_HEIGHT = stride_height;
+        convolution.STRIDE_WIDTH = stride_width;
+        return *this;
+    }
+    This &set_padding(size_t padding_height, size_t padding_width) {
+        convolution.PADDING_HEIGHT = padding_height;
+        convolution.PADDING_WIDTH = padding_width;
+        return *this;
+    }
+    // Rows and columns added at the end of the output, smaller than the strides
+    This &set_output_padding(size_t output_padding_height, size_t output_padding_width) {
+        convolution.OUTPUT_PADDING_HEIGHT = output_padding_height;
+        convolution.OUTPUT_PADDING_WIDTH = output_padding_width;
+        return *this;
+    }
+    This &set_dilation(size_t dilation_height, size_t dilation_width) {
+        convolution.DILATION_HEIGHT = dilation_height;
+        convolution.DILATION_WIDTH = dilation_width;
+        return *this;
+    }
+    // The channels are split in groups, the kernel has shape
+    // [IN_CHANNELS, OUT_CHANNELS / groups, KERNEL_HEIGHT, KERNEL_WIDTH]
+    This &set_groups(size_t groups) {
+        convolution.GROUPS = groups;
+        return *this;
+    }
+    // Channels-first (default) or channels-last x and output, the kernel keeps its layout
+    This &set_layout(ConvolutionLayout layout) {
+        convolution.LAYOUT = layout;
+        return *this;
+    }
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "ternary_operator.h"
+#include "../binary_operators/matmul_operator.h"
+#include "../../gemm/frozen_matrix.h"
+#include "../variable.h"
+
+/**
+ * Partial specialization for matmul(a, b) + c and relu(matmul(a, b) + c).
+ * The bias and the relu are applied on the output of the matrix multiplication while it is still
+ * in cache (see linear_wrapper), instead of running one more pass for each of them.
+ */
+template <typename A, typename B, typename C, bool relu>
+class DTernExprOp<A, B, C, DApLinear<relu>>
+    : public DExprCommonData<DApLinear<relu>, A, B, C>,
+      public DExpr<DTernExprOp<A, B, C, DApLinear<relu>>> {
+  private:
+    using CommonData = DExprCommonData<DApLinear<relu>, A, B, C>;
+    // a_ and b_ are the matrices
+    using CommonData::a_;
+    using CommonData::b_;
+    // c_ is the bias
+    using CommonData::c_;
+
+  public:
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    using Left = A;
+    using Middle = B;
+    using Right = C;
+
+    // The transposes are simplified as done by the matmul node
+    using MatMulT = typename DBinExprOp<A, B, DApMatMul<false, false>>::Simplify::Type;
+
+  private:
+    // The matrix b, packed once while the expression is frozen if it is a parameter
+    bool is_frozen{false};
+    FrozenMatrix<DType> frozen_b{};
+
+  public:
+    DTernExprOp(const A &a, const B &b, const C &c) : CommonData{a, b, c} {}
+
+    void compute_temporaries_for_eval() {
+        using SimplifiedT = Simplify::Type;
+        constexpr bool tL = MatMulT::transpose_left;
+        constexpr bool tR = MatMulT::transpose_right;
+
+        // The folded transposes are not evaluated
+        auto &a = matmul_operand<tL>(a_());
+        auto &b = matmul_operand<tR>(b_());
+        a.compute_temporaries_for_eval();
+        b.compute_temporaries_for_eval();
+        c_().compute_temporaries_for_eval();
+
+        auto t1 = Interpreter<typename MatMulT::Left>::const_interpret(a);
+        auto t2 = Interpreter<typename MatMulT::Right>::const_interpret(b);
+        auto bias = Interpreter<typename SimplifiedT::Right>::const_interpret(c_());
+
+        auto res_shape = Shape::get_matmul_shape<tL, tR>(t1.get_shape(), t2.get_shape());
+
+        const bool packed = is_frozen && is_parameter_leaf<std::remove_cvref_t<decltype(b)>>;
+        if (packed && frozen_b.empty()) {
+            frozen_b.template set<tR>(t2);
+        }
+        this->res = linear_wrapper<DType, tL, tR, relu>(
+            t1, t2, bias, res_shape, packed ? &frozen_b : nullptr);
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        constexpr bool tL = MatMulT::transpose_left;
+        constexpr bool tR = MatMulT::transpose_right;
+
+        if constexpr (!use_cache) {
+            ConstTensor<DType> t1 =
+                matmul_operand<tL>(a_()).template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> t2 =
+                matmul_operand<tR>(b_()).template compute_temporaries_for_backprop<use_cache>();
+            ConstTensor<DType> bias = c_().template compute_temporaries_for_backprop<use_cache>();
+
+            this->res = linear_wrapper<DType, tL, tR, relu>(
+                t1, t2, bias, Shape::get_matmul_shape<tL, tR>(t1.get_shape(), t2.get_shape()));
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        constexpr bool tL = MatMulT::transpose_left;
+        constexpr bool tR = MatMulT::transpose_right;
+
+        auto &a = matmul_operand<tL>(a_());
+        auto &b = matmul_operand<tR>(b_());
+        ConstTensor<DType> a_res =
+            a.template compute_temporaries_for_backprop</*use_cache=*/true>();
+        ConstTensor<DType> b_res =
+            b.template compute_temporaries_for_backprop</*use_cache=*/true>();
+        ConstTensor<DType> c_res =
+            c_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+
+        Tensor<DType> linear_grad = grad;
+        if constexpr (relu) {
+            // The output is positive exactly where the pre-activation is positive
+            linear_grad = grad.clone();
+            relu_backprop<DType>(linear_grad, this->res);
+        }
+        Tensor<DType> c_grad = reduce_axis(linear_grad, c_res.get_shape());
+        // The bias may be broadcasted to a bigger shape than the product
+        Shape product_shape = Shape::get_matmul_shape<tL, tR>(a_res.get_shape(), b_res.get_shape());
+        if (linear_grad.get_shape() != product_shape) {
+            linear_grad = reduce_axis(linear_grad, product_shape);
+        }
+
+        auto [a_grad, b_grad] = mat_mul_backward<DType, tL, tR>(linear_grad, a_res, b_res);
+
+        a.backward_internal(a_grad);
+        b.backward_internal(b_grad);
+        c_().backward_internal(c_grad);
+    }
+
+    void freeze(bool frozen = true) {
+        is_frozen = frozen;
+        frozen_b.clear();
+        CommonData::freeze(frozen);
+    }
+
+    struct Simplify {
+        using Type = DTernExprOp<typename A::Simplify::Type,
+                                 typename B::Simplify::Type,
+                                 typename C::Simplify::Type,
+                                 Operator>;
+    };
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <utility>
+
+#include "unary_operator.h"
+
+/**
+ * Set while a checkpoint recomputes its operand in the backward step. The checkpoints nested in
+ * the operand still hold their output from the forward step, so they return it instead of
+ * recomputing their own operand: each checkpointed subtree is evaluated at most twice per step,
+ * whatever the nesting depth.
+ */
+inline thread_local bool checkpoint_recomputing = false;
+
+/**
+ * Partial specialization for gradient checkpointing.
+ *
+ * In the forward step the operand is evaluated as usual, but then all the temporaries stored
+ * inside it (node results, im2col copies of the convolutions, etc...) are released, and only the
+ * output is kept. The dropped temporaries are recomputed in the backward step, right before they
+ * are needed, and released again afterwards.
+ * So we trade an extra forward pass of the operand for the memory of its activations.
+ *
+ * A checkpoint is a boundary for the enclosing checkpoints: its output survives their release,
+ * and their recomputation stops at it.
+ */
+template <typename A>
+class DUnaryExprOp<A, DApCheckpoint> : public DExprCommonData<DApCheckpoint, A>,
+                                       public DExpr<DUnaryExprOp<A, DApCheckpoint>> {
+  private:
+    using CommonData = DExprCommonData<DApCheckpoint, A>;
+    using CommonData::a_;
+
+    size_t n_evaluations{0};
+
+  public:
+    using Operand = A;
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    DUnaryExprOp(const A &a) : CommonData{a} {}
+
+    void compute_temporaries_for_eval() { a_().compute_temporaries_for_eval(); }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            if (!checkpoint_recomputing) {
+                this->res = a_().template compute_temporaries_for_backprop<use_cache>();
+                a_().release_temporaries();
+                n_evaluations++;
+            }
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        // Recompute the temporaries dropped in the forward step
+        const bool enclosing_recomputing = std::exchange(checkpoint_recomputing, true);
+        a_().template compute_temporaries_for_backprop</*use_cache=*/false>();
+        checkpoint_recomputing = enclosing_recomputing;
+        n_evaluations++;
+
+        a_().backward_internal(grad);
+        a_().release_temporaries();
+    }
+
+    // The output is kept, only the temporaries of the operand are dropped
+    void release_temporaries() { a_().release_temporaries(); }
+
+    // Number of times the operand has been evaluated for backpropagation, recomputations included
+    size_t get_n_evaluations() const { return n_evaluations; }
+
+    // For evaluation the checkpoint is just the identity
+    struct Simplify {
+        using Type = typename A::Simplify::Type;
+    };
+};
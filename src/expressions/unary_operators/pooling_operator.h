@@ -0,0 +1,104 @@
+#pragma once
+
+#include <type_traits>
+
+#include "unary_operator.h"
+#include "../../pooling/pooling.h"
+
+/**
+ * Partial specialization for the 1d and 2d pooling. With flatten the node also flattens its
+ * output (see flatten in expression.h): the pooled tensor is only reshaped, and the gradient is
+ * routed to x without the copy of a flatten node.
+ */
+template <typename A, size_t dims, bool flatten>
+class DUnaryExprOp<A, DApPool<dims, flatten>>
+    : public DExprCommonData<DApPool<dims, flatten>, A>,
+      public DExpr<DUnaryExprOp<A, DApPool<dims, flatten>>> {
+  private:
+    using CommonData = DExprCommonData<DApPool<dims, flatten>, A>;
+    using CommonData::a_;
+
+    using This = DUnaryExprOp<A, DApPool<dims, flatten>>;
+
+  public:
+    using Operand = A;
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    using Pooling = std::conditional_t<dims == 1, Pooling1D<DType>, Pooling2D<DType>>;
+
+  private:
+    // The actual kernels, they also cache what is needed for the backpropagation
+    Pooling pooling{};
+
+    static Tensor<DType> flatten_output(Tensor<DType> res) {
+        if constexpr (flatten) {
+            size_t batch_size = res.get_shape().get_shape()[0];
+            res.set_shape(Shape{{batch_size, res.get_size() / batch_size}});
+        }
+        return res;
+    }
+
+  public:
+    DUnaryExprOp(const A &a, const Pooling &pooling) : CommonData{a}, pooling{pooling} {}
+
+    const Pooling &get_pooling() const { return pooling; }
+
+    void compute_temporaries_for_eval() {
+        a_().compute_temporaries_for_eval();
+
+        this->res = flatten_output(pooling.template forward</*keep_temporaries=*/false>(
+            Interpreter<typename Simplify::Type::Operand>::const_interpret(a_())));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> a_res = a_().template compute_temporaries_for_backprop<use_cache>();
+            this->res = flatten_output(pooling.template forward</*keep_temporaries=*/true>(a_res));
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        a_().backward_internal(pooling.backward(grad));
+    }
+
+    void release_temporaries() {
+        pooling.release_temporaries();
+        CommonData::release_temporaries();
+    }
+
+    struct Simplify {
+        using Type = DUnaryExprOp<typename A::Simplify::Type, Operator>;
+    };
+
+    // 0 (default) is the size of the window: the windows do not overlap
+    This &set_stride(size_t stride) requires(dims == 1) {
+        pooling.STRIDE = stride;
+        return *this;
+    }
+    This &set_stride(size_t stride_height, size_t stride_width) requires(dims == 2) {
+        pooling.STRIDE_HEIGHT = stride_height;
+        pooling.STRIDE_WIDTH = stride_width;
+        return *this;
+    }
+    // Zero padding, at most half of the window
+    This &set_padding(size_t padding) requires(dims == 1) {
+        pooling.PADDING = padding;
+        return *this;
+    }
+    This &set_padding(size_t padding_height, size_t padding_width) requires(dims == 2) {
+        pooling.PADDING_HEIGHT = padding_height;
+        pooling.PADDING_WIDTH = padding_width;
+        return *this;
+    }
+    // Channels-first (default) or channels-last x and output
+    This &set_layout(ConvolutionLayout layout) {
+        pooling.LAYOUT = layout;
+        return *this;
+    }
+};
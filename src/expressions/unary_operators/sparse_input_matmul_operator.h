@@ -0,0 +1,67 @@
+#pragma once
+
+#include "unary_operator.h"
+#include "../variable.h"
+#include "../../sparse_tensor.h"
+
+/**
+ * Partial specialization for the product of a sparse input x [rows, K] with the matrix a [K, N].
+ * The input is stored in the node and the matrix is the only operand: the dense copy of x is never
+ * built, and the zeros of x are skipped both by the product and by the gradient of a. When a is a
+ * weight, its gradient is accumulated in place, on the rows hit by x only.
+ */
+template <typename A>
+class DUnaryExprOp<A, DApSparseInputMatMul> : public DExprCommonData<DApSparseInputMatMul, A>,
+                                              public DExpr<DUnaryExprOp<A, DApSparseInputMatMul>> {
+  private:
+    using CommonData = DExprCommonData<DApSparseInputMatMul, A>;
+    using CommonData::a_;
+
+  public:
+    using Operand = A;
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+  private:
+    SparseTensor<DType> x;
+
+  public:
+    DUnaryExprOp(const A &a, const SparseTensor<DType> &x) : CommonData{a}, x{x} {}
+
+    void compute_temporaries_for_eval() {
+        a_().compute_temporaries_for_eval();
+
+        this->res = sparse_input_mat_mul_wrapper<DType>(
+            *x.pattern,
+            x.values,
+            Interpreter<typename Simplify::Type::Operand>::const_interpret(a_()));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> a_res = a_().template compute_temporaries_for_backprop<use_cache>();
+            this->res = sparse_input_mat_mul_wrapper<DType>(*x.pattern, x.values, a_res);
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        if constexpr (is_parameter_leaf<A>) {
+            sparse_input_mat_mul_backward<DType>(
+                grad, *x.pattern, x.values, a_().t_.gradient, /*accumulate=*/true);
+            return;
+        }
+        ConstTensor<DType> a_res =
+            a_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+        a_().backward_internal(
+            sparse_input_mat_mul_backward<DType>(grad, *x.pattern, x.values, a_res.get_shape()));
+    }
+
+    struct Simplify {
+        using Type = DUnaryExprOp<typename A::Simplify::Type, Operator>;
+    };
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "unary_operator.h"
+#include "../../sparse_variable.h"
+
+/**
+ * Partial specialization for the product with a sparse matrix, a [..., K] times m [K, N].
+ * Only the non zeros of m are multiplied (see sparse_mat_mul_wrapper), and only their gradient is
+ * computed by the backward step.
+ */
+template <typename A, bool requires_gradient>
+class DUnaryExprOp<A, DApSparseMatMul<requires_gradient>>
+    : public DExprCommonData<DApSparseMatMul<requires_gradient>, A>,
+      public DExpr<DUnaryExprOp<A, DApSparseMatMul<requires_gradient>>> {
+  private:
+    using CommonData = DExprCommonData<DApSparseMatMul<requires_gradient>, A>;
+    using CommonData::a_;
+
+  public:
+    using Operand = A;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+  private:
+    SparseVariable<DType, requires_gradient> m;
+
+  public:
+    DUnaryExprOp(const A &a, const SparseVariable<DType, requires_gradient> &m)
+        : CommonData{a}, m{m} {}
+
+    // The values of m are a parameter of the expression
+    using CommonData::traverse;
+    template <typename Visitor>
+    void traverse(Visitor &v) {
+        if constexpr (requires_gradient && requires { v.add_parameter(m.values); }) {
+            v.add_parameter(m.values);
+        }
+        CommonData::traverse(v);
+    }
+    template <typename Visitor>
+    void traverse(Visitor &v) const {
+        if constexpr (requires_gradient && requires { v.add_parameter(m.values); }) {
+            v.add_parameter(m.values);
+        }
+        CommonData::traverse(v);
+    }
+
+    void compute_temporaries_for_eval() {
+        a_().compute_temporaries_for_eval();
+
+        this->res = sparse_mat_mul_wrapper<DType>(
+            Interpreter<typename Simplify::Type::Operand>::const_interpret(a_()),
+            *m.pattern,
+            m.values.tensor);
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> a_res = a_().template compute_temporaries_for_backprop<use_cache>();
+            this->res = sparse_mat_mul_wrapper<DType>(a_res, *m.pattern, m.values.tensor);
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        ConstTensor<DType> a_res =
+            a_().template compute_temporaries_for_backprop</*use_cache=*/true>();
+        DType *values_grad = nullptr;
+        if constexpr (requires_gradient) {
+            values_grad = &m.values.gradient[0];
+        }
+        a_().backward_internal(
+            sparse_mat_mul_backward<DType>(grad, a_res, *m.pattern, m.values.tensor, values_grad));
+    }
+
+    struct Simplify {
+        using Type = DUnaryExprOp<typename A::Simplify::Type, Operator>;
+    };
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "unary_operator.h"
+
+/**
+ * Partial specialization for the transpose operator, it swaps the last two dimensions.
+ * Inside a matrix multiplication the transpose is folded into the GEMM call (see
+ * MatMulSimplifier) and this node is never evaluated.
+ */
+template <typename A>
+class DUnaryExprOp<A, DApTranspose> : public DExprCommonData<DApTranspose, A>,
+                                      public DExpr<DUnaryExprOp<A, DApTranspose>> {
+  private:
+    using CommonData = DExprCommonData<DApTranspose, A>;
+    using CommonData::a_;
+
+  public:
+    using Operand = A;
+    using CommonData::traverse;
+    using typename CommonData::DType;
+    using typename CommonData::Operator;
+    template <bool recursive>
+    using Flatten = typename CommonData::Flatten<recursive>;
+
+    DUnaryExprOp(const A &a) : CommonData{a} {}
+
+    void compute_temporaries_for_eval() {
+        a_().compute_temporaries_for_eval();
+
+        this->res = transpose_wrapper<DType>(
+            Interpreter<typename Simplify::Type::Operand>::const_interpret(a_()));
+    }
+
+    template <bool use_cache>
+    ConstTensor<DType> compute_temporaries_for_backprop() {
+        if constexpr (!use_cache) {
+            ConstTensor<DType> a_res = a_().template compute_temporaries_for_backprop<use_cache>();
+            this->res = transpose_wrapper<DType>(a_res);
+        }
+        return this->res;
+    }
+
+    void backward_internal(const Tensor<DType> &grad) {
+        a_().backward_internal(transpose_wrapper<DType>(grad));
+    }
+
+    struct Simplify {
+        using Type = DUnaryExprOp<typename A::Simplify::Type, Operator>;
+    };
+};
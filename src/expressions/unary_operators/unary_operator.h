@@ -2,6 +2,7 @@
 
 #include "../expression_base.h"
 #include "../expression_common_data.h"
+#include "unary_operator_simplifier.h"
 
 #include "../../metaprogramming/stack.h"
 #include "../../interpreter.h"
@@ -61,6 +62,6 @@ class DUnaryExprOp : public DExprCommonData<Op, A>, public DExpr<DUnaryExprOp<A,
     }
 
     struct Simplify {
-        using Type = DUnaryExprOp<typename A::Simplify::Type, Op>;
+        using Type = typename UnarySimplifier<DUnaryExprOp<A, Op>>::Type;
     };
 };
\ No newline at end of file
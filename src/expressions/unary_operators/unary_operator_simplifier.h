@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../operations.h"
+#include "../binary_operators/common_simplifier.h"
+
+/**
+ * Utils for simplifying a unary expression
+ */
+
+template <typename Expr>
+struct UnarySimplifier;
+
+/**
+ * No simplification is possible
+ */
+template <typename A, typename Op>
+struct UnarySimplifier<DUnaryExprOp<A, Op>> {
+    using Type = DUnaryExprOp<typename A::Simplify::Type, Op>;
+};
+
+/**
+ * Simplification rules
+ */
+
+// -(-a)
+template <typename A>
+struct UnarySimplifier<DUnaryExprOp<DUnaryExprOp<A, DApFlipSign>, DApFlipSign>> {
+    using Type = typename A::Simplify::Type;
+};
\ No newline at end of file
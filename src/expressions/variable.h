@@ -35,6 +35,10 @@ requires(std::is_same_v<T, double> || std::is_same_v<T, float>) class DExprTenso
         return t_.tensor;
     }
 
+    // Leaves do not own any temporary
+    void release_temporaries() {}
+    void freeze(bool) {}
+
     void backward_internal(const Tensor<DType> &gradient) {
         if constexpr (require_gradient) {
             InterpretInternal<DType, Stack<ops::VARIABLE_OP, ops::VARIABLE_OP, ops::SUM_OP>>::eval(
@@ -56,3 +60,12 @@ requires(std::is_same_v<T, double> || std::is_same_v<T, float>) class DExprTenso
         return Visitor::template Visit<This>();
     }
 };
+
+/**
+ * True for the leaves that hold a trained parameter. Only these operands are packed by the frozen
+ * nodes: the inputs and the intermediate results change at every evaluation.
+ */
+template <typename T>
+constexpr bool is_parameter_leaf = false;
+template <typename T>
+constexpr bool is_parameter_leaf<DExprTensor<T, true>> = true;
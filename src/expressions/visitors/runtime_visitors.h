@@ -18,6 +18,22 @@ struct GetParametersVisitor {
             res.push_back(node.t_);
         }
     }
+    // Parameters that are stored in a node and are not leaves (e.g. the values of a sparse matrix)
+    void add_parameter(const Variable<T, true> &param) { res.push_back(param); }
+};
+
+/**
+ * Returns the parameters of an expression tree with a sparse gradient, see EmbeddingVariable.
+ */
+template <typename T>
+struct GetSparseParametersVisitor {
+    template <typename Operator>
+    static constexpr bool END_RECURSION = false;
+
+    std::vector<EmbeddingVariable<T>> res{};
+    template <typename Node>
+    void operator()(const Node &) {}
+    void operator()(const DExprEmbedding<T> &node) { res.push_back(node.table); }
 };
 
 /**
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cassert>
+
+#include "../blas_wrapper.h"
+#include "../tensor.h"
+
+/**
+ * Right operand of a matrix multiplication that does not change between calls (for example the
+ * weights of a layer at inference time), packed once for the in-tree GEMM.
+ */
+template <typename DType>
+class FrozenMatrix {
+    ConstTensor<DType> matrix{};
+    gemm::PackedMatrix<DType> packed{};
+    size_t rows{0};
+    size_t cols{0};
+
+  public:
+    bool empty() const { return packed.empty(); }
+
+    void clear() {
+        matrix = ConstTensor<DType>{};
+        packed = gemm::PackedMatrix<DType>{};
+    }
+
+    template <bool transpose>
+    void set(const ConstTensor<DType> &t) {
+        // Same convention of mat_mul_wrapper
+        rows = t.get_shape().first();
+        cols = t.get_size() / rows;
+        matrix = t;
+        packed = gemm::pack_matrix<DType, transpose>(&t[0], rows, cols);
+    }
+
+    const ConstTensor<DType> &get_matrix() const { return matrix; }
+
+    /**
+     * res (+)= op(m1) * op(matrix), transpose must be the same used by set
+     */
+    template <bool transpose_m1, bool transpose>
+    void mat_mul(const DType *m1, DType *res, int m1_rows, int m1_cols, bool accumulate) const {
+        assert(!empty());
+        size_t m = transpose_m1 ? m1_cols : m1_rows;
+        // The packed panels do not pay off for a matrix-vector product
+        if (m == 1 || packed.n == 1) {
+            blas_mat_mul<DType, transpose_m1, transpose>(
+                m1, &matrix[0], res, m1_rows, m1_cols, rows, cols, accumulate);
+            return;
+        }
+        packed_mat_mul<DType, transpose_m1>(m1, packed, res, m1_rows, m1_cols, accumulate);
+    }
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "../avx/avx_wrapper.h"
+#include "../constants.h"
+
+/**
+ * In-tree matrix multiplication, same interface of blas_mat_mul (row major matrices).
+ *
+ * res (+)= op(m1) * op(m2), computed with the usual GotoBLAS structure:
+ * - op(m2) is split in panels of KC x NC elements, each one packed in slivers NR columns wide.
+ * - op(m1) is split in blocks of MC x KC elements, each one packed in slivers MR rows tall.
+ * - a MR x NR tile of res is kept in registers by the microkernel, that streams one packed sliver
+ *   of op(m1) and one of op(m2) with FMAs.
+ * The transposes are resolved by the packing, so the microkernel is the same for the four variants.
+ */
+namespace gemm {
+    // Rows of the register tile
+    constexpr size_t MR = 6;
+    // Columns of the register tile, 2 AVX registers
+    template <typename T>
+    constexpr size_t NR = 2 * avx_constants::intrinsic_size<T>;
+
+    // Cache blocking: the packed sliver of op(m2) stays in L1, the packed block of op(m1) in L2
+    constexpr size_t MC = 72;
+    constexpr size_t KC = 256;
+    constexpr size_t NC = 2048;
+
+    template <typename T>
+    struct PackBuffers {
+        static inline thread_local std::vector<T> a{};
+        static inline thread_local std::vector<T> b{};
+    };
+
+    /**
+     * Packs the block of op(m1) with rows [i0, i0 + mc) and columns [k0, k0 + kc), the rows after
+     * the end of the matrix are padded with zeros
+     */
+    template <typename T, bool transpose>
+    inline void
+    pack_a(const T *m1, size_t ld, size_t i0, size_t mc, size_t k0, size_t kc, T *packed) {
+        for (size_t i = 0; i < mc; i += MR) {
+            size_t mr = std::min(MR, mc - i);
+            for (size_t k = 0; k < kc; ++k) {
+                for (size_t r = 0; r < MR; ++r) {
+                    size_t row = i0 + i + r;
+                    size_t col = k0 + k;
+                    *packed++ =
+                        r < mr ? (transpose ? m1[col * ld + row] : m1[row * ld + col]) : T{0};
+                }
+            }
+        }
+    }
+
+    /**
+     * Packs the panel of op(m2) with rows [k0, k0 + kc) and columns [j0, j0 + nc), the columns
+     * after the end of the matrix are padded with zeros
+     */
+    template <typename T, bool transpose>
+    inline void
+    pack_b(const T *m2, size_t ld, size_t k0, size_t kc, size_t j0, size_t nc, T *packed) {
+        constexpr size_t nr_max = NR<T>;
+        for (size_t j = 0; j < nc; j += nr_max) {
+            size_t nr = std::min(nr_max, nc - j);
+            for (size_t k = 0; k < kc; ++k) {
+                size_t row = k0 + k;
+                if (!transpose && nr == nr_max) {
+                    std::copy_n(&m2[row * ld + j0 + j], nr_max, packed);
+                    packed += nr_max;
+                    continue;
+                }
+                for (size_t c = 0; c < nr_max; ++c) {
+                    size_t col = j0 + j + c;
+                    *packed++ =
+                        c < nr ? (transpose ? m2[col * ld + row] : m2[row * ld + col]) : T{0};
+                }
+            }
+        }
+    }
+
+    /**
+     * res[mr x nr] (+)= a_sliver * b_sliver, with mr <= MR and nr <= NR
+     */
+    template <typename T>
+    inline void microkernel(size_t kc,
+                            const T *a,
+                            const T *b,
+                            T *res,
+                            size_t ld,
+                            size_t mr,
+                            size_t nr,
+                            bool accumulate) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+
+        simd_type<T> acc[MR][2];
+        for (size_t r = 0; r < MR; ++r) {
+            acc[r][0] = avx_constants::zero<T>;
+            acc[r][1] = avx_constants::zero<T>;
+        }
+
+        for (size_t k = 0; k < kc; ++k) {
+            simd_type<T> b0 = _mm256_loadu_px(b);
+            simd_type<T> b1 = _mm256_loadu_px(b + W);
+            for (size_t r = 0; r < MR; ++r) {
+                simd_type<T> a_r = _mm256_set1_px(a[r]);
+                acc[r][0] = _mm256_fmadd_px<T>(a_r, b0, acc[r][0]);
+                acc[r][1] = _mm256_fmadd_px<T>(a_r, b1, acc[r][1]);
+            }
+            a += MR;
+            b += NR<T>;
+        }
+
+        if (mr == MR && nr == NR<T>) {
+            for (size_t r = 0; r < MR; ++r) {
+                T *res_row = res + r * ld;
+                if (accumulate) {
+                    acc[r][0] = _mm256_add_px<T>(acc[r][0], _mm256_loadu_px(res_row));
+                    acc[r][1] = _mm256_add_px<T>(acc[r][1], _mm256_loadu_px(res_row + W));
+                }
+                _mm256_storeu_px(res_row, acc[r][0]);
+                _mm256_storeu_px(res_row + W, acc[r][1]);
+            }
+            return;
+        }
+
+        // Edge of the matrix, only the valid part of the tile is written
+        T tile[MR][NR<T>];
+        for (size_t r = 0; r < MR; ++r) {
+            _mm256_storeu_px(&tile[r][0], acc[r][0]);
+            _mm256_storeu_px(&tile[r][W], acc[r][1]);
+        }
+        for (size_t r = 0; r < mr; ++r) {
+            for (size_t c = 0; c < nr; ++c) {
+                res[r * ld + c] = accumulate ? res[r * ld + c] + tile[r][c] : tile[r][c];
+            }
+        }
+    }
+
+    // Products with at most this many multiply-adds are too small to amortize the setup of a BLAS
+    // call, the in-tree kernel is used instead
+    constexpr size_t SMALL_GEMM_FLOPS = 32 * 32 * 32;
+
+    template <typename T>
+    inline T horizontal_sum(simd_type<T> x) {
+        T lanes[avx_constants::intrinsic_size<T>];
+        _mm256_storeu_px(lanes, x);
+        T res{0};
+        for (T lane : lanes) {
+            res += lane;
+        }
+        return res;
+    }
+
+    /**
+     * res[i] (+)= dot(mat[i, :], vec), for the rows of a row major matrix with n columns
+     */
+    template <typename T>
+    inline void
+    gemv_dot(const T *mat, const T *vec, T *res, size_t rows, size_t n, bool accumulate) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        for (size_t i = 0; i < rows; ++i) {
+            const T *row = mat + i * n;
+            simd_type<T> acc0 = avx_constants::zero<T>;
+            simd_type<T> acc1 = avx_constants::zero<T>;
+            size_t k = 0;
+            for (; k + 2 * W <= n; k += 2 * W) {
+                acc0 = _mm256_fmadd_px<T>(_mm256_loadu_px(row + k), _mm256_loadu_px(vec + k), acc0);
+                acc1 = _mm256_fmadd_px<T>(
+                    _mm256_loadu_px(row + k + W), _mm256_loadu_px(vec + k + W), acc1);
+            }
+            T sum = horizontal_sum<T>(_mm256_add_px<T>(acc0, acc1));
+            for (; k < n; ++k) {
+                sum += row[k] * vec[k];
+            }
+            res[i] = accumulate ? res[i] + sum : sum;
+        }
+    }
+
+    /**
+     * res[j] (+)= sum_i vec[i] * mat[i, j], for a row major matrix with n columns: the rows are
+     * accumulated on res, which stays in cache
+     */
+    template <typename T>
+    inline void
+    gemv_axpy(const T *mat, const T *vec, T *res, size_t rows, size_t n, bool accumulate) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        if (!accumulate) {
+            std::fill_n(res, n, T{0});
+        }
+        for (size_t i = 0; i < rows; ++i) {
+            const T *row = mat + i * n;
+            simd_type<T> v = _mm256_set1_px(vec[i]);
+            size_t j = 0;
+            for (; j + W <= n; j += W) {
+                _mm256_storeu_px(res + j,
+                                 _mm256_fmadd_px<T>(v, _mm256_loadu_px(row + j),
+                                                    _mm256_loadu_px(res + j)));
+            }
+            for (; j < n; ++j) {
+                res[j] += vec[i] * row[j];
+            }
+        }
+    }
+} // namespace gemm
+
+namespace gemm {
+    // Size of the packed panel of op(m2) with kc rows and nc columns (padded to a multiple of NR)
+    template <typename T>
+    constexpr size_t packed_panel_size(size_t kc, size_t nc) {
+        return kc * ((nc + NR<T> - 1) / NR<T>) * NR<T>;
+    }
+
+    /**
+     * Loops of the blocked matrix multiplication, get_panel_b(jc, pc, kc, nc) returns the packed
+     * panel of op(m2) with rows [pc, pc + kc) and columns [jc, jc + nc)
+     */
+    template <typename T, bool TransposeM1>
+    inline void blocked_mat_mul(const T *m1,
+                                size_t m1_cols,
+                                T *res,
+                                size_t m,
+                                size_t k,
+                                size_t n,
+                                bool accumulate,
+                                auto &&get_panel_b) {
+        if (k == 0 && !accumulate) {
+            std::fill_n(res, m * n, T{0});
+            return;
+        }
+
+        std::vector<T> &packed_a = PackBuffers<T>::a;
+        packed_a.resize(MC * KC);
+
+        for (size_t jc = 0; jc < n; jc += NC) {
+            size_t nc = std::min(NC, n - jc);
+            for (size_t pc = 0; pc < k; pc += KC) {
+                size_t kc = std::min(KC, k - pc);
+                // The first panel of op(m1) overwrites res, unless we are accumulating
+                bool accumulate_panel = accumulate || pc > 0;
+                const T *packed_b = get_panel_b(jc, pc, kc, nc);
+
+                for (size_t ic = 0; ic < m; ic += MC) {
+                    size_t mc = std::min(MC, m - ic);
+                    pack_a<T, TransposeM1>(m1, m1_cols, ic, mc, pc, kc, packed_a.data());
+
+                    for (size_t jr = 0; jr < nc; jr += NR<T>) {
+                        for (size_t ir = 0; ir < mc; ir += MR) {
+                            microkernel<T>(kc,
+                                           &packed_a[ir * kc],
+                                           &packed_b[jr * kc],
+                                           &res[(ic + ir) * n + jc + jr],
+                                           n,
+                                           std::min(MR, mc - ir),
+                                           std::min(NR<T>, nc - jr),
+                                           accumulate_panel);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * op(m2) packed once, in the layout of the panels of blocked_mat_mul. Useful when the same
+     * matrix (for example the weights of a layer, at inference time) is multiplied many times.
+     */
+    template <typename T>
+    struct PackedMatrix {
+        std::vector<T> data{};
+        // op(m2) has shape k x n
+        size_t k{0};
+        size_t n{0};
+
+        bool empty() const { return data.empty(); }
+    };
+
+    template <typename T, bool transpose>
+    PackedMatrix<T> pack_matrix(const T *m2, int m2_rows, int m2_cols) {
+        PackedMatrix<T> res{};
+        res.k = transpose ? m2_cols : m2_rows;
+        res.n = transpose ? m2_rows : m2_cols;
+
+        // Panels in the same order of blocked_mat_mul
+        size_t size{0};
+        for (size_t jc = 0; jc < res.n; jc += NC) {
+            size += packed_panel_size<T>(res.k, std::min(NC, res.n - jc));
+        }
+        res.data.resize(size);
+
+        T *packed = res.data.data();
+        for (size_t jc = 0; jc < res.n; jc += NC) {
+            size_t nc = std::min(NC, res.n - jc);
+            for (size_t pc = 0; pc < res.k; pc += KC) {
+                size_t kc = std::min(KC, res.k - pc);
+                pack_b<T, transpose>(m2, m2_cols, pc, kc, jc, nc, packed);
+                packed += packed_panel_size<T>(kc, nc);
+            }
+        }
+        return res;
+    }
+} // namespace gemm
+
+template <typename T, bool TransposeM1 = false, bool TransposeM2 = false>
+requires(std::is_same_v<T, double> || std::is_same_v<T, float>) void native_mat_mul(
+    const T *m1, const T *m2, T *res, int m1_rows, int m1_cols, int m2_rows, int m2_cols,
+    bool accumulate = false) {
+    using namespace gemm;
+
+    size_t m = TransposeM1 ? m1_cols : m1_rows;
+    size_t k = TransposeM1 ? m1_rows : m1_cols;
+    size_t n = TransposeM2 ? m2_rows : m2_cols;
+    assert(k == static_cast<size_t>(TransposeM2 ? m2_cols : m2_rows));
+
+    std::vector<T> &packed_b = PackBuffers<T>::b;
+    packed_b.resize(KC * NC);
+
+    blocked_mat_mul<T, TransposeM1>(
+        m1, m1_cols, res, m, k, n, accumulate, [&](size_t jc, size_t pc, size_t kc, size_t nc) {
+            pack_b<T, TransposeM2>(m2, m2_cols, pc, kc, jc, nc, packed_b.data());
+            return static_cast<const T *>(packed_b.data());
+        });
+}
+
+/**
+ * res (+)= op(m1) * m2, with m2 already packed by gemm::pack_matrix
+ */
+template <typename T, bool TransposeM1 = false>
+requires(std::is_same_v<T, double> || std::is_same_v<T, float>) void packed_mat_mul(
+    const T *m1, const gemm::PackedMatrix<T> &m2, T *res, int m1_rows, int m1_cols,
+    bool accumulate = false) {
+    using namespace gemm;
+
+    static_assert(NC % NR<T> == 0);
+
+    size_t m = TransposeM1 ? m1_cols : m1_rows;
+    assert(m2.k == static_cast<size_t>(TransposeM1 ? m1_rows : m1_cols));
+
+    blocked_mat_mul<T, TransposeM1>(
+        m1, m1_cols, res, m, m2.k, m2.n, accumulate, [&](size_t jc, size_t pc, size_t, size_t nc) {
+            // The previous column blocks are NC wide (a multiple of NR), then the panels of this
+            // column block with rows before pc
+            return &m2.data[jc * m2.k + packed_panel_size<T>(pc, nc)];
+        });
+}
+
+/**
+ * Matrix-vector product, for a product in which op(m1) has a single row or op(m2) a single column.
+ * Returns false (and does nothing) if the product is not of this kind.
+ */
+template <typename T, bool TransposeM1 = false, bool TransposeM2 = false>
+requires(std::is_same_v<T, double> || std::is_same_v<T, float>) bool native_mat_vec(
+    const T *m1, const T *m2, T *res, int m1_rows, int m1_cols, int m2_rows, int m2_cols,
+    bool accumulate = false) {
+    using namespace gemm;
+
+    size_t m = TransposeM1 ? m1_cols : m1_rows;
+    size_t k = TransposeM1 ? m1_rows : m1_cols;
+    size_t n = TransposeM2 ? m2_rows : m2_cols;
+
+    // A single row or column is contiguous, transposed or not
+    if (m == 1) {
+        // res[1 x n] = m1 * op(m2)
+        if constexpr (TransposeM2) {
+            gemv_dot<T>(m2, m1, res, n, k, accumulate);
+        } else {
+            gemv_axpy<T>(m2, m1, res, k, n, accumulate);
+        }
+        return true;
+    }
+    if (n == 1) {
+        // res[m x 1] = op(m1) * m2
+        if constexpr (TransposeM1) {
+            gemv_axpy<T>(m1, m2, res, k, m, accumulate);
+        } else {
+            gemv_dot<T>(m1, m2, res, m, k, accumulate);
+        }
+        return true;
+    }
+    return false;
+}
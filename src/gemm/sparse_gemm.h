@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gemm.h"
+
+/**
+ * Products between a sparse matrix in CSR format and dense row major matrices.
+ *
+ * The dense operands are seen as a set of rows n elements long (for a layer: one column for each
+ * item of the batch, see sparse_mat_mul_wrapper), so each non zero of the sparse matrix is an
+ * AXPY, or a dot product, between two contiguous rows, and the zeros are skipped entirely.
+ */
+namespace gemm {
+    /**
+     * Position of the non zeros of a rows x cols matrix, the values are stored apart. The non zeros
+     * of row r are in [row_ptr[r], row_ptr[r + 1]), with increasing col_idx.
+     */
+    struct CsrPattern {
+        size_t rows{0};
+        size_t cols{0};
+        std::vector<uint32_t> row_ptr{};
+        std::vector<uint32_t> col_idx{};
+
+        size_t nnz() const { return col_idx.size(); }
+    };
+
+    // y[0, n) += w * x[0, n)
+    template <typename T>
+    inline void axpy_row(T w, const T *x, T *y, size_t n) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        simd_type<T> v = _mm256_set1_px(w);
+        size_t j = 0;
+        for (; j + W <= n; j += W) {
+            _mm256_storeu_px(y + j,
+                             _mm256_fmadd_px<T>(v, _mm256_loadu_px(x + j), _mm256_loadu_px(y + j)));
+        }
+        for (; j < n; ++j) {
+            y[j] += w * x[j];
+        }
+    }
+
+    /**
+     * res[rows x n] (+)= S * d, d is cols x n
+     */
+    template <typename T>
+    inline void sparse_mat_mul(const CsrPattern &pattern,
+                               const T *values,
+                               const T *d,
+                               T *res,
+                               size_t n,
+                               bool accumulate) {
+        if (n == 1) {
+            // A single vector: one (gathered) dot product for each row
+            for (size_t r = 0; r < pattern.rows; ++r) {
+                T sum{0};
+                for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                    sum += values[p] * d[pattern.col_idx[p]];
+                }
+                res[r] = accumulate ? res[r] + sum : sum;
+            }
+            return;
+        }
+        if (!accumulate) {
+            std::fill_n(res, pattern.rows * n, T{0});
+        }
+        for (size_t r = 0; r < pattern.rows; ++r) {
+            T *res_row = res + r * n;
+            for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                axpy_row<T>(values[p], d + pattern.col_idx[p] * n, res_row, n);
+            }
+        }
+    }
+
+    /**
+     * res[cols x n] (+)= S^T * d, d is rows x n.
+     * The rows of S are scattered on the rows of res, S^T is never built.
+     */
+    template <typename T>
+    inline void sparse_mat_mul_transposed(const CsrPattern &pattern,
+                                          const T *values,
+                                          const T *d,
+                                          T *res,
+                                          size_t n,
+                                          bool accumulate) {
+        if (!accumulate) {
+            std::fill_n(res, pattern.cols * n, T{0});
+        }
+        if (n == 1) {
+            // A single vector: plain scatter, the zeros of d are skipped
+            for (size_t r = 0; r < pattern.rows; ++r) {
+                T x = d[r];
+                if (x == T{0}) {
+                    continue;
+                }
+                for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                    res[pattern.col_idx[p]] += values[p] * x;
+                }
+            }
+            return;
+        }
+        for (size_t r = 0; r < pattern.rows; ++r) {
+            const T *d_row = d + r * n;
+            for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                axpy_row<T>(values[p], d_row, res + pattern.col_idx[p] * n, n);
+            }
+        }
+    }
+
+    /**
+     * res_values (+)= (a * b^T) sampled on the non zeros of the pattern, a is rows x n and b is
+     * cols x n. This is the gradient of the sparse matrix: only the entries that are kept are
+     * computed.
+     */
+    template <typename T>
+    inline void sampled_mat_mul(const CsrPattern &pattern,
+                                const T *a,
+                                const T *b,
+                                T *res_values,
+                                size_t n,
+                                bool accumulate) {
+        constexpr size_t W = avx_constants::intrinsic_size<T>;
+        for (size_t r = 0; r < pattern.rows; ++r) {
+            const T *a_row = a + r * n;
+            for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                const T *b_row = b + pattern.col_idx[p] * n;
+                simd_type<T> acc = avx_constants::zero<T>;
+                size_t j = 0;
+                for (; j + W <= n; j += W) {
+                    acc = _mm256_fmadd_px<T>(
+                        _mm256_loadu_px(a_row + j), _mm256_loadu_px(b_row + j), acc);
+                }
+                T sum = horizontal_sum<T>(acc);
+                for (; j < n; ++j) {
+                    sum += a_row[j] * b_row[j];
+                }
+                res_values[p] = accumulate ? res_values[p] + sum : sum;
+            }
+        }
+    }
+} // namespace gemm
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include "expressions/expression.h"
+#include "tensor_pool.h"
+
+/**
+ * A full training step (forward, loss, backward and optimizer update) captured once, with fixed
+ * shapes, and then replayed on new input data.
+ *
+ * - The expression graph is built only once at capture time. The input variables are shared with
+ *   the graph, so writing new data into them is enough to feed the next step.
+ * - The parameters are collected once, by the optimizer, at construction time.
+ * - Each replay opens a TensorPoolScope, and the pool is retained between the replays, so the
+ *   buffers allocated by the first steps (forward temporaries, im2col copies, gradients, optimizer
+ *   temporaries) are recycled by all the following ones instead of being reallocated. The code
+ *   running between two replays does not use the pool.
+ */
+template <typename Graph, typename Loss, typename Optimizer>
+class CapturedTrainingStep {
+    Graph graph;
+    Loss &loss;
+    Optimizer &optimizer;
+    RetainedTensorPool pool{};
+
+  public:
+    CapturedTrainingStep(const Graph &graph, Loss &loss, Optimizer &optimizer)
+        : graph{graph}, loss{loss}, optimizer{optimizer} {}
+
+    /**
+     * Run the captured step on the data currently stored in the input variables.
+     * Returns the argmax of the prediction (of the first batch element)
+     */
+    size_t replay(const std::vector<size_t> &classes_idx, size_t batch_size) {
+        TensorPoolScope scope{};
+        size_t prediction = loss.template forward<true>(graph);
+        loss.backward(graph, classes_idx);
+        optimizer.optimize(batch_size);
+        return prediction;
+    }
+};
+
+template <typename Expr, typename Loss, typename Optimizer>
+auto capture_training_step(const DExpr<Expr> &graph, Loss &loss, Optimizer &optimizer) {
+    return CapturedTrainingStep<Expr, Loss, Optimizer>(
+        static_cast<const Expr &>(graph), loss, optimizer);
+}
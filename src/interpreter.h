@@ -2,6 +2,7 @@
 
 #include "metaprogramming/stack.h"
 #include "expressions/expression.h"
+#include "expressions/common_subexpressions.h"
 #include "constants.h"
 
 #include <immintrin.h>
@@ -10,10 +11,14 @@
 #include "avx/avx_wrapper.h"
 
 #include "blas_wrapper.h"
+#include "gemm/frozen_matrix.h"
+#include "gemm/sparse_gemm.h"
 template <typename DType, size_t N>
 class DataStack {
     size_t stack_index{0};
     simd_type<DType> avx_stack[N];
+    // The repeated leaves, see LOAD_KEEP_OP
+    simd_type<DType> saved_registers[ops::N_SAVED_REGISTERS];
 
   public:
     void push(simd_type<DType> val) {
@@ -25,12 +30,25 @@ class DataStack {
         return avx_stack[stack_index];
     }
     void reset() { stack_index = 0; }
+
+    void save(size_t slot, simd_type<DType> val) { saved_registers[slot] = val; }
+    simd_type<DType> saved(size_t slot) const { return saved_registers[slot]; }
 };
 
 template <typename DType, size_t instruction, typename RegisterType, typename DataBuffer>
 inline void execute_instruction_avx(DataBuffer &data_pointers, RegisterType &registers, size_t i) {
     if constexpr (instruction == ops::VARIABLE_OP) {
         registers.push(_mm256_loadu_px(&data_pointers.get_next_variable()[i]));
+    } else if constexpr (ops::is_load_keep_op(instruction)) {
+        auto r1 = _mm256_loadu_px(&data_pointers.get_next_variable()[i]);
+        registers.save(instruction - ops::LOAD_KEEP_OP<0>, r1);
+        registers.push(r1);
+    } else if constexpr (ops::is_reuse_op(instruction)) {
+        registers.push(registers.saved(instruction - ops::REUSE_OP<0>));
+    } else if constexpr (instruction == ops::DUP_OP) {
+        auto r1 = registers.pop();
+        registers.push(r1);
+        registers.push(r1);
     } else if constexpr (instruction == ops::SUM_OP) {
         auto r2 = registers.pop();
         auto r1 = registers.pop();
@@ -57,6 +75,20 @@ inline void execute_instruction_avx(DataBuffer &data_pointers, RegisterType &reg
         auto r2 = registers.pop();
         auto r1 = registers.pop();
         registers.push(_mm256_fmadd_px<DType>(r2, r3, r1));
+    } else if constexpr (instruction == ops::FMS_OP) {
+        auto r3 = registers.pop();
+        auto r2 = registers.pop();
+        auto r1 = registers.pop();
+        registers.push(_mm256_fmsub_px<DType>(r1, r2, r3));
+    } else if constexpr (instruction == ops::FNMA_OP) {
+        auto r3 = registers.pop();
+        auto r2 = registers.pop();
+        auto r1 = registers.pop();
+        registers.push(_mm256_fnmadd_px<DType>(r2, r3, r1));
+    } else if constexpr (instruction == ops::DIVIDE_SQRT_OP) {
+        auto r2 = registers.pop();
+        auto r1 = registers.pop();
+        registers.push(_mm256_div_sqrt_px<DType>(r1, r2));
     } else if constexpr (instruction == ops::RELU) {
         auto r1 = registers.pop();
         registers.push(_mm256_max_px<DType>(r1, avx_constants::zero<DType>));
@@ -77,6 +109,61 @@ inline void execute_instruction_avx(DataBuffer &data_pointers, RegisterType &reg
     }
 }
 
+/**
+ * All the instructions that can be executed in the fused loop (the saved registers of
+ * LOAD_KEEP_OP and REUSE_OP are used only by the compile-time programs)
+ */
+using ElementwiseInstructions = Stack<ops::VARIABLE_OP,
+                                      ops::DUP_OP,
+                                      ops::SUM_OP,
+                                      ops::DIFF_OP,
+                                      ops::MUL_OP,
+                                      ops::DIVIDE_OP,
+                                      ops::FMA_OP,
+                                      ops::FAM_OP,
+                                      ops::FMS_OP,
+                                      ops::FNMA_OP,
+                                      ops::DIVIDE_SQRT_OP,
+                                      ops::RELU,
+                                      ops::EXP,
+                                      ops::LOG,
+                                      ops::FLIP_SIGN,
+                                      ops::SQRT>;
+
+/**
+ * Same as execute_instruction_avx, but the instruction is known only at runtime
+ */
+template <typename DType, typename RegisterType, typename DataBuffer, size_t... instructions>
+inline void execute_runtime_instruction_avx(size_t instruction,
+                                            DataBuffer &data_pointers,
+                                            RegisterType &registers,
+                                            size_t i,
+                                            Stack<instructions...>) {
+    ((instruction == instructions &&
+      (execute_instruction_avx<DType, instructions>(data_pointers, registers, i), true)) ||
+     ...);
+}
+
+/**
+ * Exact depth of the registers stack needed to run a program
+ */
+constexpr size_t get_stack_size(const auto &program) {
+    size_t depth{0};
+    size_t max_depth{0};
+    for (size_t instruction : program) {
+        size_t n_operands = ops::n_operands(instruction);
+        assert(depth >= n_operands);
+        depth = depth - n_operands + 1;
+        max_depth = std::max(max_depth, depth);
+    }
+    return max_depth;
+}
+
+template <size_t... instructions>
+consteval size_t get_stack_size(Stack<instructions...>) {
+    return get_stack_size(std::array<size_t, sizeof...(instructions)>{instructions...});
+}
+
 template <typename T, typename U>
 requires(std::is_same_v<T, double> || std::is_same_v<T, float>) struct InterpretInternal;
 
@@ -86,9 +173,7 @@ requires(std::is_same_v<DType, double> ||
     InterpretInternal() = delete;
     static void eval(auto &&data_pointers, const Tensor<DType> &res) {
 
-        // TODO: this is in an overestimate of the actual stack size needed
-        constexpr size_t registers_stack_size =
-            CountStack<Stack<indices...>, ops::VARIABLE_OP>::value;
+        constexpr size_t registers_stack_size = get_stack_size(Stack<indices...>{});
         DataStack<DType, registers_stack_size> registers;
 
         for (size_t i = 0; i < res.get_size(); i += avx_constants::intrinsic_size<DType>) {
@@ -112,29 +197,100 @@ requires(std::is_same_v<DType, double> ||
     }
 };
 
+// Only the first candidates for the common subexpression elimination are considered, since each
+// one doubles the number of programs that are instantiated
+constexpr size_t MAX_CSE_CANDIDATES = 4;
+
 template <typename SimplifiedExpr>
 class Interpreter {
     Interpreter() = delete;
     using DExprStack = typename DExpr<SimplifiedExpr>::template Flatten<true>::Type;
 
+    using Candidates = CommonSubexpressions<SimplifiedExpr>;
+    static constexpr size_t N_CANDIDATES = std::min(Candidates::LIST.size(), MAX_CSE_CANDIDATES);
+
+    // Mask of the candidates whose two copies have exactly the same tensors
+    template <typename DType, size_t N>
+    static size_t get_candidates_mask(const DataBuffer<DType, N> &data_pointers) {
+        static_assert(N == Candidates::N_HANDLES);
+        size_t mask{0};
+        for (size_t c = 0; c < N_CANDIDATES; ++c) {
+            const RepeatedOperand &candidate = Candidates::LIST[c];
+            bool is_repeated{true};
+            for (size_t k = 0; k < candidate.n_handles; ++k) {
+                is_repeated = is_repeated && data_pointers.is_same_tensor(candidate.first + k,
+                                                                          candidate.second + k);
+            }
+            mask |= static_cast<size_t>(is_repeated) << c;
+        }
+        return mask;
+    }
+
+    template <size_t MASK, typename DType, size_t N>
+    static void call_with_program(DataBuffer<DType, N> &data_pointers, auto &&f) {
+        if constexpr (MASK == 0) {
+            f.template operator()<DExprStack>(data_pointers);
+        } else {
+            using Program = CommonSubexpressionsProgram<SimplifiedExpr, MASK>;
+            auto program_data_pointers =
+                data_pointers.select(get_kept_handles<N, Program::KEPT>());
+            f.template operator()<typename Program::Type>(program_data_pointers);
+        }
+    }
+
+    template <typename DType, size_t N, size_t... masks>
+    static void dispatch(size_t mask,
+                         DataBuffer<DType, N> &data_pointers,
+                         auto &&f,
+                         std::index_sequence<masks...>) {
+        ((mask == masks && (call_with_program<masks>(data_pointers, f), true)) || ...);
+    }
+
+    /**
+     * Calls f<Program>(program_data_pointers) with the program in which all the repeated
+     * subexpressions are eliminated
+     */
+    template <typename DType, size_t N>
+    static void with_program(DataBuffer<DType, N> &data_pointers, auto &&f) {
+        if constexpr (N_CANDIDATES == 0) {
+            f.template operator()<DExprStack>(data_pointers);
+        } else {
+            dispatch(get_candidates_mask(data_pointers),
+                     data_pointers,
+                     f,
+                     std::make_index_sequence<(size_t{1} << N_CANDIDATES)>{});
+        }
+    }
+
   public:
     template <typename Expr>
     static Tensor<typename Expr::DType> interpret(const DExpr<Expr> &expression) {
+        using DType = typename Expr::DType;
         auto data_pointers = expression.collect_tensor_handles();
-        Tensor<typename Expr::DType> res{data_pointers.get_max_shape()};
+        Tensor<DType> res{data_pointers.get_max_shape()};
 
-        InterpretInternal<typename Expr::DType, DExprStack>::eval(data_pointers, res);
+        with_program(data_pointers, [&]<typename Program>(auto &program_data_pointers) {
+            InterpretInternal<DType, Program>::eval(program_data_pointers, res);
+        });
         return res;
     }
     template <typename Expr>
     static void interpret(const DExpr<Expr> &expression, const Tensor<typename Expr::DType> &res) {
+        using DType = typename Expr::DType;
         auto data_pointers = expression.collect_tensor_handles();
-        InterpretInternal<typename Expr::DType, DExprStack>::eval(data_pointers, res);
+        with_program(data_pointers, [&]<typename Program>(auto &program_data_pointers) {
+            InterpretInternal<DType, Program>::eval(program_data_pointers, res);
+        });
     }
     template <typename Expr>
     static ConstTensor<typename Expr::DType> const_interpret(const DExpr<Expr> &expression) {
+        using DType = typename Expr::DType;
         auto data_pointers = expression.collect_tensor_handles();
-        return InterpretInternal<typename Expr::DType, DExprStack>::const_eval(data_pointers);
+        ConstTensor<DType> res{};
+        with_program(data_pointers, [&]<typename Program>(auto &program_data_pointers) {
+            res = InterpretInternal<DType, Program>::const_eval(program_data_pointers);
+        });
+        return res;
     }
 };
 
@@ -278,4 +434,363 @@ static inline Tensor<DType> mat_mul_wrapper(const ConstTensor<DType> &t1,
 
     res.wrap_for_broadcasting();
     return res;
-}
\ No newline at end of file
+}
+/**
+ * Batched matrix multiplication, t1 [..., N, K] times t2 [..., K, M]. The transposes apply to the
+ * matrices of each batch item.
+ * There is one GEMM call per batch item, on the matrices stored contiguously in t1, t2 and res.
+ * When the product of a batch item is too small to be split by BLAS (e.g. the groups of a grouped
+ * convolution), the batch items are split between the threads instead, and each GEMM call is
+ * single threaded.
+ */
+template <typename DType, bool transpose_t1 = false, bool transpose_t2 = false>
+static inline Tensor<DType> batch_mat_mul_wrapper(const ConstTensor<DType> &t1,
+                                                  const ConstTensor<DType> &t2,
+                                                  const Shape &res_shape) {
+    Tensor<DType> res{res_shape};
+
+    const auto &t1_s = t1.get_shape();
+    const auto &t2_s = t2.get_shape();
+    size_t d = t1_s.get_dimension();
+
+    size_t t1_row = t1_s[d - 2];
+    size_t t1_col = t1_s[d - 1];
+    size_t t2_row = t2_s[d - 2];
+    size_t t2_col = t2_s[d - 1];
+    size_t res_matrix_size = res_shape[d - 2] * res_shape[d - 1];
+    size_t batch_size = res.get_size() / res_matrix_size;
+
+    auto multiply = [&](size_t b_begin, size_t b_end) {
+        for (size_t b = b_begin; b < b_end; ++b) {
+            blas_mat_mul<DType, transpose_t1, transpose_t2>(&t1[b * t1_row * t1_col],
+                                                            &t2[b * t2_row * t2_col],
+                                                            &res[b * res_matrix_size],
+                                                            t1_row,
+                                                            t1_col,
+                                                            t2_row,
+                                                            t2_col);
+        }
+    };
+    size_t item_flops = res_matrix_size * (transpose_t1 ? t1_row : t1_col);
+    if (threading::threads_for(item_flops) == 1) {
+        // Set here, the calls made by the threads find it already set
+        threading::set_blas_threads(1);
+        threading::parallel_for(batch_size, item_flops, multiply);
+    } else {
+        multiply(0, batch_size);
+    }
+
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * Grouped matrix multiplication, t1, t2 and res are 2d: each stacks groups matrices along its
+ * rows, and the matrix g of res is the product of the matrices g of t1 and t2 (e.g. the grouped
+ * convolutions). There is one GEMM call per group.
+ */
+template <typename DType, bool transpose_t1 = false, bool transpose_t2 = false>
+static inline Tensor<DType> grouped_mat_mul_wrapper(ConstTensor<DType> t1,
+                                                    ConstTensor<DType> t2,
+                                                    const Shape &res_shape,
+                                                    size_t groups) {
+    if (groups == 1) {
+        return mat_mul_wrapper<DType, transpose_t1, transpose_t2>(t1, t2, res_shape);
+    }
+    t1.set_shape({groups, t1.get_shape()[0] / groups, t1.get_shape()[1]});
+    t2.set_shape({groups, t2.get_shape()[0] / groups, t2.get_shape()[1]});
+    Tensor<DType> res = batch_mat_mul_wrapper<DType, transpose_t1, transpose_t2>(
+        t1, t2, {groups, res_shape[0] / groups, res_shape[1]});
+    res.set_shape(res_shape);
+    return res;
+}
+
+// Side of the square tiles of transpose_matrix, a tile of the source and one of the destination
+// fit in L1
+constexpr size_t TRANSPOSE_BLOCK = 64;
+
+/**
+ * dst = src^T, for a row major matrix with the given rows and cols.
+ * The matrix is split in tiles to keep both the reads and the writes in cache, inside a tile the
+ * square blocks of intrinsic_size<T> elements are transposed in registers.
+ */
+template <typename T>
+inline void transpose_matrix(const T *src, T *dst, size_t rows, size_t cols) {
+    constexpr size_t W = avx_constants::intrinsic_size<T>;
+    for (size_t ib = 0; ib < rows; ib += TRANSPOSE_BLOCK) {
+        size_t ie = std::min(ib + TRANSPOSE_BLOCK, rows);
+        for (size_t jb = 0; jb < cols; jb += TRANSPOSE_BLOCK) {
+            size_t je = std::min(jb + TRANSPOSE_BLOCK, cols);
+
+            size_t i = ib;
+            for (; i + W <= ie; i += W) {
+                size_t j = jb;
+                for (; j + W <= je; j += W) {
+                    simd_type<T> block[W];
+                    for (size_t k = 0; k < W; ++k) {
+                        block[k] = _mm256_loadu_px(&src[(i + k) * cols + j]);
+                    }
+                    _mm256_transpose_px<T>(block);
+                    for (size_t k = 0; k < W; ++k) {
+                        _mm256_storeu_px(&dst[(j + k) * rows + i], block[k]);
+                    }
+                }
+                for (; j < je; ++j) {
+                    for (size_t k = 0; k < W; ++k) {
+                        dst[j * rows + i + k] = src[(i + k) * cols + j];
+                    }
+                }
+            }
+            for (; i < ie; ++i) {
+                for (size_t j = jb; j < je; ++j) {
+                    dst[j * rows + i] = src[i * cols + j];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Swaps the last two dimensions of t, for each of the matrices in the leading dimensions
+ */
+template <typename DType>
+static inline Tensor<DType> transpose_wrapper(const ConstTensor<DType> &t) {
+    const Shape &t_s = t.get_shape();
+    size_t d = t_s.get_dimension();
+    Tensor<DType> res{Shape::get_transpose_shape(t_s)};
+
+    size_t rows = t_s[d - 2];
+    size_t cols = t_s[d - 1];
+    for (size_t offset = 0; offset < t.get_size(); offset += rows * cols) {
+        transpose_matrix<DType>(&t[offset], &res[offset], rows, cols);
+    }
+
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * t [..., K] times the sparse matrix m [K, N], pattern is the CSR of m^T (see SparseVariable).
+ * The batch is moved to the columns (t^T [K, batch]), so that each non zero of m is a SIMD AXPY
+ * between two rows batch elements long. A single vector does not need the transposes.
+ */
+template <typename DType>
+static inline Tensor<DType> sparse_mat_mul_wrapper(const ConstTensor<DType> &t,
+                                                   const gemm::CsrPattern &pattern,
+                                                   const ConstTensor<DType> &values) {
+    const Shape &t_s = t.get_shape();
+    size_t k = pattern.cols;
+    size_t n = pattern.rows;
+    assert(t_s.last() == k);
+    Tensor<DType> res{Shape::get_matmul_shape<false, false>(t_s, Shape{k, n})};
+    size_t batch = t.get_size() / k;
+
+    if (batch == 1) {
+        gemm::sparse_mat_mul<DType>(pattern, &values[0], &t[0], &res[0], 1, false);
+    } else {
+        Tensor<DType> t_t{k, batch};
+        Tensor<DType> res_t{n, batch};
+        transpose_matrix<DType>(&t[0], &t_t[0], batch, k);
+        gemm::sparse_mat_mul<DType>(pattern, &values[0], &t_t[0], &res_t[0], batch, false);
+        transpose_matrix<DType>(&res_t[0], &res[0], n, batch);
+    }
+
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * Backward step of sparse_mat_mul_wrapper: returns the gradient of t, and accumulates the gradient
+ * of the non zeros on values_grad (if it is not null). The pruned entries have no gradient.
+ */
+template <typename DType>
+static inline Tensor<DType> sparse_mat_mul_backward(const Tensor<DType> &grad,
+                                                    const ConstTensor<DType> &t,
+                                                    const gemm::CsrPattern &pattern,
+                                                    const ConstTensor<DType> &values,
+                                                    DType *values_grad) {
+    size_t k = pattern.cols;
+    size_t n = pattern.rows;
+    Tensor<DType> t_grad{t.get_shape()};
+    size_t batch = t.get_size() / k;
+
+    if (batch == 1) {
+        gemm::sparse_mat_mul_transposed<DType>(pattern, &values[0], &grad[0], &t_grad[0], 1, false);
+        if (values_grad != nullptr) {
+            gemm::sampled_mat_mul<DType>(pattern, &grad[0], &t[0], values_grad, 1, true);
+        }
+    } else {
+        Tensor<DType> t_t{k, batch};
+        Tensor<DType> grad_t{n, batch};
+        Tensor<DType> t_grad_t{k, batch};
+        transpose_matrix<DType>(&t[0], &t_t[0], batch, k);
+        transpose_matrix<DType>(&grad[0], &grad_t[0], batch, n);
+        gemm::sparse_mat_mul_transposed<DType>(
+            pattern, &values[0], &grad_t[0], &t_grad_t[0], batch, false);
+        transpose_matrix<DType>(&t_grad_t[0], &t_grad[0], k, batch);
+        if (values_grad != nullptr) {
+            gemm::sampled_mat_mul<DType>(pattern, &grad_t[0], &t_t[0], values_grad, batch, true);
+        }
+    }
+
+    t_grad.wrap_for_broadcasting();
+    return t_grad;
+}
+
+/**
+ * The sparse input x [rows, K] times t [K, N]: each non zero of x is a SIMD AXPY of a row of t
+ */
+template <typename DType>
+static inline Tensor<DType> sparse_input_mat_mul_wrapper(const gemm::CsrPattern &pattern,
+                                                         const std::vector<DType> &values,
+                                                         const ConstTensor<DType> &t) {
+    size_t k = pattern.cols;
+    assert(t.get_shape().first() == k);
+    size_t n = t.get_size() / k;
+    Tensor<DType> res{pattern.rows, n};
+
+    gemm::sparse_mat_mul<DType>(pattern, values.data(), &t[0], &res[0], n, false);
+
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * Gradient of t in sparse_input_mat_mul_wrapper, x^T * grad: only the rows of t that are hit by a
+ * non zero of x get a non zero gradient. With accumulate the gradient is added to t_grad, and
+ * only the rows hit by x are written.
+ */
+template <typename DType>
+static inline void sparse_input_mat_mul_backward(const Tensor<DType> &grad,
+                                                 const gemm::CsrPattern &pattern,
+                                                 const std::vector<DType> &values,
+                                                 Tensor<DType> &t_grad,
+                                                 bool accumulate) {
+    size_t n = t_grad.get_size() / pattern.cols;
+
+    gemm::sparse_mat_mul_transposed<DType>(
+        pattern, values.data(), &grad[0], &t_grad[0], n, accumulate);
+
+    t_grad.wrap_for_broadcasting();
+}
+
+template <typename DType>
+static inline Tensor<DType> sparse_input_mat_mul_backward(const Tensor<DType> &grad,
+                                                          const gemm::CsrPattern &pattern,
+                                                          const std::vector<DType> &values,
+                                                          const Shape &t_shape) {
+    Tensor<DType> t_grad{t_shape};
+    sparse_input_mat_mul_backward<DType>(grad, pattern, values, t_grad, false);
+    return t_grad;
+}
+
+/**
+ * mat_mul_wrapper with a frozen right operand
+ */
+template <typename DType, bool transpose_t1 = false, bool transpose_t2 = false>
+static inline Tensor<DType> mat_mul_wrapper(const ConstTensor<DType> &t1,
+                                            const FrozenMatrix<DType> &t2,
+                                            const Shape &res_shape) {
+    Tensor<DType> res{res_shape};
+
+    const auto &t1_s = t1.get_shape();
+    size_t t1_row = t1_s.get_dimension() == 1 ? t1_s.get_size() : t1_s.get_size() / t1_s.last();
+    size_t t1_col = t1_s.get_size() / t1_row;
+
+    t2.template mat_mul<transpose_t1, transpose_t2>(&t1[0], &res[0], t1_row, t1_col, false);
+
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+// Size of the output panels of linear_wrapper, a panel is still in cache when its epilogue runs
+constexpr size_t LINEAR_PANEL_BYTES = 1 << 17;
+constexpr size_t LINEAR_PANEL_MIN_ROWS = 32;
+
+/**
+ * matmul(t1, t2) + bias, followed by a relu if requested.
+ *
+ * The output is computed by row panels: each panel is initialized with the bias, the matrix
+ * multiplication accumulates on it (so the bias add is done by the GEMM), and the relu is applied
+ * while the panel is still in cache.
+ */
+template <typename DType, bool transpose_t1, bool transpose_t2, bool relu>
+static inline Tensor<DType> linear_wrapper(const ConstTensor<DType> &t1,
+                                           const ConstTensor<DType> &t2,
+                                           const ConstTensor<DType> &bias,
+                                           const Shape &res_shape,
+                                           const FrozenMatrix<DType> *frozen_t2 = nullptr) {
+    assert(Shape::are_broadcastable(res_shape, bias.get_shape()));
+    // The bias is bigger than the product, the result is not a matrix product with an epilogue
+    if (Shape::get_broadcasted_shape(res_shape, bias.get_shape()) != res_shape) {
+        using ops::VARIABLE_OP;
+        using Program = std::conditional_t<relu,
+                                           Stack<VARIABLE_OP, VARIABLE_OP, ops::SUM_OP, ops::RELU>,
+                                           Stack<VARIABLE_OP, VARIABLE_OP, ops::SUM_OP>>;
+        Tensor<DType> product =
+            mat_mul_wrapper<DType, transpose_t1, transpose_t2>(t1, t2, res_shape);
+        Tensor<DType> res{bias.get_shape()};
+        InterpretInternal<DType, Program>::eval(make_data_buffer<DType>(product, bias), res);
+        return res;
+    }
+
+    Tensor<DType> res{res_shape};
+
+    const auto &t1_s = t1.get_shape();
+    const auto &t2_s = t2.get_shape();
+
+    // Same convention of mat_mul_wrapper
+    size_t t1_row = t1_s.get_dimension() == 1 ? t1_s.get_size() : t1_s.get_size() / t1_s.last();
+    size_t t1_col = t1_s.get_size() / t1_row;
+
+    size_t t2_row = t2_s.first();
+    size_t t2_col = t2_s.get_size() / t2_row;
+
+    size_t res_rows = transpose_t1 ? t1_col : t1_row;
+    size_t res_cols = res.get_size() / res_rows;
+    // The rows of a transposed t1 are not contiguous, in that case there is a single panel
+    size_t panel_rows =
+        transpose_t1
+            ? res_rows
+            : std::max(LINEAR_PANEL_MIN_ROWS, LINEAR_PANEL_BYTES / (res_cols * sizeof(DType)));
+
+    size_t bias_size = bias.get_size();
+    for (size_t row = 0; row < res_rows; row += panel_rows) {
+        size_t n_rows = std::min(panel_rows, res_rows - row);
+        size_t begin = row * res_cols;
+        size_t end = begin + n_rows * res_cols;
+
+        // The bias is broadcasted over the rows
+        size_t j = begin % bias_size;
+        for (size_t i = begin; i < end; ++i) {
+            res[i] = bias[j];
+            j = j + 1 == bias_size ? 0 : j + 1;
+        }
+
+        const DType *m1 = &t1[transpose_t1 ? 0 : row * t1_col];
+        size_t m1_rows = transpose_t1 ? t1_row : n_rows;
+        if (frozen_t2 != nullptr && !frozen_t2->empty()) {
+            frozen_t2->template mat_mul<transpose_t1, transpose_t2>(
+                m1, &res[begin], m1_rows, t1_col, /*accumulate=*/true);
+        } else {
+            blas_mat_mul<DType, transpose_t1, transpose_t2>(
+                m1, &t2[0], &res[begin], m1_rows, t1_col, t2_row, t2_col, /*accumulate=*/true);
+        }
+
+        if constexpr (relu) {
+            size_t i = begin;
+            for (; i + avx_constants::intrinsic_size<DType> <= end;
+                 i += avx_constants::intrinsic_size<DType>) {
+                _mm256_storeu_px(&res[i],
+                                 _mm256_max_px<DType>(_mm256_loadu_px(&res[i]),
+                                                      avx_constants::zero<DType>));
+            }
+            for (; i < end; ++i) {
+                res[i] = std::max(res[i], static_cast<DType>(0));
+            }
+        }
+    }
+
+    res.wrap_for_broadcasting();
+    return res;
+}
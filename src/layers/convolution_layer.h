@@ -12,16 +12,32 @@ class ConvolutionLayer1D {
 
     size_t stride;
     size_t padding;
+    size_t dilation;
+    size_t groups;
+
+    // Layout of x and of the output, it is not serialized: the parameters do not depend on it
+    ConvolutionLayout layout;
 
   public:
-    ConvolutionLayer1D(
-        size_t in_channels, size_t out_channels, size_t kernel_size, size_t stride, size_t padding)
-        : k{{out_channels, in_channels, kernel_size}}, q{{out_channels}}, stride{stride},
-          padding{padding} {}
+    ConvolutionLayer1D(size_t in_channels,
+                       size_t out_channels,
+                       size_t kernel_size,
+                       size_t stride,
+                       size_t padding,
+                       size_t dilation = 1,
+                       size_t groups = 1,
+                       ConvolutionLayout layout = ConvolutionLayout::CHANNELS_FIRST)
+        : k{{out_channels, in_channels / groups, kernel_size}}, q{{out_channels}}, stride{stride},
+          padding{padding}, dilation{dilation}, groups{groups}, layout{layout} {}
 
     template <typename Expr>
     auto forward(const Expr &x) {
-        return conv_1d(k, x, q).set_stride(stride).set_padding(padding);
+        return conv_1d(k, x, q)
+            .set_stride(stride)
+            .set_padding(padding)
+            .set_dilation(dilation)
+            .set_groups(groups)
+            .set_layout(layout);
     }
 
     template <typename Stream>
@@ -30,6 +46,8 @@ class ConvolutionLayer1D {
         q.serialize(stream);
         stream.write(stride);
         stream.write(padding);
+        stream.write(dilation);
+        stream.write(groups);
     }
     template <typename Stream>
     void deserialize(Stream &stream) {
@@ -37,6 +55,8 @@ class ConvolutionLayer1D {
         q.deserialize(stream);
         stream.read(stride);
         stream.read(padding);
+        stream.read(dilation);
+        stream.read(groups);
     }
 };
 
@@ -53,6 +73,14 @@ class ConvolutionLayer2D {
     size_t padding_x;
     size_t padding_y;
 
+    size_t dilation_x;
+    size_t dilation_y;
+
+    size_t groups;
+
+    // Layout of x and of the output, it is not serialized: the parameters do not depend on it
+    ConvolutionLayout layout;
+
   public:
     ConvolutionLayer2D(size_t in_channels,
                        size_t out_channels,
@@ -61,13 +89,23 @@ class ConvolutionLayer2D {
                        size_t stride_x,
                        size_t stride_y,
                        size_t padding_x,
-                       size_t padding_y)
-        : k{{out_channels, in_channels, kernel_size_x, kernel_size_y}}, q{{out_channels}},
-          stride_x{stride_x}, stride_y{stride_y}, padding_x{padding_x}, padding_y{padding_y} {}
+                       size_t padding_y,
+                       size_t dilation_x = 1,
+                       size_t dilation_y = 1,
+                       size_t groups = 1,
+                       ConvolutionLayout layout = ConvolutionLayout::CHANNELS_FIRST)
+        : k{{out_channels, in_channels / groups, kernel_size_x, kernel_size_y}}, q{{out_channels}},
+          stride_x{stride_x}, stride_y{stride_y}, padding_x{padding_x}, padding_y{padding_y},
+          dilation_x{dilation_x}, dilation_y{dilation_y}, groups{groups}, layout{layout} {}
 
     template <typename Expr>
     auto forward(const Expr &x) {
-        return conv_2d(k, x, q).set_stride(stride_x, stride_y).set_padding(padding_x, padding_y);
+        return conv_2d(k, x, q)
+            .set_stride(stride_x, stride_y)
+            .set_padding(padding_x, padding_y)
+            .set_dilation(dilation_x, dilation_y)
+            .set_groups(groups)
+            .set_layout(layout);
     }
 
     template <typename Stream>
@@ -78,6 +116,9 @@ class ConvolutionLayer2D {
         stream.write(stride_y);
         stream.write(padding_x);
         stream.write(padding_y);
+        stream.write(dilation_x);
+        stream.write(dilation_y);
+        stream.write(groups);
     }
     template <typename Stream>
     void deserialize(Stream &stream) {
@@ -87,5 +128,8 @@ class ConvolutionLayer2D {
         stream.read(stride_y);
         stream.read(padding_x);
         stream.read(padding_y);
+        stream.read(dilation_x);
+        stream.read(dilation_y);
+        stream.read(groups);
     }
 };
\ No newline at end of file
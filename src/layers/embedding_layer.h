@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "../embedding_variable.h"
+#include "../expressions/expression.h"
+
+/**
+ * Lookup table, forward maps n indices to their n rows. The gradient of a step touches only the
+ * rows that were read, see get_sparse_parameters() and the sparse paths of the optimizers.
+ */
+template <typename DType>
+class EmbeddingLayer {
+    EmbeddingVariable<DType> table;
+
+  public:
+    EmbeddingLayer(size_t n_rows, size_t dim) : table{n_rows, dim} {}
+
+    auto forward(std::vector<size_t> indices) { return embedding(table, std::move(indices)); }
+
+    template <typename Stream>
+    void serialize(Stream &stream) const {
+        table.serialize(stream);
+    }
+    template <typename Stream>
+    void deserialize(Stream &stream) {
+        table.deserialize(stream);
+    }
+};
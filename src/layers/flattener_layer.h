@@ -3,6 +3,8 @@
 #include "../expressions/expression.h"
 #include "../tensor.h"
 
+// Flattening is a plain reshape: after a channels-last convolution the features are ordered by
+// position, then by channel, without any transpose
 template <typename DType>
 class FlattenerLayer {
   public:
@@ -2,6 +2,7 @@
 
 #include "../expressions/expression.h"
 #include "../tensor_variable.h"
+#include "sparse_linear_layer.h"
 
 template <typename DType>
 class LinearLayer {
@@ -18,6 +19,15 @@ class LinearLayer {
         return matmul(x, m) + q;
     }
 
+    /**
+     * Magnitude pruning of the weights: the fraction sparsity of the smallest weights is dropped.
+     * The bias is copied, the two layers can be trained independently.
+     */
+    SparseLinearLayer<DType> prune(double sparsity) const {
+        return SparseLinearLayer<DType>{SparseVariable<DType, true>::from_dense(m.tensor, sparsity),
+                                        Variable<DType, true>(q.tensor.clone())};
+    }
+
     template <typename Stream>
     void serialize(Stream &stream) const {
         m.serialize(stream);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../expressions/expression.h"
+#include "../tensor.h"
+
+// A window of 0 elements pools the whole of x (global pooling), a stride of 0 is the size of the
+// window. The pooling layers have no parameters.
+template <typename DType>
+class PoolingLayer1D {
+    PoolingMode mode;
+    size_t window;
+    size_t stride;
+    size_t padding;
+
+    // Layout of x and of the output
+    ConvolutionLayout layout;
+
+  public:
+    PoolingLayer1D(PoolingMode mode,
+                   size_t window,
+                   size_t stride = 0,
+                   size_t padding = 0,
+                   ConvolutionLayout layout = ConvolutionLayout::CHANNELS_FIRST)
+        : mode{mode}, window{window}, stride{stride}, padding{padding}, layout{layout} {}
+
+    template <typename Expr>
+    auto forward(const Expr &x) {
+        return pool_1d(x, mode, window).set_stride(stride).set_padding(padding).set_layout(layout);
+    }
+};
+
+template <typename DType>
+class PoolingLayer2D {
+    PoolingMode mode;
+    size_t window_x;
+    size_t window_y;
+
+    size_t stride_x;
+    size_t stride_y;
+
+    size_t padding_x;
+    size_t padding_y;
+
+    // Layout of x and of the output
+    ConvolutionLayout layout;
+
+  public:
+    PoolingLayer2D(PoolingMode mode,
+                   size_t window_x,
+                   size_t window_y,
+                   size_t stride_x = 0,
+                   size_t stride_y = 0,
+                   size_t padding_x = 0,
+                   size_t padding_y = 0,
+                   ConvolutionLayout layout = ConvolutionLayout::CHANNELS_FIRST)
+        : mode{mode}, window_x{window_x}, window_y{window_y}, stride_x{stride_x},
+          stride_y{stride_y}, padding_x{padding_x}, padding_y{padding_y}, layout{layout} {}
+
+    template <typename Expr>
+    auto forward(const Expr &x) {
+        return pool_2d(x, mode, window_x, window_y)
+            .set_stride(stride_x, stride_y)
+            .set_padding(padding_x, padding_y)
+            .set_layout(layout);
+    }
+};
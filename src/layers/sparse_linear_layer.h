@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../expressions/expression.h"
+#include "../sparse_variable.h"
+#include "../tensor_variable.h"
+
+/**
+ * Linear layer with a sparse weight matrix, usually obtained by pruning a trained LinearLayer (see
+ * LinearLayer::prune). The pruned weights are not stored and are not multiplied.
+ */
+template <typename DType>
+class SparseLinearLayer {
+    // weight matrix
+    SparseVariable<DType, true> m;
+    // bias vector
+    Variable<DType, true> q;
+
+  public:
+    SparseLinearLayer(const SparseVariable<DType, true> &m, const Variable<DType, true> &q)
+        : m{m}, q{q} {}
+
+    template <typename Expr>
+    auto forward(const Expr &x) {
+        return sparse_matmul(x, m) + q;
+    }
+
+    template <typename Stream>
+    void serialize(Stream &stream) const {
+        m.serialize(stream);
+        q.serialize(stream);
+    }
+    template <typename Stream>
+    void deserialize(Stream &stream) {
+        m.deserialize(stream);
+        q.deserialize(stream);
+    }
+};
@@ -16,8 +16,9 @@ template <typename DType>
 class SoftMaxLoss {
   public:
     Tensor<DType> softmax_probabilities;
-    template <bool requires_grad, typename Expr>
-    size_t forward(DExpr<Expr> &expr) {
+    // Graph is either a DExpr or a DynamicGraph
+    template <bool requires_grad, typename Graph>
+    size_t forward(Graph &expr) {
         auto res = requires_grad ? expr.forward().clone() : expr.eval();
         softmax_max_shift(res);
         // std::cout << res.get_shape() << std::endl;
@@ -36,8 +37,8 @@ class SoftMaxLoss {
         return std::max_element(ptr, ptr + softmax_probabilities.get_size()) - ptr;
     }
 
-    template <typename Expr>
-    void backward(DExpr<Expr> &expr, const std::vector<size_t> &classes_idx) {
+    template <typename Graph>
+    void backward(Graph &expr, const std::vector<size_t> &classes_idx) {
         for (size_t b = 0; b < softmax_probabilities.get_shape().get_shape()[0]; ++b) {
             // safety check
             size_t class_idx = classes_idx[b];
@@ -34,6 +34,7 @@
 
 #include <chrono>
 #include "serializer.h"
+#include "graph_capture.h"
 
 template <typename DType>
 class MyModel {
@@ -103,6 +104,10 @@ int main() {
 
     he_initialization(model.get_parameters());
 
+    // The graphs are built only once, and then replayed on new input data
+    auto train_step = capture_training_step(model.forward(x_input_train), loss_computer, optimizer);
+    auto test_graph = model.forward(x_input_test);
+
     for (size_t epoch = 0; epoch < 6 * 50; epoch++) {
         size_t good_preds = 0;
         size_t total_preds = 0;
@@ -117,21 +122,18 @@ int main() {
                 b += 1;
             }
 
-            auto y_predicted = model.forward(x_input_train);
-            loss_computer.forward<true>(y_predicted);
-            loss_computer.backward(y_predicted, y_input_train);
-
-            optimizer.optimize(batch_size);
+            train_step.replay(y_input_train, batch_size);
         });
 
+        // The weights do not change while testing
+        test_graph.freeze();
         test_set.randomIter(1, [&](auto batch) {
             for (const auto &[vx, vy] : batch) {
                 for (size_t i = 0; i < 40; i++) {
                     x_input_test.tensor(0, 0, i) = vx[i];
                 }
 
-                auto y_predicted = model.forward(x_input_test);
-                auto idx = loss_computer.forward<false>(y_predicted);
+                auto idx = loss_computer.forward<false>(test_graph);
                 good_preds += static_cast<size_t>(idx == vy);
                 total_preds += 1;
             }
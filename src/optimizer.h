@@ -2,8 +2,10 @@
 
 #include "tensor.h"
 
+#include <cmath>
 #include <vector>
 #include "tensor_variable.h"
+#include "embedding_variable.h"
 
 template <typename DType>
 class StandardOptimizer {
@@ -12,14 +14,35 @@ class StandardOptimizer {
 
     // Vector of pairs (parameters, gradient)
     std::vector<std::pair<const Tensor<DType> &, const Tensor<DType> &>> parameters;
+    // Parameters with a sparse gradient, only the touched rows are updated
+    std::vector<EmbeddingVariable<DType>> sparse_parameters;
 
   public:
-    StandardOptimizer(DType alpha, size_t batch_size, decltype(parameters) &&params)
-        : alpha{alpha}, parameters{std::move(params)} {};
+    // The batch size of each step is given to optimize
+    StandardOptimizer(DType alpha,
+                      [[maybe_unused]] size_t batch_size,
+                      decltype(parameters) &&params,
+                      decltype(sparse_parameters) &&sparse_params = {})
+        : alpha{alpha}, parameters{std::move(params)},
+          sparse_parameters{std::move(sparse_params)} {};
     void optimize(size_t batch_size) {
         DType corrected_alpha = alpha / static_cast<DType>(batch_size);
         for (const auto &[param, gradient] : parameters) {
-            param -= corrected_alpha * gradient;
+            param -= no_grad(corrected_alpha) * no_grad(gradient);
+            gradient.set_zero();
+        }
+        for (const auto &sparse_param : sparse_parameters) {
+            RowSparseGradient<DType> &gradient = *sparse_param.gradient;
+            size_t dim = gradient.get_dim();
+            for (size_t i = 0; i < gradient.get_rows().size(); ++i) {
+                DType *row = &sparse_param.tensor[gradient.get_rows()[i] * dim];
+                const DType *g = gradient.slot(i);
+                for (size_t j = 0; j < dim; ++j) {
+                    row[j] -= corrected_alpha * g[j];
+                }
+            }
+            // The rows are written directly, the padding of the tensor is restored
+            sparse_param.tensor.wrap_for_broadcasting();
             gradient.set_zero();
         }
     }
@@ -43,11 +66,33 @@ class AdamOptimizer {
     std::vector<Tensor<DType>> momentums;
     std::vector<Tensor<DType>> momentums_sq;
 
+    /**
+     * Parameters with a sparse gradient, lazy Adam: the moments of a row are updated only when the
+     * row is touched, the bias correction uses the global step.
+     */
+    std::vector<EmbeddingVariable<DType>> sparse_parameters;
+    std::vector<Tensor<DType>> sparse_momentums;
+    std::vector<Tensor<DType>> sparse_momentums_sq;
+
   public:
-    AdamOptimizer(
-        DType alpha, DType beta, DType gamma, DType epsilon, decltype(parameters) &&params)
+    AdamOptimizer(DType alpha,
+                  DType beta,
+                  DType gamma,
+                  DType epsilon,
+                  decltype(parameters) &&params,
+                  decltype(sparse_parameters) &&sparse_params = {})
         : alpha{alpha}, beta{beta}, one_minus_beta{one - beta}, gamma{gamma},
-          one_minus_gamma{one - gamma}, epsilon{epsilon}, parameters{std::move(params)} {
+          one_minus_gamma{one - gamma}, epsilon{epsilon}, parameters{std::move(params)},
+          sparse_parameters{std::move(sparse_params)} {
+        for (const auto &sparse_param : sparse_parameters) {
+            Tensor<DType> momentum{sparse_param.tensor.get_shape()};
+            momentum.set_zero();
+            sparse_momentums.push_back(std::move(momentum));
+
+            Tensor<DType> momentum_sq{sparse_param.tensor.get_shape()};
+            momentum_sq.set_zero();
+            sparse_momentums_sq.push_back(std::move(momentum_sq));
+        }
         for (const auto &param : this->parameters) {
             const auto &gradient = param.gradient;
             auto momentum = Tensor<DType>{{gradient.get_shape()}};
@@ -86,6 +131,32 @@ class AdamOptimizer {
             gradient.set_zero();
         }
 
+        DType momentum_scale_inv = one / (one - pow(beta, time_stamp + 1));
+        DType momentum_sq_scale_inv = one / (one - pow(gamma, time_stamp + 1));
+        for (size_t i = 0; i < sparse_parameters.size(); i++) {
+            RowSparseGradient<DType> &gradient = *sparse_parameters[i].gradient;
+            size_t dim = gradient.get_dim();
+            for (size_t r = 0; r < gradient.get_rows().size(); ++r) {
+                size_t offset = gradient.get_rows()[r] * dim;
+                DType *row = &sparse_parameters[i].tensor[offset];
+                DType *momentum = &sparse_momentums[i][offset];
+                DType *momentum_sq = &sparse_momentums_sq[i][offset];
+                const DType *g = gradient.slot(r);
+                for (size_t j = 0; j < dim; ++j) {
+                    DType gradient_norm = g[j] * batch_size_inv;
+                    momentum[j] += one_minus_beta * (gradient_norm - momentum[j]);
+                    momentum_sq[j] +=
+                        one_minus_gamma * (gradient_norm * gradient_norm - momentum_sq[j]);
+                    row[j] -= alpha * (momentum[j] * momentum_scale_inv) /
+                              (std::sqrt(momentum_sq[j] * momentum_sq_scale_inv) + epsilon);
+                }
+            }
+            sparse_parameters[i].tensor.wrap_for_broadcasting();
+            sparse_momentums[i].wrap_for_broadcasting();
+            sparse_momentums_sq[i].wrap_for_broadcasting();
+            gradient.set_zero();
+        }
+
         time_stamp += 1;
     }
 };
@@ -102,9 +173,22 @@ class MomentumOptimizer {
 
     std::vector<Tensor<DType>> momentums;
 
+    // Parameters with a sparse gradient, the momentum of a row is updated only when it is touched
+    std::vector<EmbeddingVariable<DType>> sparse_parameters;
+    std::vector<Tensor<DType>> sparse_momentums;
+
   public:
-    MomentumOptimizer(DType alpha, DType beta, decltype(parameters) &&params)
-        : alpha{alpha}, one_minus_beta{one - beta}, parameters{std::move(params)} {
+    MomentumOptimizer(DType alpha,
+                      DType beta,
+                      decltype(parameters) &&params,
+                      decltype(sparse_parameters) &&sparse_params = {})
+        : alpha{alpha}, one_minus_beta{one - beta}, parameters{std::move(params)},
+          sparse_parameters{std::move(sparse_params)} {
+        for (const auto &sparse_param : sparse_parameters) {
+            Tensor<DType> momentum{sparse_param.tensor.get_shape()};
+            momentum.set_zero();
+            sparse_momentums.push_back(std::move(momentum));
+        }
         for (const auto &[param, gradient] : this->parameters) {
 
             auto momentum = Tensor<DType>{{gradient.get_shape()}};
@@ -121,10 +205,27 @@ class MomentumOptimizer {
 
             const Tensor<DType> &momentum = momentums[i];
 
-            auto gradient_norm = gradient * batch_size_inv;
+            auto gradient_norm = no_grad(gradient) * no_grad(batch_size_inv);
 
-            momentum += one_minus_beta * (gradient_norm - momentum);
-            param -= alpha * momentum;
+            momentum += no_grad(one_minus_beta) * (gradient_norm - no_grad(momentum));
+            param -= no_grad(alpha) * no_grad(momentum);
+            gradient.set_zero();
+        }
+        for (size_t i = 0; i < sparse_parameters.size(); i++) {
+            RowSparseGradient<DType> &gradient = *sparse_parameters[i].gradient;
+            size_t dim = gradient.get_dim();
+            for (size_t r = 0; r < gradient.get_rows().size(); ++r) {
+                size_t offset = gradient.get_rows()[r] * dim;
+                DType *row = &sparse_parameters[i].tensor[offset];
+                DType *momentum = &sparse_momentums[i][offset];
+                const DType *g = gradient.slot(r);
+                for (size_t j = 0; j < dim; ++j) {
+                    momentum[j] += one_minus_beta * (g[j] * batch_size_inv - momentum[j]);
+                    row[j] -= alpha * momentum[j];
+                }
+            }
+            sparse_parameters[i].tensor.wrap_for_broadcasting();
+            sparse_momentums[i].wrap_for_broadcasting();
             gradient.set_zero();
         }
     }
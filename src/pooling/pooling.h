@@ -0,0 +1,564 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "../tensor.h"
+#include "../threading.h"
+#include "../avx/avx_wrapper.h"
+#include "../convolution/direct_convolution.h"
+
+/**
+ * Max and average pooling kernels, shared by the 1d and 2d expression nodes DApPool.
+ *
+ * The windows are reduced in AVX registers. In the channels-last layout a register holds a few
+ * channels of the same position of x, for any stride. In the channels-first layout it holds the
+ * windows of a few consecutive outputs of a row, when the windows are inside x: with stride 1 the
+ * same element of the windows is a block of x, with a larger stride (e.g. the default one, the
+ * size of the window) it is gathered. The outputs on the borders are reduced one at a time.
+ *
+ * The max pooling keeps the position in x of the max of each window (the first one if several
+ * elements are equal), the backward step routes the gradient of an output there. The padding is
+ * never the max, and the average pooling divides by the whole window, padding included.
+ *
+ * A window of 0 elements is the whole of x, i.e. a global pooling. The 1d pooling is a 2d pooling
+ * with a single row.
+ */
+enum class PoolingMode { MAX, AVERAGE };
+
+template <typename DType>
+class Pooling2D {
+  public:
+    PoolingMode MODE{PoolingMode::MAX};
+    // Size of the window, 0 is the whole height (width) of x
+    size_t WINDOW_HEIGHT{0};
+    size_t WINDOW_WIDTH{0};
+    // 0 is the size of the window: the windows do not overlap
+    size_t STRIDE_HEIGHT{0};
+    size_t STRIDE_WIDTH{0};
+    // Zero padding, at most half of the window
+    size_t PADDING_HEIGHT{0};
+    size_t PADDING_WIDTH{0};
+    // Layout of x and of the output, as for the convolutions
+    ConvolutionLayout LAYOUT{ConvolutionLayout::CHANNELS_FIRST};
+
+  private:
+    // Position in x of the max of each output, for the backward step of the max pooling
+    std::vector<size_t> argmax{};
+
+    // those variables get a non-zero value in the forward step.
+    // The window and the stride actually used
+    size_t KERNEL_HEIGHT{0};
+    size_t KERNEL_WIDTH{0};
+    size_t STEP_HEIGHT{0};
+    size_t STEP_WIDTH{0};
+
+    size_t BATCH_SIZE{0};
+    size_t CHANNELS{0};
+    size_t DATA_HEIGHT{0};
+    size_t DATA_WIDTH{0};
+    size_t EFFECTIVE_HEIGHT{0};
+    size_t EFFECTIVE_WIDTH{0};
+
+  public:
+    /**
+     * x has shape [BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH], or
+     * [BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, CHANNELS] in the channels-last layout. The output has
+     * the same layout.
+     *
+     * If keep_temporaries is true the max pooling keeps the position of the max of each window
+     * for the backward step
+     */
+    template <bool keep_temporaries>
+    Tensor<DType> forward(const ConstTensor<DType> &x) {
+        set_shapes(x);
+        Tensor<DType> res(output_shape());
+        size_t *argmax_data = nullptr;
+        if constexpr (keep_temporaries) {
+            argmax.resize(MODE == PoolingMode::MAX ? res.get_size() : 0);
+            argmax_data = argmax.data();
+        }
+        const DType *x_data = &x[0];
+        DType *res_data = &res[0];
+        const size_t KERNEL_SIZE = KERNEL_HEIGHT * KERNEL_WIDTH;
+
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            // Each thread reduces whole rows of the output
+            auto reduce_rows = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    forward_row_channels_last(x_data, res_data, argmax_data, i);
+                }
+            };
+            threading::parallel_for(BATCH_SIZE * EFFECTIVE_HEIGHT,
+                                    EFFECTIVE_WIDTH * CHANNELS * KERNEL_SIZE,
+                                    reduce_rows);
+        } else {
+            // Each thread reduces whole channels
+            auto reduce_channels = [&](size_t begin, size_t end) {
+                for (size_t channel = begin; channel < end; ++channel) {
+                    forward_channel(x_data, res_data, argmax_data, channel);
+                }
+            };
+            threading::parallel_for(BATCH_SIZE * CHANNELS,
+                                    EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH * KERNEL_SIZE,
+                                    reduce_channels);
+        }
+
+        res.wrap_for_broadcasting();
+        return res;
+    }
+
+    /**
+     * Returns the gradient of x, grad has the size of the output (it can be flattened).
+     * The max pooling requires a previous call to forward<true>
+     */
+    Tensor<DType> backward(const ConstTensor<DType> &grad) {
+        const size_t OUTPUT_SIZE = output_shape().get_size();
+        assert(grad.get_size() == OUTPUT_SIZE);
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+
+        Tensor<DType> grad_x(input_shape());
+        grad_x.set_zero();
+        const DType *grad_data = &grad[0];
+        DType *grad_x_data = &grad_x[0];
+        // The windows overlap, each thread adds to its own samples (channels-last) or channels
+        // (channels-first) of grad_x
+        const size_t n_items = channels_last ? BATCH_SIZE : BATCH_SIZE * CHANNELS;
+        const size_t item_outputs = OUTPUT_SIZE / n_items;
+
+        if (MODE == PoolingMode::MAX) {
+            assert(argmax.size() == OUTPUT_SIZE);
+            auto route = [&](size_t begin, size_t end) {
+                for (size_t o = begin * item_outputs; o < end * item_outputs; ++o) {
+                    grad_x_data[argmax[o]] += grad_data[o];
+                }
+            };
+            threading::parallel_for(n_items, item_outputs, route);
+        } else {
+            auto spread = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (channels_last) {
+                        average_backward_sample(grad_data, grad_x_data, i);
+                    } else {
+                        average_backward_channel(grad_data, grad_x_data, i);
+                    }
+                }
+            };
+            threading::parallel_for(
+                n_items, item_outputs * KERNEL_HEIGHT * KERNEL_WIDTH, spread);
+        }
+
+        grad_x.wrap_for_broadcasting();
+        return grad_x;
+    }
+
+    void release_temporaries() { argmax = std::vector<size_t>{}; }
+
+  private:
+    void set_shapes(const ConstTensor<DType> &x) {
+        const Shape &t_shape = x.get_shape();
+        const auto &t_shape_data = t_shape.get_shape();
+
+        // By convention we assume that the input x must have the following shape
+        // [BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH], or
+        // [BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, CHANNELS]
+        assert(t_shape.get_dimension() == 4);
+        BATCH_SIZE = t_shape_data[0];
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            DATA_HEIGHT = t_shape_data[1];
+            DATA_WIDTH = t_shape_data[2];
+            CHANNELS = t_shape_data[3];
+        } else {
+            CHANNELS = t_shape_data[1];
+            DATA_HEIGHT = t_shape_data[2];
+            DATA_WIDTH = t_shape_data[3];
+        }
+
+        KERNEL_HEIGHT = WINDOW_HEIGHT == 0 ? DATA_HEIGHT : WINDOW_HEIGHT;
+        KERNEL_WIDTH = WINDOW_WIDTH == 0 ? DATA_WIDTH : WINDOW_WIDTH;
+        STEP_HEIGHT = STRIDE_HEIGHT == 0 ? KERNEL_HEIGHT : STRIDE_HEIGHT;
+        STEP_WIDTH = STRIDE_WIDTH == 0 ? KERNEL_WIDTH : STRIDE_WIDTH;
+        // so that every window reads at least an element of x
+        if (2 * PADDING_HEIGHT > KERNEL_HEIGHT || 2 * PADDING_WIDTH > KERNEL_WIDTH) {
+            throw std::runtime_error("The padding of a pooling must be at most half of the window");
+        }
+        // The positions in a window are tracked in the registers as DType
+        if (MODE == PoolingMode::MAX &&
+            KERNEL_HEIGHT * KERNEL_WIDTH > (size_t{1} << std::numeric_limits<DType>::digits)) {
+            throw std::runtime_error("The window of the max pooling is too large");
+        }
+
+        assert(DATA_HEIGHT + 2 * PADDING_HEIGHT >= KERNEL_HEIGHT);
+        assert(DATA_WIDTH + 2 * PADDING_WIDTH >= KERNEL_WIDTH);
+        EFFECTIVE_HEIGHT = (DATA_HEIGHT + 2 * PADDING_HEIGHT - KERNEL_HEIGHT) / STEP_HEIGHT + 1;
+        EFFECTIVE_WIDTH = (DATA_WIDTH + 2 * PADDING_WIDTH - KERNEL_WIDTH) / STEP_WIDTH + 1;
+    }
+
+    Shape input_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, CHANNELS};
+        }
+        return {BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH};
+    }
+
+    Shape output_shape() const {
+        if (LAYOUT == ConvolutionLayout::CHANNELS_LAST) {
+            return {BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, CHANNELS};
+        }
+        return {BATCH_SIZE, CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH};
+    }
+
+    DType average_scale() const {
+        return DType{1} / static_cast<DType>(KERNEL_HEIGHT * KERNEL_WIDTH);
+    }
+
+    void forward_channel(const DType *x_data,
+                         DType *res_data,
+                         size_t *argmax_data,
+                         size_t channel) const {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        const size_t x_offset = channel * DATA_HEIGHT * DATA_WIDTH;
+        const size_t res_offset = channel * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        // The windows of the outputs [interior_begin, interior_end) of a row are inside x along
+        // the width, they are reduced W at a time
+        const size_t interior_begin = direct_conv::valid_outputs(
+                                          0, STEP_WIDTH, PADDING_WIDTH, DATA_WIDTH, EFFECTIVE_WIDTH)
+                                          .first;
+        const size_t interior_end = std::max(interior_begin,
+                                             direct_conv::valid_outputs(KERNEL_WIDTH - 1,
+                                                                        STEP_WIDTH,
+                                                                        PADDING_WIDTH,
+                                                                        DATA_WIDTH,
+                                                                        EFFECTIVE_WIDTH)
+                                                 .second);
+        const size_t simd_end = interior_begin + (interior_end - interior_begin) / W * W;
+        for (size_t oh = 0; oh < EFFECTIVE_HEIGHT; ++oh) {
+            auto [kh_begin, kh_end] = direct_conv::valid_window(
+                oh * STEP_HEIGHT, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT);
+            const size_t o = res_offset + oh * EFFECTIVE_WIDTH;
+            size_t *argmax_row = argmax_data == nullptr ? nullptr : argmax_data + o;
+            size_t ow = 0;
+            for (; ow < interior_begin; ++ow) {
+                reduce_window(x_data, x_offset, oh, ow, kh_begin, kh_end, res_data + o, argmax_row);
+            }
+            for (; ow < simd_end; ow += W) {
+                reduce_windows_simd(
+                    x_data, x_offset, oh, ow, kh_begin, kh_end, res_data + o, argmax_row);
+            }
+            for (; ow < EFFECTIVE_WIDTH; ++ow) {
+                reduce_window(x_data, x_offset, oh, ow, kh_begin, kh_end, res_data + o, argmax_row);
+            }
+        }
+    }
+
+    // Window of the output (oh, ow) of the channel of x at x_offset, the rows [kh_begin, kh_end)
+    // of the window are inside x. res_row and argmax_row are the row oh of the output.
+    void reduce_window(const DType *x_data,
+                       size_t x_offset,
+                       size_t oh,
+                       size_t ow,
+                       size_t kh_begin,
+                       size_t kh_end,
+                       DType *res_row,
+                       size_t *argmax_row) const {
+        const size_t start_h = oh * STEP_HEIGHT;
+        const size_t start_w = ow * STEP_WIDTH;
+        auto [kw_begin, kw_end] =
+            direct_conv::valid_window(start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH);
+        const DType *x_channel = x_data + x_offset;
+        if (MODE == PoolingMode::AVERAGE) {
+            DType sum{0};
+            for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                const DType *x_row = x_channel + (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH;
+                for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                    sum += x_row[start_w + kw - PADDING_WIDTH];
+                }
+            }
+            res_row[ow] = sum * average_scale();
+            return;
+        }
+        DType best = -std::numeric_limits<DType>::infinity();
+        size_t best_index = (start_h + kh_begin - PADDING_HEIGHT) * DATA_WIDTH + start_w +
+                            kw_begin - PADDING_WIDTH;
+        for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+            const size_t row = (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH;
+            for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                const size_t index = row + start_w + kw - PADDING_WIDTH;
+                if (x_channel[index] > best) {
+                    best = x_channel[index];
+                    best_index = index;
+                }
+            }
+        }
+        res_row[ow] = best;
+        if (argmax_row != nullptr) {
+            argmax_row[ow] = x_offset + best_index;
+        }
+    }
+
+    // Windows of the outputs [ow, ow + W) of a row, inside x along the width: the element kw of
+    // the W windows is a block of x with stride 1, and it is gathered with a larger stride
+    void reduce_windows_simd(const DType *x_data,
+                             size_t x_offset,
+                             size_t oh,
+                             size_t ow,
+                             size_t kh_begin,
+                             size_t kh_end,
+                             DType *res_row,
+                             size_t *argmax_row) const {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        const size_t start_h = oh * STEP_HEIGHT;
+        const DType *x_block = x_data + x_offset + ow * STEP_WIDTH - PADDING_WIDTH;
+        const int stride = static_cast<int>(STEP_WIDTH);
+        auto load = [stride](const DType *x) {
+            return stride == 1 ? _mm256_loadu_px(x) : _mm256_strided_load_px(x, stride);
+        };
+        if (MODE == PoolingMode::AVERAGE) {
+            simd_type<DType> acc = avx_constants::zero<DType>;
+            for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                const DType *x_row = x_block + (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH;
+                for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                    acc = _mm256_add_px<DType>(acc, load(x_row + kw));
+                }
+            }
+            _mm256_storeu_px(res_row + ow,
+                             _mm256_mul_px<DType>(acc, _mm256_set1_px(average_scale())));
+            return;
+        }
+        simd_type<DType> best = _mm256_set1_px(-std::numeric_limits<DType>::infinity());
+        simd_type<DType> best_k = _mm256_set1_px(static_cast<DType>(kh_begin * KERNEL_WIDTH));
+        for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+            const DType *x_row = x_block + (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH;
+            for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                simd_type<DType> v = load(x_row + kw);
+                simd_type<DType> greater = _mm256_cmp_px<DType, _CMP_GT_OQ>(v, best);
+                best = _mm256_blendv_px<DType>(best, v, greater);
+                best_k = _mm256_blendv_px<DType>(
+                    best_k, _mm256_set1_px(static_cast<DType>(kh * KERNEL_WIDTH + kw)), greater);
+            }
+        }
+        _mm256_storeu_px(res_row + ow, best);
+        if (argmax_row != nullptr) {
+            DType k[W];
+            _mm256_storeu_px(k, best_k);
+            for (size_t l = 0; l < W; ++l) {
+                const size_t kh = static_cast<size_t>(k[l]) / KERNEL_WIDTH;
+                const size_t kw = static_cast<size_t>(k[l]) % KERNEL_WIDTH;
+                argmax_row[ow + l] = x_offset + (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH +
+                                     (ow + l) * STEP_WIDTH + kw - PADDING_WIDTH;
+            }
+        }
+    }
+
+    // Row i = b * EFFECTIVE_HEIGHT + oh of the output, in the channels-last layout: a register
+    // holds W channels of a position of x
+    void
+    forward_row_channels_last(const DType *x_data, DType *res_data, size_t *argmax_data, size_t i)
+        const {
+        constexpr size_t W = avx_constants::intrinsic_size<DType>;
+        const size_t b = i / EFFECTIVE_HEIGHT;
+        const size_t start_h = i % EFFECTIVE_HEIGHT * STEP_HEIGHT;
+        const size_t x_offset = b * DATA_HEIGHT * DATA_WIDTH * CHANNELS;
+        const DType *x_sample = x_data + x_offset;
+        auto [kh_begin, kh_end] =
+            direct_conv::valid_window(start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT);
+        // Offset in the sample of the position k of the window
+        auto position = [&](size_t start_w, size_t k) {
+            const size_t h = start_h + k / KERNEL_WIDTH - PADDING_HEIGHT;
+            const size_t w = start_w + k % KERNEL_WIDTH - PADDING_WIDTH;
+            return (h * DATA_WIDTH + w) * CHANNELS;
+        };
+        for (size_t ow = 0; ow < EFFECTIVE_WIDTH; ++ow) {
+            const size_t start_w = ow * STEP_WIDTH;
+            auto [kw_begin, kw_end] =
+                direct_conv::valid_window(start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH);
+            const size_t o = (i * EFFECTIVE_WIDTH + ow) * CHANNELS;
+            DType *res = res_data + o;
+            size_t *argmax_out = argmax_data == nullptr ? nullptr : argmax_data + o;
+            const size_t first_k = kh_begin * KERNEL_WIDTH + kw_begin;
+
+            size_t c = 0;
+            for (; c + W <= CHANNELS; c += W) {
+                if (MODE == PoolingMode::AVERAGE) {
+                    simd_type<DType> acc = avx_constants::zero<DType>;
+                    for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                        for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                            const DType *x = x_sample + position(start_w, kh * KERNEL_WIDTH + kw);
+                            acc = _mm256_add_px<DType>(acc, _mm256_loadu_px(x + c));
+                        }
+                    }
+                    _mm256_storeu_px(res + c,
+                                     _mm256_mul_px<DType>(acc, _mm256_set1_px(average_scale())));
+                    continue;
+                }
+                simd_type<DType> best = _mm256_set1_px(-std::numeric_limits<DType>::infinity());
+                simd_type<DType> best_k = _mm256_set1_px(static_cast<DType>(first_k));
+                for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                    for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                        const size_t k = kh * KERNEL_WIDTH + kw;
+                        simd_type<DType> v = _mm256_loadu_px(x_sample + position(start_w, k) + c);
+                        simd_type<DType> greater = _mm256_cmp_px<DType, _CMP_GT_OQ>(v, best);
+                        best = _mm256_blendv_px<DType>(best, v, greater);
+                        best_k = _mm256_blendv_px<DType>(
+                            best_k, _mm256_set1_px(static_cast<DType>(k)), greater);
+                    }
+                }
+                _mm256_storeu_px(res + c, best);
+                if (argmax_out != nullptr) {
+                    DType k[W];
+                    _mm256_storeu_px(k, best_k);
+                    for (size_t l = 0; l < W; ++l) {
+                        argmax_out[c + l] = x_offset +
+                                            position(start_w, static_cast<size_t>(k[l])) + c + l;
+                    }
+                }
+            }
+            for (; c < CHANNELS; ++c) {
+                if (MODE == PoolingMode::AVERAGE) {
+                    DType sum{0};
+                    for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                        for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                            sum += x_sample[position(start_w, kh * KERNEL_WIDTH + kw) + c];
+                        }
+                    }
+                    res[c] = sum * average_scale();
+                    continue;
+                }
+                DType best = -std::numeric_limits<DType>::infinity();
+                size_t best_position = position(start_w, first_k);
+                for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                    for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                        const size_t p = position(start_w, kh * KERNEL_WIDTH + kw);
+                        if (x_sample[p + c] > best) {
+                            best = x_sample[p + c];
+                            best_position = p;
+                        }
+                    }
+                }
+                res[c] = best;
+                if (argmax_out != nullptr) {
+                    argmax_out[c] = x_offset + best_position + c;
+                }
+            }
+        }
+    }
+
+    // Adds the gradient of the average pooling of a channel to grad_x, channels-first layout
+    void
+    average_backward_channel(const DType *grad_data, DType *grad_x_data, size_t channel) const {
+        const DType scale = average_scale();
+        const DType *grad_channel = grad_data + channel * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH;
+        DType *grad_x_channel = grad_x_data + channel * DATA_HEIGHT * DATA_WIDTH;
+        for (size_t oh = 0; oh < EFFECTIVE_HEIGHT; ++oh) {
+            const size_t start_h = oh * STEP_HEIGHT;
+            auto [kh_begin, kh_end] =
+                direct_conv::valid_window(start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT);
+            const DType *grad_row = grad_channel + oh * EFFECTIVE_WIDTH;
+            for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                DType *grad_x_row = grad_x_channel + (start_h + kh - PADDING_HEIGHT) * DATA_WIDTH;
+                for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                    auto [w_begin, w_end] = direct_conv::valid_outputs(
+                        kw, STEP_WIDTH, PADDING_WIDTH, DATA_WIDTH, EFFECTIVE_WIDTH);
+                    for (size_t ow = w_begin; ow < w_end; ++ow) {
+                        grad_x_row[ow * STEP_WIDTH + kw - PADDING_WIDTH] += grad_row[ow] * scale;
+                    }
+                }
+            }
+        }
+    }
+
+    // Adds the gradient of the average pooling of the sample b to grad_x, channels-last layout
+    void average_backward_sample(const DType *grad_data, DType *grad_x_data, size_t b) const {
+        const DType scale = average_scale();
+        DType *grad_x_sample = grad_x_data + b * DATA_HEIGHT * DATA_WIDTH * CHANNELS;
+        for (size_t oh = 0; oh < EFFECTIVE_HEIGHT; ++oh) {
+            const size_t start_h = oh * STEP_HEIGHT;
+            auto [kh_begin, kh_end] =
+                direct_conv::valid_window(start_h, PADDING_HEIGHT, DATA_HEIGHT, KERNEL_HEIGHT);
+            for (size_t ow = 0; ow < EFFECTIVE_WIDTH; ++ow) {
+                const size_t start_w = ow * STEP_WIDTH;
+                auto [kw_begin, kw_end] =
+                    direct_conv::valid_window(start_w, PADDING_WIDTH, DATA_WIDTH, KERNEL_WIDTH);
+                const DType *grad =
+                    grad_data + ((b * EFFECTIVE_HEIGHT + oh) * EFFECTIVE_WIDTH + ow) * CHANNELS;
+                for (size_t kh = kh_begin; kh < kh_end; ++kh) {
+                    for (size_t kw = kw_begin; kw < kw_end; ++kw) {
+                        const size_t h = start_h + kh - PADDING_HEIGHT;
+                        const size_t w = start_w + kw - PADDING_WIDTH;
+                        DType *grad_x = grad_x_sample + (h * DATA_WIDTH + w) * CHANNELS;
+                        for (size_t c = 0; c < CHANNELS; ++c) {
+                            grad_x[c] += grad[c] * scale;
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+template <typename DType>
+class Pooling1D {
+  public:
+    PoolingMode MODE{PoolingMode::MAX};
+    // Size of the window, 0 is the whole width of x
+    size_t WINDOW{0};
+    // 0 is the size of the window: the windows do not overlap
+    size_t STRIDE{0};
+    // Zero padding, at most half of the window
+    size_t PADDING{0};
+    // Layout of x and of the output, as for the convolutions
+    ConvolutionLayout LAYOUT{ConvolutionLayout::CHANNELS_FIRST};
+
+  private:
+    // A 1d pooling is a 2d pooling with a single row
+    Pooling2D<DType> pooling{};
+    Shape x_shape{};
+
+  public:
+    /**
+     * x has shape [BATCH_SIZE, CHANNELS, FEATURE_SIZE], or [BATCH_SIZE, FEATURE_SIZE, CHANNELS] in
+     * the channels-last layout
+     */
+    template <bool keep_temporaries>
+    Tensor<DType> forward(const ConstTensor<DType> &x) {
+        x_shape = x.get_shape();
+        assert(x_shape.get_dimension() == 3);
+        const auto &x_shape_data = x_shape.get_shape();
+        const bool channels_last = LAYOUT == ConvolutionLayout::CHANNELS_LAST;
+
+        pooling.MODE = MODE;
+        pooling.WINDOW_HEIGHT = 1;
+        pooling.WINDOW_WIDTH = WINDOW;
+        pooling.STRIDE_HEIGHT = 1;
+        pooling.STRIDE_WIDTH = STRIDE;
+        pooling.PADDING_WIDTH = PADDING;
+        pooling.LAYOUT = LAYOUT;
+        ConstTensor<DType> x_rows = x;
+        x_rows.set_shape(channels_last
+                             ? Shape{x_shape_data[0], 1, x_shape_data[1], x_shape_data[2]}
+                             : Shape{x_shape_data[0], x_shape_data[1], 1, x_shape_data[2]});
+
+        Tensor<DType> res = pooling.template forward<keep_temporaries>(x_rows);
+        const auto &res_shape = res.get_shape().get_shape();
+        Shape output_shape = channels_last ? Shape{res_shape[0], res_shape[2], res_shape[3]}
+                                           : Shape{res_shape[0], res_shape[1], res_shape[3]};
+        res.set_shape(std::move(output_shape));
+        return res;
+    }
+
+    /**
+     * Returns the gradient of x, grad has the size of the output (it can be flattened).
+     * The max pooling requires a previous call to forward<true>
+     */
+    Tensor<DType> backward(const ConstTensor<DType> &grad) {
+        Tensor<DType> grad_x = pooling.backward(grad);
+        grad_x.set_shape(x_shape);
+        return grad_x;
+    }
+
+    void release_temporaries() { pooling.release_temporaries(); }
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "gemm/sparse_gemm.h"
+#include "tensor.h"
+
+/**
+ * Input matrix in CSR format, one row for each sample (e.g. bag of words or one hot features),
+ * that can be the left operand of matmul. Only the non zeros are stored, so the number of columns
+ * can be much bigger than what a dense Tensor could hold. It has no gradient.
+ *
+ * Unlike Tensor, a sample can have no non zeros at all.
+ */
+template <typename T>
+class SparseTensor {
+  public:
+    std::shared_ptr<const gemm::CsrPattern> pattern;
+    std::vector<T> values;
+
+    SparseTensor(std::shared_ptr<const gemm::CsrPattern> pattern, std::vector<T> values)
+        : pattern{std::move(pattern)}, values{std::move(values)} {
+        assert(this->pattern->nnz() == this->values.size());
+    }
+
+    /**
+     * A single sample with cols features, entries are the pairs (column, value) of the non zeros
+     */
+    static SparseTensor from_entries(size_t cols, std::vector<std::pair<size_t, T>> entries) {
+        std::sort(entries.begin(), entries.end(), [](const auto &e1, const auto &e2) {
+            return e1.first < e2.first;
+        });
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        csr->rows = 1;
+        csr->cols = cols;
+        std::vector<T> values;
+        values.reserve(entries.size());
+        csr->col_idx.reserve(entries.size());
+        for (const auto &[col, value] : entries) {
+            if (col >= cols) {
+                throw std::runtime_error("Sparse entry out of bounds");
+            }
+            csr->col_idx.push_back(static_cast<uint32_t>(col));
+            values.push_back(value);
+        }
+        csr->row_ptr = {0, static_cast<uint32_t>(values.size())};
+        return SparseTensor{std::move(csr), std::move(values)};
+    }
+
+    /**
+     * The non zeros of a matrix (a vector is a single sample)
+     */
+    static SparseTensor from_dense(const Tensor<T> &dense) {
+        const Shape &shape = dense.get_shape();
+        size_t cols = shape.last();
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        csr->rows = dense.get_size() / cols;
+        csr->cols = cols;
+        std::vector<T> values;
+        csr->row_ptr.push_back(0);
+        for (size_t r = 0; r < csr->rows; ++r) {
+            for (size_t c = 0; c < cols; ++c) {
+                if (dense[r * cols + c] != T{0}) {
+                    csr->col_idx.push_back(static_cast<uint32_t>(c));
+                    values.push_back(dense[r * cols + c]);
+                }
+            }
+            csr->row_ptr.push_back(static_cast<uint32_t>(values.size()));
+        }
+        return SparseTensor{std::move(csr), std::move(values)};
+    }
+
+    /**
+     * The samples one after the other, as the rows of a single matrix (e.g. to build a batch)
+     */
+    static SparseTensor stack(std::span<const SparseTensor *const> samples) {
+        if (samples.empty()) {
+            throw std::runtime_error("Cannot stack an empty list of sparse tensors");
+        }
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        csr->cols = samples[0]->pattern->cols;
+        std::vector<T> values;
+        csr->row_ptr.push_back(0);
+        for (const SparseTensor *sample : samples) {
+            const gemm::CsrPattern &p = *sample->pattern;
+            if (p.cols != csr->cols) {
+                throw std::runtime_error("Cannot stack sparse tensors with different columns");
+            }
+            uint32_t offset = static_cast<uint32_t>(values.size());
+            for (size_t r = 0; r < p.rows; ++r) {
+                csr->row_ptr.push_back(offset + p.row_ptr[r + 1]);
+            }
+            csr->col_idx.insert(csr->col_idx.end(), p.col_idx.begin(), p.col_idx.end());
+            values.insert(values.end(), sample->values.begin(), sample->values.end());
+            csr->rows += p.rows;
+        }
+        return SparseTensor{std::move(csr), std::move(values)};
+    }
+
+    Shape get_shape() const { return Shape{pattern->rows, pattern->cols}; }
+
+    Tensor<T> to_dense() const {
+        Tensor<T> dense{pattern->rows, pattern->cols};
+        dense.set_zero();
+        for (size_t r = 0; r < pattern->rows; ++r) {
+            for (size_t p = pattern->row_ptr[r]; p < pattern->row_ptr[r + 1]; ++p) {
+                dense[r * pattern->cols + pattern->col_idx[p]] = values[p];
+            }
+        }
+        return dense;
+    }
+
+    template <typename Stream>
+    void serialize(Stream &stream) const {
+        stream.write(pattern->rows);
+        stream.write(pattern->cols);
+        stream.write(pattern->row_ptr.data(), pattern->rows + 1);
+        stream.write(pattern->nnz());
+        stream.write(pattern->col_idx.data(), pattern->nnz());
+        stream.write(values.data(), values.size());
+    }
+    template <typename Stream>
+    void deserialize(Stream &stream) {
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        stream.read(csr->rows);
+        stream.read(csr->cols);
+        csr->row_ptr.resize(csr->rows + 1);
+        stream.read(csr->row_ptr.data(), csr->rows + 1);
+        size_t nnz;
+        stream.read(nnz);
+        csr->col_idx.resize(nnz);
+        stream.read(csr->col_idx.data(), nnz);
+        values.resize(nnz);
+        stream.read(values.data(), nnz);
+        pattern = std::move(csr);
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "gemm/sparse_gemm.h"
+#include "tensor_variable.h"
+
+/**
+ * A matrix in which most of the entries are zero (e.g. the weights of a pruned layer).
+ * Only the non zeros are stored: their position, and their values in a Variable with shape {nnz},
+ * so that the optimizers update them as any other parameter. The pattern never changes: the
+ * entries that are pruned stay zero during training.
+ *
+ * The matrix m [K, N] is the right operand of a product x * m, so the pattern is the CSR of m^T
+ * (i.e. m is compressed by columns): each output of the product is a dot product over the non
+ * zeros of one column. The pattern is shared between the copies, as the tensors.
+ */
+template <typename T, bool requires_gradient>
+class SparseVariable {
+  public:
+    std::shared_ptr<const gemm::CsrPattern> pattern;
+    Variable<T, requires_gradient> values;
+
+    SparseVariable(std::shared_ptr<const gemm::CsrPattern> pattern,
+                   const Variable<T, requires_gradient> &values)
+        : pattern{std::move(pattern)}, values{values} {
+        assert(this->pattern->nnz() == this->values.tensor.get_size());
+    }
+
+    /**
+     * Magnitude pruning of a dense matrix: the fraction sparsity of the entries with the smallest
+     * absolute value is dropped. At least one entry is kept.
+     */
+    static SparseVariable from_dense(const Tensor<T> &dense, double sparsity) {
+        const Shape &shape = dense.get_shape();
+        if (shape.get_dimension() != 2) {
+            throw std::runtime_error("Only matrices can be converted to a sparse format");
+        }
+        if (sparsity < 0.0 || sparsity > 1.0) {
+            throw std::runtime_error("The sparsity must be in [0, 1]");
+        }
+        size_t size = dense.get_size();
+        size_t n_kept = std::max<size_t>(
+            1, static_cast<size_t>(std::llround((1.0 - sparsity) * static_cast<double>(size))));
+
+        std::vector<T> magnitudes(size);
+        for (size_t i = 0; i < size; ++i) {
+            magnitudes[i] = std::abs(dense[i]);
+        }
+        std::nth_element(magnitudes.begin(),
+                         magnitudes.begin() + static_cast<std::ptrdiff_t>(n_kept - 1),
+                         magnitudes.end(),
+                         std::greater<T>{});
+        T threshold = magnitudes[n_kept - 1];
+        // The entries equal to the threshold are kept until n_kept is reached
+        size_t n_ties = n_kept - static_cast<size_t>(std::count_if(
+                                     magnitudes.begin(), magnitudes.end(), [threshold](T x) {
+                                         return x > threshold;
+                                     }));
+
+        // Pattern of the transpose: the rows of the CSR are the columns of dense
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        csr->rows = shape[1];
+        csr->cols = shape[0];
+        csr->row_ptr.reserve(csr->rows + 1);
+        csr->col_idx.reserve(n_kept);
+        Tensor<T> kept_values{n_kept};
+        csr->row_ptr.push_back(0);
+        for (size_t c = 0; c < shape[1]; ++c) {
+            for (size_t r = 0; r < shape[0]; ++r) {
+                T x = dense[r * shape[1] + c];
+                bool kept = std::abs(x) > threshold || (std::abs(x) == threshold && n_ties > 0);
+                if (kept) {
+                    n_ties -= std::abs(x) == threshold ? 1 : 0;
+                    kept_values[csr->col_idx.size()] = x;
+                    csr->col_idx.push_back(static_cast<uint32_t>(r));
+                }
+            }
+            csr->row_ptr.push_back(static_cast<uint32_t>(csr->col_idx.size()));
+        }
+        return SparseVariable{std::move(csr), Variable<T, requires_gradient>(kept_values)};
+    }
+
+    Shape get_shape() const { return Shape{pattern->cols, pattern->rows}; }
+
+    Tensor<T> to_dense() const {
+        Tensor<T> dense{pattern->cols, pattern->rows};
+        dense.set_zero();
+        for (size_t c = 0; c < pattern->rows; ++c) {
+            for (size_t p = pattern->row_ptr[c]; p < pattern->row_ptr[c + 1]; ++p) {
+                dense[pattern->col_idx[p] * pattern->rows + c] = values.tensor[p];
+            }
+        }
+        return dense;
+    }
+
+    template <typename Stream>
+    void serialize(Stream &stream) const {
+        stream.write(pattern->rows);
+        stream.write(pattern->cols);
+        stream.write(pattern->row_ptr.data(), pattern->rows + 1);
+        stream.write(pattern->nnz());
+        stream.write(pattern->col_idx.data(), pattern->nnz());
+        values.serialize(stream);
+    }
+    template <typename Stream>
+    void deserialize(Stream &stream) {
+        auto csr = std::make_shared<gemm::CsrPattern>();
+        stream.read(csr->rows);
+        stream.read(csr->cols);
+        csr->row_ptr.resize(csr->rows + 1);
+        stream.read(csr->row_ptr.data(), csr->rows + 1);
+        size_t nnz;
+        stream.read(nnz);
+        csr->col_idx.resize(nnz);
+        stream.read(csr->col_idx.data(), nnz);
+        pattern = std::move(csr);
+        values.deserialize(stream);
+    }
+};
@@ -11,6 +11,7 @@
 #include <array>
 
 #include "constants.h"
+#include "tensor_pool.h"
 
 class Shape {
     static constexpr size_t SHAPE_MAX_DIM = 10;
@@ -123,6 +124,38 @@ class Shape {
         return Shape{res_shape, res_dimension};
     }
 
+    /**
+     * Shape of the batched matrix multiplication of s1 [..., N, K] and s2 [..., K, M]: the matrices
+     * are the last two dimensions, the leading (batch) dimensions must be the same.
+     */
+    template <bool transpose_s1, bool transpose_s2>
+    static const Shape get_batch_matmul_shape(const Shape &s1, const Shape &s2) {
+        assert(s1.dimension >= 3);
+        assert(s1.dimension == s2.dimension);
+        size_t d = s1.dimension;
+        for (size_t i = 0; i < d - 2; ++i) {
+            assert(s1.shape[i] == s2.shape[i]);
+        }
+        size_t s1_common_dimension = transpose_s1 ? s1.shape[d - 2] : s1.shape[d - 1];
+        size_t s2_common_dimension = transpose_s2 ? s2.shape[d - 1] : s2.shape[d - 2];
+        assert(s1_common_dimension == s2_common_dimension);
+
+        std::array<size_t, SHAPE_MAX_DIM> res_shape = s1.shape;
+        res_shape[d - 2] = transpose_s1 ? s1.shape[d - 1] : s1.shape[d - 2];
+        res_shape[d - 1] = transpose_s2 ? s2.shape[d - 2] : s2.shape[d - 1];
+        return Shape{res_shape, d};
+    }
+
+    /**
+     * Shape of the transpose of s: the last two dimensions are swapped
+     */
+    static const Shape get_transpose_shape(const Shape &s) {
+        assert(s.dimension >= 2);
+        std::array<size_t, SHAPE_MAX_DIM> res_shape = s.shape;
+        std::swap(res_shape[s.dimension - 2], res_shape[s.dimension - 1]);
+        return Shape{res_shape, s.dimension};
+    }
+
     friend std::ostream &operator<<(std::ostream &o, const Shape &shape) {
         o << "( ";
         for (size_t i = 0; i < shape.get_dimension(); i++) {
@@ -170,9 +203,9 @@ class GenericTensorData {
 
     GenericTensorData() = default;
     GenericTensorData(size_t size) : data_size{size} {
-        data = new T[size];
+        data = TensorPool<std::remove_const_t<T>>::allocate(size);
 
-        ref_counter = new size_t;
+        ref_counter = TensorPool<size_t>::allocate(1);
         *ref_counter = 1;
     }
 
@@ -210,8 +243,9 @@ class GenericTensorData {
         if (ref_counter) {
             *ref_counter -= 1;
             if (*ref_counter == 0) {
-                delete[] data;
-                delete ref_counter;
+                using DataType = std::remove_const_t<T>;
+                TensorPool<DataType>::release(const_cast<DataType *>(data), data_size);
+                TensorPool<size_t>::release(ref_counter, 1);
             }
         }
     }
@@ -424,6 +458,23 @@ class DataBuffer {
 
     void reset() { expression_variables_idx = 0; }
 
+    // True if the i-th and the j-th variables are the same tensor
+    bool is_same_tensor(size_t i, size_t j) const {
+        const auto &t1 = expression_variables[i].t_ref;
+        const auto &t2 = expression_variables[j].t_ref;
+        return &t1[0] == &t2[0] && t1.get_shape() == t2.get_shape();
+    }
+
+    // New buffer with only the tensors at the given indices
+    template <size_t M>
+    DataBuffer<DType, M> select(const std::array<size_t, M> &indices) const {
+        DataBuffer<DType, M> res{};
+        for (size_t idx : indices) {
+            res.push_back_variable(expression_variables[idx].t_ref);
+        }
+        return res;
+    }
+
     // Returns the biggest shape stored in the buffer
     const Shape &get_max_shape() {
         size_t i_arg_max{0};
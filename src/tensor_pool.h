@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Recycling of the tensor buffers.
+ *
+ * While at least one TensorPoolScope is alive, the buffers of destroyed tensors are not given back
+ * to the system, they are kept in per-size free lists and reused by the next tensors of the same
+ * size. A training step with fixed shapes allocates exactly the same buffers at every iteration,
+ * so after the first step all the allocations are served by the pool.
+ *
+ * The cached buffers are freed when the last scope is closed, unless a RetainedTensorPool keeps
+ * them for the next scopes.
+ *
+ * The pool is thread local, a buffer can be allocated and released indifferently inside or
+ * outside a scope.
+ */
+namespace tensor_pool {
+    inline thread_local size_t active_scopes{0};
+    inline thread_local size_t active_retainers{0};
+    // Buffers allocated from the system, the ones served by the free lists are not counted
+    inline thread_local size_t n_allocations{0};
+    // Functions that empty the pools that have been used so far
+    inline thread_local std::vector<void (*)()> pool_cleaners{};
+
+    // Free the cached buffers, if neither a scope nor a retainer needs them anymore
+    inline void clear_if_unused() {
+        if (active_scopes == 0 && active_retainers == 0) {
+            for (auto cleaner : pool_cleaners) {
+                cleaner();
+            }
+        }
+    }
+} // namespace tensor_pool
+
+template <typename T>
+class TensorPool {
+    static inline thread_local std::unordered_map<size_t, std::vector<T *>> free_lists{};
+    static inline thread_local bool is_registered{false};
+
+  public:
+    TensorPool() = delete;
+
+    static T *allocate(size_t size) {
+        if (tensor_pool::active_scopes > 0) {
+            auto it = free_lists.find(size);
+            if (it != free_lists.end() && !it->second.empty()) {
+                T *data = it->second.back();
+                it->second.pop_back();
+                return data;
+            }
+        }
+        tensor_pool::n_allocations += 1;
+        return new T[size];
+    }
+
+    static void release(T *data, size_t size) {
+        if (tensor_pool::active_scopes == 0) {
+            delete[] data;
+            return;
+        }
+        if (!is_registered) {
+            tensor_pool::pool_cleaners.push_back(&TensorPool<T>::clear);
+            is_registered = true;
+        }
+        free_lists[size].push_back(data);
+    }
+
+    static void clear() {
+        for (auto &[_, free_list] : free_lists) {
+            for (T *data : free_list) {
+                delete[] data;
+            }
+        }
+        free_lists.clear();
+    }
+};
+
+/**
+ * RAII guard enabling the pool, when the last scope is closed all the cached buffers are freed
+ * (unless they are retained).
+ */
+class TensorPoolScope {
+  public:
+    TensorPoolScope() { tensor_pool::active_scopes += 1; }
+    ~TensorPoolScope() {
+        tensor_pool::active_scopes -= 1;
+        tensor_pool::clear_if_unused();
+    }
+    TensorPoolScope(const TensorPoolScope &) = delete;
+    TensorPoolScope &operator=(const TensorPoolScope &) = delete;
+};
+
+/**
+ * Keeps the cached buffers alive between the scopes, without enabling the pool: the buffers
+ * released inside a scope are reused by the next scopes, while outside of them the tensors are
+ * allocated and freed as usual.
+ */
+class RetainedTensorPool {
+  public:
+    RetainedTensorPool() { tensor_pool::active_retainers += 1; }
+    ~RetainedTensorPool() {
+        tensor_pool::active_retainers -= 1;
+        tensor_pool::clear_if_unused();
+    }
+    RetainedTensorPool(const RetainedTensorPool &) = delete;
+    RetainedTensorPool &operator=(const RetainedTensorPool &) = delete;
+};
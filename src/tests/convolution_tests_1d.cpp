@@ -3,12 +3,29 @@
 #include "../weight_initializer.h"
 
 #include "test_utils.h"
+#include <algorithm>
+#include <array>
 #include <sstream>
 #include <tuple>
+#include <type_traits>
 
 static void convolution_operator_1d_tests();
-
-void convolution_tests_1d() { convolution_operator_1d_tests(); }
+static void fft_1d_tests();
+static void channels_last_1d_tests();
+static void threaded_1d_tests();
+static void grouped_1d_tests();
+static void transposed_1d_tests();
+static void fused_relu_1d_tests();
+
+void convolution_tests_1d() {
+    convolution_operator_1d_tests();
+    fft_1d_tests();
+    channels_last_1d_tests();
+    threaded_1d_tests();
+    grouped_1d_tests();
+    transposed_1d_tests();
+    fused_relu_1d_tests();
+}
 
 static Tensor<double> add_x_padding(ConstTensor<double> x, size_t PADDING) {
     const auto &x_shape = x.get_shape().get_shape();
@@ -38,7 +55,9 @@ static Tensor<double> naive_1d_convolution_forward(ConstTensor<double> kernel,
                                                    ConstTensor<double> x,
                                                    ConstTensor<double> bias,
                                                    size_t STRIDE,
-                                                   size_t PADDING) {
+                                                   size_t PADDING,
+                                                   size_t DILATION = 1,
+                                                   size_t GROUPS = 1) {
     assert(kernel.get_shape().get_dimension() == 3);
     assert(x.get_shape().get_dimension() == 3);
     assert(bias.get_shape().get_dimension() == 1);
@@ -49,26 +68,30 @@ static Tensor<double> naive_1d_convolution_forward(ConstTensor<double> kernel,
     size_t OUT_CHANNELS = kernel_shape[0];
     assert(OUT_CHANNELS == bias.get_shape().get_shape()[0]);
 
-    size_t IN_CHANNELS = kernel_shape[1];
+    size_t GROUP_IN_CHANNELS = kernel_shape[1];
+    size_t GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
     size_t KERNEL_SIZE = kernel_shape[2];
+    size_t KERNEL_EXTENT = DILATION * (KERNEL_SIZE - 1) + 1;
 
     size_t BATCH_SIZE = x_shape[0];
-    assert(IN_CHANNELS == x_shape[1]);
+    assert(GROUPS * GROUP_IN_CHANNELS == x_shape[1]);
     size_t FEATURE_SIZE = x_shape[2];
 
-    assert(FEATURE_SIZE + 2 * PADDING >= KERNEL_SIZE);
-    size_t EFFECTIVE_WIDTH = (FEATURE_SIZE - KERNEL_SIZE + 2 * PADDING) / STRIDE + 1;
+    assert(FEATURE_SIZE + 2 * PADDING >= KERNEL_EXTENT);
+    size_t EFFECTIVE_WIDTH = (FEATURE_SIZE - KERNEL_EXTENT + 2 * PADDING) / STRIDE + 1;
 
     Tensor<double> x_padded = add_x_padding(x, PADDING);
     Tensor<double> res{{BATCH_SIZE, OUT_CHANNELS, EFFECTIVE_WIDTH}};
 
     for (size_t b = 0; b < BATCH_SIZE; ++b) {
         for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            size_t first_channel = oc / GROUP_OUT_CHANNELS * GROUP_IN_CHANNELS;
             for (size_t w = 0; w < EFFECTIVE_WIDTH; ++w) {
                 res(b, oc, w) = bias(oc);
                 for (size_t k = 0; k < KERNEL_SIZE; ++k) {
-                    for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
-                        res(b, oc, w) += kernel(oc, ic, k) * x_padded(b, ic, w * STRIDE + k);
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        res(b, oc, w) += kernel(oc, ic, k) *
+                                         x_padded(b, first_channel + ic, w * STRIDE + k * DILATION);
                     }
                 }
             }
@@ -85,21 +108,25 @@ naive_1d_convolution_backward(ConstTensor<double> kernel,
                               ConstTensor<double> x,
                               ConstTensor<double> grad_out,
                               size_t STRIDE,
-                              size_t PADDING) {
+                              size_t PADDING,
+                              size_t DILATION = 1,
+                              size_t GROUPS = 1) {
     const auto &kernel_shape = kernel.get_shape().get_shape();
     const auto &x_shape = x.get_shape().get_shape();
     const auto &g_shape = grad_out.get_shape().get_shape();
 
     size_t OUT_CHANNELS = kernel_shape[0];
-    size_t IN_CHANNELS = kernel_shape[1];
+    size_t GROUP_IN_CHANNELS = kernel_shape[1];
+    size_t GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
     size_t KERNEL_SIZE = kernel_shape[2];
 
     size_t BATCH_SIZE = x_shape[0];
+    size_t IN_CHANNELS = x_shape[1];
     size_t FEATURE_SIZE = x_shape[2];
 
     size_t EFFECTIVE_WIDTH = g_shape[2];
 
-    Tensor<double> grad_kernel{{OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE}};
+    Tensor<double> grad_kernel{{OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_SIZE}};
     grad_kernel.set_zero();
 
     Tensor<double> grad_bias{{OUT_CHANNELS}};
@@ -111,15 +138,17 @@ naive_1d_convolution_backward(ConstTensor<double> kernel,
 
     for (size_t b = 0; b < BATCH_SIZE; ++b) {
         for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            size_t first_channel = oc / GROUP_OUT_CHANNELS * GROUP_IN_CHANNELS;
             for (size_t w = 0; w < EFFECTIVE_WIDTH; ++w) {
                 double grad = grad_out(b, oc, w);
 
                 grad_bias(oc) += grad;
 
                 for (size_t k = 0; k < KERNEL_SIZE; ++k) {
-                    for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
-                        grad_kernel(oc, ic, k) += grad * x_padded(b, ic, w * STRIDE + k);
-                        grad_x_padded(b, ic, w * STRIDE + k) += grad * kernel(oc, ic, k);
+                    size_t f = w * STRIDE + k * DILATION;
+                    for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
+                        grad_kernel(oc, ic, k) += grad * x_padded(b, first_channel + ic, f);
+                        grad_x_padded(b, first_channel + ic, f) += grad * kernel(oc, ic, k);
                     }
                 }
             }
@@ -141,6 +170,12 @@ naive_1d_convolution_backward(ConstTensor<double> kernel,
 static void convolution_operator_1d_tests() {
     constexpr size_t test_runs = 100;
     constexpr double eps_threshold = 1e-4;
+    constexpr std::array algorithms{
+        ConvolutionAlgorithm::AUTOMATIC,
+        ConvolutionAlgorithm::IM2COL,
+        ConvolutionAlgorithm::DIRECT,
+        ConvolutionAlgorithm::FFT,
+    };
 
     for (size_t i = 0; i < test_runs; ++i) {
         // Generate a random convolution
@@ -156,7 +191,11 @@ static void convolution_operator_1d_tests() {
         Variable<double, true> x_data({BATCH_SIZE, IN_CHANNELS, FEATURES});
         Variable<double, true> bias({OUT_CHANNELS});
 
-        auto res = conv_1d(kernel, x_data, bias).set_stride(STRIDE).set_padding(PADDING);
+        // Each implementation is checked, and the automatic choice between them
+        auto res = conv_1d(kernel, x_data, bias)
+                       .set_stride(STRIDE)
+                       .set_padding(PADDING)
+                       .set_algorithm(algorithms[i % algorithms.size()]);
         const auto &conv_parameters = res.get_parameters();
         random_test_initialization(conv_parameters);
 
@@ -199,4 +238,565 @@ static void convolution_operator_1d_tests() {
             throw std::runtime_error(oss.str());
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * The FFT convolutions with long kernels (several blocks for each sample) against the im2col ones
+ */
+static void fft_1d_tests() {
+    constexpr size_t test_runs = 20;
+    constexpr double eps_threshold = 1e-8;
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t IN_CHANNELS = random_size_t(1, 4);
+        const size_t OUT_CHANNELS = random_size_t(1, 4);
+        const size_t KERNEL_SIZE = random_size_t(32, 200);
+        const size_t PADDING = random_size_t(0, KERNEL_SIZE / 2);
+        const size_t STRIDE = random_size_t(1, 3);
+        const size_t BATCH_SIZE = random_size_t(1, 3);
+        const size_t FEATURES = random_size_t(KERNEL_SIZE, 3000);
+
+        Tensor<double> kernel = random_tensor({OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE});
+        Tensor<double> x = random_tensor({BATCH_SIZE, IN_CHANNELS, FEATURES});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+
+        Convolution1D<double> im2col;
+        Convolution1D<double> fft;
+        for (auto *convolution : {&im2col, &fft}) {
+            convolution->PADDING = PADDING;
+            convolution->STRIDE = STRIDE;
+        }
+        im2col.ALGORITHM = ConvolutionAlgorithm::IM2COL;
+        fft.ALGORITHM = ConvolutionAlgorithm::FFT;
+
+        Tensor<double> expected = im2col.forward<true>(kernel, x, bias);
+        Tensor<double> actual = fft.forward<true>(kernel, x, bias);
+        if (!check_tensor_equality<double>(actual, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[FFT_1D_TEST]: forward pass error mismatch (actual, im2col)=(" << actual << ", "
+                << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        auto expected_grads = im2col.backward(gradient);
+        auto actual_grads = fft.backward(gradient);
+        if (!check_tensor_equality<double>(
+                std::get<0>(actual_grads), std::get<0>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<1>(actual_grads), std::get<1>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<2>(actual_grads), std::get<2>(expected_grads), eps_threshold)) {
+            throw std::runtime_error("[FFT_1D_TEST]: gradient mismatch");
+        }
+    }
+}
+
+// [B, M, N] -> [B, N, M], between the channels-first and the channels-last layouts
+static Tensor<double> swap_last_dimensions(ConstTensor<double> t) {
+    const auto &shape = t.get_shape().get_shape();
+    const size_t B = shape[0], M = shape[1], N = shape[2];
+    Tensor<double> res{{B, N, M}};
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t m = 0; m < M; ++m) {
+            for (size_t n = 0; n < N; ++n) {
+                res(b, n, m) = t(b, m, n);
+            }
+        }
+    }
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * The channels-last convolutions against the naive ones on the transposed x
+ */
+static void channels_last_1d_tests() {
+    constexpr size_t test_runs = 20;
+    constexpr double eps_threshold = 1e-8;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        size_t IN_CHANNELS = random_size_t(1, 10);
+        size_t OUT_CHANNELS = random_size_t(1, 10);
+        size_t KERNEL_SIZE = random_size_t(1, 10);
+        size_t PADDING = random_size_t(0, 10);
+        size_t STRIDE = random_size_t(1, 4);
+        size_t BATCH_SIZE = random_size_t(1, 20);
+        size_t FEATURES = random_size_t(KERNEL_SIZE, 100);
+
+        Variable<double, true> kernel({OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE});
+        Variable<double, true> x_data({BATCH_SIZE, FEATURES, IN_CHANNELS});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = conv_1d(kernel, x_data, bias)
+                       .set_stride(STRIDE)
+                       .set_padding(PADDING)
+                       .set_layout(ConvolutionLayout::CHANNELS_LAST);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Tensor<double> x_channels_first = swap_last_dimensions(x_data.tensor);
+        auto layer_res = res.forward();
+        auto layer_res_simulated = naive_1d_convolution_forward(
+            kernel.tensor, x_channels_first, bias.tensor, STRIDE, PADDING);
+        if (!check_tensor_equality<double>(
+                swap_last_dimensions(layer_res), layer_res_simulated, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[CHANNELS_LAST_1D_TEST]: forward pass error mismatch (actual, simulated)=("
+                << layer_res << ", " << layer_res_simulated << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(layer_res.get_shape());
+        const auto &[kernel_grad, x_grad, bias_grad] = naive_1d_convolution_backward(
+            kernel.tensor, x_channels_first, swap_last_dimensions(gradient), STRIDE, PADDING);
+        res.backward(gradient);
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(
+                x_grad, swap_last_dimensions(conv_parameters[1].gradient), eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[CHANNELS_LAST_1D_TEST]: gradient mismatch");
+        }
+    }
+
+    // Only the im2col kernels support the channels-last layout
+    Convolution1D<double> convolution;
+    convolution.LAYOUT = ConvolutionLayout::CHANNELS_LAST;
+    convolution.ALGORITHM = ConvolutionAlgorithm::DIRECT;
+    Tensor<double> kernel{{1, 1, 3}};
+    Tensor<double> x{{1, 8, 1}};
+    Tensor<double> bias{{1}};
+    bool thrown = false;
+    try {
+        convolution.forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[CHANNELS_LAST_1D_TEST]: the direct kernels were used");
+    }
+}
+
+/**
+ * The im2col convolutions split between several threads, and by chunks of samples, against the
+ * single threaded ones
+ */
+static void threaded_1d_tests() {
+    constexpr size_t test_runs = 10;
+    constexpr double eps_threshold = 1e-10;
+    const ThreadingConfig default_config = get_threading();
+    ThreadingConfig single_thread{};
+    single_thread.outer_parallelism = true;
+    ThreadingConfig threaded{};
+    threaded.max_threads = 4;
+    threaded.flops_per_thread = 64;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t IN_CHANNELS = random_size_t(1, 6);
+        const size_t OUT_CHANNELS = random_size_t(1, 6);
+        const size_t KERNEL_SIZE = random_size_t(1, 6);
+        const size_t STRIDE = random_size_t(1, 3);
+        const size_t PADDING = random_size_t(0, 3);
+        const size_t BATCH_SIZE = random_size_t(1, 9);
+        const size_t FEATURES = random_size_t(KERNEL_SIZE, 60);
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+
+        Tensor<double> kernel = random_tensor({OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE});
+        Tensor<double> x = random_tensor(layout == ConvolutionLayout::CHANNELS_LAST
+                                             ? Shape{BATCH_SIZE, FEATURES, IN_CHANNELS}
+                                             : Shape{BATCH_SIZE, IN_CHANNELS, FEATURES});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+        auto make_convolution = [&]() {
+            Convolution1D<double> convolution;
+            convolution.STRIDE = STRIDE;
+            convolution.PADDING = PADDING;
+            convolution.ALGORITHM = ConvolutionAlgorithm::IM2COL;
+            convolution.LAYOUT = layout;
+            return convolution;
+        };
+
+        set_threading(single_thread);
+        Convolution1D<double> reference = make_convolution();
+        Tensor<double> expected = reference.forward<true>(kernel, x, bias);
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        auto expected_grads = reference.backward(gradient);
+
+        set_threading(threaded);
+        Convolution1D<double> convolution = make_convolution();
+        Tensor<double> actual = convolution.forward<true>(kernel, x, bias);
+        auto actual_grads = convolution.backward(gradient);
+        // Chunks of one sample, of a few samples, and frozen
+        Convolution1D<double> tiled = make_convolution();
+        tiled.IM2COL_TILE_BYTES = 1;
+        Tensor<double> tiled_single = tiled.forward<false>(kernel, x, bias);
+        const size_t im2col_sample_bytes = actual.get_size() / (BATCH_SIZE * OUT_CHANNELS) *
+                                           IN_CHANNELS * KERNEL_SIZE * sizeof(double);
+        tiled.IM2COL_TILE_BYTES = 2 * im2col_sample_bytes + 1;
+        tiled.freeze();
+        Tensor<double> tiled_frozen = tiled.forward<false>(kernel, x, bias);
+        set_threading(default_config);
+
+        if (!check_tensor_equality<double>(actual, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_single, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_frozen, expected, eps_threshold)) {
+            throw std::runtime_error("[THREADED_1D_TEST]: forward pass error mismatch");
+        }
+        if (!check_tensor_equality<double>(
+                std::get<0>(actual_grads), std::get<0>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<1>(actual_grads), std::get<1>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<2>(actual_grads), std::get<2>(expected_grads), eps_threshold)) {
+            throw std::runtime_error("[THREADED_1D_TEST]: gradient mismatch");
+        }
+    }
+}
+
+/**
+ * Grouped, depthwise and dilated convolutions, with every algorithm and layout that supports them,
+ * against the naive ones
+ */
+static void grouped_1d_tests() {
+    constexpr size_t test_runs = 30;
+    constexpr double eps_threshold = 1e-8;
+    constexpr std::array algorithms{ConvolutionAlgorithm::AUTOMATIC,
+                                    ConvolutionAlgorithm::IM2COL,
+                                    ConvolutionAlgorithm::DIRECT};
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t GROUPS = random_size_t(1, 4);
+        const bool depthwise = i % 3 == 0;
+        const size_t GROUP_IN_CHANNELS = depthwise ? 1 : random_size_t(1, 4);
+        const size_t GROUP_OUT_CHANNELS = random_size_t(1, 4);
+        const size_t IN_CHANNELS = GROUPS * GROUP_IN_CHANNELS;
+        const size_t OUT_CHANNELS = GROUPS * GROUP_OUT_CHANNELS;
+        const size_t KERNEL_SIZE = random_size_t(1, 6);
+        const size_t DILATION = random_size_t(1, 3);
+        const size_t STRIDE = random_size_t(1, 3);
+        const size_t PADDING = random_size_t(0, 4);
+        const size_t BATCH_SIZE = random_size_t(1, 6);
+        const size_t FEATURES = random_size_t(DILATION * (KERNEL_SIZE - 1) + 1, 60);
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+        const bool channels_last = layout == ConvolutionLayout::CHANNELS_LAST;
+
+        Tensor<double> kernel = random_tensor({OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_SIZE});
+        Tensor<double> x = random_tensor({BATCH_SIZE, IN_CHANNELS, FEATURES});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+        Tensor<double> expected =
+            naive_1d_convolution_forward(kernel, x, bias, STRIDE, PADDING, DILATION, GROUPS);
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        const auto &[kernel_grad, x_grad, bias_grad] = naive_1d_convolution_backward(
+            kernel, x, gradient, STRIDE, PADDING, DILATION, GROUPS);
+
+        for (ConvolutionAlgorithm algorithm : algorithms) {
+            if (channels_last && algorithm == ConvolutionAlgorithm::DIRECT) {
+                continue;
+            }
+            auto make_convolution = [&]() {
+                Convolution1D<double> convolution;
+                convolution.STRIDE = STRIDE;
+                convolution.PADDING = PADDING;
+                convolution.DILATION = DILATION;
+                convolution.GROUPS = GROUPS;
+                convolution.ALGORITHM = algorithm;
+                convolution.LAYOUT = layout;
+                return convolution;
+            };
+            Tensor<double> layout_x = channels_last ? swap_last_dimensions(x) : x;
+            Tensor<double> layout_gradient =
+                channels_last ? swap_last_dimensions(gradient) : gradient;
+
+            Convolution1D<double> convolution = make_convolution();
+            Tensor<double> actual = convolution.forward<true>(kernel, layout_x, bias);
+            auto [actual_kernel_grad, actual_x_grad, actual_bias_grad] =
+                convolution.backward(layout_gradient);
+            // The im2col matrix by chunks of one sample
+            Convolution1D<double> tiled = make_convolution();
+            tiled.IM2COL_TILE_BYTES = 1;
+            Tensor<double> actual_tiled = tiled.forward<false>(kernel, layout_x, bias);
+            if (channels_last) {
+                actual = swap_last_dimensions(actual);
+                actual_tiled = swap_last_dimensions(actual_tiled);
+                actual_x_grad = swap_last_dimensions(actual_x_grad);
+            }
+
+            if (!check_tensor_equality<double>(actual, expected, eps_threshold) ||
+                !check_tensor_equality<double>(actual_tiled, expected, eps_threshold)) {
+                std::ostringstream oss;
+                oss << "[GROUPED_1D_TEST]: forward pass error mismatch (actual, simulated)=("
+                    << actual << ", " << expected << ")";
+                throw std::runtime_error(oss.str());
+            }
+            if (!check_tensor_equality<double>(actual_kernel_grad, kernel_grad, eps_threshold) ||
+                !check_tensor_equality<double>(actual_x_grad, x_grad, eps_threshold) ||
+                !check_tensor_equality<double>(actual_bias_grad, bias_grad, eps_threshold)) {
+                throw std::runtime_error("[GROUPED_1D_TEST]: gradient mismatch");
+            }
+        }
+    }
+
+    // The FFT kernels are only dense
+    Convolution1D<double> convolution;
+    convolution.GROUPS = 2;
+    convolution.ALGORITHM = ConvolutionAlgorithm::FFT;
+    Tensor<double> kernel{{2, 1, 3}};
+    Tensor<double> x{{1, 2, 8}};
+    Tensor<double> bias{{2}};
+    bool thrown = false;
+    try {
+        convolution.forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[GROUPED_1D_TEST]: the FFT kernels were used with groups");
+    }
+}
+
+/**
+ * Naive transposed convolution: each element of x adds the kernel, times itself, to the output
+ */
+static Tensor<double> naive_1d_transposed_convolution_forward(ConstTensor<double> kernel,
+                                                              ConstTensor<double> x,
+                                                              ConstTensor<double> bias,
+                                                              size_t STRIDE,
+                                                              size_t PADDING,
+                                                              size_t OUTPUT_PADDING,
+                                                              size_t DILATION,
+                                                              size_t GROUPS) {
+    const auto &kernel_shape = kernel.get_shape().get_shape();
+    const auto &x_shape = x.get_shape().get_shape();
+
+    size_t IN_CHANNELS = kernel_shape[0];
+    size_t GROUP_OUT_CHANNELS = kernel_shape[1];
+    size_t GROUP_IN_CHANNELS = IN_CHANNELS / GROUPS;
+    size_t OUT_CHANNELS = GROUPS * GROUP_OUT_CHANNELS;
+    size_t KERNEL_SIZE = kernel_shape[2];
+
+    size_t BATCH_SIZE = x_shape[0];
+    assert(IN_CHANNELS == x_shape[1]);
+    size_t WIDTH = x_shape[2];
+    size_t OUTPUT_WIDTH =
+        (WIDTH - 1) * STRIDE + DILATION * (KERNEL_SIZE - 1) + 1 + OUTPUT_PADDING - 2 * PADDING;
+
+    Tensor<double> res{{BATCH_SIZE, OUT_CHANNELS, OUTPUT_WIDTH}};
+    for (size_t b = 0; b < BATCH_SIZE; ++b) {
+        for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            for (size_t w = 0; w < OUTPUT_WIDTH; ++w) {
+                res(b, oc, w) = bias(oc);
+            }
+        }
+        for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
+            size_t first_channel = ic / GROUP_IN_CHANNELS * GROUP_OUT_CHANNELS;
+            for (size_t w = 0; w < WIDTH; ++w) {
+                for (size_t k = 0; k < KERNEL_SIZE; ++k) {
+                    size_t f = w * STRIDE + k * DILATION;
+                    if (f < PADDING || f - PADDING >= OUTPUT_WIDTH) {
+                        continue;
+                    }
+                    for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; ++oc) {
+                        res(b, first_channel + oc, f - PADDING) += x(b, ic, w) * kernel(ic, oc, k);
+                    }
+                }
+            }
+        }
+    }
+    return res;
+}
+
+/**
+ * The transposed convolutions against the naive one. Their gradients are the steps of the naive
+ * convolution with the same kernel: the gradient of x is the convolution of the gradient of the
+ * output, and the gradient of the kernel the one of the convolution of the output.
+ */
+static void transposed_1d_tests() {
+    constexpr size_t test_runs = 40;
+    constexpr double eps_threshold = 1e-8;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t GROUPS = i % 4 == 0 ? random_size_t(2, 3) : 1;
+        const size_t IN_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t OUT_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t KERNEL_SIZE = random_size_t(1, 6);
+        const size_t DILATION = i % 3 == 0 ? random_size_t(1, 3) : 1;
+        const size_t STRIDE = random_size_t(1, 4);
+        const size_t OUTPUT_PADDING = random_size_t(0, STRIDE - 1);
+        const size_t PADDING = random_size_t(0, DILATION * (KERNEL_SIZE - 1) / 2);
+        const size_t BATCH_SIZE = random_size_t(1, 8);
+        const size_t WIDTH = random_size_t(1, 30);
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+        const bool channels_last = layout == ConvolutionLayout::CHANNELS_LAST;
+
+        Variable<double, true> kernel({IN_CHANNELS, OUT_CHANNELS / GROUPS, KERNEL_SIZE});
+        Variable<double, true> x_data(channels_last ? Shape{BATCH_SIZE, WIDTH, IN_CHANNELS}
+                                                    : Shape{BATCH_SIZE, IN_CHANNELS, WIDTH});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = conv_transpose_1d(kernel, x_data, bias)
+                       .set_stride(STRIDE)
+                       .set_padding(PADDING)
+                       .set_output_padding(OUTPUT_PADDING)
+                       .set_dilation(DILATION)
+                       .set_groups(GROUPS)
+                       .set_layout(layout);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Tensor<double> x = channels_last ? swap_last_dimensions(x_data.tensor) : x_data.tensor;
+        Tensor<double> layer_res = res.forward().clone();
+        if (channels_last) {
+            layer_res = swap_last_dimensions(layer_res);
+        }
+        Tensor<double> expected = naive_1d_transposed_convolution_forward(
+            kernel.tensor, x, bias.tensor, STRIDE, PADDING, OUTPUT_PADDING, DILATION, GROUPS);
+        if (!check_tensor_equality<double>(layer_res, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[TRANSPOSED_1D_TEST]: forward pass error mismatch (actual, simulated)=("
+                << layer_res << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        Tensor<double> no_bias{{IN_CHANNELS}};
+        no_bias.set_zero();
+        Tensor<double> x_grad = naive_1d_convolution_forward(
+            kernel.tensor, gradient, no_bias, STRIDE, PADDING, DILATION, GROUPS);
+        Tensor<double> kernel_grad = std::get<0>(naive_1d_convolution_backward(
+            kernel.tensor, gradient, x, STRIDE, PADDING, DILATION, GROUPS));
+        Tensor<double> bias_grad{{OUT_CHANNELS}};
+        bias_grad.set_zero();
+        for (size_t j = 0; j < gradient.get_size(); ++j) {
+            bias_grad[j / gradient.get_shape()[2] % OUT_CHANNELS] += gradient[j];
+        }
+
+        res.backward(channels_last ? swap_last_dimensions(gradient) : gradient);
+        Tensor<double> actual_x_grad = conv_parameters[1].gradient;
+        if (channels_last) {
+            actual_x_grad = swap_last_dimensions(actual_x_grad);
+        }
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(x_grad, actual_x_grad, eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[TRANSPOSED_1D_TEST]: gradient mismatch");
+        }
+    }
+
+    // The output padding selects one of the STRIDE sizes of the output
+    Convolution1D<double> convolution;
+    convolution.STRIDE = 2;
+    convolution.OUTPUT_PADDING = 2;
+    Tensor<double> kernel{{1, 1, 3}};
+    Tensor<double> x{{1, 1, 8}};
+    Tensor<double> bias{{1}};
+    bool thrown = false;
+    try {
+        convolution.transposed_forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[TRANSPOSED_1D_TEST]: the output padding was not checked");
+    }
+}
+
+/**
+ * relu(conv_1d(...)) is a single node, the relu is applied with the bias: against the naive
+ * convolution followed by a relu, with every algorithm and layout
+ */
+static void fused_relu_1d_tests() {
+    constexpr size_t test_runs = 32;
+    constexpr double eps_threshold = 1e-8;
+    constexpr std::array algorithms{ConvolutionAlgorithm::AUTOMATIC,
+                                    ConvolutionAlgorithm::IM2COL,
+                                    ConvolutionAlgorithm::DIRECT,
+                                    ConvolutionAlgorithm::FFT};
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+        const bool channels_last = layout == ConvolutionLayout::CHANNELS_LAST;
+        ConvolutionAlgorithm algorithm = algorithms[i / 2 % algorithms.size()];
+        // Only the im2col kernels support the channels-last layout
+        if (channels_last && (algorithm == ConvolutionAlgorithm::DIRECT ||
+                              algorithm == ConvolutionAlgorithm::FFT)) {
+            algorithm = ConvolutionAlgorithm::IM2COL;
+        }
+        const size_t GROUPS =
+            algorithm != ConvolutionAlgorithm::FFT && i % 3 == 0 ? random_size_t(2, 3) : 1;
+        const size_t IN_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t OUT_CHANNELS = GROUPS * random_size_t(1, 6);
+        const size_t KERNEL_SIZE = random_size_t(1, 8);
+        const size_t STRIDE = random_size_t(1, 3);
+        const size_t PADDING = random_size_t(0, 3);
+        const size_t BATCH_SIZE = random_size_t(1, 8);
+        const size_t FEATURES = random_size_t(KERNEL_SIZE, 60);
+
+        Variable<double, true> kernel({OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_SIZE});
+        Variable<double, true> x_data(channels_last ? Shape{BATCH_SIZE, FEATURES, IN_CHANNELS}
+                                                    : Shape{BATCH_SIZE, IN_CHANNELS, FEATURES});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = relu(conv_1d(kernel, x_data, bias)
+                            .set_stride(STRIDE)
+                            .set_padding(PADDING)
+                            .set_groups(GROUPS)
+                            .set_algorithm(algorithm)
+                            .set_layout(layout));
+        static_assert(std::is_same_v<typename decltype(res)::Operator, DApConv1d<true>>);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Tensor<double> x = channels_last ? swap_last_dimensions(x_data.tensor) : x_data.tensor;
+        Tensor<double> expected = naive_1d_convolution_forward(
+            kernel.tensor, x, bias.tensor, STRIDE, PADDING, 1, GROUPS);
+        for (size_t j = 0; j < expected.get_size(); ++j) {
+            expected[j] = std::max(expected[j], 0.0);
+        }
+        Tensor<double> layer_res = res.forward().clone();
+        // Out of training, by chunks of one sample
+        Convolution1D<double> tiled = res.get_convolution();
+        tiled.IM2COL_TILE_BYTES = 1;
+        Tensor<double> tiled_res =
+            tiled.forward<false, true>(kernel.tensor, x_data.tensor, bias.tensor);
+        if (channels_last) {
+            layer_res = swap_last_dimensions(layer_res);
+            tiled_res = swap_last_dimensions(tiled_res);
+        }
+        if (!check_tensor_equality<double>(layer_res, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_res, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[FUSED_RELU_1D_TEST]: forward pass error mismatch (actual, simulated)=("
+                << layer_res << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        // The gradient goes through the relu where the output is positive
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        Tensor<double> masked_gradient = expected.clone();
+        for (size_t j = 0; j < gradient.get_size(); ++j) {
+            masked_gradient[j] = expected[j] > 0.0 ? gradient[j] : 0.0;
+        }
+        masked_gradient.wrap_for_broadcasting();
+        const auto &[kernel_grad, x_grad, bias_grad] = naive_1d_convolution_backward(
+            kernel.tensor, x, masked_gradient, STRIDE, PADDING, 1, GROUPS);
+
+        res.backward(channels_last ? swap_last_dimensions(gradient) : gradient);
+        Tensor<double> actual_x_grad = conv_parameters[1].gradient;
+        if (channels_last) {
+            actual_x_grad = swap_last_dimensions(actual_x_grad);
+        }
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(x_grad, actual_x_grad, eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[FUSED_RELU_1D_TEST]: gradient mismatch");
+        }
+    }
+}
@@ -3,12 +3,29 @@
 #include "../weight_initializer.h"
 
 #include "test_utils.h"
+#include <algorithm>
+#include <array>
 #include <sstream>
 #include <tuple>
+#include <type_traits>
 
 static void convolution_operator_2d_tests();
-
-void convolution_tests_2d() { convolution_operator_2d_tests(); }
+static void winograd_2d_tests();
+static void channels_last_2d_tests();
+static void threaded_2d_tests();
+static void grouped_2d_tests();
+static void transposed_2d_tests();
+static void fused_relu_2d_tests();
+
+void convolution_tests_2d() {
+    convolution_operator_2d_tests();
+    winograd_2d_tests();
+    channels_last_2d_tests();
+    threaded_2d_tests();
+    grouped_2d_tests();
+    transposed_2d_tests();
+    fused_relu_2d_tests();
+}
 
 static Tensor<double>
 add_x_padding(ConstTensor<double> x, size_t PADDING_HEIGHT, size_t PADDING_WIDTH) {
@@ -46,7 +63,10 @@ static Tensor<double> naive_2d_convolution_forward(ConstTensor<double> kernel,
                                                    size_t STRIDE_HEIGHT,
                                                    size_t STRIDE_WIDTH,
                                                    size_t PADDING_HEIGHT,
-                                                   size_t PADDING_WIDTH) {
+                                                   size_t PADDING_WIDTH,
+                                                   size_t DILATION_HEIGHT = 1,
+                                                   size_t DILATION_WIDTH = 1,
+                                                   size_t GROUPS = 1) {
     assert(kernel.get_shape().get_dimension() == 4);
     assert(x.get_shape().get_dimension() == 4);
 
@@ -54,23 +74,26 @@ static Tensor<double> naive_2d_convolution_forward(ConstTensor<double> kernel,
     const auto &x_shape = x.get_shape().get_shape();
 
     const size_t OUT_CHANNELS = kernel_shape[0];
-    const size_t IN_CHANNELS = kernel_shape[1];
+    const size_t GROUP_IN_CHANNELS = kernel_shape[1];
+    const size_t GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
     const size_t KERNEL_HEIGHT = kernel_shape[2];
     const size_t KERNEL_WIDTH = kernel_shape[3];
+    const size_t KERNEL_EXTENT_HEIGHT = DILATION_HEIGHT * (KERNEL_HEIGHT - 1) + 1;
+    const size_t KERNEL_EXTENT_WIDTH = DILATION_WIDTH * (KERNEL_WIDTH - 1) + 1;
 
     const size_t BATCH_SIZE = x_shape[0];
-    assert(IN_CHANNELS == x_shape[1]);
+    assert(GROUPS * GROUP_IN_CHANNELS == x_shape[1]);
 
     const size_t DATA_HEIGHT = x_shape[2];
     const size_t DATA_WIDTH = x_shape[3];
 
-    assert(DATA_HEIGHT + 2 * PADDING_HEIGHT >= KERNEL_HEIGHT);
-    assert(DATA_WIDTH + 2 * PADDING_WIDTH >= KERNEL_WIDTH);
+    assert(DATA_HEIGHT + 2 * PADDING_HEIGHT >= KERNEL_EXTENT_HEIGHT);
+    assert(DATA_WIDTH + 2 * PADDING_WIDTH >= KERNEL_EXTENT_WIDTH);
 
     const size_t EFFECTIVE_WIDTH =
-        (DATA_WIDTH - KERNEL_WIDTH + 2 * PADDING_WIDTH) / STRIDE_WIDTH + 1;
+        (DATA_WIDTH - KERNEL_EXTENT_WIDTH + 2 * PADDING_WIDTH) / STRIDE_WIDTH + 1;
     const size_t EFFECTIVE_HEIGHT =
-        (DATA_HEIGHT - KERNEL_HEIGHT + 2 * PADDING_HEIGHT) / STRIDE_HEIGHT + 1;
+        (DATA_HEIGHT - KERNEL_EXTENT_HEIGHT + 2 * PADDING_HEIGHT) / STRIDE_HEIGHT + 1;
 
     Tensor<double> x_padded = add_x_padding(x, PADDING_HEIGHT, PADDING_WIDTH);
 
@@ -79,17 +102,17 @@ static Tensor<double> naive_2d_convolution_forward(ConstTensor<double> kernel,
 
     for (size_t b = 0; b < BATCH_SIZE; ++b) {
         for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            const size_t first_channel = oc / GROUP_OUT_CHANNELS * GROUP_IN_CHANNELS;
             for (size_t eff_h = 0; eff_h < EFFECTIVE_HEIGHT; ++eff_h) {
                 for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
                     res(b, oc, eff_h, eff_w) = bias(oc);
                     for (size_t ker_h = 0; ker_h < KERNEL_HEIGHT; ++ker_h) {
                         for (size_t ker_w = 0; ker_w < KERNEL_WIDTH; ++ker_w) {
-                            for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
+                            const size_t h = eff_h * STRIDE_HEIGHT + ker_h * DILATION_HEIGHT;
+                            const size_t w = eff_w * STRIDE_WIDTH + ker_w * DILATION_WIDTH;
+                            for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
                                 res(b, oc, eff_h, eff_w) += kernel(oc, ic, ker_h, ker_w) *
-                                                            x_padded(b,
-                                                                     ic,
-                                                                     eff_h * STRIDE_HEIGHT + ker_h,
-                                                                     eff_w * STRIDE_WIDTH + ker_w);
+                                                            x_padded(b, first_channel + ic, h, w);
                             }
                         }
                     }
@@ -110,17 +133,22 @@ naive_2d_convolution_backward(ConstTensor<double> kernel,
                               size_t STRIDE_HEIGHT,
                               size_t STRIDE_WIDTH,
                               size_t PADDING_HEIGHT,
-                              size_t PADDING_WIDTH) {
+                              size_t PADDING_WIDTH,
+                              size_t DILATION_HEIGHT = 1,
+                              size_t DILATION_WIDTH = 1,
+                              size_t GROUPS = 1) {
     const auto &kernel_shape = kernel.get_shape().get_shape();
     const auto &x_shape = x.get_shape().get_shape();
     const auto &g_shape = grad_out.get_shape().get_shape();
 
     const size_t OUT_CHANNELS = kernel_shape[0];
-    const size_t IN_CHANNELS = kernel_shape[1];
+    const size_t GROUP_IN_CHANNELS = kernel_shape[1];
+    const size_t GROUP_OUT_CHANNELS = OUT_CHANNELS / GROUPS;
     const size_t KERNEL_HEIGHT = kernel_shape[2];
     const size_t KERNEL_WIDTH = kernel_shape[3];
 
     const size_t BATCH_SIZE = x_shape[0];
+    const size_t IN_CHANNELS = x_shape[1];
     const size_t FEATURE_HEIGHT = x_shape[2];
     const size_t FEATURE_WIDTH = x_shape[3];
 
@@ -129,7 +157,7 @@ naive_2d_convolution_backward(ConstTensor<double> kernel,
 
     Tensor<double> x_padded = add_x_padding(x, PADDING_HEIGHT, PADDING_WIDTH);
 
-    Tensor<double> grad_kernel{{OUT_CHANNELS, IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH}};
+    Tensor<double> grad_kernel{{OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH}};
     grad_kernel.set_zero();
 
     Tensor<double> grad_bias{{OUT_CHANNELS}};
@@ -143,6 +171,7 @@ naive_2d_convolution_backward(ConstTensor<double> kernel,
 
     for (size_t b = 0; b < BATCH_SIZE; ++b) {
         for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            const size_t first_channel = oc / GROUP_OUT_CHANNELS * GROUP_IN_CHANNELS;
             for (size_t eff_h = 0; eff_h < EFFECTIVE_HEIGHT; ++eff_h) {
                 for (size_t eff_w = 0; eff_w < EFFECTIVE_WIDTH; ++eff_w) {
                     double grad = grad_out(b, oc, eff_h, eff_w);
@@ -150,17 +179,13 @@ naive_2d_convolution_backward(ConstTensor<double> kernel,
 
                     for (size_t ker_h = 0; ker_h < KERNEL_HEIGHT; ++ker_h) {
                         for (size_t ker_w = 0; ker_w < KERNEL_WIDTH; ++ker_w) {
-                            for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
+                            const size_t h = eff_h * STRIDE_HEIGHT + ker_h * DILATION_HEIGHT;
+                            const size_t w = eff_w * STRIDE_WIDTH + ker_w * DILATION_WIDTH;
+                            for (size_t ic = 0; ic < GROUP_IN_CHANNELS; ++ic) {
 
                                 grad_kernel(oc, ic, ker_h, ker_w) +=
-                                    grad * x_padded(b,
-                                                    ic,
-                                                    eff_h * STRIDE_HEIGHT + ker_h,
-                                                    eff_w * STRIDE_WIDTH + ker_w);
-                                grad_x_padded(b,
-                                              ic,
-                                              eff_h * STRIDE_HEIGHT + ker_h,
-                                              eff_w * STRIDE_WIDTH + ker_w) +=
+                                    grad * x_padded(b, first_channel + ic, h, w);
+                                grad_x_padded(b, first_channel + ic, h, w) +=
                                     grad * kernel(oc, ic, ker_h, ker_w);
                             }
                         }
@@ -188,6 +213,11 @@ naive_2d_convolution_backward(ConstTensor<double> kernel,
 static void convolution_operator_2d_tests() {
     constexpr size_t test_runs = 100;
     constexpr double eps_threshold = 1e-4;
+    constexpr std::array algorithms{
+        ConvolutionAlgorithm::AUTOMATIC,
+        ConvolutionAlgorithm::IM2COL,
+        ConvolutionAlgorithm::DIRECT,
+    };
 
     for (size_t i = 0; i < test_runs; ++i) {
         // Generate a random convolution
@@ -210,9 +240,11 @@ static void convolution_operator_2d_tests() {
         Variable<double, true> x_data({BATCH_SIZE, IN_CHANNELS, FEATURES_HEIGHT, FEATURES_WIDTH});
         Variable<double, true> bias({OUT_CHANNELS});
 
+        // Each implementation is checked, and the automatic choice between them
         auto res = conv_2d(kernel, x_data, bias)
                        .set_stride(STRIDE_HEIGHT, STRIDE_WIDTH)
-                       .set_padding(PADDING_HEIGHT, PADDING_WIDTH);
+                       .set_padding(PADDING_HEIGHT, PADDING_WIDTH)
+                       .set_algorithm(algorithms[i % algorithms.size()]);
         const auto &conv_parameters = res.get_parameters();
         he_initialization(conv_parameters);
 
@@ -265,4 +297,701 @@ static void convolution_operator_2d_tests() {
             throw std::runtime_error(oss.str());
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * The Winograd convolutions (3x3 kernels with stride 1) against the im2col ones
+ */
+static void winograd_2d_tests() {
+    constexpr size_t test_runs = 20;
+    constexpr double eps_threshold = 1e-8;
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t IN_CHANNELS = random_size_t(1, 40);
+        const size_t OUT_CHANNELS = random_size_t(1, 40);
+        const size_t PADDING = random_size_t(0, 2);
+        const size_t BATCH_SIZE = random_size_t(1, 8);
+        // Odd sizes leave the last tiles partially outside the output
+        const size_t FEATURES_HEIGHT = random_size_t(3, 30);
+        const size_t FEATURES_WIDTH = random_size_t(3, 30);
+
+        Tensor<double> kernel = random_tensor({OUT_CHANNELS, IN_CHANNELS, 3, 3});
+        Tensor<double> x =
+            random_tensor({BATCH_SIZE, IN_CHANNELS, FEATURES_HEIGHT, FEATURES_WIDTH});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+
+        Convolution2D<double> im2col;
+        Convolution2D<double> winograd;
+        for (auto *convolution : {&im2col, &winograd}) {
+            convolution->PADDING_HEIGHT = PADDING;
+            convolution->PADDING_WIDTH = PADDING;
+        }
+        im2col.ALGORITHM = ConvolutionAlgorithm::IM2COL;
+        winograd.ALGORITHM = ConvolutionAlgorithm::WINOGRAD;
+
+        Tensor<double> expected = im2col.forward<true>(kernel, x, bias);
+        Tensor<double> actual = winograd.forward<true>(kernel, x, bias);
+        if (!check_tensor_equality<double>(actual, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[WINOGRAD_2D_TEST]: forward pass error mismatch (actual, im2col)=(" << actual
+                << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        auto expected_grads = im2col.backward(gradient);
+        auto actual_grads = winograd.backward(gradient);
+        if (!check_tensor_equality<double>(
+                std::get<0>(actual_grads), std::get<0>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<1>(actual_grads), std::get<1>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<2>(actual_grads), std::get<2>(expected_grads), eps_threshold)) {
+            throw std::runtime_error("[WINOGRAD_2D_TEST]: gradient mismatch");
+        }
+    }
+
+    // Only the 3x3 kernels with stride 1 can be computed with Winograd
+    Convolution2D<double> convolution;
+    convolution.ALGORITHM = ConvolutionAlgorithm::WINOGRAD;
+    convolution.STRIDE_HEIGHT = 2;
+    bool thrown = false;
+    try {
+        convolution.forward<false>(
+            random_tensor({1, 1, 3, 3}), random_tensor({1, 1, 8, 8}), random_tensor({1}));
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[WINOGRAD_2D_TEST]: a stride of 2 was accepted");
+    }
+}
+
+// [B, C, H, W] -> [B, H, W, C], or back with to_channels_last = false
+static Tensor<double> change_layout(ConstTensor<double> t, bool to_channels_last) {
+    const auto &shape = t.get_shape().get_shape();
+    const size_t B = shape[0];
+    const size_t C = to_channels_last ? shape[1] : shape[3];
+    const size_t H = to_channels_last ? shape[2] : shape[1];
+    const size_t W = to_channels_last ? shape[3] : shape[2];
+    Tensor<double> res{to_channels_last ? Shape{B, H, W, C} : Shape{B, C, H, W}};
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t h = 0; h < H; ++h) {
+                for (size_t w = 0; w < W; ++w) {
+                    if (to_channels_last) {
+                        res(b, h, w, c) = t(b, c, h, w);
+                    } else {
+                        res(b, c, h, w) = t(b, h, w, c);
+                    }
+                }
+            }
+        }
+    }
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * The channels-last convolutions against the channels-first ones on the transposed x
+ */
+static void channels_last_2d_tests() {
+    constexpr size_t test_runs = 20;
+    constexpr double eps_threshold = 1e-8;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t IN_CHANNELS = random_size_t(1, 10);
+        const size_t OUT_CHANNELS = random_size_t(1, 10);
+        const size_t KERNEL_HEIGHT = random_size_t(1, 5);
+        const size_t KERNEL_WIDTH = random_size_t(1, 5);
+        const size_t STRIDE_HEIGHT = random_size_t(1, 3);
+        const size_t STRIDE_WIDTH = random_size_t(1, 3);
+        const size_t PADDING_HEIGHT = random_size_t(0, 5);
+        const size_t PADDING_WIDTH = random_size_t(0, 5);
+        const size_t BATCH_SIZE = random_size_t(1, 10);
+        const size_t FEATURES_HEIGHT = random_size_t(KERNEL_HEIGHT, 30);
+        const size_t FEATURES_WIDTH = random_size_t(KERNEL_WIDTH, 30);
+
+        Variable<double, true> kernel({OUT_CHANNELS, IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Variable<double, true> x_data({BATCH_SIZE, FEATURES_HEIGHT, FEATURES_WIDTH, IN_CHANNELS});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = conv_2d(kernel, x_data, bias)
+                       .set_stride(STRIDE_HEIGHT, STRIDE_WIDTH)
+                       .set_padding(PADDING_HEIGHT, PADDING_WIDTH)
+                       .set_layout(ConvolutionLayout::CHANNELS_LAST);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Convolution2D<double> channels_first;
+        channels_first.STRIDE_HEIGHT = STRIDE_HEIGHT;
+        channels_first.STRIDE_WIDTH = STRIDE_WIDTH;
+        channels_first.PADDING_HEIGHT = PADDING_HEIGHT;
+        channels_first.PADDING_WIDTH = PADDING_WIDTH;
+        channels_first.ALGORITHM = ConvolutionAlgorithm::IM2COL;
+
+        auto layer_res = res.forward();
+        Tensor<double> expected = channels_first.forward<true>(
+            kernel.tensor, change_layout(x_data.tensor, /*to_channels_last=*/false), bias.tensor);
+        if (!check_tensor_equality<double>(
+                change_layout(layer_res, /*to_channels_last=*/false), expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[CHANNELS_LAST_2D_TEST]: forward pass error mismatch (actual, expected)=("
+                << layer_res << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(layer_res.get_shape());
+        res.backward(gradient);
+        auto [kernel_grad, x_grad, bias_grad] =
+            channels_first.backward(change_layout(gradient, /*to_channels_last=*/false));
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(
+                change_layout(x_grad, /*to_channels_last=*/true),
+                conv_parameters[1].gradient,
+                eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[CHANNELS_LAST_2D_TEST]: gradient mismatch");
+        }
+    }
+
+    // Only the im2col kernels support the channels-last layout
+    Convolution2D<double> convolution;
+    convolution.LAYOUT = ConvolutionLayout::CHANNELS_LAST;
+    convolution.ALGORITHM = ConvolutionAlgorithm::WINOGRAD;
+    Tensor<double> kernel{{1, 1, 3, 3}};
+    Tensor<double> x{{1, 8, 8, 1}};
+    Tensor<double> bias{{1}};
+    bool thrown = false;
+    try {
+        convolution.forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[CHANNELS_LAST_2D_TEST]: the Winograd kernels were used");
+    }
+}
+
+/**
+ * The im2col convolutions split between several threads, and by chunks of samples, against the
+ * single threaded ones
+ */
+static void threaded_2d_tests() {
+    constexpr size_t test_runs = 10;
+    constexpr double eps_threshold = 1e-10;
+    const ThreadingConfig default_config = get_threading();
+    ThreadingConfig single_thread{};
+    single_thread.outer_parallelism = true;
+    ThreadingConfig threaded{};
+    threaded.max_threads = 4;
+    threaded.flops_per_thread = 64;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t IN_CHANNELS = random_size_t(1, 6);
+        const size_t OUT_CHANNELS = random_size_t(1, 6);
+        const size_t KERNEL_SIZE = random_size_t(1, 4);
+        const size_t STRIDE = random_size_t(1, 2);
+        const size_t PADDING = random_size_t(0, 2);
+        const size_t BATCH_SIZE = random_size_t(1, 9);
+        const size_t FEATURES = random_size_t(KERNEL_SIZE, 20);
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+
+        Tensor<double> kernel =
+            random_tensor({OUT_CHANNELS, IN_CHANNELS, KERNEL_SIZE, KERNEL_SIZE});
+        Tensor<double> x = random_tensor(layout == ConvolutionLayout::CHANNELS_LAST
+                                             ? Shape{BATCH_SIZE, FEATURES, FEATURES, IN_CHANNELS}
+                                             : Shape{BATCH_SIZE, IN_CHANNELS, FEATURES, FEATURES});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+        auto make_convolution = [&]() {
+            Convolution2D<double> convolution;
+            convolution.STRIDE_HEIGHT = convolution.STRIDE_WIDTH = STRIDE;
+            convolution.PADDING_HEIGHT = convolution.PADDING_WIDTH = PADDING;
+            convolution.ALGORITHM = ConvolutionAlgorithm::IM2COL;
+            convolution.LAYOUT = layout;
+            return convolution;
+        };
+
+        set_threading(single_thread);
+        Convolution2D<double> reference = make_convolution();
+        Tensor<double> expected = reference.forward<true>(kernel, x, bias);
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        auto expected_grads = reference.backward(gradient);
+
+        set_threading(threaded);
+        Convolution2D<double> convolution = make_convolution();
+        Tensor<double> actual = convolution.forward<true>(kernel, x, bias);
+        auto actual_grads = convolution.backward(gradient);
+        // Chunks of one sample, of a few samples, and frozen
+        Convolution2D<double> tiled = make_convolution();
+        tiled.IM2COL_TILE_BYTES = 1;
+        Tensor<double> tiled_single = tiled.forward<false>(kernel, x, bias);
+        const size_t im2col_sample_bytes = actual.get_size() / (BATCH_SIZE * OUT_CHANNELS) *
+                                           IN_CHANNELS * KERNEL_SIZE * KERNEL_SIZE * sizeof(double);
+        tiled.IM2COL_TILE_BYTES = 2 * im2col_sample_bytes + 1;
+        tiled.freeze();
+        Tensor<double> tiled_frozen = tiled.forward<false>(kernel, x, bias);
+        set_threading(default_config);
+
+        if (!check_tensor_equality<double>(actual, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_single, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_frozen, expected, eps_threshold)) {
+            throw std::runtime_error("[THREADED_2D_TEST]: forward pass error mismatch");
+        }
+        if (!check_tensor_equality<double>(
+                std::get<0>(actual_grads), std::get<0>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<1>(actual_grads), std::get<1>(expected_grads), eps_threshold) ||
+            !check_tensor_equality<double>(
+                std::get<2>(actual_grads), std::get<2>(expected_grads), eps_threshold)) {
+            throw std::runtime_error("[THREADED_2D_TEST]: gradient mismatch");
+        }
+    }
+}
+
+/**
+ * Grouped, depthwise and dilated convolutions, with every algorithm and layout that supports them,
+ * against the naive ones
+ */
+static void grouped_2d_tests() {
+    constexpr size_t test_runs = 20;
+    constexpr double eps_threshold = 1e-8;
+    constexpr std::array algorithms{ConvolutionAlgorithm::AUTOMATIC,
+                                    ConvolutionAlgorithm::IM2COL,
+                                    ConvolutionAlgorithm::DIRECT};
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t GROUPS = random_size_t(1, 4);
+        const bool depthwise = i % 3 == 0;
+        const size_t GROUP_IN_CHANNELS = depthwise ? 1 : random_size_t(1, 3);
+        const size_t GROUP_OUT_CHANNELS = random_size_t(1, 3);
+        const size_t IN_CHANNELS = GROUPS * GROUP_IN_CHANNELS;
+        const size_t OUT_CHANNELS = GROUPS * GROUP_OUT_CHANNELS;
+        const size_t KERNEL_HEIGHT = random_size_t(1, 4);
+        const size_t KERNEL_WIDTH = random_size_t(1, 4);
+        const size_t DILATION_HEIGHT = random_size_t(1, 3);
+        const size_t DILATION_WIDTH = random_size_t(1, 3);
+        const size_t STRIDE_HEIGHT = random_size_t(1, 3);
+        const size_t STRIDE_WIDTH = random_size_t(1, 3);
+        const size_t PADDING_HEIGHT = random_size_t(0, 3);
+        const size_t PADDING_WIDTH = random_size_t(0, 3);
+        const size_t BATCH_SIZE = random_size_t(1, 4);
+        const size_t DATA_HEIGHT = random_size_t(DILATION_HEIGHT * (KERNEL_HEIGHT - 1) + 1, 20);
+        const size_t DATA_WIDTH = random_size_t(DILATION_WIDTH * (KERNEL_WIDTH - 1) + 1, 20);
+        const bool channels_last = i % 2 == 1;
+        const ConvolutionLayout layout =
+            channels_last ? ConvolutionLayout::CHANNELS_LAST : ConvolutionLayout::CHANNELS_FIRST;
+
+        Tensor<double> kernel =
+            random_tensor({OUT_CHANNELS, GROUP_IN_CHANNELS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Tensor<double> x = random_tensor({BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Tensor<double> bias = random_tensor({OUT_CHANNELS});
+        Tensor<double> expected = naive_2d_convolution_forward(kernel,
+                                                               x,
+                                                               bias,
+                                                               STRIDE_HEIGHT,
+                                                               STRIDE_WIDTH,
+                                                               PADDING_HEIGHT,
+                                                               PADDING_WIDTH,
+                                                               DILATION_HEIGHT,
+                                                               DILATION_WIDTH,
+                                                               GROUPS);
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        const auto &[kernel_grad, x_grad, bias_grad] =
+            naive_2d_convolution_backward(kernel,
+                                          x,
+                                          gradient,
+                                          STRIDE_HEIGHT,
+                                          STRIDE_WIDTH,
+                                          PADDING_HEIGHT,
+                                          PADDING_WIDTH,
+                                          DILATION_HEIGHT,
+                                          DILATION_WIDTH,
+                                          GROUPS);
+
+        for (ConvolutionAlgorithm algorithm : algorithms) {
+            if (channels_last && algorithm == ConvolutionAlgorithm::DIRECT) {
+                continue;
+            }
+            auto make_convolution = [&]() {
+                Convolution2D<double> convolution;
+                convolution.STRIDE_HEIGHT = STRIDE_HEIGHT;
+                convolution.STRIDE_WIDTH = STRIDE_WIDTH;
+                convolution.PADDING_HEIGHT = PADDING_HEIGHT;
+                convolution.PADDING_WIDTH = PADDING_WIDTH;
+                convolution.DILATION_HEIGHT = DILATION_HEIGHT;
+                convolution.DILATION_WIDTH = DILATION_WIDTH;
+                convolution.GROUPS = GROUPS;
+                convolution.ALGORITHM = algorithm;
+                convolution.LAYOUT = layout;
+                return convolution;
+            };
+            Tensor<double> layout_x = channels_last ? change_layout(x, true) : x;
+            Tensor<double> layout_gradient =
+                channels_last ? change_layout(gradient, true) : gradient;
+
+            Convolution2D<double> convolution = make_convolution();
+            Tensor<double> actual = convolution.forward<true>(kernel, layout_x, bias);
+            auto [actual_kernel_grad, actual_x_grad, actual_bias_grad] =
+                convolution.backward(layout_gradient);
+            // The im2col matrix by chunks of one sample
+            Convolution2D<double> tiled = make_convolution();
+            tiled.IM2COL_TILE_BYTES = 1;
+            Tensor<double> actual_tiled = tiled.forward<false>(kernel, layout_x, bias);
+            if (channels_last) {
+                actual = change_layout(actual, false);
+                actual_tiled = change_layout(actual_tiled, false);
+                actual_x_grad = change_layout(actual_x_grad, false);
+            }
+
+            if (!check_tensor_equality<double>(actual, expected, eps_threshold) ||
+                !check_tensor_equality<double>(actual_tiled, expected, eps_threshold)) {
+                std::ostringstream oss;
+                oss << "[GROUPED_2D_TEST]: forward pass error mismatch (actual, simulated)=("
+                    << actual << ", " << expected << ")";
+                throw std::runtime_error(oss.str());
+            }
+            if (!check_tensor_equality<double>(actual_kernel_grad, kernel_grad, eps_threshold) ||
+                !check_tensor_equality<double>(actual_x_grad, x_grad, eps_threshold) ||
+                !check_tensor_equality<double>(actual_bias_grad, bias_grad, eps_threshold)) {
+                throw std::runtime_error("[GROUPED_2D_TEST]: gradient mismatch");
+            }
+        }
+    }
+
+    // The Winograd kernels are only dense
+    Convolution2D<double> convolution;
+    convolution.GROUPS = 2;
+    convolution.PADDING_HEIGHT = 1;
+    convolution.PADDING_WIDTH = 1;
+    convolution.ALGORITHM = ConvolutionAlgorithm::WINOGRAD;
+    Tensor<double> kernel{{2, 1, 3, 3}};
+    Tensor<double> x{{1, 2, 8, 8}};
+    Tensor<double> bias{{2}};
+    bool thrown = false;
+    try {
+        convolution.forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[GROUPED_2D_TEST]: the Winograd kernels were used with groups");
+    }
+}
+
+/**
+ * Naive transposed convolution: each element of x adds the kernel, times itself, to the output
+ */
+static Tensor<double> naive_2d_transposed_convolution_forward(ConstTensor<double> kernel,
+                                                              ConstTensor<double> x,
+                                                              ConstTensor<double> bias,
+                                                              std::array<size_t, 2> STRIDE,
+                                                              std::array<size_t, 2> PADDING,
+                                                              std::array<size_t, 2> OUTPUT_PADDING,
+                                                              std::array<size_t, 2> DILATION,
+                                                              size_t GROUPS) {
+    const auto &kernel_shape = kernel.get_shape().get_shape();
+    const auto &x_shape = x.get_shape().get_shape();
+
+    const size_t IN_CHANNELS = kernel_shape[0];
+    const size_t GROUP_OUT_CHANNELS = kernel_shape[1];
+    const size_t GROUP_IN_CHANNELS = IN_CHANNELS / GROUPS;
+    const size_t OUT_CHANNELS = GROUPS * GROUP_OUT_CHANNELS;
+    const std::array<size_t, 2> KERNEL{kernel_shape[2], kernel_shape[3]};
+
+    const size_t BATCH_SIZE = x_shape[0];
+    assert(IN_CHANNELS == x_shape[1]);
+    const std::array<size_t, 2> DATA{x_shape[2], x_shape[3]};
+    std::array<size_t, 2> OUTPUT{};
+    for (size_t d = 0; d < 2; ++d) {
+        OUTPUT[d] = (DATA[d] - 1) * STRIDE[d] + DILATION[d] * (KERNEL[d] - 1) + 1 +
+                    OUTPUT_PADDING[d] - 2 * PADDING[d];
+    }
+
+    Tensor<double> res{{BATCH_SIZE, OUT_CHANNELS, OUTPUT[0], OUTPUT[1]}};
+    for (size_t b = 0; b < BATCH_SIZE; ++b) {
+        for (size_t oc = 0; oc < OUT_CHANNELS; ++oc) {
+            for (size_t h = 0; h < OUTPUT[0]; ++h) {
+                for (size_t w = 0; w < OUTPUT[1]; ++w) {
+                    res(b, oc, h, w) = bias(oc);
+                }
+            }
+        }
+        for (size_t ic = 0; ic < IN_CHANNELS; ++ic) {
+            const size_t first_channel = ic / GROUP_IN_CHANNELS * GROUP_OUT_CHANNELS;
+            for (size_t h = 0; h < DATA[0]; ++h) {
+                for (size_t w = 0; w < DATA[1]; ++w) {
+                    for (size_t kh = 0; kh < KERNEL[0]; ++kh) {
+                        for (size_t kw = 0; kw < KERNEL[1]; ++kw) {
+                            const size_t out_h = h * STRIDE[0] + kh * DILATION[0];
+                            const size_t out_w = w * STRIDE[1] + kw * DILATION[1];
+                            if (out_h < PADDING[0] || out_h - PADDING[0] >= OUTPUT[0] ||
+                                out_w < PADDING[1] || out_w - PADDING[1] >= OUTPUT[1]) {
+                                continue;
+                            }
+                            const size_t res_h = out_h - PADDING[0];
+                            const size_t res_w = out_w - PADDING[1];
+                            for (size_t oc = 0; oc < GROUP_OUT_CHANNELS; ++oc) {
+                                res(b, first_channel + oc, res_h, res_w) +=
+                                    x(b, ic, h, w) * kernel(ic, oc, kh, kw);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return res;
+}
+
+/**
+ * The transposed convolutions against the naive one, the gradients are the steps of the naive
+ * convolution as in transposed_1d_tests
+ */
+static void transposed_2d_tests() {
+    constexpr size_t test_runs = 30;
+    constexpr double eps_threshold = 1e-8;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const size_t GROUPS = i % 4 == 0 ? random_size_t(2, 3) : 1;
+        const size_t IN_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t OUT_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t KERNEL_HEIGHT = random_size_t(1, 4);
+        const size_t KERNEL_WIDTH = random_size_t(1, 4);
+        const size_t DILATION_HEIGHT = i % 3 == 0 ? random_size_t(1, 2) : 1;
+        const size_t DILATION_WIDTH = i % 3 == 0 ? random_size_t(1, 2) : 1;
+        const size_t STRIDE_HEIGHT = random_size_t(1, 3);
+        const size_t STRIDE_WIDTH = random_size_t(1, 3);
+        const size_t OUTPUT_PADDING_HEIGHT = random_size_t(0, STRIDE_HEIGHT - 1);
+        const size_t OUTPUT_PADDING_WIDTH = random_size_t(0, STRIDE_WIDTH - 1);
+        const size_t PADDING_HEIGHT =
+            random_size_t(0, DILATION_HEIGHT * (KERNEL_HEIGHT - 1) / 2);
+        const size_t PADDING_WIDTH = random_size_t(0, DILATION_WIDTH * (KERNEL_WIDTH - 1) / 2);
+        const size_t BATCH_SIZE = random_size_t(1, 4);
+        const size_t DATA_HEIGHT = random_size_t(1, 10);
+        const size_t DATA_WIDTH = random_size_t(1, 10);
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+        const bool channels_last = layout == ConvolutionLayout::CHANNELS_LAST;
+
+        Variable<double, true> kernel(
+            {IN_CHANNELS, OUT_CHANNELS / GROUPS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Variable<double, true> x_data(
+            channels_last ? Shape{BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS}
+                          : Shape{BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = conv_transpose_2d(kernel, x_data, bias)
+                       .set_stride(STRIDE_HEIGHT, STRIDE_WIDTH)
+                       .set_padding(PADDING_HEIGHT, PADDING_WIDTH)
+                       .set_output_padding(OUTPUT_PADDING_HEIGHT, OUTPUT_PADDING_WIDTH)
+                       .set_dilation(DILATION_HEIGHT, DILATION_WIDTH)
+                       .set_groups(GROUPS)
+                       .set_layout(layout);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Tensor<double> x = channels_last ? change_layout(x_data.tensor, false) : x_data.tensor;
+        Tensor<double> layer_res = res.forward().clone();
+        if (channels_last) {
+            layer_res = change_layout(layer_res, false);
+        }
+        Tensor<double> expected =
+            naive_2d_transposed_convolution_forward(kernel.tensor,
+                                                    x,
+                                                    bias.tensor,
+                                                    {STRIDE_HEIGHT, STRIDE_WIDTH},
+                                                    {PADDING_HEIGHT, PADDING_WIDTH},
+                                                    {OUTPUT_PADDING_HEIGHT, OUTPUT_PADDING_WIDTH},
+                                                    {DILATION_HEIGHT, DILATION_WIDTH},
+                                                    GROUPS);
+        if (!check_tensor_equality<double>(layer_res, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[TRANSPOSED_2D_TEST]: forward pass error mismatch (actual, simulated)=("
+                << layer_res << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        Tensor<double> no_bias{{IN_CHANNELS}};
+        no_bias.set_zero();
+        Tensor<double> x_grad = naive_2d_convolution_forward(kernel.tensor,
+                                                             gradient,
+                                                             no_bias,
+                                                             STRIDE_HEIGHT,
+                                                             STRIDE_WIDTH,
+                                                             PADDING_HEIGHT,
+                                                             PADDING_WIDTH,
+                                                             DILATION_HEIGHT,
+                                                             DILATION_WIDTH,
+                                                             GROUPS);
+        const auto &[kernel_grad, gradient_grad, x_sums] =
+            naive_2d_convolution_backward(kernel.tensor,
+                                          gradient,
+                                          x,
+                                          STRIDE_HEIGHT,
+                                          STRIDE_WIDTH,
+                                          PADDING_HEIGHT,
+                                          PADDING_WIDTH,
+                                          DILATION_HEIGHT,
+                                          DILATION_WIDTH,
+                                          GROUPS);
+        const size_t OUTPUT_SIZE = gradient.get_shape()[2] * gradient.get_shape()[3];
+        Tensor<double> bias_grad{{OUT_CHANNELS}};
+        bias_grad.set_zero();
+        for (size_t j = 0; j < gradient.get_size(); ++j) {
+            bias_grad[j / OUTPUT_SIZE % OUT_CHANNELS] += gradient[j];
+        }
+
+        res.backward(channels_last ? change_layout(gradient, true) : gradient);
+        Tensor<double> actual_x_grad = conv_parameters[1].gradient;
+        if (channels_last) {
+            actual_x_grad = change_layout(actual_x_grad, false);
+        }
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(x_grad, actual_x_grad, eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[TRANSPOSED_2D_TEST]: gradient mismatch");
+        }
+    }
+
+    // The output padding selects one of the sizes of the output
+    Convolution2D<double> convolution;
+    convolution.STRIDE_WIDTH = 2;
+    convolution.OUTPUT_PADDING_WIDTH = 2;
+    Tensor<double> kernel{{1, 1, 3, 3}};
+    Tensor<double> x{{1, 1, 8, 8}};
+    Tensor<double> bias{{1}};
+    bool thrown = false;
+    try {
+        convolution.transposed_forward<false>(kernel, x, bias);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[TRANSPOSED_2D_TEST]: the output padding was not checked");
+    }
+}
+
+/**
+ * relu(conv_2d(...)) is a single node, as relu(conv_1d(...))
+ */
+static void fused_relu_2d_tests() {
+    constexpr size_t test_runs = 32;
+    constexpr double eps_threshold = 1e-8;
+    constexpr std::array algorithms{ConvolutionAlgorithm::AUTOMATIC,
+                                    ConvolutionAlgorithm::IM2COL,
+                                    ConvolutionAlgorithm::DIRECT,
+                                    ConvolutionAlgorithm::WINOGRAD};
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const ConvolutionLayout layout =
+            i % 2 == 0 ? ConvolutionLayout::CHANNELS_FIRST : ConvolutionLayout::CHANNELS_LAST;
+        const bool channels_last = layout == ConvolutionLayout::CHANNELS_LAST;
+        ConvolutionAlgorithm algorithm = algorithms[i / 2 % algorithms.size()];
+        // Only the im2col kernels support the channels-last layout
+        if (channels_last && (algorithm == ConvolutionAlgorithm::DIRECT ||
+                              algorithm == ConvolutionAlgorithm::WINOGRAD)) {
+            algorithm = ConvolutionAlgorithm::IM2COL;
+        }
+        // The Winograd kernels are only for dense 3x3 kernels with stride 1
+        const bool winograd = algorithm == ConvolutionAlgorithm::WINOGRAD;
+        const size_t GROUPS = !winograd && i % 3 == 0 ? random_size_t(2, 3) : 1;
+        const size_t IN_CHANNELS = GROUPS * random_size_t(1, 4);
+        const size_t OUT_CHANNELS = GROUPS * random_size_t(1, 6);
+        const size_t KERNEL_HEIGHT = winograd ? 3 : random_size_t(1, 4);
+        const size_t KERNEL_WIDTH = winograd ? 3 : random_size_t(1, 4);
+        const size_t STRIDE_HEIGHT = winograd ? 1 : random_size_t(1, 3);
+        const size_t STRIDE_WIDTH = winograd ? 1 : random_size_t(1, 3);
+        const size_t PADDING_HEIGHT = random_size_t(0, 2);
+        const size_t PADDING_WIDTH = random_size_t(0, 2);
+        const size_t BATCH_SIZE = random_size_t(1, 4);
+        const size_t DATA_HEIGHT = random_size_t(KERNEL_HEIGHT, 12);
+        const size_t DATA_WIDTH = random_size_t(KERNEL_WIDTH, 12);
+
+        Variable<double, true> kernel(
+            {OUT_CHANNELS, IN_CHANNELS / GROUPS, KERNEL_HEIGHT, KERNEL_WIDTH});
+        Variable<double, true> x_data(
+            channels_last ? Shape{BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, IN_CHANNELS}
+                          : Shape{BATCH_SIZE, IN_CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Variable<double, true> bias({OUT_CHANNELS});
+
+        auto res = relu(conv_2d(kernel, x_data, bias)
+                            .set_stride(STRIDE_HEIGHT, STRIDE_WIDTH)
+                            .set_padding(PADDING_HEIGHT, PADDING_WIDTH)
+                            .set_groups(GROUPS)
+                            .set_algorithm(algorithm)
+                            .set_layout(layout));
+        static_assert(std::is_same_v<typename decltype(res)::Operator, DApConv2d<true>>);
+        const auto &conv_parameters = res.get_parameters();
+        random_test_initialization(conv_parameters);
+
+        Tensor<double> x = channels_last ? change_layout(x_data.tensor, false) : x_data.tensor;
+        Tensor<double> expected = naive_2d_convolution_forward(kernel.tensor,
+                                                               x,
+                                                               bias.tensor,
+                                                               STRIDE_HEIGHT,
+                                                               STRIDE_WIDTH,
+                                                               PADDING_HEIGHT,
+                                                               PADDING_WIDTH,
+                                                               1,
+                                                               1,
+                                                               GROUPS);
+        for (size_t j = 0; j < expected.get_size(); ++j) {
+            expected[j] = std::max(expected[j], 0.0);
+        }
+        Tensor<double> layer_res = res.forward().clone();
+        // Out of training, by chunks of one sample
+        Convolution2D<double> tiled = res.get_convolution();
+        tiled.IM2COL_TILE_BYTES = 1;
+        Tensor<double> tiled_res =
+            tiled.forward<false, true>(kernel.tensor, x_data.tensor, bias.tensor);
+        if (channels_last) {
+            layer_res = change_layout(layer_res, false);
+            tiled_res = change_layout(tiled_res, false);
+        }
+        if (!check_tensor_equality<double>(layer_res, expected, eps_threshold) ||
+            !check_tensor_equality<double>(tiled_res, expected, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[FUSED_RELU_2D_TEST]: forward pass error mismatch (actual, simulated)=("
+                << layer_res << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        // The gradient goes through the relu where the output is positive
+        Tensor<double> gradient = random_tensor(expected.get_shape());
+        Tensor<double> masked_gradient = expected.clone();
+        for (size_t j = 0; j < gradient.get_size(); ++j) {
+            masked_gradient[j] = expected[j] > 0.0 ? gradient[j] : 0.0;
+        }
+        masked_gradient.wrap_for_broadcasting();
+        const auto &[kernel_grad, x_grad, bias_grad] =
+            naive_2d_convolution_backward(kernel.tensor,
+                                          x,
+                                          masked_gradient,
+                                          STRIDE_HEIGHT,
+                                          STRIDE_WIDTH,
+                                          PADDING_HEIGHT,
+                                          PADDING_WIDTH,
+                                          1,
+                                          1,
+                                          GROUPS);
+
+        res.backward(channels_last ? change_layout(gradient, true) : gradient);
+        Tensor<double> actual_x_grad = conv_parameters[1].gradient;
+        if (channels_last) {
+            actual_x_grad = change_layout(actual_x_grad, false);
+        }
+        if (!check_tensor_equality<double>(
+                kernel_grad, conv_parameters[0].gradient, eps_threshold) ||
+            !check_tensor_equality<double>(x_grad, actual_x_grad, eps_threshold) ||
+            !check_tensor_equality<double>(
+                bias_grad, conv_parameters[2].gradient, eps_threshold)) {
+            throw std::runtime_error("[FUSED_RELU_2D_TEST]: gradient mismatch");
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#include "dynamic_graph_tests.h"
+
+#include "../expressions/expression.h"
+#include "../dynamic/dynamic_graph.h"
+#include "../dynamic/graph_loader.h"
+#include "../weight_initializer.h"
+
+#include <sstream>
+
+#include "../tensor_variable.h"
+#include "test_utils.h"
+
+static void compile_time_equivalence_tests();
+static void graph_loader_tests();
+static void batch_matmul_equivalence_tests();
+
+void dynamic_graph_tests() {
+    compile_time_equivalence_tests();
+    graph_loader_tests();
+    batch_matmul_equivalence_tests();
+}
+
+/**
+ * Runs the same network as an expression template and as a DynamicGraph, and checks that the
+ * outputs (forward and fused eval) and the gradients of the parameters are the same.
+ */
+template <typename Expr>
+static void check_equivalence(DExpr<Expr> &expected,
+                              DynamicGraph<double> &graph,
+                              const std::vector<Variable<double, true>> &params,
+                              const std::string &test_name) {
+    constexpr double eps_threshold = 1e-8;
+
+    Tensor<double> out = expected.forward().clone();
+    if (!check_tensor_equality<double>(out, graph.eval(), eps_threshold)) {
+        throw std::runtime_error("[" + test_name + "]: eval mismatch");
+    }
+    if (!check_tensor_equality<double>(out, graph.forward(), eps_threshold)) {
+        throw std::runtime_error("[" + test_name + "]: forward pass mismatch");
+    }
+
+    Tensor<double> gradient = out.clone();
+    for (size_t i = 0; i < gradient.get_size(); ++i) {
+        gradient[i] = static_cast<double>(i % 7) - 3.0;
+    }
+    gradient.wrap_for_broadcasting();
+
+    for (const auto &[_, grad] : params) {
+        grad.set_zero();
+    }
+    expected.backward(gradient);
+    std::vector<Tensor<double>> expected_grads;
+    for (const auto &[_, grad] : params) {
+        expected_grads.push_back(grad.clone());
+        grad.set_zero();
+    }
+
+    graph.backward(gradient);
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (!check_tensor_equality<double>(expected_grads[i], params[i].gradient, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[" << test_name << "]: gradient mismatch for parameter " << i;
+            throw std::runtime_error(oss.str());
+        }
+    }
+}
+
+static void compile_time_equivalence_tests() {
+    Variable<double, true> k({4, 2, 3});
+    Variable<double, true> q({4});
+    Variable<double, true> m({4 * 9, 5});
+    Variable<double, true> q2({5});
+    Variable<double, true> w({5});
+    Variable<double, true> c({3, 5});
+    Variable<double, false> x({3, 2, 17});
+
+    std::vector<Variable<double, true>> params{k, q, m, q2, w, c};
+    random_test_initialization(params);
+    Variable<double, true> x_random{x.tensor};
+    random_test_initialization(std::vector<Variable<double, true>>{x_random});
+
+    auto y = matmul(flatten(relu(conv_1d(k, x, q).set_stride(2).set_padding(1))), m) + q2;
+    auto expected = relu(y) * w + y - c;
+
+    DynamicGraph<double> graph;
+    size_t x_node = graph.add_input(x);
+    size_t k_node = graph.add_parameter(k);
+    size_t q_node = graph.add_parameter(q);
+    size_t m_node = graph.add_parameter(m);
+    size_t q2_node = graph.add_parameter(q2);
+    size_t w_node = graph.add_parameter(w);
+    size_t c_node = graph.add_parameter(c);
+
+    size_t conv_node = graph.add_conv_1d(k_node, x_node, q_node, 2, 1);
+    size_t flat_node =
+        graph.add_node<DApFlatten>({graph.add_node<DApRELU>({conv_node})});
+    size_t y_node = graph.add_node<DApSum>(
+        {graph.add_node<DApMatMul<false, false>>({flat_node, m_node}), q2_node});
+    size_t relu_node = graph.add_node<DApRELU>({y_node});
+    size_t mul_node = graph.add_node<DApMul>({relu_node, w_node});
+    size_t sum_node = graph.add_node<DApSum>({mul_node, y_node});
+    size_t out_node = graph.add_node<DApDiff>({sum_node, c_node});
+    graph.compile(out_node);
+
+    // y is used twice, so it is not fused, but relu(y) * w + y - c is a single program
+    // conv, relu, flatten, matmul, y, fused output
+    if (graph.get_eval_plan_size() != 6) {
+        throw std::runtime_error("[DYNAMIC_GRAPH_TEST]: elementwise chain not fused");
+    }
+
+    check_equivalence(expected, graph, params, "DYNAMIC_GRAPH_TEST");
+}
+
+static void graph_loader_tests() {
+    std::istringstream description{"# small convolutional network\n"
+                                   "input 1 20\n"
+                                   "conv1d 3 3 2 1\n"
+                                   "relu\n"
+                                   "\n"
+                                   "conv1d 2 3 1 0\n"
+                                   "relu\n"
+                                   "flatten\n"
+                                   "linear 4\n"};
+    DynamicGraph<double> graph = parse_dynamic_graph<double>(description, /*batch_size=*/5);
+
+    auto params = graph.get_parameters();
+    if (params.size() != 6) {
+        throw std::runtime_error("[GRAPH_LOADER_TEST]: wrong number of parameters");
+    }
+    random_test_initialization(params);
+    Variable<double, true> x_random{graph.get_input()};
+    random_test_initialization(std::vector<Variable<double, true>>{x_random});
+
+    Variable<double, false> x{graph.get_input()};
+    auto y1 = relu(conv_1d(params[0], x, params[1]).set_stride(2).set_padding(1));
+    auto y2 = relu(conv_1d(params[2], y1, params[3]));
+    auto expected = matmul(flatten(y2), params[4]) + params[5];
+
+    check_equivalence(expected, graph, params, "GRAPH_LOADER_TEST");
+
+    // A new input must have the shape the graph was built for
+    Tensor<double> new_x = x.tensor.clone();
+    for (size_t i = 0; i < new_x.get_size(); ++i) {
+        new_x[i] = new_x[i] * 0.5 + 0.125;
+        x.tensor[i] = new_x[i];
+    }
+    graph.set_input(0, new_x);
+    if (!check_tensor_equality<double>(expected.eval(), graph.eval(), 1e-8)) {
+        throw std::runtime_error("[GRAPH_LOADER_TEST]: eval mismatch after set_input");
+    }
+    bool has_thrown = false;
+    try {
+        graph.set_input(0, Tensor<double>{6, 1, 20});
+    } catch (const std::runtime_error &) {
+        has_thrown = true;
+    }
+    if (!has_thrown) {
+        throw std::runtime_error("[GRAPH_LOADER_TEST]: input with a new batch size accepted");
+    }
+
+    // Invalid descriptions
+    for (const char *invalid : {"relu\n", "input 1 20\nconv1d 3 3\n", "input 1 20\nfoo\n",
+                                "input 1 20\nlinear 4\n", "input 1 20\nconv1d 3 30 1 0\n"}) {
+        std::istringstream stream{invalid};
+        bool has_thrown = false;
+        try {
+            parse_dynamic_graph<double>(stream, 5);
+        } catch (const std::runtime_error &) {
+            has_thrown = true;
+        }
+        if (!has_thrown) {
+            throw std::runtime_error(std::string("[GRAPH_LOADER_TEST]: invalid description "
+                                                 "accepted: ") +
+                                     invalid);
+        }
+    }
+}
+
+static void batch_matmul_equivalence_tests() {
+    Variable<double, true> a({4, 6, 3});
+    Variable<double, true> b({4, 3, 5});
+    Variable<double, true> c({5});
+
+    std::vector<Variable<double, true>> params{a, b, c};
+    random_test_initialization(params);
+
+    auto expected = batch_matmul(a, b) * c;
+
+    DynamicGraph<double> graph;
+    size_t a_node = graph.add_parameter(a);
+    size_t b_node = graph.add_parameter(b);
+    size_t c_node = graph.add_parameter(c);
+    size_t out_node =
+        graph.add_node<DApMul>({graph.add_node<DApBatchMatMul>({a_node, b_node}), c_node});
+    graph.compile(out_node);
+
+    check_equivalence(expected, graph, params, "DYNAMIC_GRAPH_BATCH_MATMUL_TEST");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void dynamic_graph_tests();
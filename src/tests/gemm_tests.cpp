@@ -0,0 +1,206 @@
+#include "gemm_tests.h"
+
+#include "../blas_wrapper.h"
+#include "../expressions/expression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "test_utils.h"
+
+static void native_gemm_tests();
+static void gemm_backend_tests();
+static void threading_tests();
+
+void gemm_tests() {
+    native_gemm_tests();
+    gemm_backend_tests();
+    threading_tests();
+}
+
+template <typename T>
+static std::vector<T> make_matrix(size_t rows, size_t cols, size_t seed) {
+    std::vector<T> res(rows * cols);
+    for (size_t i = 0; i < res.size(); ++i) {
+        res[i] = static_cast<T>(static_cast<double>((i * 7 + seed) % 13) * 0.125 - 0.75);
+    }
+    return res;
+}
+
+/**
+ * Checks native_mat_mul (or native_mat_vec if m or n is 1) and packed_mat_mul against a naive
+ * triple loop for op(m1) of shape m x k and op(m2) of shape k x n
+ */
+template <typename T, bool TransposeM1, bool TransposeM2>
+static void check_native_gemm(size_t m, size_t k, size_t n, bool accumulate) {
+    constexpr double eps_threshold = std::is_same_v<T, float> ? 1e-3 : 1e-10;
+
+    size_t m1_rows = TransposeM1 ? k : m;
+    size_t m1_cols = TransposeM1 ? m : k;
+    size_t m2_rows = TransposeM2 ? n : k;
+    size_t m2_cols = TransposeM2 ? k : n;
+
+    std::vector<T> m1 = make_matrix<T>(m1_rows, m1_cols, 1);
+    std::vector<T> m2 = make_matrix<T>(m2_rows, m2_cols, 5);
+    std::vector<T> res = make_matrix<T>(m, n, 3);
+    std::vector<T> res_packed = res;
+
+    std::vector<double> expected(m * n);
+    for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            double sum = accumulate ? static_cast<double>(res[i * n + j]) : 0.0;
+            for (size_t l = 0; l < k; ++l) {
+                T x = TransposeM1 ? m1[l * m1_cols + i] : m1[i * m1_cols + l];
+                T y = TransposeM2 ? m2[j * m2_cols + l] : m2[l * m2_cols + j];
+                sum += static_cast<double>(x) * static_cast<double>(y);
+            }
+            expected[i * n + j] = sum;
+        }
+    }
+
+    auto args = std::make_tuple(m1.data(),
+                                m2.data(),
+                                res.data(),
+                                static_cast<int>(m1_rows),
+                                static_cast<int>(m1_cols),
+                                static_cast<int>(m2_rows),
+                                static_cast<int>(m2_cols),
+                                accumulate);
+    if (m == 1 || n == 1) {
+        if (!std::apply(native_mat_vec<T, TransposeM1, TransposeM2>, args)) {
+            throw std::runtime_error("Native gemm test failed: matrix-vector product not detected");
+        }
+    } else {
+        std::apply(native_mat_mul<T, TransposeM1, TransposeM2>, args);
+    }
+    packed_mat_mul<T, TransposeM1>(m1.data(),
+                                   gemm::pack_matrix<T, TransposeM2>(m2.data(), m2_rows, m2_cols),
+                                   res_packed.data(),
+                                   m1_rows,
+                                   m1_cols,
+                                   accumulate);
+
+    for (size_t i = 0; i < m * n; ++i) {
+        if (std::abs(static_cast<double>(res[i]) - expected[i]) > eps_threshold ||
+            std::abs(static_cast<double>(res_packed[i]) - expected[i]) > eps_threshold) {
+            throw std::runtime_error("Native gemm test failed: m=" + std::to_string(m) +
+                                     " k=" + std::to_string(k) + " n=" + std::to_string(n));
+        }
+    }
+}
+
+template <typename T>
+static void check_native_gemm_all_variants(size_t m, size_t k, size_t n) {
+    for (bool accumulate : {false, true}) {
+        check_native_gemm<T, false, false>(m, k, n, accumulate);
+        check_native_gemm<T, true, false>(m, k, n, accumulate);
+        check_native_gemm<T, false, true>(m, k, n, accumulate);
+        check_native_gemm<T, true, true>(m, k, n, accumulate);
+    }
+}
+
+static void native_gemm_tests() {
+    // Sizes smaller than a register tile, multiples of the tile, and sizes spanning more than one
+    // cache block in each dimension (with edges)
+    constexpr size_t sizes[][3] = {{1, 1, 1},
+                                   {1, 40, 64},
+                                   {1, 37, 5},
+                                   {64, 128, 1},
+                                   {29, 3, 1},
+                                   {5, 3, 7},
+                                   {6, 16, 16},
+                                   {12, 8, 32},
+                                   {37, 300, 45},
+                                   {150, 17, 2100},
+                                   {80, 520, 9}};
+    for (const auto &[m, k, n] : sizes) {
+        check_native_gemm_all_variants<float>(m, k, n);
+        check_native_gemm_all_variants<double>(m, k, n);
+    }
+}
+
+/**
+ * The same expression evaluated with the two backends gives the same result
+ */
+static void gemm_backend_tests() {
+#ifndef NATIVE_GEMM
+    // Big enough to not be treated as a small product
+    Tensor<double> a{71, 53};
+    Tensor<double> b{53, 29};
+    for (size_t i = 0; i < a.get_size(); ++i) {
+        a[i] = static_cast<double>(i % 9) * 0.5 - 2.0;
+    }
+    for (size_t i = 0; i < b.get_size(); ++i) {
+        b[i] = static_cast<double>(i % 5) * 0.25 - 0.5;
+    }
+
+    set_gemm_backend(GemmBackend::BLAS);
+    Tensor<double> res_blas = matmul(no_grad(a), no_grad(b)).eval();
+    set_gemm_backend(GemmBackend::NATIVE);
+    Tensor<double> res_native = matmul(no_grad(a), no_grad(b)).eval();
+    set_gemm_backend(GemmBackend::BLAS);
+
+    if (!check_tensor_equality<double>(res_blas, res_native, 1e-10)) {
+        throw std::runtime_error("Gemm backend test failed");
+    }
+#endif
+}
+
+/**
+ * Threads given to a product depending on its size and on the outer parallelism, the results do
+ * not depend on the number of threads
+ */
+static void threading_tests() {
+    const ThreadingConfig default_config = get_threading();
+
+    ThreadingConfig config{};
+    config.max_threads = 4;
+    config.flops_per_thread = 1000;
+    set_threading(config);
+    if (threading::threads_for(10) != 1 || threading::threads_for(2500) != 2 ||
+        threading::threads_for(size_t{1} << 30) != 4) {
+        throw std::runtime_error("Threading test failed, wrong number of threads");
+    }
+
+    // The calling thread runs the first range, the workers are reused by the following calls
+    std::vector<std::thread::id> first_ids(4);
+    std::vector<std::thread::id> second_ids(4);
+    for (std::vector<std::thread::id> *ids : {&first_ids, &second_ids}) {
+        threading::parallel_for(4, 1000, [ids](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                (*ids)[i] = std::this_thread::get_id();
+            }
+        });
+    }
+    if (first_ids != second_ids || first_ids[0] != std::this_thread::get_id() ||
+        std::find(first_ids.begin() + 1, first_ids.end(), first_ids[0]) != first_ids.end()) {
+        throw std::runtime_error("Threading test failed, the workers are not reused");
+    }
+
+    Tensor<double> a{71, 53};
+    Tensor<double> b{53, 29};
+    for (size_t i = 0; i < a.get_size(); ++i) {
+        a[i] = static_cast<double>(i % 7) * 0.5 - 1.0;
+    }
+    for (size_t i = 0; i < b.get_size(); ++i) {
+        b[i] = static_cast<double>(i % 3) * 0.25 - 0.25;
+    }
+    Tensor<double> res_parallel = matmul(no_grad(a), no_grad(b)).eval();
+
+    config.outer_parallelism = true;
+    set_threading(config);
+    if (threading::threads_for(size_t{1} << 30) != 1) {
+        throw std::runtime_error("Threading test failed, outer parallelism is not respected");
+    }
+    Tensor<double> res_single = matmul(no_grad(a), no_grad(b)).eval();
+
+    set_threading(default_config);
+
+    if (!check_tensor_equality<double>(res_parallel, res_single, 1e-10)) {
+        throw std::runtime_error("Threading test failed");
+    }
+}
@@ -0,0 +1,241 @@
+#include "interpreter_tests.h"
+
+#include "../expressions/expression.h"
+#include "../interpreter.h"
+#include "../dynamic/dynamic_graph.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "test_utils.h"
+
+static void stack_size_tests();
+static void common_subexpressions_tests();
+static void simplifier_tests();
+
+void interpreter_tests() {
+    stack_size_tests();
+    common_subexpressions_tests();
+    simplifier_tests();
+}
+
+static void stack_size_tests() {
+    using ops::VARIABLE_OP;
+    static_assert(get_stack_size(Stack<VARIABLE_OP>{}) == 1);
+    static_assert(get_stack_size(Stack<VARIABLE_OP, VARIABLE_OP, VARIABLE_OP, ops::FMA_OP>{}) == 3);
+    static_assert(get_stack_size(Stack<VARIABLE_OP, ops::DUP_OP, ops::MUL_OP>{}) == 2);
+    // x0 + (x1 + relu(x2)) needs 3 registers, (x0 + x1) + relu(x2) only 2
+    static_assert(get_stack_size(Stack<VARIABLE_OP,
+                                       VARIABLE_OP,
+                                       VARIABLE_OP,
+                                       ops::RELU,
+                                       ops::SUM_OP,
+                                       ops::SUM_OP>{}) == 3);
+    static_assert(get_stack_size(Stack<VARIABLE_OP,
+                                       VARIABLE_OP,
+                                       ops::SUM_OP,
+                                       VARIABLE_OP,
+                                       ops::RELU,
+                                       ops::SUM_OP>{}) == 2);
+}
+
+static Tensor<double> make_test_tensor(std::initializer_list<size_t> shape, double offset) {
+    Tensor<double> t{shape};
+    for (size_t i = 0; i < t.get_size(); ++i) {
+        t[i] = offset + static_cast<double>(i % 11) * 0.25 - 1.0;
+    }
+    t.wrap_for_broadcasting();
+    return t;
+}
+
+// expected_fn(i) returns the expected value of the i-th element
+static void check_result(const Tensor<double> &actual,
+                         auto &&expected_fn,
+                         const std::string &test_name) {
+    constexpr double eps_threshold = 1e-12;
+    Tensor<double> expected{actual.get_shape()};
+    for (size_t i = 0; i < expected.get_size(); ++i) {
+        expected[i] = expected_fn(i);
+    }
+    expected.wrap_for_broadcasting();
+    if (!check_tensor_equality<double>(actual, expected, eps_threshold)) {
+        std::ostringstream oss;
+        oss << "[INTERPRETER_TEST]: " << test_name << " mismatch (actual, expected)=(" << actual
+            << ", " << expected << ")";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+static void common_subexpressions_tests() {
+    using ops::VARIABLE_OP;
+    Tensor<double> x = make_test_tensor({3, 13}, 0.5);
+    Tensor<double> y = make_test_tensor({3, 13}, -0.3);
+    Tensor<double> q = make_test_tensor({13}, 0.1);
+
+    // Programs after the elimination
+    using Square = typename decltype(no_grad(x) * no_grad(x))::Simplify::Type;
+    static_assert(RepeatedOperands<Square>::LIST.size() == 1);
+    static_assert(std::is_same_v<typename EliminateCommonSubexpressions<Square, 0>::Type,
+                                 Stack<VARIABLE_OP, VARIABLE_OP, ops::MUL_OP>>);
+    static_assert(std::is_same_v<typename EliminateCommonSubexpressions<Square, 1>::Type,
+                                 Stack<VARIABLE_OP, ops::DUP_OP, ops::MUL_OP>>);
+
+    using SquarePlus = typename decltype(no_grad(x) * no_grad(x) + no_grad(y))::Simplify::Type;
+    static_assert(std::is_same_v<typename EliminateCommonSubexpressions<SquarePlus, 1>::Type,
+                                 Stack<VARIABLE_OP, ops::DUP_OP, VARIABLE_OP, ops::FMA_OP>>);
+
+    // Candidates: the product, then the two sums
+    using SumSquared =
+        typename decltype((no_grad(x) + no_grad(y)) * (no_grad(x) + no_grad(y)))::Simplify::Type;
+    using SumSquaredProgram = EliminateCommonSubexpressions<SumSquared, 0b001>;
+    static_assert(RepeatedOperands<SumSquared>::LIST.size() == 3);
+    static_assert(
+        std::is_same_v<typename SumSquaredProgram::Type,
+                       Stack<VARIABLE_OP, VARIABLE_OP, ops::SUM_OP, ops::DUP_OP, ops::MUL_OP>>);
+    static_assert(SumSquaredProgram::KEPT == std::array<bool, 4>{true, true, false, false});
+
+    // The candidates of op(a, a), then the pairs of leaves: the last x is reused from a saved
+    // register, the second one by DUP
+    using SquarePlusX = typename decltype(no_grad(x) * no_grad(x) + no_grad(x))::Simplify::Type;
+    using SquarePlusXProgram = CommonSubexpressionsProgram<SquarePlusX, 0b111>;
+    static_assert(CommonSubexpressions<SquarePlusX>::LIST.size() == 3);
+    static_assert(std::is_same_v<
+                  typename SquarePlusXProgram::Type,
+                  Stack<ops::LOAD_KEEP_OP<0>, ops::DUP_OP, ops::REUSE_OP<0>, ops::FMA_OP>>);
+    static_assert(SquarePlusXProgram::KEPT == std::array<bool, 3>{true, false, false});
+    static_assert(get_stack_size(typename SquarePlusXProgram::Type{}) == 3);
+    // x * y + x, only the pair of the two x
+    using ProductPlusXProgram = CommonSubexpressionsProgram<SquarePlusX, 0b010>;
+    static_assert(std::is_same_v<
+                  typename ProductPlusXProgram::Type,
+                  Stack<ops::LOAD_KEEP_OP<0>, VARIABLE_OP, ops::REUSE_OP<0>, ops::FMA_OP>>);
+    static_assert(ProductPlusXProgram::KEPT == std::array<bool, 3>{true, true, false});
+
+    // Same tensors, the reduced program is used
+    check_result(
+        (no_grad(x) * no_grad(x)).eval(), [&](size_t i) { return x[i] * x[i]; }, "x * x");
+    check_result((no_grad(x) * no_grad(x) + no_grad(y)).eval(),
+                 [&](size_t i) { return x[i] * x[i] + y[i]; },
+                 "x * x + y");
+    check_result(((no_grad(x) + no_grad(y)) * (no_grad(x) + no_grad(y))).eval(),
+                 [&](size_t i) { return (x[i] + y[i]) * (x[i] + y[i]); },
+                 "(x + y) * (x + y)");
+    check_result((no_grad(x) * no_grad(x) + no_grad(x)).eval(),
+                 [&](size_t i) { return x[i] * x[i] + x[i]; },
+                 "x * x + x");
+    check_result((no_grad(x) * no_grad(y) + no_grad(x)).eval(),
+                 [&](size_t i) { return x[i] * y[i] + x[i]; },
+                 "x * y + x");
+    check_result((no_grad(x) * no_grad(y) - no_grad(y) * no_grad(x)).eval(),
+                 [&](size_t i) { return x[i] * y[i] - y[i] * x[i]; },
+                 "x * y - y * x");
+
+    // Same types but different tensors, the full program must be used
+    check_result(
+        (no_grad(x) * no_grad(y)).eval(), [&](size_t i) { return x[i] * y[i]; }, "x * y");
+    check_result(((no_grad(x) + no_grad(y)) * (no_grad(y) + no_grad(x))).eval(),
+                 [&](size_t i) { return (x[i] + y[i]) * (y[i] + x[i]); },
+                 "(x + y) * (y + x)");
+    // Only the second candidate is a repeated subexpression (as in AdamOptimizer)
+    check_result((no_grad(x) + no_grad(q) * (no_grad(y) * no_grad(y) - no_grad(x))).eval(),
+                 [&](size_t i) { return x[i] + q[i % 13] * (y[i] * y[i] - x[i]); },
+                 "x + q * (y * y - x)");
+    // Same data, different shape (broadcasting)
+    check_result(
+        (no_grad(x) * no_grad(q)).eval(), [&](size_t i) { return x[i] * q[i % 13]; }, "x * q");
+
+    // The runtime programs of the dynamic graphs use DUP_OP as well
+    DynamicGraph<double> graph;
+    size_t x_node = graph.add_input(Variable<double, false>{x});
+    size_t y_node = graph.add_input(Variable<double, false>{y});
+    size_t square_node = graph.add_node<DApMul>({x_node, x_node});
+    graph.compile(graph.add_node<DApSum>({square_node, y_node}));
+    check_result(
+        graph.eval(), [&](size_t i) { return x[i] * x[i] + y[i]; }, "dynamic x * x + y");
+}
+
+static void simplifier_tests() {
+    Tensor<double> x = make_test_tensor({3, 13}, 0.5);
+    Tensor<double> y = make_test_tensor({3, 13}, -0.3);
+    Tensor<double> q = make_test_tensor({13}, 2.5);
+    using X = DExprTensor<double, false>;
+
+    // Simplified types
+    static_assert(std::is_same_v<typename decltype(no_grad(x) * no_grad(y) -
+                                                   no_grad(q))::Simplify::Type,
+                                 DTernExprOp<X, X, X, DApFMS>>);
+    static_assert(std::is_same_v<typename decltype(no_grad(q) -
+                                                   no_grad(x) * no_grad(y))::Simplify::Type,
+                                 DTernExprOp<X, X, X, DApFNMA>>);
+    static_assert(
+        std::is_same_v<typename decltype(no_grad(x) / sqrt(no_grad(q)))::Simplify::Type,
+                       DBinExprOp<X, X, DApDivideSqrt>>);
+    static_assert(std::is_same_v<typename decltype(-(-no_grad(x)))::Simplify::Type, X>);
+    static_assert(std::is_same_v<typename decltype(-(-(-no_grad(x))))::Simplify::Type,
+                                 DUnaryExprOp<X, DApFlipSign>>);
+    static_assert(std::is_same_v<typename decltype(no_grad(x) / 4.0)::Simplify::Type,
+                                 DBinExprOp<X, X, DApMul>>);
+
+    check_result((no_grad(x) * no_grad(y) - no_grad(q)).eval(),
+                 [&](size_t i) { return x[i] * y[i] - q[i % 13]; },
+                 "x * y - q");
+    check_result((no_grad(q) - no_grad(x) * no_grad(y)).eval(),
+                 [&](size_t i) { return q[i % 13] - x[i] * y[i]; },
+                 "q - x * y");
+    check_result((no_grad(x) / sqrt(no_grad(q))).eval(),
+                 [&](size_t i) { return x[i] / std::sqrt(q[i % 13]); },
+                 "x / sqrt(q)");
+    check_result(
+        (-(-no_grad(x))).eval(), [&](size_t i) { return x[i]; }, "-(-x)");
+    check_result((no_grad(y) + -(-no_grad(x))).eval(),
+                 [&](size_t i) { return y[i] + x[i]; },
+                 "y + -(-x)");
+    check_result(
+        (no_grad(x) / 4.0).eval(), [&](size_t i) { return x[i] * 0.25; }, "x / 4");
+
+    // rsqrt with the Newton-Raphson refinement (float only)
+    Tensor<float> a{{2, 8}};
+    Tensor<float> b{{2, 8}};
+    for (size_t i = 0; i < a.get_size(); ++i) {
+        a[i] = static_cast<float>(i) - 5.0f;
+        b[i] = static_cast<float>(i * i) * 0.37f + 1e-3f;
+    }
+    b[3] = 0.0f;
+    b[9] = std::numeric_limits<float>::infinity();
+    a.wrap_for_broadcasting();
+    b.wrap_for_broadcasting();
+    Tensor<float> res = (no_grad(a) / sqrt(no_grad(b))).eval();
+    for (size_t i = 0; i < a.get_size(); ++i) {
+        float expected = a[i] / std::sqrt(b[i]);
+        bool is_close = std::isinf(expected) ? res[i] == expected
+                                             : std::abs(res[i] - expected) <=
+                                                   2e-6f * std::abs(expected);
+        if (!is_close) {
+            std::ostringstream oss;
+            oss << "[INTERPRETER_TEST]: float x / sqrt(y) mismatch at " << i
+                << " (actual, expected)=(" << res[i] << ", " << expected << ")";
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    // The dynamic graphs fuse the same patterns
+    DynamicGraph<double> graph;
+    size_t x_node = graph.add_input(Variable<double, false>{x});
+    size_t y_node = graph.add_input(Variable<double, false>{y});
+    size_t q_node = graph.add_input(Variable<double, false>{q});
+    size_t fms_node = graph.add_node<DApDiff>({graph.add_node<DApMul>({x_node, y_node}), q_node});
+    size_t product_node = graph.add_node<DApMul>({y_node, fms_node});
+    size_t fnma_node = graph.add_node<DApDiff>({q_node, product_node});
+    size_t sqrt_node = graph.add_node<DApSqrt>({q_node});
+    graph.compile(graph.add_node<DApDivide>({fnma_node, sqrt_node}));
+    if (graph.get_eval_plan_size() != 1) {
+        throw std::runtime_error("[INTERPRETER_TEST]: the dynamic graph is not fused");
+    }
+    check_result(
+        graph.eval(),
+        [&](size_t i) {
+            return (q[i % 13] - y[i] * (x[i] * y[i] - q[i % 13])) / std::sqrt(q[i % 13]);
+        },
+        "dynamic (q - y * (x * y - q)) / sqrt(q)");
+}
@@ -2,15 +2,44 @@
 #include "../expressions/expression.h"
 #include "../random.h"
 #include "../optimizer.h"
+#include "../loss.h"
+#include "../graph_capture.h"
 #include "../weight_initializer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <sstream>
 
 #include "../tensor_variable.h"
+#include "../layers/linear_layer.h"
+#include "../layers/embedding_layer.h"
+#include "../data_loader.h"
+#include "test_utils.h"
 
 static void gradient_flow_tests();
+static void checkpoint_tests();
+static void graph_capture_tests();
+static void linear_tests();
+static void batch_matmul_tests();
+static void freeze_tests();
+static void transpose_tests();
+static void sparse_tests();
+static void sparse_input_tests();
+static void embedding_tests();
 
-void nn_tests() { gradient_flow_tests(); }
+void nn_tests() {
+    gradient_flow_tests();
+    checkpoint_tests();
+    graph_capture_tests();
+    linear_tests();
+    batch_matmul_tests();
+    freeze_tests();
+    transpose_tests();
+    sparse_tests();
+    sparse_input_tests();
+    embedding_tests();
+}
 
 /**
  * Idea: In the backpropagation the neural network will output dl/dx, the
@@ -103,4 +132,744 @@ static void gradient_flow_tests() {
     if (non_zero_gradients == 0) {
         throw std::runtime_error("[NN_TEST]: gradients were all null");
     }
-}
\ No newline at end of file
+}
+
+/**
+ * A checkpointed network must produce exactly the same output and gradients of the plain one.
+ */
+static void checkpoint_tests() {
+    constexpr double eps_threshold = 1e-8;
+
+    Variable<double, true> k1({4, 2, 3});
+    Variable<double, true> q1({4});
+    Variable<double, true> k2({3, 4, 3});
+    Variable<double, true> q2({3});
+    Variable<double, true> m({3 * 5, 5});
+    Variable<double, true> q3({5});
+
+    Variable<double, true> x({7, 2, 17});
+
+    auto y1 = relu(conv_1d(k1, x, q1).set_stride(2).set_padding(1));
+    auto y2 = relu(conv_1d(k2, y1, q2).set_stride(2).set_padding(1));
+    auto predicted = matmul(flatten(y2), m) + q3;
+
+    auto y1_ckpt = checkpoint(relu(conv_1d(k1, x, q1).set_stride(2).set_padding(1)));
+    auto y2_ckpt = checkpoint(relu(conv_1d(k2, y1_ckpt, q2).set_stride(2).set_padding(1)));
+    auto predicted_ckpt = matmul(flatten(y2_ckpt), m) + q3;
+
+    auto params = predicted.get_parameters();
+    random_test_initialization(params);
+
+    Tensor<double> out = predicted.forward().clone();
+    Tensor<double> out_ckpt = predicted_ckpt.forward().clone();
+    if (!check_tensor_equality<double>(out, out_ckpt, eps_threshold)) {
+        throw std::runtime_error("[CHECKPOINT_TEST]: forward pass mismatch");
+    }
+
+    Tensor<double> gradient = out.clone();
+    gradient.set_constant(1.0);
+
+    for (const auto &[_, grad] : params) {
+        grad.set_zero();
+    }
+    predicted.backward(gradient);
+    std::vector<Tensor<double>> expected_grads;
+    for (const auto &[_, grad] : params) {
+        expected_grads.push_back(grad.clone());
+        grad.set_zero();
+    }
+
+    predicted_ckpt.backward(gradient);
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (!check_tensor_equality<double>(
+                expected_grads[i], params[i].gradient, eps_threshold)) {
+            std::ostringstream oss;
+            oss << "[CHECKPOINT_TEST]: gradient mismatch for parameter " << i;
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    // Each operand of the nested checkpoints is evaluated once in the forward step and once in
+    // its own backward step, the enclosing checkpoints do not recompute it
+    auto nested = checkpoint(relu(checkpoint(relu(checkpoint(relu(x))))));
+    auto operand = [](auto &node) -> auto & { return std::get<0>(node.child_nodes); };
+    auto &middle = operand(operand(nested));
+    auto &inner = operand(operand(middle));
+    for (size_t step = 1; step <= 2; ++step) {
+        Tensor<double> out_nested = nested.forward().clone();
+        nested.backward(out_nested);
+        if (nested.get_n_evaluations() != 2 * step || middle.get_n_evaluations() != 2 * step ||
+            inner.get_n_evaluations() != 2 * step) {
+            throw std::runtime_error("[CHECKPOINT_TEST]: nested checkpoints recomputed");
+        }
+    }
+}
+
+/**
+ * A captured training step must give the same predictions and updates of the plain one, and once
+ * the pool is warm its allocations must all be served by the buffers of the previous replays.
+ */
+static void graph_capture_tests() {
+    constexpr double eps_threshold = 1e-8;
+    constexpr size_t batch_size = 4;
+
+    Variable<double, true> m({6, 5});
+    Variable<double, true> q({5});
+    Variable<double, true> m2({5, 3});
+    Variable<double, false> x({batch_size, 6});
+    random_test_initialization(std::vector<Variable<double, true>>{m, q, m2});
+    Variable<double, true> m_plain{m.tensor.clone()};
+    Variable<double, true> q_plain{q.tensor.clone()};
+    Variable<double, true> m2_plain{m2.tensor.clone()};
+
+    auto graph = matmul(relu(matmul(x, m) + q), m2);
+    auto graph_plain = matmul(relu(matmul(x, m_plain) + q_plain), m2_plain);
+
+    auto loss = SoftMaxLoss<double>{};
+    auto loss_plain = SoftMaxLoss<double>{};
+    auto optimizer = AdamOptimizer<double>(0.01, 0.9, 0.999, 1.0e-6, graph.get_parameters());
+    auto optimizer_plain =
+        AdamOptimizer<double>(0.01, 0.9, 0.999, 1.0e-6, graph_plain.get_parameters());
+    std::vector<size_t> classes{0, 2, 1, 2};
+
+    auto train_step = capture_training_step(graph, loss, optimizer);
+    for (size_t step = 0; step < 4; ++step) {
+        // The pool is enabled only while replaying
+        if (tensor_pool::active_scopes != 0) {
+            throw std::runtime_error("[GRAPH_CAPTURE_TEST]: pool enabled outside of the replay");
+        }
+
+        for (size_t i = 0; i < x.tensor.get_size(); ++i) {
+            x.tensor[i] = std::sin(static_cast<double>(step * x.tensor.get_size() + i));
+        }
+
+        size_t n_allocations = tensor_pool::n_allocations;
+        train_step.replay(classes, batch_size);
+        if (step >= 2 && tensor_pool::n_allocations != n_allocations) {
+            throw std::runtime_error("[GRAPH_CAPTURE_TEST]: buffers not reused by the replay");
+        }
+
+        loss_plain.forward<true>(graph_plain);
+        loss_plain.backward(graph_plain, classes);
+        optimizer_plain.optimize(batch_size);
+
+        if (!check_tensor_equality<double>(
+                loss.softmax_probabilities, loss_plain.softmax_probabilities, eps_threshold) ||
+            !check_tensor_equality<double>(m.tensor, m_plain.tensor, eps_threshold) ||
+            !check_tensor_equality<double>(q.tensor, q_plain.tensor, eps_threshold) ||
+            !check_tensor_equality<double>(m2.tensor, m2_plain.tensor, eps_threshold)) {
+            throw std::runtime_error("[GRAPH_CAPTURE_TEST]: mismatch with the plain step");
+        }
+    }
+}
+
+/**
+ * matmul(x, m) + q and relu(matmul(x, m) + q) are fused in a single node, check it against the
+ * same operations run one at a time.
+ */
+static void linear_tests() {
+    constexpr double eps_threshold = 1e-8;
+    using Linear = decltype(matmul(to_dexpr(Variable<double, true>{{1, 1}}),
+                                   to_dexpr(Variable<double, true>{{1, 1}})) +
+                            to_dexpr(Variable<double, true>{{1}}));
+    static_assert(std::is_same_v<typename Linear::Operator, DApLinear<false>>);
+    static_assert(
+        std::is_same_v<typename decltype(relu(std::declval<Linear>()))::Operator, DApLinear<true>>);
+
+    // Enough rows for more than one output panel
+    Variable<double, true> x({300, 70});
+    Variable<double, true> m({70, 130});
+    Variable<double, true> q({130});
+    // Bias broadcasted to a bigger shape than the product
+    Variable<double, true> q_big({3, 300, 130});
+
+    auto check = [&](auto &&fused, const Variable<double, true> &bias, bool with_relu) {
+        auto params = fused.get_parameters();
+        random_test_initialization(params);
+
+        // Reference, with the product evaluated on its own
+        Tensor<double> product = matmul(no_grad(x.tensor), no_grad(m.tensor)).eval();
+        Tensor<double> pre_activation = (no_grad(product) + no_grad(bias.tensor)).eval();
+        Tensor<double> expected = with_relu ? relu(no_grad(pre_activation)).eval() : pre_activation;
+
+        Tensor<double> out = fused.eval();
+        Tensor<double> out_forward = fused.forward().clone();
+        if (!check_tensor_equality<double>(out, expected, eps_threshold) ||
+            !check_tensor_equality<double>(out_forward, expected, eps_threshold)) {
+            throw std::runtime_error("[LINEAR_TEST]: forward pass mismatch");
+        }
+
+        Tensor<double> gradient = out.clone();
+        for (size_t i = 0; i < gradient.get_size(); ++i) {
+            gradient[i] = static_cast<double>(i % 7) - 3.0;
+        }
+        for (const auto &[_, grad] : params) {
+            grad.set_zero();
+        }
+        fused.backward(gradient);
+
+        Tensor<double> linear_grad = gradient.clone();
+        if (with_relu) {
+            relu_backprop<double>(linear_grad, pre_activation);
+        }
+        Tensor<double> product_grad = reduce_axis(linear_grad, product.get_shape());
+        Tensor<double> x_grad =
+            mat_mul_wrapper<double, false, true>(product_grad, m.tensor, x.tensor.get_shape());
+        Tensor<double> m_grad =
+            mat_mul_wrapper<double, true, false>(x.tensor, product_grad, m.tensor.get_shape());
+        Tensor<double> bias_grad = reduce_axis(linear_grad, bias.tensor.get_shape());
+        if (!check_tensor_equality<double>(x.gradient, x_grad, eps_threshold) ||
+            !check_tensor_equality<double>(m.gradient, m_grad, eps_threshold) ||
+            !check_tensor_equality<double>(bias.gradient, bias_grad, eps_threshold)) {
+            throw std::runtime_error("[LINEAR_TEST]: gradient mismatch");
+        }
+    };
+
+    check(matmul(x, m) + q, q, false);
+    check(relu(matmul(x, m) + q), q, true);
+    check(matmul(x, m) + q_big, q_big, false);
+    check(relu(matmul(x, m) + q_big), q_big, true);
+}
+
+/**
+ * batch_matmul(a, b) against a naive product of the matrices of each batch item, for the forward
+ * pass and the gradients.
+ */
+static void batch_matmul_tests() {
+    constexpr double eps_threshold = 1e-8;
+    constexpr size_t B0 = 2, B1 = 3, N = 7, K = 5, M = 9;
+    constexpr size_t n_batches = B0 * B1;
+
+    Variable<double, true> a({B0, B1, N, K});
+    Variable<double, true> b({B0, B1, K, M});
+    std::vector<Variable<double, true>> params{a, b};
+    random_test_initialization(params);
+
+    auto y = relu(batch_matmul(a, b));
+
+    Tensor<double> expected({B0, B1, N, M});
+    for (size_t batch = 0; batch < n_batches; ++batch) {
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t j = 0; j < M; ++j) {
+                double sum{0};
+                for (size_t k = 0; k < K; ++k) {
+                    sum += a.tensor[(batch * N + i) * K + k] * b.tensor[(batch * K + k) * M + j];
+                }
+                expected[(batch * N + i) * M + j] = std::max(sum, 0.0);
+            }
+        }
+    }
+
+    Tensor<double> out = y.eval();
+    Tensor<double> out_forward = y.forward().clone();
+    if (!check_tensor_equality<double>(out, expected, eps_threshold) ||
+        !check_tensor_equality<double>(out_forward, expected, eps_threshold)) {
+        throw std::runtime_error("[BATCH_MATMUL_TEST]: forward pass mismatch");
+    }
+
+    Tensor<double> gradient = out.clone();
+    for (size_t i = 0; i < gradient.get_size(); ++i) {
+        gradient[i] = static_cast<double>(i % 7) - 3.0;
+    }
+    for (const auto &[_, grad] : params) {
+        grad.set_zero();
+    }
+    y.backward(gradient);
+
+    // grad_a = grad * b^T and grad_b = a^T * grad, for each batch item
+    Tensor<double> product_grad = gradient.clone();
+    relu_backprop<double>(product_grad, expected);
+    Tensor<double> a_grad({B0, B1, N, K});
+    Tensor<double> b_grad({B0, B1, K, M});
+    a_grad.set_zero();
+    b_grad.set_zero();
+    for (size_t batch = 0; batch < n_batches; ++batch) {
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t j = 0; j < M; ++j) {
+                double g = product_grad[(batch * N + i) * M + j];
+                for (size_t k = 0; k < K; ++k) {
+                    a_grad[(batch * N + i) * K + k] += g * b.tensor[(batch * K + k) * M + j];
+                    b_grad[(batch * K + k) * M + j] += g * a.tensor[(batch * N + i) * K + k];
+                }
+            }
+        }
+    }
+    if (!check_tensor_equality<double>(a.gradient, a_grad, eps_threshold) ||
+        !check_tensor_equality<double>(b.gradient, b_grad, eps_threshold)) {
+        throw std::runtime_error("[BATCH_MATMUL_TEST]: gradient mismatch");
+    }
+}
+
+/**
+ * A frozen expression gives the same result of the unfrozen one, and picks up the new weights
+ * only when it is frozen again.
+ */
+static void freeze_tests() {
+    constexpr double eps_threshold = 1e-8;
+
+    Variable<double, true> k1({6, 2, 3});
+    Variable<double, true> q1({6});
+    Variable<double, true> k2({3, 2, 3, 3});
+    Variable<double, true> q2({3});
+    Variable<double, true> m({6 * 18, 40});
+    Variable<double, true> q({40});
+    Variable<double, true> m2({40, 20});
+    Variable<double, false> x({8, 2, 20});
+    Variable<double, false> x_2d({8, 2, 9, 11});
+
+    std::vector<Variable<double, true>> params{k1, q1, k2, q2, m, q, m2};
+    random_test_initialization(params);
+    Variable<double, true> x_random{x.tensor};
+    Variable<double, true> x_2d_random{x_2d.tensor};
+    random_test_initialization(std::vector<Variable<double, true>>{x_random, x_2d_random});
+
+    auto y = matmul(relu(matmul(flatten(relu(conv_1d(k1, x, q1))), m) + q), m2);
+    auto y_2d = conv_2d(k2, x_2d, q2);
+
+    auto check = [&](auto &expr, const std::string &step) {
+        Tensor<double> expected = expr.eval();
+        expr.freeze();
+        Tensor<double> frozen = expr.eval();
+        Tensor<double> frozen_again = expr.eval();
+        if (!check_tensor_equality<double>(frozen, expected, eps_threshold) ||
+            !check_tensor_equality<double>(frozen_again, expected, eps_threshold)) {
+            throw std::runtime_error("[FREEZE_TEST]: eval mismatch " + step);
+        }
+        expr.freeze(false);
+    };
+    check(y, "before the update");
+    check(y_2d, "before the update");
+
+    // New weights, the next freeze prepares them again
+    for (const auto &[tensor, _] : params) {
+        for (size_t i = 0; i < tensor.get_size(); ++i) {
+            tensor[i] = tensor[i] * 0.5 + 0.125;
+        }
+    }
+    check(y, "after the update");
+    check(y_2d, "after the update");
+
+    // Only the parameters are packed: an input on the right is read again at every eval, also
+    // by the single row product
+    for (size_t rows : {1, 4}) {
+        Variable<double, false> lhs({rows, 20});
+        Variable<double, false> rhs({20, 7});
+        random_test_initialization(std::vector<Variable<double, true>>{
+            Variable<double, true>{lhs.tensor}, Variable<double, true>{rhs.tensor}});
+
+        auto product = matmul(lhs, rhs);
+        product.freeze();
+        Tensor<double> before = product.eval();
+        for (size_t i = 0; i < rhs.tensor.get_size(); ++i) {
+            rhs.tensor[i] = rhs.tensor[i] * 0.5 + 0.125;
+        }
+        Tensor<double> after = product.eval();
+        product.freeze(false);
+        Tensor<double> expected = product.eval();
+        if (check_tensor_equality<double>(after, before, eps_threshold) ||
+            !check_tensor_equality<double>(after, expected, eps_threshold)) {
+            throw std::runtime_error("[FREEZE_TEST]: stale right operand");
+        }
+    }
+
+    // Same for the kernel of the convolutions, with the im2col and the Winograd kernels
+    Variable<double, false> k1_input({6, 2, 3});
+    Variable<double, false> k2_input({3, 2, 3, 3});
+    random_test_initialization(std::vector<Variable<double, true>>{
+        Variable<double, true>{k1_input.tensor}, Variable<double, true>{k2_input.tensor}});
+    auto check_kernel_input = [&](auto &expr, const Tensor<double> &kernel) {
+        expr.freeze();
+        Tensor<double> before = expr.eval();
+        for (size_t i = 0; i < kernel.get_size(); ++i) {
+            kernel[i] = kernel[i] * 0.5 + 0.125;
+        }
+        Tensor<double> after = expr.eval();
+        expr.freeze(false);
+        Tensor<double> expected = expr.eval();
+        if (check_tensor_equality<double>(after, before, eps_threshold) ||
+            !check_tensor_equality<double>(after, expected, eps_threshold)) {
+            throw std::runtime_error("[FREEZE_TEST]: stale convolution kernel");
+        }
+    };
+    auto conv_1d_input = conv_1d(k1_input, x, q1).set_algorithm(ConvolutionAlgorithm::IM2COL);
+    check_kernel_input(conv_1d_input, k1_input.tensor);
+    for (ConvolutionAlgorithm algorithm :
+         {ConvolutionAlgorithm::IM2COL, ConvolutionAlgorithm::WINOGRAD}) {
+        auto conv_2d_input = conv_2d(k2_input, x_2d, q2).set_algorithm(algorithm);
+        check_kernel_input(conv_2d_input, k2_input.tensor);
+    }
+}
+
+/**
+ * transpose() evaluated on its own, and folded in the matrix multiplications, checked against the
+ * same expressions with the transposed matrices built by hand.
+ */
+static void transpose_tests() {
+    constexpr double eps_threshold = 1e-8;
+
+    auto transposed = [](const Tensor<double> &t) {
+        const auto &dims = t.get_shape().get_shape();
+        size_t rows = dims[dims.size() - 2];
+        size_t cols = dims[dims.size() - 1];
+        Tensor<double> res{Shape::get_transpose_shape(t.get_shape())};
+        for (size_t offset = 0; offset < t.get_size(); offset += rows * cols) {
+            for (size_t i = 0; i < rows; ++i) {
+                for (size_t j = 0; j < cols; ++j) {
+                    res[offset + j * rows + i] = t[offset + i * cols + j];
+                }
+            }
+        }
+        return res;
+    };
+
+    // Standalone transpose, with sizes that are not multiple of the blocks
+    Variable<double, true> big({3, 70, 67});
+    random_test_initialization(std::vector<Variable<double, true>>{big});
+    if (!check_tensor_equality<double>(
+            transpose(no_grad(big.tensor)).eval(), transposed(big.tensor), eps_threshold)) {
+        throw std::runtime_error("[TRANSPOSE_TEST]: standalone transpose mismatch");
+    }
+    Tensor<float> big_float{{70, 67}};
+    for (size_t i = 0; i < big_float.get_size(); ++i) {
+        big_float[i] = static_cast<float>(big.tensor[i]);
+    }
+    Tensor<float> big_float_t = transpose(no_grad(big_float)).eval();
+    for (size_t i = 0; i < 70; ++i) {
+        for (size_t j = 0; j < 67; ++j) {
+            if (big_float_t[j * 70 + i] != big_float[i * 67 + j]) {
+                throw std::runtime_error("[TRANSPOSE_TEST]: standalone float transpose mismatch");
+            }
+        }
+    }
+
+    Variable<double, true> x({20, 30});
+    Variable<double, true> w({25, 30});
+    Variable<double, true> a({30, 20});
+    Variable<double, true> q({25});
+    Variable<double, true> c({30, 20});
+    std::vector<Variable<double, true>> params{x, w, a, q, c};
+    random_test_initialization(params);
+
+    // Same expression, with the transposed matrices as variables
+    Variable<double, true> w_t{transposed(w.tensor)};
+    Variable<double, true> a_t{transposed(a.tensor)};
+    Variable<double, true> c_t{transposed(c.tensor)};
+
+    auto check = [&](auto &&expr,
+                     auto &&reference,
+                     const std::vector<std::pair<Variable<double, true>, Variable<double, true>>>
+                         &transposed_params,
+                     const std::string &name) {
+        Tensor<double> expected = reference.forward().clone();
+        Tensor<double> out = expr.eval();
+        Tensor<double> out_forward = expr.forward().clone();
+        if (!check_tensor_equality<double>(out, expected, eps_threshold) ||
+            !check_tensor_equality<double>(out_forward, expected, eps_threshold)) {
+            throw std::runtime_error("[TRANSPOSE_TEST]: forward mismatch " + name);
+        }
+
+        Tensor<double> gradient = out.clone();
+        for (size_t i = 0; i < gradient.get_size(); ++i) {
+            gradient[i] = static_cast<double>(i % 7) - 3.0;
+        }
+        auto zero_gradients = [&] {
+            for (const auto &[param, param_t] : transposed_params) {
+                param.gradient.set_zero();
+                param_t.gradient.set_zero();
+            }
+        };
+        zero_gradients();
+        reference.backward(gradient);
+        // param_t is either param itself or its transpose
+        std::vector<Tensor<double>> expected_grads;
+        for (const auto &[param, param_t] : transposed_params) {
+            expected_grads.push_back(param.tensor.get_shape() == param_t.tensor.get_shape()
+                                         ? param_t.gradient.clone()
+                                         : transposed(param_t.gradient));
+        }
+        zero_gradients();
+        expr.backward(gradient);
+        for (size_t i = 0; i < transposed_params.size(); ++i) {
+            if (!check_tensor_equality<double>(
+                    transposed_params[i].first.gradient, expected_grads[i], eps_threshold)) {
+                throw std::runtime_error("[TRANSPOSE_TEST]: gradient mismatch " + name);
+            }
+        }
+    };
+
+    check(matmul(x, transpose(w)), matmul(x, w_t), {{x, x}, {w, w_t}}, "matmul(x, w^T)");
+    check(matmul(transpose(a), transpose(w)),
+          matmul(a_t, w_t),
+          {{a, a_t}, {w, w_t}},
+          "matmul(a^T, w^T)");
+    check(relu(matmul(transpose(a), transpose(w)) + q),
+          relu(matmul(a_t, w_t) + q),
+          {{a, a_t}, {w, w_t}, {q, q}},
+          "linear(a^T, w^T)");
+    // Not folded: the transpose is evaluated as a node
+    check(relu(transpose(c) * x), relu(c_t * x), {{c, c_t}, {x, x}}, "transpose(c) * x");
+}
+
+/**
+ * Pruning of a linear layer, and products with the sparse matrix checked against the same products
+ * with the pruned matrix stored as a dense one.
+ */
+static void sparse_tests() {
+    constexpr double eps_threshold = 1e-8;
+
+    LinearLayer<double> layer{40, 30};
+    Variable<double, false> x_dummy({1, 40});
+    auto params = layer.forward(x_dummy).get_parameters();
+    random_test_initialization(params);
+    const Tensor<double> &w = params[0].tensor;
+
+    // Pruning keeps the largest weights
+    auto sparse_w = SparseVariable<double, true>::from_dense(w, 0.9);
+    if (sparse_w.pattern->nnz() != 120) {
+        throw std::runtime_error("[SPARSE_TEST]: wrong number of non zeros");
+    }
+    double min_kept = std::numeric_limits<double>::max();
+    double max_dropped = 0.0;
+    Tensor<double> pruned = sparse_w.to_dense();
+    for (size_t i = 0; i < w.get_size(); ++i) {
+        if (pruned[i] == 0.0) {
+            max_dropped = std::max(max_dropped, std::abs(w[i]));
+        } else if (pruned[i] != w[i]) {
+            throw std::runtime_error("[SPARSE_TEST]: pruning changed a weight");
+        } else {
+            min_kept = std::min(min_kept, std::abs(w[i]));
+        }
+    }
+    if (max_dropped > min_kept) {
+        throw std::runtime_error("[SPARSE_TEST]: pruning dropped a bigger weight");
+    }
+
+    Variable<double, true> dense_w{pruned};
+    auto check = [&](const Variable<double, true> &x, const std::string &name) {
+        Tensor<double> expected = matmul(x, dense_w).forward().clone();
+        auto expr = sparse_matmul(x, sparse_w);
+        Tensor<double> out = expr.eval();
+        Tensor<double> out_forward = expr.forward().clone();
+        if (!check_tensor_equality<double>(out, expected, eps_threshold) ||
+            !check_tensor_equality<double>(out_forward, expected, eps_threshold)) {
+            throw std::runtime_error("[SPARSE_TEST]: forward mismatch " + name);
+        }
+
+        Tensor<double> gradient = out.clone();
+        for (size_t i = 0; i < gradient.get_size(); ++i) {
+            gradient[i] = static_cast<double>(i % 7) - 3.0;
+        }
+        x.gradient.set_zero();
+        dense_w.gradient.set_zero();
+        matmul(x, dense_w).backward(gradient);
+        Tensor<double> expected_x_grad = x.gradient.clone();
+        x.gradient.set_zero();
+        sparse_w.values.gradient.set_zero();
+        expr.backward(gradient);
+        if (!check_tensor_equality<double>(x.gradient, expected_x_grad, eps_threshold)) {
+            throw std::runtime_error("[SPARSE_TEST]: input gradient mismatch " + name);
+        }
+        // Only the non zeros have a gradient
+        const auto &pattern = *sparse_w.pattern;
+        for (size_t r = 0; r < pattern.rows; ++r) {
+            for (size_t p = pattern.row_ptr[r]; p < pattern.row_ptr[r + 1]; ++p) {
+                // The pattern is the one of the transpose
+                double expected_grad = dense_w.gradient[pattern.col_idx[p] * pattern.rows + r];
+                if (std::abs(sparse_w.values.gradient[p] - expected_grad) > eps_threshold) {
+                    throw std::runtime_error("[SPARSE_TEST]: weight gradient mismatch " + name);
+                }
+            }
+        }
+    };
+    Variable<double, true> x_batch({19, 40});
+    Variable<double, true> x_vector({1, 40});
+    random_test_initialization(std::vector<Variable<double, true>>{x_batch, x_vector});
+    check(x_batch, "batch");
+    check(x_vector, "vector");
+
+    // The pruned layer, its parameters are the non zeros and the bias
+    SparseLinearLayer<double> sparse_layer = layer.prune(0.9);
+    auto sparse_y = sparse_layer.forward(no_grad(x_batch.tensor));
+    auto sparse_params = sparse_y.get_parameters();
+    if (sparse_params.size() != 2 || sparse_params[0].tensor.get_size() != 120) {
+        throw std::runtime_error("[SPARSE_TEST]: wrong parameters of the pruned layer");
+    }
+    if (!check_tensor_equality<double>(sparse_y.eval(),
+                                       (matmul(x_batch, dense_w) + params[1]).eval(),
+                                       eps_threshold)) {
+        throw std::runtime_error("[SPARSE_TEST]: pruned layer mismatch");
+    }
+}
+
+/**
+ * Sparse inputs batched by the DataLoader, checked against the dense copy of the same batch
+ */
+static void sparse_input_tests() {
+    constexpr double eps_threshold = 1e-8;
+    constexpr size_t n_features = 1000;
+
+    DataLoader<SparseTensor<double>, size_t> loader;
+    for (size_t i = 0; i < 7; ++i) {
+        std::vector<std::pair<size_t, double>> entries;
+        // The third sample has no features at all
+        for (size_t j = 0; i != 2 && j < 3 + i; ++j) {
+            entries.emplace_back((i * 131 + j * 37) % n_features, static_cast<double>(j) - 1.5);
+        }
+        loader.push(SparseTensor<double>::from_entries(n_features, entries), i);
+    }
+
+    for (size_t out_size : {16, 1}) {
+        Variable<double, true> w({n_features, out_size});
+        Variable<double, true> q({out_size});
+        random_test_initialization(std::vector<Variable<double, true>>{w, q});
+
+        loader.randomIter(4, [&](auto batch) {
+            SparseTensor<double> x = stack_samples(batch);
+            Tensor<double> x_dense = x.to_dense();
+            for (size_t b = 0; b < batch.size(); ++b) {
+                Tensor<double> sample = batch[b].first.to_dense();
+                for (size_t j = 0; j < n_features; ++j) {
+                    if (x_dense[b * n_features + j] != sample[j]) {
+                        throw std::runtime_error("[SPARSE_INPUT_TEST]: wrong stacked batch");
+                    }
+                }
+            }
+
+            auto expr = relu(matmul(x, w) + q);
+            auto reference = relu(matmul(no_grad(x_dense), w) + q);
+            Tensor<double> expected = reference.forward().clone();
+            if (!check_tensor_equality<double>(expr.eval(), expected, eps_threshold) ||
+                !check_tensor_equality<double>(expr.forward(), expected, eps_threshold)) {
+                throw std::runtime_error("[SPARSE_INPUT_TEST]: forward mismatch");
+            }
+
+            Tensor<double> gradient = expected.clone();
+            for (size_t i = 0; i < gradient.get_size(); ++i) {
+                gradient[i] = static_cast<double>(i % 5) - 2.0;
+            }
+            w.gradient.set_zero();
+            reference.backward(gradient);
+            Tensor<double> expected_grad = w.gradient.clone();
+            w.gradient.set_zero();
+            expr.backward(gradient);
+            if (!check_tensor_equality<double>(w.gradient, expected_grad, eps_threshold)) {
+                throw std::runtime_error("[SPARSE_INPUT_TEST]: weight gradient mismatch");
+            }
+            // The gradient of the touched rows is accumulated on the one already there
+            expr.backward(gradient);
+            Tensor<double> twice_expected_grad = (no_grad(expected_grad) * no_grad(2.0)).eval();
+            if (!check_tensor_equality<double>(w.gradient, twice_expected_grad, eps_threshold)) {
+                throw std::runtime_error("[SPARSE_INPUT_TEST]: weight gradient not accumulated");
+            }
+        });
+    }
+}
+
+/**
+ * Embedding lookup and its sparse gradient, checked against the same lookup written as a matmul of
+ * one hot rows with a dense table. The sparse optimizer steps only move the touched rows.
+ */
+static void embedding_tests() {
+    constexpr double eps_threshold = 1e-8;
+    constexpr size_t n_rows = 50;
+    constexpr size_t dim = 11;
+
+    EmbeddingLayer<double> layer{n_rows, dim};
+    std::vector<size_t> indices{3, 17, 3, 49, 0};
+    auto y = layer.forward(indices);
+    auto sparse_params = y.get_sparse_parameters();
+    if (sparse_params.size() != 1 || !y.get_parameters().empty()) {
+        throw std::runtime_error("[EMBEDDING_TEST]: wrong parameters");
+    }
+    EmbeddingVariable<double> table = sparse_params[0];
+    for (size_t i = 0; i < table.tensor.get_size(); ++i) {
+        table.tensor[i] = std::sin(static_cast<double>(i));
+    }
+    table.tensor.wrap_for_broadcasting();
+
+    Variable<double, true> dense_table{table.tensor.clone()};
+    Tensor<double> one_hot{indices.size(), n_rows};
+    one_hot.set_zero();
+    for (size_t i = 0; i < indices.size(); ++i) {
+        one_hot[i * n_rows + indices[i]] = 1.0;
+    }
+    auto reference = matmul(no_grad(one_hot), dense_table);
+
+    Tensor<double> expected = reference.forward().clone();
+    if (!check_tensor_equality<double>(y.eval(), expected, eps_threshold) ||
+        !check_tensor_equality<double>((y * no_grad(2.0)).eval(),
+                                       (reference * no_grad(2.0)).eval(),
+                                       eps_threshold)) {
+        throw std::runtime_error("[EMBEDDING_TEST]: forward mismatch");
+    }
+
+    auto loss = y * y;
+    auto reference_loss = reference * reference;
+    Tensor<double> gradient = loss.forward().clone();
+    for (size_t i = 0; i < gradient.get_size(); ++i) {
+        gradient[i] = static_cast<double>(i % 3) - 1.0;
+    }
+    gradient.wrap_for_broadcasting();
+    reference_loss.forward();
+    reference_loss.backward(gradient);
+    loss.backward(gradient);
+
+    // The repeated index accumulates, the rows that are not read have no gradient
+    const RowSparseGradient<double> &table_gradient = *table.gradient;
+    if (table_gradient.get_rows() != std::vector<size_t>{3, 17, 49, 0}) {
+        throw std::runtime_error("[EMBEDDING_TEST]: wrong touched rows");
+    }
+    for (size_t r = 0; r < table_gradient.get_rows().size(); ++r) {
+        size_t row = table_gradient.get_rows()[r];
+        for (size_t j = 0; j < dim; ++j) {
+            if (std::abs(table_gradient.slot(r)[j] - dense_table.gradient[row * dim + j]) >
+                eps_threshold) {
+                throw std::runtime_error("[EMBEDDING_TEST]: gradient mismatch");
+            }
+        }
+    }
+
+    // The first step of lazy Adam is the one of Adam, the rows that are not touched do not move
+    Tensor<double> before = table.tensor.clone();
+    std::vector<Variable<double, true>> dense_params{dense_table};
+    AdamOptimizer<double> dense_adam(0.01, 0.9, 0.999, 1.0e-6, std::move(dense_params));
+    AdamOptimizer<double> sparse_adam(0.01, 0.9, 0.999, 1.0e-6, {}, std::move(sparse_params));
+    dense_adam.optimize(2);
+    sparse_adam.optimize(2);
+    if (!check_tensor_equality<double>(table.tensor, dense_table.tensor, eps_threshold) ||
+        !table_gradient.empty()) {
+        throw std::runtime_error("[EMBEDDING_TEST]: adam step mismatch");
+    }
+
+    for (size_t i = 0; i < indices.size(); ++i) {
+        table.gradient->row(indices[i])[0] = 1.0;
+    }
+    StandardOptimizer<double> sgd(0.5, 1, {}, std::vector<EmbeddingVariable<double>>{table});
+    Tensor<double> after_adam = table.tensor.clone();
+    sgd.optimize(1);
+    for (size_t row = 0; row < n_rows; ++row) {
+        bool touched = std::find(indices.begin(), indices.end(), row) != indices.end();
+        for (size_t j = 0; j < dim; ++j) {
+            double expected_value = after_adam[row * dim + j] - (touched && j == 0 ? 0.5 : 0.0);
+            if (std::abs(table.tensor[row * dim + j] - expected_value) > eps_threshold) {
+                throw std::runtime_error("[EMBEDDING_TEST]: sgd step mismatch");
+            }
+            if (!touched && table.tensor[row * dim + j] != before[row * dim + j]) {
+                throw std::runtime_error("[EMBEDDING_TEST]: untouched row moved");
+            }
+        }
+    }
+
+    // First momentum step: the touched rows move by alpha * (1 - beta) * gradient
+    table.gradient->row(17)[1] = 2.0;
+    MomentumOptimizer<double> momentum(
+        0.5, 0.75, {}, std::vector<EmbeddingVariable<double>>{table});
+    Tensor<double> after_sgd = table.tensor.clone();
+    momentum.optimize(1);
+    for (size_t i = 0; i < table.tensor.get_size(); ++i) {
+        double expected_value = after_sgd[i] - (i == 17 * dim + 1 ? 0.25 : 0.0);
+        if (std::abs(table.tensor[i] - expected_value) > eps_threshold) {
+            throw std::runtime_error("[EMBEDDING_TEST]: momentum step mismatch");
+        }
+    }
+}
@@ -0,0 +1,315 @@
+#include "pooling_tests.h"
+#include "../expressions/expression.h"
+#include "../weight_initializer.h"
+
+#include "test_utils.h"
+#include <limits>
+#include <sstream>
+#include <tuple>
+
+static void pooling_operator_tests();
+static void pooling_kernels_tests();
+
+void pooling_tests() {
+    pooling_operator_tests();
+    pooling_kernels_tests();
+}
+
+/**
+ * To test the correctness of the pooling, we check the result against this manual naive
+ * implementation, on x [BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH]. It returns the output and
+ * the gradient of x for the gradient grad_out of the output.
+ */
+static std::tuple<Tensor<double>, Tensor<double>>
+naive_2d_pooling(ConstTensor<double> x,
+                 ConstTensor<double> grad_out,
+                 PoolingMode MODE,
+                 size_t KERNEL_HEIGHT,
+                 size_t KERNEL_WIDTH,
+                 size_t STRIDE_HEIGHT,
+                 size_t STRIDE_WIDTH,
+                 size_t PADDING_HEIGHT,
+                 size_t PADDING_WIDTH) {
+    const auto &x_shape = x.get_shape().get_shape();
+    const size_t BATCH_SIZE = x_shape[0];
+    const size_t CHANNELS = x_shape[1];
+    const size_t DATA_HEIGHT = x_shape[2];
+    const size_t DATA_WIDTH = x_shape[3];
+
+    const size_t EFFECTIVE_HEIGHT =
+        (DATA_HEIGHT + 2 * PADDING_HEIGHT - KERNEL_HEIGHT) / STRIDE_HEIGHT + 1;
+    const size_t EFFECTIVE_WIDTH =
+        (DATA_WIDTH + 2 * PADDING_WIDTH - KERNEL_WIDTH) / STRIDE_WIDTH + 1;
+
+    Tensor<double> res{{BATCH_SIZE, CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH}};
+    Tensor<double> grad_x{{BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH}};
+    grad_x.set_zero();
+    const double scale = 1.0 / static_cast<double>(KERNEL_HEIGHT * KERNEL_WIDTH);
+
+    for (size_t b = 0; b < BATCH_SIZE; ++b) {
+        for (size_t c = 0; c < CHANNELS; ++c) {
+            for (size_t oh = 0; oh < EFFECTIVE_HEIGHT; ++oh) {
+                for (size_t ow = 0; ow < EFFECTIVE_WIDTH; ++ow) {
+                    double sum = 0.0;
+                    double best = -std::numeric_limits<double>::infinity();
+                    size_t best_h = 0;
+                    size_t best_w = 0;
+                    double grad = grad_out(b, c, oh, ow);
+                    for (size_t kh = 0; kh < KERNEL_HEIGHT; ++kh) {
+                        for (size_t kw = 0; kw < KERNEL_WIDTH; ++kw) {
+                            // Position on the padded x
+                            size_t h = oh * STRIDE_HEIGHT + kh;
+                            size_t w = ow * STRIDE_WIDTH + kw;
+                            if (h < PADDING_HEIGHT || h >= DATA_HEIGHT + PADDING_HEIGHT ||
+                                w < PADDING_WIDTH || w >= DATA_WIDTH + PADDING_WIDTH) {
+                                continue;
+                            }
+                            h -= PADDING_HEIGHT;
+                            w -= PADDING_WIDTH;
+                            sum += x(b, c, h, w);
+                            if (MODE == PoolingMode::AVERAGE) {
+                                grad_x(b, c, h, w) += grad * scale;
+                            }
+                            if (x(b, c, h, w) > best) {
+                                best = x(b, c, h, w);
+                                best_h = h;
+                                best_w = w;
+                            }
+                        }
+                    }
+                    if (MODE == PoolingMode::AVERAGE) {
+                        res(b, c, oh, ow) = sum * scale;
+                    } else {
+                        res(b, c, oh, ow) = best;
+                        grad_x(b, c, best_h, best_w) += grad;
+                    }
+                }
+            }
+        }
+    }
+    return {res, grad_x};
+}
+
+// [B, C, H, W] -> [B, H, W, C], or back with to_channels_last = false
+static Tensor<double> change_layout(ConstTensor<double> t, bool to_channels_last) {
+    const auto &shape = t.get_shape().get_shape();
+    const size_t B = shape[0];
+    const size_t C = to_channels_last ? shape[1] : shape[3];
+    const size_t H = to_channels_last ? shape[2] : shape[1];
+    const size_t W = to_channels_last ? shape[3] : shape[2];
+    Tensor<double> res{to_channels_last ? Shape{B, H, W, C} : Shape{B, C, H, W}};
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t h = 0; h < H; ++h) {
+                for (size_t w = 0; w < W; ++w) {
+                    if (to_channels_last) {
+                        res(b, h, w, c) = t(b, c, h, w);
+                    } else {
+                        res(b, c, h, w) = t(b, h, w, c);
+                    }
+                }
+            }
+        }
+    }
+    res.wrap_for_broadcasting();
+    return res;
+}
+
+/**
+ * The 1d and 2d pooling nodes, also flattened, in both layouts, against the naive pooling
+ */
+static void pooling_operator_tests() {
+    constexpr size_t test_runs = 40;
+    constexpr double eps_threshold = 1e-10;
+
+    for (size_t i = 0; i < test_runs; ++i) {
+        const PoolingMode MODE = i % 2 == 0 ? PoolingMode::MAX : PoolingMode::AVERAGE;
+        const bool channels_last = i % 4 >= 2;
+        const bool one_dimensional = i % 8 >= 4;
+        const ConvolutionLayout layout =
+            channels_last ? ConvolutionLayout::CHANNELS_LAST : ConvolutionLayout::CHANNELS_FIRST;
+        const size_t BATCH_SIZE = random_size_t(1, 4);
+        const size_t CHANNELS = random_size_t(1, 11);
+        const size_t KERNEL_HEIGHT = one_dimensional ? 1 : random_size_t(1, 4);
+        const size_t KERNEL_WIDTH = random_size_t(1, 5);
+        // The vectorized rows of the channels-first layout load the windows with stride 1, and
+        // gather them with a larger stride, e.g. the stride of the windows that do not overlap
+        const bool stride_is_window = i % 3 == 1;
+        const size_t STRIDE_HEIGHT =
+            one_dimensional ? 1 : (stride_is_window ? KERNEL_HEIGHT : random_size_t(1, 3));
+        const size_t STRIDE_WIDTH =
+            i % 3 == 0 ? 1 : (stride_is_window ? KERNEL_WIDTH : random_size_t(2, 3));
+        const size_t PADDING_HEIGHT = random_size_t(0, KERNEL_HEIGHT / 2);
+        const size_t PADDING_WIDTH = random_size_t(0, KERNEL_WIDTH / 2);
+        const size_t DATA_HEIGHT = one_dimensional ? 1 : random_size_t(KERNEL_HEIGHT, 12);
+        const size_t DATA_WIDTH = random_size_t(KERNEL_WIDTH, 30);
+
+        Tensor<double> x_reference = random_tensor({BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+        Shape x_shape = channels_last ? Shape{BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, CHANNELS}
+                                      : Shape{BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH};
+        Tensor<double> x_layout = channels_last ? change_layout(x_reference, true) : x_reference;
+        if (one_dimensional) {
+            x_shape = channels_last ? Shape{BATCH_SIZE, DATA_WIDTH, CHANNELS}
+                                    : Shape{BATCH_SIZE, CHANNELS, DATA_WIDTH};
+        }
+        Variable<double, true> x_data(x_shape);
+        std::copy_n(&x_layout[0], x_layout.get_size(), &x_data.tensor[0]);
+        x_data.tensor.wrap_for_broadcasting();
+
+        // Forward and backward steps of node, with a random gradient of the output
+        auto check = [&](auto node, bool flattened) {
+            Tensor<double> res = node.forward().clone();
+            Tensor<double> gradient = random_tensor(res.get_shape());
+            node.backward(gradient);
+
+            const size_t EFFECTIVE_HEIGHT =
+                (DATA_HEIGHT + 2 * PADDING_HEIGHT - KERNEL_HEIGHT) / STRIDE_HEIGHT + 1;
+            const size_t EFFECTIVE_WIDTH =
+                (DATA_WIDTH + 2 * PADDING_WIDTH - KERNEL_WIDTH) / STRIDE_WIDTH + 1;
+            Shape output_shape = channels_last
+                               ? Shape{BATCH_SIZE, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH, CHANNELS}
+                               : Shape{BATCH_SIZE, CHANNELS, EFFECTIVE_HEIGHT, EFFECTIVE_WIDTH};
+            if (flattened && res.get_shape() !=
+                                 Shape{BATCH_SIZE, CHANNELS * EFFECTIVE_HEIGHT * EFFECTIVE_WIDTH}) {
+                throw std::runtime_error("[POOLING_TEST]: the output is not flattened");
+            }
+            res.set_shape(output_shape);
+            gradient.set_shape(output_shape);
+            if (channels_last) {
+                res = change_layout(res, false);
+                gradient = change_layout(gradient, false);
+            }
+
+            auto [expected, expected_grad] = naive_2d_pooling(x_reference,
+                                                              gradient,
+                                                              MODE,
+                                                              KERNEL_HEIGHT,
+                                                              KERNEL_WIDTH,
+                                                              STRIDE_HEIGHT,
+                                                              STRIDE_WIDTH,
+                                                              PADDING_HEIGHT,
+                                                              PADDING_WIDTH);
+            if (!check_tensor_equality<double>(res, expected, eps_threshold)) {
+                std::ostringstream oss;
+                oss << "[POOLING_TEST]: forward pass error mismatch (actual, simulated)=(" << res
+                    << ", " << expected << ")";
+                throw std::runtime_error(oss.str());
+            }
+
+            Tensor<double> x_grad = node.get_parameters()[0].gradient.clone();
+            x_grad.set_shape(channels_last
+                                 ? Shape{BATCH_SIZE, DATA_HEIGHT, DATA_WIDTH, CHANNELS}
+                                 : Shape{BATCH_SIZE, CHANNELS, DATA_HEIGHT, DATA_WIDTH});
+            if (channels_last) {
+                x_grad = change_layout(x_grad, false);
+            }
+            if (!check_tensor_equality<double>(x_grad, expected_grad, eps_threshold)) {
+                std::ostringstream oss;
+                oss << "[POOLING_TEST]: x gradient mismatch (actual, simulated)=(" << x_grad
+                    << ", " << expected_grad << ")";
+                throw std::runtime_error(oss.str());
+            }
+            x_data.gradient.set_zero();
+        };
+
+        if (one_dimensional) {
+            auto node = pool_1d(x_data, MODE, KERNEL_WIDTH)
+                            .set_stride(STRIDE_WIDTH)
+                            .set_padding(PADDING_WIDTH)
+                            .set_layout(layout);
+            check(node, false);
+            check(flatten(node), true);
+        } else {
+            auto node = pool_2d(x_data, MODE, KERNEL_HEIGHT, KERNEL_WIDTH)
+                            .set_stride(STRIDE_HEIGHT, STRIDE_WIDTH)
+                            .set_padding(PADDING_HEIGHT, PADDING_WIDTH)
+                            .set_layout(layout);
+            check(node, false);
+            check(flatten(node), true);
+        }
+    }
+}
+
+/**
+ * Global pooling, float registers, threads, and the errors of the kernels
+ */
+static void pooling_kernels_tests() {
+    constexpr double eps_threshold = 1e-10;
+
+    // The global average pooling is the mean of each channel
+    Tensor<double> x = random_tensor({3, 5, 7, 37});
+    Tensor<double> mean{{3, 5}};
+    for (size_t i = 0; i < mean.get_size(); ++i) {
+        mean[i] = 0.0;
+        for (size_t j = 0; j < 7 * 37; ++j) {
+            mean[i] += x[i * 7 * 37 + j] / (7 * 37);
+        }
+    }
+    mean.wrap_for_broadcasting();
+    Tensor<double> global = flatten(global_avg_pool_2d(no_grad(x))).forward().clone();
+    if (!check_tensor_equality<double>(global, mean, eps_threshold)) {
+        throw std::runtime_error("[POOLING_KERNELS_TEST]: global average pooling mismatch");
+    }
+
+    // 8 floats in a register, split between threads, against the doubles. Stride 0 is the size of
+    // the window, the strided windows are gathered
+    const ThreadingConfig default_config = get_threading();
+    ThreadingConfig threaded{};
+    threaded.max_threads = 4;
+    threaded.flops_per_thread = 64;
+    for (ConvolutionLayout layout :
+         {ConvolutionLayout::CHANNELS_FIRST, ConvolutionLayout::CHANNELS_LAST}) {
+        for (auto [mode, stride] : {std::pair{PoolingMode::MAX, size_t{1}},
+                                    std::pair{PoolingMode::AVERAGE, size_t{1}},
+                                    std::pair{PoolingMode::MAX, size_t{0}},
+                                    std::pair{PoolingMode::AVERAGE, size_t{0}}}) {
+            Tensor<float> x_float{{3, 5, 7, 37}};
+            for (size_t i = 0; i < x.get_size(); ++i) {
+                x_float[i] = static_cast<float>(x[i]);
+            }
+            x_float.wrap_for_broadcasting();
+            Pooling2D<float> pooling_float;
+            Pooling2D<double> pooling_double;
+            pooling_float.MODE = pooling_double.MODE = mode;
+            pooling_float.LAYOUT = pooling_double.LAYOUT = layout;
+            pooling_float.WINDOW_HEIGHT = pooling_double.WINDOW_HEIGHT = 3;
+            pooling_float.WINDOW_WIDTH = pooling_double.WINDOW_WIDTH = 2;
+            pooling_float.STRIDE_HEIGHT = pooling_double.STRIDE_HEIGHT = stride;
+            pooling_float.STRIDE_WIDTH = pooling_double.STRIDE_WIDTH = stride;
+            pooling_float.PADDING_HEIGHT = pooling_double.PADDING_HEIGHT = 1;
+            pooling_float.PADDING_WIDTH = pooling_double.PADDING_WIDTH = 1;
+
+            set_threading(threaded);
+            Tensor<float> res_float = pooling_float.forward<true>(x_float);
+            Tensor<float> grad_x_float = pooling_float.backward(res_float);
+            set_threading(default_config);
+            Tensor<double> res_double = pooling_double.forward<true>(x);
+            Tensor<double> grad_x_double = pooling_double.backward(res_double);
+            for (size_t i = 0; i < res_double.get_size(); ++i) {
+                if (std::abs(res_float[i] - res_double[i]) > 1e-5) {
+                    throw std::runtime_error("[POOLING_KERNELS_TEST]: float forward mismatch");
+                }
+            }
+            for (size_t i = 0; i < grad_x_double.get_size(); ++i) {
+                if (std::abs(grad_x_float[i] - grad_x_double[i]) > 1e-5) {
+                    throw std::runtime_error("[POOLING_KERNELS_TEST]: float gradient mismatch");
+                }
+            }
+        }
+    }
+
+    // Every window must read x
+    Pooling2D<double> pooling;
+    pooling.WINDOW_HEIGHT = 2;
+    pooling.WINDOW_WIDTH = 2;
+    pooling.PADDING_WIDTH = 2;
+    bool thrown = false;
+    try {
+        pooling.forward<false>(x);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("[POOLING_KERNELS_TEST]: the padding was larger than the window");
+    }
+}
@@ -1,10 +1,18 @@
 #include "convolution_tests_1d.h"
 #include "convolution_tests_2d.h"
+#include "pooling_tests.h"
 
 #include "nn_tests.h"
+#include "dynamic_graph_tests.h"
+#include "interpreter_tests.h"
+#include "gemm_tests.h"
 
 void run_tests() {
     convolution_tests_1d();
     convolution_tests_2d();
+    pooling_tests();
     nn_tests();
+    dynamic_graph_tests();
+    interpreter_tests();
+    gemm_tests();
 }
\ No newline at end of file
@@ -1 +1,14 @@
 #include "test_utils.h"
+
+#include <random>
+
+Tensor<double> random_tensor(const Shape &shape) {
+    static std::mt19937 generator{std::random_device{}()};
+    std::normal_distribution<double> distribution{0.0, 1.0};
+    Tensor<double> res{shape};
+    for (size_t i = 0; i < res.get_size(); ++i) {
+        res[i] = distribution(generator);
+    }
+    res.wrap_for_broadcasting();
+    return res;
+}
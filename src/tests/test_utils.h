@@ -17,4 +17,7 @@ bool check_tensor_equality(ConstTensor<T> t1, ConstTensor<T> t2, double epsilon)
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+// Tensor of the given shape, filled with samples of the standard normal distribution
+Tensor<double> random_tensor(const Shape &shape);
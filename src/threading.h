@@ -0,0 +1,252 @@
+#pragma once
+
+#ifndef NATIVE_GEMM
+#include <cblas.h>
+#endif
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Engine-wide threading configuration.
+ *
+ * BLAS has its own thread pool: left alone it uses every core for every call, even for products too
+ * small to be split, and it oversubscribes the machine as soon as there is some other level of
+ * parallelism (several replicas on the same host, data parallel training). All the threads
+ * used by the engine are configured here:
+ * - max_threads is the number of threads of a single call, 0 means one for each core of cpus (or
+ *   of the machine, if cpus is empty).
+ * - a BLAS call gets one thread every flops_per_thread multiply-adds, up to max_threads.
+ * - outer_parallelism is set when the caller already runs the engine on several threads or
+ *   processes, the BLAS calls are single threaded.
+ * - cpus is the set of cores the engine can use. The calling thread, the BLAS threads and the
+ *   workers of parallel_for are pinned to them, one core each. Replicas on the same host should
+ *   be given disjoint sets.
+ */
+struct ThreadingConfig {
+    size_t max_threads{0};
+    size_t flops_per_thread{size_t{1} << 21};
+    bool outer_parallelism{false};
+    std::vector<int> cpus{};
+};
+
+namespace threading {
+    inline ThreadingConfig config{};
+    // Threads requested to BLAS by the last call, 0 if not set yet
+    inline size_t blas_threads{0};
+
+    inline size_t max_threads() {
+        if (config.max_threads != 0) {
+            return config.max_threads;
+        }
+        if (!config.cpus.empty()) {
+            return config.cpus.size();
+        }
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * Threads used for a product of flops multiply-adds
+     */
+    inline size_t threads_for(size_t flops) {
+        if (config.outer_parallelism) {
+            return 1;
+        }
+        return std::clamp<size_t>(flops / config.flops_per_thread, 1, max_threads());
+    }
+
+#ifdef __linux__
+    // Pins the thread to the core cpu
+    inline void pin_thread(pthread_t thread, int cpu) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        if (pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) != 0) {
+            throw std::runtime_error("Cannot set the affinity of a thread");
+        }
+    }
+#endif
+
+    /**
+     * Threads of parallel_for, created at the first call and reused by all the following ones.
+     * The worker t runs the range t of a call (the calling thread runs the range 0), and it is
+     * pinned to its own core of cpus, if they are set. The workers are stopped, and created
+     * again at the next call, when the configuration changes.
+     */
+    class WorkerPool {
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake_workers;
+        std::condition_variable wake_caller;
+
+        // The current job, the ranges [1, n_ranges) are run by the workers
+        void (*run_range)(const void *, size_t){nullptr};
+        const void *job{nullptr};
+        size_t n_ranges{0};
+        size_t n_pending{0};
+        size_t generation{0};
+        bool stopping{false};
+
+        void work(size_t t) {
+            size_t last_generation = 0;
+            std::unique_lock lock{mutex};
+            while (true) {
+                wake_workers.wait(lock, [&] { return stopping || generation != last_generation; });
+                if (stopping) {
+                    return;
+                }
+                last_generation = generation;
+                if (t >= n_ranges) {
+                    continue;
+                }
+                lock.unlock();
+                run_range(job, t);
+                lock.lock();
+                if (--n_pending == 0) {
+                    wake_caller.notify_one();
+                }
+            }
+        }
+
+      public:
+        WorkerPool() = default;
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+        ~WorkerPool() { stop(); }
+
+        // f(t) is called for each t in [0, n), on the calling thread for t = 0
+        template <typename F>
+        void run(size_t n, const F &f) {
+            {
+                std::lock_guard lock{mutex};
+                for (size_t t = workers.size() + 1; t < n; ++t) {
+                    workers.emplace_back([this, t] { work(t); });
+#ifdef __linux__
+                    // Otherwise the worker keeps the affinity of the calling thread
+                    if (!config.cpus.empty()) {
+                        pin_thread(workers.back().native_handle(),
+                                   config.cpus[t % config.cpus.size()]);
+                    }
+#endif
+                }
+                run_range = [](const void *job, size_t t) { (*static_cast<const F *>(job))(t); };
+                job = &f;
+                n_ranges = n;
+                n_pending = n - 1;
+                generation += 1;
+            }
+            wake_workers.notify_all();
+            f(size_t{0});
+            std::unique_lock lock{mutex};
+            wake_caller.wait(lock, [&] { return n_pending == 0; });
+        }
+
+        void stop() {
+            {
+                std::lock_guard lock{mutex};
+                stopping = true;
+            }
+            wake_workers.notify_all();
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+            workers.clear();
+            stopping = false;
+        }
+    };
+
+    inline WorkerPool worker_pool{};
+    // Serializes the calls of different threads, a call that finds the pool busy runs alone
+    inline std::mutex worker_pool_mutex{};
+    // Set while the thread runs a range of parallel_for, the nested calls run alone
+    inline thread_local bool inside_parallel_for{false};
+
+    /**
+     * Calls f(begin, end) on contiguous ranges that partition [0, n), on up to
+     * threads_for(n * work_per_item) threads, the calling thread included. It is meant for the
+     * loops that move data around the BLAS calls (e.g. im2col), the work is then counted in
+     * elements. The ranges must write disjoint data, and f must not allocate tensors: the pool
+     * is thread local.
+     */
+    template <typename F>
+    void parallel_for(size_t n, size_t work_per_item, const F &f) {
+        const size_t n_threads = std::min(n, threads_for(n * work_per_item));
+        std::unique_lock pool_lock{worker_pool_mutex, std::defer_lock};
+        if (n_threads <= 1 || inside_parallel_for || !pool_lock.try_lock()) {
+            if (n > 0) {
+                f(size_t{0}, n);
+            }
+            return;
+        }
+        worker_pool.run(n_threads, [&f, n, n_threads](size_t t) {
+            inside_parallel_for = true;
+            f(t * n / n_threads, (t + 1) * n / n_threads);
+            inside_parallel_for = false;
+        });
+    }
+
+    /**
+     * Sets the BLAS threads of the next call, openblas_set_num_threads is called only if the
+     * number changes
+     */
+    inline void set_blas_threads([[maybe_unused]] size_t n_threads) {
+#ifndef NATIVE_GEMM
+        if (n_threads != blas_threads) {
+            openblas_set_num_threads(static_cast<int>(n_threads));
+            blas_threads = n_threads;
+        }
+#endif
+    }
+
+    inline void pin_threads() {
+#ifdef __linux__
+        if (config.cpus.empty()) {
+            return;
+        }
+        pin_thread(pthread_self(), config.cpus[0]);
+#ifndef NATIVE_GEMM
+        // The last BLAS thread is the calling thread, the workers of the pool get the next cores
+        cpu_set_t cpu_set;
+        int n_blas_threads = openblas_get_num_threads();
+        for (int i = 0; i + 1 < n_blas_threads; ++i) {
+            CPU_ZERO(&cpu_set);
+            CPU_SET(config.cpus[static_cast<size_t>(i + 1) % config.cpus.size()], &cpu_set);
+            if (openblas_setaffinity(i, sizeof(cpu_set), &cpu_set) != 0) {
+                throw std::runtime_error("Cannot set the affinity of the BLAS threads");
+            }
+        }
+#endif
+#else
+        if (!config.cpus.empty()) {
+            throw std::runtime_error("Thread affinity is supported only on Linux");
+        }
+#endif
+    }
+} // namespace threading
+
+inline void set_threading(const ThreadingConfig &config) {
+    if (config.flops_per_thread == 0) {
+        throw std::runtime_error("flops_per_thread must be positive");
+    }
+    // The workers of parallel_for are created again with the new configuration
+    {
+        std::lock_guard pool_lock{threading::worker_pool_mutex};
+        threading::worker_pool.stop();
+    }
+    threading::config = config;
+    // The pool is resized to the new maximum before pinning its threads
+    threading::blas_threads = 0;
+    threading::set_blas_threads(threading::max_threads());
+    threading::pin_threads();
+}
+
+inline const ThreadingConfig &get_threading() { return threading::config; }